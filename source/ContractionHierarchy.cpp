@@ -0,0 +1,382 @@
+#include "ContractionHierarchy.h"
+#include "Router.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+
+// Witness searches give up after this many lanes. Giving up early only
+// adds shortcuts that were not strictly needed.
+static const int WITNESS_SEARCH_SETTLE_LIMIT = 64;
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+ContractionHierarchy::ContractionHierarchy()
+	: m_graphVersion(0)
+	, m_isBuilt(false)
+	, m_shortcutCount(0)
+	, m_searchStamp(0)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+bool ContractionHierarchy::IsBuilt() const
+{
+	return m_isBuilt;
+}
+
+uint32 ContractionHierarchy::GetGraphVersion() const
+{
+	return m_graphVersion;
+}
+
+int ContractionHierarchy::GetShortcutCount() const
+{
+	return m_shortcutCount;
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+void ContractionHierarchy::Clear()
+{
+	m_isBuilt = false;
+	m_shortcutCount = 0;
+	m_edges.clear();
+	m_rank.clear();
+	m_upOffsets.clear();
+	m_upEdges.clear();
+	m_downOffsets.clear();
+	m_downEdges.clear();
+}
+
+void ContractionHierarchy::Build(const LaneGraph& laneGraph)
+{
+	Clear();
+	int laneCount = laneGraph.GetLaneCount();
+	m_graphVersion = laneGraph.GetVersion();
+
+	for (int k = 0; k < 2; k++)
+	{
+		m_distance[k].assign(laneCount, 0.0f);
+		m_parentEdge[k].assign(laneCount, -1);
+		m_stamp[k].assign(laneCount, 0);
+	}
+	m_searchStamp = 0;
+
+	// Copy the lane graph edges
+	m_outEdges.assign(laneCount, Array<int>());
+	m_inEdges.assign(laneCount, Array<int>());
+	m_contracted.assign(laneCount, false);
+	for (int i = 0; i < laneGraph.GetEdgeCount(); i++)
+	{
+		const LaneGraphEdge& laneEdge = laneGraph.GetEdge(i);
+		if (laneEdge.fromLane == laneEdge.toLane)
+			continue;
+		Edge edge;
+		edge.fromLane = laneEdge.fromLane;
+		edge.toLane = laneEdge.toLane;
+		edge.length = laneEdge.length;
+		edge.laneGraphEdge = i;
+		edge.lowerEdges[0] = -1;
+		edge.lowerEdges[1] = -1;
+		m_outEdges[edge.fromLane].push_back((int) m_edges.size());
+		m_inEdges[edge.toLane].push_back((int) m_edges.size());
+		m_edges.push_back(edge);
+	}
+
+	// Contract lanes in order of how many edges contracting them would add,
+	// re-evaluating lazily as neighbors get contracted
+	typedef std::pair<int, int> PriorityEntry;
+	std::priority_queue<PriorityEntry, Array<PriorityEntry>,
+		std::greater<PriorityEntry>> queue;
+	Array<int> contractedNeighbors(laneCount, 0);
+	auto getPriority = [&](int lane) -> int {
+		int degree = 0;
+		for (int edge : m_outEdges[lane])
+			degree += (m_contracted[m_edges[edge].toLane] ? 0 : 1);
+		for (int edge : m_inEdges[lane])
+			degree += (m_contracted[m_edges[edge].fromLane] ? 0 : 1);
+		return ContractLane(lane, true) - degree + contractedNeighbors[lane];
+	};
+	for (int lane = 0; lane < laneCount; lane++)
+		queue.push(PriorityEntry(getPriority(lane), lane));
+
+	m_rank.assign(laneCount, 0);
+	int rank = 0;
+	while (!queue.empty())
+	{
+		int lane = queue.top().second;
+		queue.pop();
+		if (m_contracted[lane])
+			continue;
+		int priority = getPriority(lane);
+		if (!queue.empty() && priority > queue.top().first)
+		{
+			queue.push(PriorityEntry(priority, lane));
+			continue;
+		}
+
+		m_shortcutCount += ContractLane(lane, false);
+		m_contracted[lane] = true;
+		m_rank[lane] = rank++;
+		for (int edge : m_outEdges[lane])
+			contractedNeighbors[m_edges[edge].toLane]++;
+		for (int edge : m_inEdges[lane])
+			contractedNeighbors[m_edges[edge].fromLane]++;
+	}
+	m_outEdges.clear();
+	m_inEdges.clear();
+	m_contracted.clear();
+
+	// Split the edges into upward edges for the forward search and
+	// downward edges (walked in reverse) for the backward search
+	m_upOffsets.assign(laneCount + 1, 0);
+	m_downOffsets.assign(laneCount + 1, 0);
+	for (const Edge& edge : m_edges)
+	{
+		if (m_rank[edge.toLane] > m_rank[edge.fromLane])
+			m_upOffsets[edge.fromLane + 1]++;
+		else
+			m_downOffsets[edge.toLane + 1]++;
+	}
+	for (int lane = 0; lane < laneCount; lane++)
+	{
+		m_upOffsets[lane + 1] += m_upOffsets[lane];
+		m_downOffsets[lane + 1] += m_downOffsets[lane];
+	}
+	m_upEdges.resize(m_upOffsets[laneCount]);
+	m_downEdges.resize(m_downOffsets[laneCount]);
+	Array<int> upCounts(laneCount, 0);
+	Array<int> downCounts(laneCount, 0);
+	for (int i = 0; i < (int) m_edges.size(); i++)
+	{
+		const Edge& edge = m_edges[i];
+		if (m_rank[edge.toLane] > m_rank[edge.fromLane])
+			m_upEdges[m_upOffsets[edge.fromLane] + upCounts[edge.fromLane]++] = i;
+		else
+			m_downEdges[m_downOffsets[edge.toLane] + downCounts[edge.toLane]++] = i;
+	}
+
+	m_isBuilt = true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Queries
+//-----------------------------------------------------------------------------
+
+bool ContractionHierarchy::FindRoute(int originLane, int destinationLane, Route& outRoute)
+{
+	outRoute.originLane = originLane;
+	outRoute.destinationLane = destinationLane;
+	outRoute.edges.clear();
+	outRoute.length = 0.0f;
+	if (originLane == destinationLane)
+		return true;
+
+	// Search upward from both ends at once, until neither search can find
+	// a shorter meeting point
+	m_searchStamp++;
+	int lanes[2] = { originLane, destinationLane };
+	for (int k = 0; k < 2; k++)
+	{
+		m_queue[k].clear();
+		m_stamp[k][lanes[k]] = m_searchStamp;
+		m_distance[k][lanes[k]] = 0.0f;
+		m_parentEdge[k][lanes[k]] = -1;
+		PushQueue(k, 0.0f, lanes[k]);
+	}
+	Meters best = FLT_MAX;
+	int meetingLane = -1;
+	while (!m_queue[0].empty() || !m_queue[1].empty())
+	{
+		for (int k = 0; k < 2; k++)
+		{
+			if (m_queue[k].empty())
+				continue;
+			QueueEntry entry = PopQueue(k);
+			Meters distance = entry.first;
+			int lane = entry.second;
+			if (distance > m_distance[k][lane])
+				continue;
+			if (distance >= best)
+			{
+				m_queue[k].clear();
+				continue;
+			}
+			if (m_stamp[1 - k][lane] == m_searchStamp &&
+				distance + m_distance[1 - k][lane] < best)
+			{
+				best = distance + m_distance[1 - k][lane];
+				meetingLane = lane;
+			}
+
+			const Array<int>& offsets = (k == 0 ? m_upOffsets : m_downOffsets);
+			const Array<int>& edges = (k == 0 ? m_upEdges : m_downEdges);
+			for (int i = offsets[lane]; i < offsets[lane + 1]; i++)
+			{
+				const Edge& edge = m_edges[edges[i]];
+				int next = (k == 0 ? edge.toLane : edge.fromLane);
+				Meters nextDistance = distance + edge.length;
+				if (m_stamp[k][next] != m_searchStamp ||
+					nextDistance < m_distance[k][next])
+				{
+					m_stamp[k][next] = m_searchStamp;
+					m_distance[k][next] = nextDistance;
+					m_parentEdge[k][next] = edges[i];
+					PushQueue(k, nextDistance, next);
+				}
+			}
+		}
+	}
+	if (meetingLane < 0)
+		return false;
+
+	// Walk back to the origin, then forward to the destination, expanding
+	// shortcuts into lane graph edges
+	Array<int> forwardEdges;
+	for (int lane = meetingLane; m_parentEdge[0][lane] >= 0;)
+	{
+		forwardEdges.push_back(m_parentEdge[0][lane]);
+		lane = m_edges[m_parentEdge[0][lane]].fromLane;
+	}
+	for (auto it = forwardEdges.rbegin(); it != forwardEdges.rend(); it++)
+		UnpackEdge(*it, outRoute.edges);
+	for (int lane = meetingLane; m_parentEdge[1][lane] >= 0;)
+	{
+		UnpackEdge(m_parentEdge[1][lane], outRoute.edges);
+		lane = m_edges[m_parentEdge[1][lane]].toLane;
+	}
+	outRoute.length = best;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+int ContractionHierarchy::ContractLane(int lane, bool simulate)
+{
+	// A shortcut is needed for each pair of neighbors whose shortest path
+	// runs through this lane
+	int shortcutCount = 0;
+	for (unsigned int i = 0; i < m_inEdges[lane].size(); i++)
+	{
+		int inEdge = m_inEdges[lane][i];
+		int fromLane = m_edges[inEdge].fromLane;
+		if (m_contracted[fromLane])
+			continue;
+
+		Meters maxLength = 0.0f;
+		for (int outEdge : m_outEdges[lane])
+		{
+			if (!m_contracted[m_edges[outEdge].toLane])
+				maxLength = Math::Max(maxLength, m_edges[outEdge].length);
+		}
+		SearchWitnesses(fromLane, lane, m_edges[inEdge].length + maxLength);
+
+		for (unsigned int j = 0; j < m_outEdges[lane].size(); j++)
+		{
+			int outEdge = m_outEdges[lane][j];
+			int toLane = m_edges[outEdge].toLane;
+			if (m_contracted[toLane] || toLane == fromLane)
+				continue;
+			Meters length = m_edges[inEdge].length + m_edges[outEdge].length;
+			if (m_stamp[0][toLane] == m_searchStamp &&
+				m_distance[0][toLane] <= length)
+				continue;
+
+			shortcutCount++;
+			if (!simulate)
+			{
+				Edge shortcut;
+				shortcut.fromLane = fromLane;
+				shortcut.toLane = toLane;
+				shortcut.length = length;
+				shortcut.laneGraphEdge = -1;
+				shortcut.lowerEdges[0] = inEdge;
+				shortcut.lowerEdges[1] = outEdge;
+				m_outEdges[fromLane].push_back((int) m_edges.size());
+				m_inEdges[toLane].push_back((int) m_edges.size());
+				m_edges.push_back(shortcut);
+			}
+		}
+	}
+	return shortcutCount;
+}
+
+void ContractionHierarchy::SearchWitnesses(int fromLane, int skipLane, Meters maxLength)
+{
+	// Bounded search over the remaining lanes for paths that avoid the
+	// lane being contracted
+	m_searchStamp++;
+	m_queue[0].clear();
+	m_stamp[0][fromLane] = m_searchStamp;
+	m_distance[0][fromLane] = 0.0f;
+	PushQueue(0, 0.0f, fromLane);
+	int settledCount = 0;
+	while (!m_queue[0].empty() && settledCount < WITNESS_SEARCH_SETTLE_LIMIT)
+	{
+		QueueEntry entry = PopQueue(0);
+		Meters distance = entry.first;
+		int lane = entry.second;
+		if (distance > m_distance[0][lane])
+			continue;
+		if (distance > maxLength)
+			break;
+		settledCount++;
+		for (int edgeIndex : m_outEdges[lane])
+		{
+			const Edge& edge = m_edges[edgeIndex];
+			if (edge.toLane == skipLane || m_contracted[edge.toLane])
+				continue;
+			Meters nextDistance = distance + edge.length;
+			if (m_stamp[0][edge.toLane] != m_searchStamp ||
+				nextDistance < m_distance[0][edge.toLane])
+			{
+				m_stamp[0][edge.toLane] = m_searchStamp;
+				m_distance[0][edge.toLane] = nextDistance;
+				PushQueue(0, nextDistance, edge.toLane);
+			}
+		}
+	}
+}
+
+void ContractionHierarchy::PushQueue(int direction, Meters distance, int lane)
+{
+	m_queue[direction].push_back(QueueEntry(distance, lane));
+	std::push_heap(m_queue[direction].begin(), m_queue[direction].end(),
+		std::greater<QueueEntry>());
+}
+
+ContractionHierarchy::QueueEntry ContractionHierarchy::PopQueue(int direction)
+{
+	std::pop_heap(m_queue[direction].begin(), m_queue[direction].end(),
+		std::greater<QueueEntry>());
+	QueueEntry entry = m_queue[direction].back();
+	m_queue[direction].pop_back();
+	return entry;
+}
+
+void ContractionHierarchy::UnpackEdge(int edge, Array<int>& outLaneGraphEdges) const
+{
+	if (m_edges[edge].laneGraphEdge >= 0)
+	{
+		outLaneGraphEdges.push_back(m_edges[edge].laneGraphEdge);
+	}
+	else
+	{
+		UnpackEdge(m_edges[edge].lowerEdges[0], outLaneGraphEdges);
+		UnpackEdge(m_edges[edge].lowerEdges[1], outLaneGraphEdges);
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include "CommonTypes.h"
+#include "LaneGraph.h"
+
+struct Route;
+
+
+//-----------------------------------------------------------------------------
+// Class:   ContractionHierarchy
+// Purpose: Preprocessed form of a lane graph for fast shortest-route
+//          queries. Lanes are contracted one at a time in order of
+//          importance, adding shortcut edges wherever a shortest path ran
+//          through the contracted lane. Queries then only search upward
+//          in importance from both ends and meet in the middle.
+//-----------------------------------------------------------------------------
+class ContractionHierarchy
+{
+public:
+	// Constructors
+
+	ContractionHierarchy();
+
+	// Getters
+
+	bool IsBuilt() const;
+	uint32 GetGraphVersion() const;
+	int GetShortcutCount() const;
+
+	// Setters
+
+	void Clear();
+	void Build(const LaneGraph& laneGraph);
+
+	// Queries
+
+	bool FindRoute(int originLane, int destinationLane, Route& outRoute);
+
+private:
+	struct Edge
+	{
+		int fromLane;
+		int toLane;
+		Meters length;
+		int laneGraphEdge; // -1 for shortcuts
+		int lowerEdges[2]; // The two edges a shortcut skips over
+	};
+
+	typedef std::pair<Meters, int> QueueEntry;
+
+	int ContractLane(int lane, bool simulate);
+	void SearchWitnesses(int fromLane, int skipLane, Meters maxLength);
+	void PushQueue(int direction, Meters distance, int lane);
+	QueueEntry PopQueue(int direction);
+	void UnpackEdge(int edge, Array<int>& outLaneGraphEdges) const;
+
+	uint32 m_graphVersion;
+	bool m_isBuilt;
+	int m_shortcutCount;
+	Array<Edge> m_edges;
+	Array<int> m_rank; // Contraction order of each lane
+
+	// Upward edges out of (and into) each lane, as CSR arrays
+	Array<int> m_upOffsets;
+	Array<int> m_upEdges;
+	Array<int> m_downOffsets;
+	Array<int> m_downEdges;
+
+	// Edges incident to each lane while contracting
+	Array<Array<int>> m_outEdges;
+	Array<Array<int>> m_inEdges;
+	Array<bool> m_contracted;
+
+	// Per-lane search state for the forward and backward searches, reset
+	// lazily by comparing the search stamp
+	Array<Meters> m_distance[2];
+	Array<int> m_parentEdge[2];
+	Array<uint32> m_stamp[2];
+	Array<QueueEntry> m_queue[2];
+	uint32 m_searchStamp;
+};
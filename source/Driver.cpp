@@ -1,5 +1,6 @@
 #include "Driver.h"
 #include "DrivingSystem.h"
+#include "RoadNetwork.h"
 
 
 //-----------------------------------------------------------------------------
@@ -7,34 +8,82 @@
 //-----------------------------------------------------------------------------
 
 Driver::Driver()
-	: m_velocity(Vector2f::ZERO)
-	, m_direction(Vector2f::UNITX)
+	: m_store(nullptr)
+	, m_slot(-1)
 	, m_roadNetwork(nullptr)
-	, m_speed(20.0f)
-	, m_distance(0.0f)
+	, m_drivingSystem(nullptr)
+	, m_surface(nullptr)
+	, m_surfaceLane(-1)
+	, m_driverAhead(nullptr)
+	, m_driverBehind(nullptr)
+	, m_destroy(false)
+	, m_isNextStopValid(false)
+	, m_nextStopIndex(-1)
+	, m_nextStopSignal(TrafficLightSignal::NONE)
+	, m_nextStopGraphVersion(0)
+	, m_nextStopProgramCount(0)
+	, m_collisionBoxes(MAX_VEHICLE_TRAILERS * DRIVER_MAX_FUTURE_STATES)
+	, m_predictionSpeed(0.0f)
+	, m_predictionDistance(0.0f)
+	, m_isPredicted(false)
+	, m_destinationLane(-1)
+	, m_routeIndex(0)
+	, m_routeVersion(0)
+	, m_rerouteTimer(0.0f)
+	, m_pathNodeTime(0.0f)
+	, m_traversedEdge(-1)
+	, m_traversedTime(0.0f)
+	, m_gridCell(0)
+	, m_gridIndex(-1)
 {
 }
 
-Driver::Driver(RoadNetwork* network, DrivingSystem* drivingSystem, Node* node, int id)
-	: m_nodeCurrent(node)
-	, m_roadNetwork(network)
-	, m_drivingSystem(drivingSystem)
-	, m_distance(0.0f)
-	, m_speed(0.0f)
-	, m_acceleration(0.0f)
-	, m_desiredSpeed(20.0f)
-	, m_destroy(false)
-	, m_speedPrev(0.0f)
-	, m_brakeLightTimer(0.0f)
-	, m_blinkerTimer(0.0f)
-	, m_id(id)
-	, m_currentStopNode(nullptr)
+Driver::~Driver()
 {
-	m_state = DriverState::DRIVING;
+}
 
-	m_desiredSpeed = Random::NextFloat(10.0f, 20.0f);
-	m_speed = m_desiredSpeed;
-	m_distance = Random::NextFloat(0.0f, 3.0f);
+void Driver::Initialize(RoadNetwork* network, DrivingSystem* drivingSystem, Node* node, int id)
+{
+	m_nodeCurrent = node;
+	m_roadNetwork = network;
+	m_drivingSystem = drivingSystem;
+	m_surface = nullptr;
+	m_surfaceLane = -1;
+	m_driverAhead = nullptr;
+	m_driverBehind = nullptr;
+	m_destroy = false;
+	m_speedPrev = 0.0f;
+	m_brakeLightTimer = 0.0f;
+	m_blinkerTimer = 0.0f;
+	m_id = id;
+	m_currentStopNode = NodeRef();
+	m_stopTimer = 0.0f;
+	m_lightState = DriverLightState();
+	m_path.Clear();
+	m_isNextStopValid = false;
+	m_speedSamples.clear();
+	m_collisions.clear();
+	m_collisionIndex = -1;
+	m_futureCollision = false;
+	m_isColliding = false;
+	m_destination = NodeRef();
+	m_destinationLane = -1;
+	m_route.clear();
+	m_routeIndex = 0;
+	m_pathNodeTime = 0.0f;
+	m_traversedEdge = -1;
+
+	// Stagger the route checks so they don't all land in the same batch
+	m_rerouteTimer = DRIVER_REROUTE_INTERVAL * ((id % 16) + 1) / 16.0f;
+
+	m_store->m_state[m_slot] = DriverState::DRIVING;
+	m_store->m_acceleration[m_slot] = 0.0f;
+	m_store->m_direction[m_slot] = Vector2f::UNITX;
+
+	m_random = drivingSystem->GetRandom().CreateStream((uint64) id);
+	m_desiredSpeed = m_random.NextFloat(10.0f, 20.0f);
+	m_store->m_speed[m_slot] = m_desiredSpeed;
+	m_store->m_distance[m_slot] = m_random.NextFloat(0.0f, 3.0f);
 
 	DriverVehicleParams params;
 	Array<DriverVehicleParams> vehicles;
@@ -81,10 +130,12 @@ Driver::Driver(RoadNetwork* network, DrivingSystem* drivingSystem, Node* node, i
 	//m_vehicleParams = Random::Choose(vehicles);
 
 
+	m_futureStates[0].time = 0.0f;
+	m_futureStates[0].count = m_vehicleParams.trailerCount;
 	if (node != nullptr)
 	{
-		m_position = node->GetCenter();
-		m_futureStates[0].position[0] = m_position;
+		m_store->m_position[m_slot] = node->GetCenter();
+		m_futureStates[0].position[0] = node->GetCenter();
 		m_futureStates[0].direction[0] = Vector2f::UNITX;
 		for (int i = 1; i < m_vehicleParams.trailerCount; i++)
 		{
@@ -95,130 +146,385 @@ Driver::Driver(RoadNetwork* network, DrivingSystem* drivingSystem, Node* node, i
 			m_futureStates[0].direction[i] = Vector2f::UNITX;
 		}
 	}
+	m_predictionSpeed = m_store->m_speed[m_slot];
+	m_predictionDistance = m_store->m_distance[m_slot];
+	m_isPredicted.store(false);
+	UpdateCollisionBoxes(0);
 }
 
-Driver::~Driver()
+void Driver::Release()
 {
-	if (m_surface != nullptr) 
+	if (m_surface != nullptr)
 		m_surface->RemoveDriver(this);
+	m_surface = nullptr;
+	m_path.Clear();
+	m_isNextStopValid = false;
+	m_collisions.clear();
+	m_destination = NodeRef();
+	m_route.clear();
 }
 
-bool Driver::GetFuturePosition(Meters distance, Vector3f& position, Vector2f& direction)
+bool Driver::SyncWithNetwork()
 {
-	Meters currentDistance = -m_distance;
-	for (unsigned int i = 0; i < m_path.size(); i++)
+	// Called after the road network changed. A road the driver is on or
+	// about to enter may have been deleted. Between updates, the driver's
+	// surface is the one of the front path node.
+	CMG_ASSERT(m_surface == (m_path.IsEmpty() ? nullptr : m_path.Front().GetSurface()));
+	for (int i = 0; i < m_path.GetCount(); i++)
 	{
-		DriverPathNode pathNode = m_path[i];
-
-		if (currentDistance + pathNode.GetDistance() >= distance)
+		const DriverPathNode& pathNode = m_path[i];
+		bool isValid = (pathNode.GetConnection() != nullptr ?
+			m_roadNetwork->IsValid(pathNode.GetConnection(), pathNode.GetSurfaceId()) :
+			m_roadNetwork->IsValid(pathNode.GetIntersection(), pathNode.GetSurfaceId()));
+		if (!isValid)
 		{
-			Meters distOnNode = distance - currentDistance;
-			position = pathNode.GetDrivingLine().GetPoint(distOnNode);
-			direction = pathNode.GetDrivingLine().horizontalCurve.GetTangent(distOnNode);
-			return true;
+			// The deleted surface's lanes went with it
+			if (i == 0)
+			{
+				m_surface = nullptr;
+				m_surfaceLane = -1;
+				m_driverAhead = nullptr;
+				m_driverBehind = nullptr;
+			}
+			return false;
 		}
+	}
 
-		currentDistance += pathNode.GetDistance();
+	// Lanes are held by node group and index. Lanes added on the right
+	// leave them be, but lanes may have been removed, or added on the left
+	// moving the rest to other indices.
+	if (!m_nodeCurrent.IsNull() && !m_roadNetwork->IsValid(m_nodeCurrent))
+		return false;
+	for (int i = 0; i < m_path.GetCount(); i++)
+	{
+		if (!m_roadNetwork->IsValid(m_path[i].GetStartNodeRef()) ||
+			!m_roadNetwork->IsValid(m_path[i].GetEndNodeRef()))
+			return false;
 	}
-	return false;
+	if (!m_path.ResolveDrivingLines())
+		return false;
+	m_path.UpdateDistances();
+
+	// Losing the destination or the stop only changes what the driver does
+	if (!m_destination.IsNull() && !m_roadNetwork->IsValid(m_destination))
+	{
+		m_destination = NodeRef();
+		m_destinationLane = -1;
+		m_route.clear();
+	}
+	if (!m_currentStopNode.IsNull() && !m_roadNetwork->IsValid(m_currentStopNode))
+	{
+		m_currentStopNode = NodeRef();
+		m_store->m_state[m_slot] = DriverState::DRIVING;
+	}
+	m_isNextStopValid = false;
+	return true;
+}
+
+void Driver::SetDestination(Node* destination)
+{
+	m_destination = destination;
+	m_destinationLane = -1;
+	if (destination != nullptr)
+		m_destinationLane = m_roadNetwork->GetLaneGraph().GetLaneId(destination);
+	m_route.clear();
+	m_routeIndex = 0;
+	m_routeVersion = m_roadNetwork->GetLaneGraph().GetVersion();
+}
+
+void Driver::SetRoute(const Array<int>& route)
+{
+	m_route = route;
+	m_routeIndex = 0;
+	m_routeVersion = m_roadNetwork->GetLaneGraph().GetVersion();
+}
+
+bool Driver::PollReroute(int& outOriginLane, int& outDestinationLane, Array<int>& outRoute)
+{
+	// Check the rest of the route every so often, while it is being followed
+	if (m_rerouteTimer > 0.0f || m_destination.IsNull())
+		return false;
+	m_rerouteTimer = DRIVER_REROUTE_INTERVAL;
+	const LaneGraph& laneGraph = m_roadNetwork->GetLaneGraph();
+	if (m_routeVersion != laneGraph.GetVersion() ||
+		m_routeIndex >= (int) m_route.size())
+		return false;
+	outOriginLane = laneGraph.GetEdge(m_route[m_routeIndex]).fromLane;
+	outDestinationLane = m_destinationLane;
+	outRoute.assign(m_route.begin() + m_routeIndex, m_route.end());
+	return true;
+}
+
+bool Driver::GetFuturePosition(Meters distance, Vector3f& position, Vector2f& direction)
+{
+	distance += m_store->m_distance[m_slot];
+	int index = m_path.Find(distance);
+	if (index < 0)
+		return false;
+	const RoadCurveLine& drivingLine = m_path[index].GetDrivingLine();
+	Meters distOnNode = distance - m_path.GetStartDistance(index);
+	position = drivingLine.GetPoint(distOnNode);
+	direction = drivingLine.horizontalCurve.GetTangent(distOnNode);
+	return true;
 }
 
 void Driver::GetNextStop(Meters& outDistance, Node*& outNode, TrafficLightSignal& outSignal)
 {
-	outDistance = -m_distance - (m_vehicleParams.size[0].x * 0.5f);
-	for (unsigned int i = 0; i < m_path.size(); i++)
+	if (!IsNextStopValid())
+		FindNextStop();
+	if (m_nextStopIndex >= 0)
+	{
+		outDistance = m_path.GetEndDistance(m_nextStopIndex) -
+			m_store->m_distance[m_slot] - (m_vehicleParams.size[0].x * 0.5f);
+		outNode = m_path[m_nextStopIndex].GetEndNode();
+		outSignal = m_nextStopSignal;
+	}
+	else
+	{
+		outDistance = -1.0f;
+		outNode = nullptr;
+		outSignal = TrafficLightSignal::NONE;
+	}
+}
+
+bool Driver::IsNextStopValid() const
+{
+	if (!m_isNextStopValid ||
+		m_nextStopGraphVersion != m_roadNetwork->GetLaneGraph().GetVersion())
+		return false;
+	for (int i = 0; i < m_nextStopProgramCount; i++)
+	{
+		if (m_nextStopPrograms[i]->GetSignalVersion() != m_nextStopProgramVersions[i])
+			return false;
+	}
+	return true;
+}
+
+void Driver::FindNextStop()
+{
+	// Remember the traffic lights passed on the way to the stop, as the stop
+	// can only move when one of them changes its signals. Traffic light
+	// programs are only recreated along with the lane graph.
+	m_isNextStopValid = true;
+	m_nextStopIndex = -1;
+	m_nextStopSignal = TrafficLightSignal::NONE;
+	m_nextStopGraphVersion = m_roadNetwork->GetLaneGraph().GetVersion();
+	m_nextStopProgramCount = 0;
+
+	for (int i = 0; i < m_path.GetCount(); i++)
 	{
-		DriverPathNode pathNode = m_path[i];
-		outDistance += pathNode.GetDistance();
-		TrafficLightSignal signal = pathNode.GetEndNode()->GetSignal();
+		Node* endNode = m_path[i].GetEndNode();
+		RoadIntersection* intersection = endNode->GetNodeGroup()->GetIntersection();
+		const TrafficLightProgram* program = nullptr;
+		if (intersection != nullptr)
+			program = intersection->GetTrafficLightProgram();
+		if (program == nullptr)
+			continue;
+
+		if (m_nextStopProgramCount == 0 ||
+			m_nextStopPrograms[m_nextStopProgramCount - 1] != program)
+		{
+			m_nextStopPrograms[m_nextStopProgramCount] = program;
+			m_nextStopProgramVersions[m_nextStopProgramCount] = program->GetSignalVersion();
+			m_nextStopProgramCount++;
+		}
+
+		TrafficLightSignal signal = program->GetSignal(endNode);
 		if (signal == TrafficLightSignal::STOP ||
 			signal == TrafficLightSignal::STOP_SIGN ||
 			signal == TrafficLightSignal::YELLOW)
 		{
-			outNode = pathNode.GetEndNode();
-			outSignal = signal;
+			m_nextStopIndex = i;
+			m_nextStopSignal = signal;
 			return;
 		}
 	}
-	outDistance = -1.0f;
-	outNode = nullptr;
-	outSignal = TrafficLightSignal::NONE;
 }
 
 void Driver::Next()
 {
-	Node* node = m_nodeCurrent;
-	if (m_path.size() > 0)
-		node = m_path.back().GetEndNode();
+	Node* node = m_nodeCurrent.Get();
+	if (!m_path.IsEmpty())
+		node = m_path.Back().GetEndNode();
 	DriverPathNode next = Next(node);
 	if (next.GetSurface() != nullptr)
-		m_path.push_back(next);
+	{
+		m_path.PushBack(next);
+
+		// The new node can only matter if there was no stop before it
+		if (m_nextStopIndex < 0)
+			m_isNextStopValid = false;
+	}
+}
+
+static DriverPathNode CreatePathNode(const LaneGraph& laneGraph,
+	Node* node, int edgeIndex)
+{
+	const LaneGraphEdge& edge = laneGraph.GetEdge(edgeIndex);
+	DriverPathNode pathNode;
+	if (edge.connection != nullptr)
+	{
+		pathNode = DriverPathNode(edge.connection, edge.fromLaneIndex,
+			edge.toLaneIndex, edge.laneShift);
+	}
+	else
+	{
+		pathNode = DriverPathNode(edge.intersection, node,
+			laneGraph.GetLane(edge.toLane));
+	}
+	pathNode.SetLaneGraphEdge(edgeIndex);
+	return pathNode;
 }
 
 DriverPathNode Driver::Next(Node* node)
 {
-	NodeGroup* nodeGroup = node->GetNodeGroup();
+	const LaneGraph& laneGraph = m_roadNetwork->GetLaneGraph();
+	int lane = laneGraph.GetLaneId(node);
+	if (lane < 0)
+		return DriverPathNode();
+
+	// Follow the route to the destination, and stop once it is reached
+	if (!m_destination.IsNull())
+	{
+		if (node == m_destination.Get())
+			return DriverPathNode();
+		if (UpdateRoute(lane))
+			return CreatePathNode(laneGraph, node, m_route[m_routeIndex++]);
+
+		// The destination can't be reached from here, so wander instead
+		m_destination = NodeRef();
+		m_route.clear();
+	}
+
+	// Pick a connection (or intersection exit), then a lane within it
+	int branchBegin = laneGraph.GetBranchBegin(lane);
+	int branchCount = laneGraph.GetBranchEnd(lane) - branchBegin;
+	if (branchCount == 0)
+		return DriverPathNode();
+	int branch = branchBegin + m_random.NextInt(branchCount);
+	int edgeBegin = laneGraph.GetBranchEdgeBegin(branch);
+	int edgeCount = laneGraph.GetBranchEdgeEnd(branch) - edgeBegin;
+	if (edgeCount == 0)
+		return DriverPathNode();
+	return CreatePathNode(laneGraph, node,
+		edgeBegin + m_random.NextInt(edgeCount));
+}
+
+bool Driver::UpdateRoute(int lane)
+{
+	// Keep following the current route while it is still valid
+	const LaneGraph& laneGraph = m_roadNetwork->GetLaneGraph();
+	if (m_routeVersion == laneGraph.GetVersion() &&
+		m_routeIndex < (int) m_route.size() &&
+		laneGraph.GetEdge(m_route[m_routeIndex]).fromLane == lane)
+		return true;
+
+	// Lane IDs are only stable while the lane graph is unchanged, so give
+	// up on a destination that no longer has the same ID
+	if (m_destinationLane < 0 || (m_routeVersion != laneGraph.GetVersion() &&
+		(m_destinationLane >= laneGraph.GetLaneCount() ||
+		laneGraph.GetLane(m_destinationLane) != m_destination.Get())))
+		return false;
+
+	// Route again from this lane
+	const Route* route = m_drivingSystem->GetRouter().FindRoute(
+		lane, m_destinationLane);
+	if (route == nullptr || route->edges.empty())
+		return false;
+	m_route = route->edges;
+	m_routeIndex = 0;
+	m_routeVersion = laneGraph.GetVersion();
+	return true;
+}
 
-	if (nodeGroup->GetIntersection() != nullptr &&
-		nodeGroup->GetOutputs().size() == 0)
+bool Driver::FindLeader(Driver*& outLeader, Meters& outGap) const
+{
+	// The leader is the driver ahead in this driver's lane, or else the
+	// last driver in the next lane along the path which has any
+	Meters distance = m_store->m_distance[m_slot];
+	for (int i = 0; i < m_path.GetCount(); i++)
 	{
-		RoadIntersection* intersection = nodeGroup->GetIntersection();
-		Array<NodeGroup*> possibleGroups;
-		for (RoadIntersectionPoint* point : intersection->GetPoints())
+		if (m_path.GetStartDistance(i) - distance > DRIVER_FOLLOWING_LOOK_AHEAD)
+			break;
+		Driver* leader = nullptr;
+		if (i == 0)
 		{
-			if (point->GetIOType() == IOType::OUTPUT)
-				possibleGroups.push_back(point->GetNodeGroup());
+			leader = m_driverAhead;
 		}
-		if (possibleGroups.size() > 0)
+		else
 		{
-			NodeGroup* nextGroup = Random::Choose(possibleGroups);
-			Node* nextNode = nextGroup->GetNode(Random::NextInt(nextGroup->GetNumNodes()));
-			return DriverPathNode(intersection, node, nextNode);
+			RoadSurface* surface = m_path[i].GetSurface();
+			int lane = surface->FindLane(m_path[i].GetStartNodeRef(),
+				m_path[i].GetEndNodeRef());
+			if (lane >= 0)
+				leader = surface->GetLane(lane).back;
 		}
-		else
+		if (leader != nullptr && leader != this)
 		{
-			return DriverPathNode();
+			outLeader = leader;
+			outGap = (m_path.GetStartDistance(i) + leader->GetSnapshotDistance() -
+				leader->GetRearOffset()) -
+				(distance + (m_vehicleParams.size[0].x * 0.5f));
+			return true;
 		}
 	}
+	return false;
+}
 
-	Array<NodeGroupConnection*> possibleConnections;
-	for (NodeGroupConnection* connection : nodeGroup->GetOutputs())
+Meters Driver::GetRearOffset() const
+{
+	// Distance back from the vehicle's position to the end of its last
+	// trailer, with the trailers lined up behind it
+	Meters offset = m_vehicleParams.size[0].x * 0.5f;
+	for (int i = 1; i < m_vehicleParams.trailerCount; i++)
 	{
-		const NodeSubGroup& group = connection->GetInput();
-		if (!connection->IsGhost() &&
-			node->GetIndex() >= group.index &&
-			node->GetIndex() < group.index + group.count)
-		{
-			possibleConnections.push_back(connection);
-		}
+		offset += m_vehicleParams.size[i].x +
+			(2.0f * m_vehicleParams.pivotOffset[i - 1]);
 	}
-	if (possibleConnections.size() == 0)
-		return DriverPathNode();
+	return offset;
+}
 
-	int index = Random::NextInt((int) possibleConnections.size());
-	NodeGroupConnection* connection = possibleConnections[index];
-	int fromLaneIndex = node->GetIndex() -
-		connection->GetInput().index;
-	int toLaneFirst, toLaneCount;
-	NodeSubGroup output = connection->GetOutput();
-	connection->GetLaneOutputRange(fromLaneIndex, toLaneFirst, toLaneCount);
-	int toLaneNextFirst = Math::Max(0, toLaneFirst - 1);
-	int toLaneNextLast = Math::Min(output.count - 1, toLaneFirst + toLaneCount);
-	int toLaneindex = Random::NextInt(toLaneNextFirst, toLaneNextLast + 1);
-	int laneShift = 0;
-	if (toLaneindex < toLaneFirst)
-		laneShift = -1;
-	else if (toLaneindex >= toLaneFirst + toLaneCount)
-		laneShift = 1;
-	return DriverPathNode(connection, fromLaneIndex, toLaneindex, laneShift);
+MetersPerSecondSq Driver::GetFollowingAcceleration() const
+{
+	Driver* leader;
+	Meters gap;
+	if (FindLeader(leader, gap))
+		return GetFollowingAcceleration(gap, leader->GetSnapshotSpeed());
+	return GetFollowingAcceleration(FLT_MAX, GetSpeed());
+}
+
+MetersPerSecondSq Driver::GetFollowingAcceleration(
+	Meters gap, MetersPerSecond leaderSpeed) const
+{
+	// Intelligent driver model: speed up toward the desired speed, and
+	// brake to keep a minimum gap plus a time headway behind the leader
+	MetersPerSecond speed = GetSpeed();
+	MetersPerSecondSq maxAcceleration = m_vehicleParams.acceleration;
+	MetersPerSecondSq comfortDeceleration = m_vehicleParams.deceleration;
+	float speedRatio = speed / m_desiredSpeed;
+	speedRatio *= speedRatio;
+	float freeRoad = 1.0f - (speedRatio * speedRatio);
+
+	MetersPerSecond approachRate = speed - leaderSpeed;
+	Meters desiredGap = DRIVER_FOLLOWING_MIN_GAP + Math::Max(0.0f,
+		(speed * DRIVER_FOLLOWING_TIME_GAP) + ((speed * approachRate) /
+		(2.0f * Math::Sqrt(maxAcceleration * comfortDeceleration))));
+	float gapRatio = desiredGap / Math::Max(gap, 0.1f);
+	float interaction = gapRatio * gapRatio;
+	return maxAcceleration * (freeRoad - interaction);
 }
 
 void Driver::CheckAvoidance()
 {
-	if (m_path.size() == 0)
+	if (m_path.IsEmpty())
 		return;
 
-	DriverPathNode current = m_path[0];
+	// Following the leader also covers speeding up on an open road
+	if (m_drivingSystem->GetCarFollowingModel() ==
+		CarFollowingModel::INTELLIGENT_DRIVER)
+		m_store->m_acceleration[m_slot] = GetFollowingAcceleration();
+
+	const DriverPathNode& current = m_path[0];
 
 	Node* node = current.GetStartNode();
 	if (m_surface != nullptr)
@@ -247,15 +553,150 @@ void Driver::CheckAvoidance()
 
 void Driver::CheckAvoidance(RoadSurface* surface)
 {
-	for (Driver* driver : surface->GetDrivers())
+	// The surface's lane lists are the broadphase here rather than the
+	// driver grid. The drivers to check are those on particular lanes, not
+	// those within a distance, and the boxes reach up to the look ahead
+	// time at both drivers' speeds, which would span a great many cells.
+	//
+	// With the car following model, drivers in the path's lanes are left
+	// to it, and lanes running alongside can't be hit. Intersections on the
+	// path are resolved by their conflict zones, and boxes are only tested
+	// against other lanes that cross or merge with the path.
+	int pathIndex = -1;
+	if (m_drivingSystem->GetCarFollowingModel() ==
+		CarFollowingModel::INTELLIGENT_DRIVER)
 	{
-		if (driver != this)
+		for (int i = 0; i < m_path.GetCount() && pathIndex < 0; i++)
+		{
+			if (m_path[i].GetSurface() == surface)
+				pathIndex = i;
+		}
+		if (pathIndex >= 0 && m_path[pathIndex].GetIntersection() != nullptr)
+		{
+			CheckConflicts(m_path[pathIndex].GetIntersection(), pathIndex);
+			return;
+		}
+	}
+
+	for (int i = 0; i < surface->GetLaneCount(); i++)
+	{
+		const RoadSurfaceLane& lane = surface->GetLane(i);
+		if (pathIndex >= 0)
+		{
+			const DriverPathNode& pathNode = m_path[pathIndex];
+			if ((lane.startNode == pathNode.GetStartNodeRef() &&
+				lane.endNode == pathNode.GetEndNodeRef()) ||
+				lane.IsParallel(pathNode.GetStartNodeRef(), pathNode.GetEndNodeRef()))
+				continue;
+		}
+		else if (surface == m_surface && i == m_surfaceLane)
+		{
+			// In its own lane, only the driver directly ahead can be hit
+			// first
+			if (m_driverAhead != nullptr)
+				CheckAvoidance(m_driverAhead);
+			continue;
+		}
+		for (Driver* driver = lane.front; driver != nullptr;
+			driver = driver->m_driverBehind)
 			CheckAvoidance(driver);
 	}
 }
 
+void Driver::CheckConflicts(RoadIntersection* intersection, int pathIndex)
+{
+	// Look up where this driver's movement through the intersection meets
+	// the movement of each of its lanes, and yield to the drivers who will
+	// be in the conflict zone first. Yielding is following a stopped leader
+	// at the start of the zone.
+	const DriverPathNode& pathNode = m_path[pathIndex];
+	int movement = intersection->GetMovementIndex(
+		pathNode.GetStartNodeRef(), pathNode.GetEndNodeRef());
+	if (movement < 0)
+		return;
+	MetersPerSecondSq& acceleration = m_store->m_acceleration[m_slot];
+	Meters distance = GetDistance() - m_path.GetStartDistance(pathIndex);
+	Meters front = distance + (m_vehicleParams.size[0].x * 0.5f);
+	Meters rear = distance - GetRearOffset();
+	MetersPerSecond speed = Math::Max(GetSpeed(), DRIVER_CONFLICT_MIN_SPEED);
+	RightOfWay myRightOfWay = pathNode.GetStartNode()->GetNodeGroup()->GetRightOfWay();
+
+	for (int i = 0; i < intersection->GetLaneCount(); i++)
+	{
+		const RoadSurfaceLane& lane = intersection->GetLane(i);
+		if (lane.IsParallel(pathNode.GetStartNodeRef(), pathNode.GetEndNodeRef()))
+			continue;
+		const RoadIntersectionConflict* conflict = intersection->GetConflict(
+			movement, intersection->GetMovementIndex(lane.startNode, lane.endNode));
+		if (conflict == nullptr || rear >= conflict->exit)
+			continue;
+		Seconds myEnterTime = (conflict->enter - front) / speed;
+		Seconds myExitTime = (conflict->exit - rear) / speed;
+		if (myEnterTime > DRIVER_CONFLICT_LOOK_AHEAD)
+			continue;
+		RightOfWay otherRightOfWay = lane.startNode.group->GetRightOfWay();
+
+		for (Driver* driver = lane.front; driver != nullptr;
+			driver = driver->m_driverBehind)
+		{
+			Meters otherFront = driver->GetSnapshotDistance() +
+				(driver->m_vehicleParams.size[0].x * 0.5f);
+			Meters otherRear = driver->GetSnapshotDistance() - driver->GetRearOffset();
+			if (otherRear >= conflict->otherExit)
+				continue;
+			MetersPerSecond otherSpeed = Math::Max(
+				driver->GetSnapshotSpeed(), DRIVER_CONFLICT_MIN_SPEED);
+			Seconds otherEnterTime = (conflict->otherEnter - otherFront) / otherSpeed;
+			Seconds otherExitTime = (conflict->otherExit - otherRear) / otherSpeed;
+
+			bool yield;
+			Meters gap = 0.0f;
+			MetersPerSecond leaderSpeed = 0.0f;
+			if (myEnterTime <= 0.0f && otherEnterTime <= 0.0f)
+			{
+				// Both are in the zone, so the one further behind follows
+				Meters progress = front - conflict->enter;
+				Meters otherProgress = otherFront - conflict->otherEnter;
+				yield = (progress < otherProgress ||
+					(progress == otherProgress && m_id > driver->m_id));
+				gap = (otherRear - conflict->otherEnter) - progress;
+				leaderSpeed = driver->GetSnapshotSpeed();
+			}
+			else if (myEnterTime <= 0.0f)
+			{
+				yield = false;
+			}
+			else
+			{
+				// Only yield if the two would be in the zone at once
+				gap = conflict->enter - front;
+				if (otherEnterTime <= 0.0f)
+					yield = true;
+				else if (otherEnterTime > DRIVER_CONFLICT_LOOK_AHEAD ||
+					otherEnterTime > myExitTime + DRIVER_CONFLICT_TIME_MARGIN ||
+					otherExitTime + DRIVER_CONFLICT_TIME_MARGIN < myEnterTime)
+					yield = false;
+				else if (myRightOfWay != otherRightOfWay)
+					yield = ((int) myRightOfWay < (int) otherRightOfWay);
+				else
+					yield = (otherEnterTime < myEnterTime ||
+						(otherEnterTime == myEnterTime && m_id > driver->m_id));
+			}
+
+			if (yield)
+			{
+				acceleration = Math::Min(acceleration,
+					GetFollowingAcceleration(gap, leaderSpeed));
+				m_collisions.push_back(driver);
+			}
+		}
+	}
+}
+
 void Driver::CheckAvoidance(Driver* driver)
 {
+	MetersPerSecond& speed = m_store->m_speed[m_slot];
+	MetersPerSecondSq& acceleration = m_store->m_acceleration[m_slot];
 	Meters timeOfImpact = -1.0f;
 
 	RightOfWay myRightOfWay = RightOfWay::NONE;
@@ -265,9 +706,10 @@ void Driver::CheckAvoidance(Driver* driver)
 
 	// Make sure we are behind the other driver
 	Vector3f front0 = GetFrontPostion();
-	Vector3f front1 = driver->GetFrontPostion();
+	Vector3f front1 = driver->GetSnapshotFrontPosition();
+	Vector2f otherDirection = driver->GetSnapshotDirection();
 	Meters distToOther = front1.xy.Dot(GetDirection()) - front0.xy.Dot(GetDirection());
-	Meters distToMe = front0.xy.Dot(driver->GetDirection()) - front1.xy.Dot(driver->GetDirection());
+	Meters distToMe = front0.xy.Dot(otherDirection) - front1.xy.Dot(otherDirection);
 	if (distToOther < 0.0f)
 		return;
 
@@ -278,48 +720,69 @@ void Driver::CheckAvoidance(Driver* driver)
 			return;
 	}
 
-	// Determine time of collision
+	// Determine time of collision. Each trailer's boxes over all future
+	// states are tested at once, one bit per future state. The other
+	// driver's future is only needed if its current state is clear.
 	bool staticCollision = false;
 	bool futureCollision = false;
-	for (unsigned int i = 0; i < DRIVER_MAX_FUTURE_STATES; i++)
+	PredictFutureStates();
+	const OrientedBoxBatch& otherBoxes = driver->m_collisionBoxes;
+	uint32 staticMask = 0;
+	for (int j = 0; j < driver->m_vehicleParams.trailerCount; j++)
 	{
-		if (Driver::CheckCollision(
-				m_vehicleParams, m_futureStates[i],
-				driver->m_vehicleParams, driver->m_futureStates[0]))
+		OrientedBox box = otherBoxes.Get(j * DRIVER_MAX_FUTURE_STATES);
+		for (int i = 0; i < m_vehicleParams.trailerCount; i++)
 		{
-			timeOfImpact = driver->m_futureStates[i].time;
-			if (i == 0)
-			{
-				m_isColliding = true;
-				m_collisions.push_back(driver);
-			}
-			staticCollision = true;
-			m_collisionIndex = i;
-			m_futureCollision = false;
-			break;
+			staticMask |= OrientedBoxBatch::Overlap(box, m_collisionBoxes,
+				i * DRIVER_MAX_FUTURE_STATES, DRIVER_MAX_FUTURE_STATES);
+		}
+	}
+	if (staticMask != 0)
+	{
+		int i = 0;
+		while ((staticMask & (1u << i)) == 0)
+			i++;
+		timeOfImpact = m_futureStates[i].time;
+		if (i == 0)
+		{
+			m_isColliding = true;
+			m_collisions.push_back(driver);
 		}
+		staticCollision = true;
+		m_collisionIndex = i;
+		m_futureCollision = false;
 	}
-	if (!staticCollision)
+	else
 	{
-		for (unsigned int i = 1; i < DRIVER_MAX_FUTURE_STATES; i++)
+		driver->PredictFutureStates();
+		uint32 futureMask = 0;
+		for (int i = 0; i < m_vehicleParams.trailerCount; i++)
 		{
-			if (Driver::CheckCollision(
-				m_vehicleParams, m_futureStates[i],
-				driver->m_vehicleParams, driver->m_futureStates[i]))
+			for (int j = 0; j < driver->m_vehicleParams.trailerCount; j++)
 			{
-				timeOfImpact = driver->m_futureStates[i].time;
-				futureCollision = true;
-				m_collisionIndex = i;
-				m_futureCollision = true;
-				break;
+				futureMask |= OrientedBoxBatch::OverlapPairs(
+					m_collisionBoxes, i * DRIVER_MAX_FUTURE_STATES,
+					otherBoxes, j * DRIVER_MAX_FUTURE_STATES,
+					DRIVER_MAX_FUTURE_STATES);
 			}
 		}
+		futureMask &= ~1u;
+		if (futureMask != 0)
+		{
+			int i = 0;
+			while ((futureMask & (1u << i)) == 0)
+				i++;
+			timeOfImpact = driver->m_futureStates[i].time;
+			futureCollision = true;
+			m_collisionIndex = i;
+			m_futureCollision = true;
+		}
 	}
 
 	if ((int) myRightOfWay > (int) otherRightOfWay && !staticCollision)
 		return;
 
-	Meters distOfImpact = timeOfImpact * m_speed;
+	Meters distOfImpact = timeOfImpact * speed;
 	if (timeOfImpact < 0.0f)
 		return;
 	if (timeOfImpact > DRIVER_COLLISION_LOOK_AHEAD)
@@ -328,14 +791,14 @@ void Driver::CheckAvoidance(Driver* driver)
 	//distOfImpact = distToOther;
 	MetersPerSecondSq deceleration = 0.0f;
 	if (distOfImpact > FLT_EPSILON)
-		deceleration = Math::Max(0.01f, (m_speed * m_speed) / (2.0f * distOfImpact)) * 1.2f;
-	m_acceleration = Math::Min(m_acceleration, -deceleration);
+		deceleration = Math::Max(0.01f, (speed * speed) / (2.0f * distOfImpact)) * 1.2f;
+	acceleration = Math::Min(acceleration, -deceleration);
 	m_collisions.push_back(driver);
 	//m_acceleration = -m_vehicleParams.deceleration;
 	if (m_isColliding)
 	{
-		m_speed = 0.0f;
-		m_acceleration = 0.0f;
+		speed = 0.0f;
+		acceleration = 0.0f;
 	}
 }
 
@@ -345,65 +808,35 @@ bool Driver::CheckCollision(
 	const DriverVehicleParams& paramsB,
 	const DriverCollisionState& b)
 {
-	Vector2f c1, c2, c3, c4, mins, maxs;
-	Vector2f stretch(1.3f, 1.1f);
+	Vector2f stretch(DRIVER_COLLISION_STRETCH_X, DRIVER_COLLISION_STRETCH_Y);
 	for (int i = 0; i < paramsA.trailerCount; i++)
 	{
-		Vector2f posA = a.position[i].xy;
-		Vector2f dirA = a.direction[i];
-		Vector2f sizeA = paramsA.size[i].xy * 0.5f * stretch;
-
+		OrientedBox boxA;
+		boxA.center = a.position[i].xy;
+		boxA.axis = a.direction[i];
+		boxA.halfSize = paramsA.size[i].xy * 0.5f * stretch;
 		for (int j = 0; j < paramsB.trailerCount; j++)
 		{
-			Vector2f posB = b.position[j].xy;
-			Vector2f dirB = b.direction[j];
-			Vector2f sizeB = paramsB.size[j].xy * 0.5f * stretch;
-
-			if (posA.DistTo(posB) > sizeA.Length() + sizeB.Length())
-				continue;
-
-			bool touching = true;
-
-			Matrix3f t = b.GetTransformInv(j) * a.GetTransform(i);
-			c1 = t.TransformVector(Vector2f(sizeA.x, sizeA.y));
-			c2 = t.TransformVector(Vector2f(sizeA.x, -sizeA.y));
-			c3 = t.TransformVector(Vector2f(-sizeA.x, sizeA.y));
-			c4 = t.TransformVector(Vector2f(-sizeA.x, -sizeA.y));
-			mins.x = Math::Min(Math::Min(c1.x, c2.x), Math::Min(c3.x, c4.x));
-			mins.y = Math::Min(Math::Min(c1.y, c2.y), Math::Min(c3.y, c4.y));
-			maxs.x = Math::Max(Math::Max(c1.x, c2.x), Math::Max(c3.x, c4.x));
-			maxs.y = Math::Max(Math::Max(c1.y, c2.y), Math::Max(c3.y, c4.y));
-			if (maxs.x < -sizeB.x || mins.x > sizeB.x ||
-				maxs.y < -sizeB.y || mins.y > sizeB.y)
-				touching = false;
-
-			t = a.GetTransformInv(i) * b.GetTransform(j);
-			c1 = t.TransformVector(Vector2f(sizeB.x, sizeB.y));
-			c2 = t.TransformVector(Vector2f(sizeB.x, -sizeB.y));
-			c3 = t.TransformVector(Vector2f(-sizeB.x, sizeB.y));
-			c4 = t.TransformVector(Vector2f(-sizeB.x, -sizeB.y));
-			mins.x = Math::Min(Math::Min(c1.x, c2.x), Math::Min(c3.x, c4.x));
-			mins.y = Math::Min(Math::Min(c1.y, c2.y), Math::Min(c3.y, c4.y));
-			maxs.x = Math::Max(Math::Max(c1.x, c2.x), Math::Max(c3.x, c4.x));
-			maxs.y = Math::Max(Math::Max(c1.y, c2.y), Math::Max(c3.y, c4.y));
-			if (maxs.x < -sizeA.x || mins.x > sizeA.x ||
-				maxs.y < -sizeA.y || mins.y > sizeA.y)
-				touching = false;
-
-			if (touching)
+			OrientedBox boxB;
+			boxB.center = b.position[j].xy;
+			boxB.axis = b.direction[j];
+			boxB.halfSize = paramsB.size[j].xy * 0.5f * stretch;
+			if (OrientedBoxBatch::Overlap(boxA, boxB))
 				return true;
 		}
 	}
 	return false;
-
-	Meters radius = 2.5f;
-	Vector2f pos0 = a.position[0].xy;
-	Vector2f pos1 = b.position[0].xy;
-	return (Vector2f::Dist(pos0, pos1) < radius);
 }
 
 void Driver::Update(float dt)
 {
+	Meters& distance = m_store->m_distance[m_slot];
+	MetersPerSecond& speed = m_store->m_speed[m_slot];
+	MetersPerSecondSq& acceleration = m_store->m_acceleration[m_slot];
+	Vector3f& position = m_store->m_position[m_slot];
+	Vector2f& direction = m_store->m_direction[m_slot];
+	DriverState& state = m_store->m_state[m_slot];
+
 	MetersPerSecondSq minBrakeRate = 10.0f;
 	MetersPerSecondSq maxBrakeRate = 20.0f;
 	Meters distanceToStopSign;
@@ -411,136 +844,122 @@ void Driver::Update(float dt)
 	TrafficLightSignal signal;
 	GetNextStop(distanceToStopSign, stopNode, signal);
 
-	if (m_state == DriverState::DRIVING)
+	if (state == DriverState::DRIVING)
 	{
-		if (m_collisions.empty())
+		if (m_collisions.empty() && m_drivingSystem->GetCarFollowingModel() ==
+			CarFollowingModel::COLLISION_BOXES)
 		{
-			if (m_speed < m_desiredSpeed)
-				m_acceleration = m_vehicleParams.acceleration;
-			else if (m_speed > m_desiredSpeed)
-				m_acceleration = -m_vehicleParams.deceleration;
-			if (Math::Abs(m_speed - m_desiredSpeed) < m_acceleration * dt)
-				m_acceleration = 0.0f;
+			if (speed < m_desiredSpeed)
+				acceleration = m_vehicleParams.acceleration;
+			else if (speed > m_desiredSpeed)
+				acceleration = -m_vehicleParams.deceleration;
+			if (Math::Abs(speed - m_desiredSpeed) < acceleration * dt)
+				acceleration = 0.0f;
 		}
 
-		Meters maxBrakingDistance = (m_speed * m_speed) / (2.0f * minBrakeRate);
-		Meters minBrakingDistance = (m_speed * m_speed) / (2.0f * maxBrakeRate);
+		Meters maxBrakingDistance = (speed * speed) / (2.0f * minBrakeRate);
+		Meters minBrakingDistance = (speed * speed) / (2.0f * maxBrakeRate);
 		if (distanceToStopSign >= 0.0f &&
 			distanceToStopSign <= maxBrakingDistance &&
 			!(signal == TrafficLightSignal::YELLOW &&
 				distanceToStopSign < minBrakingDistance))
 		{
 				m_currentStopNode = stopNode;
-				m_state = DriverState::STOPPING;
+				state = DriverState::STOPPING;
 		}
 	}
-	if (m_state == DriverState::STOPPING)
+	if (state == DriverState::STOPPING)
 	{
 		MetersPerSecondSq deceleration = 1.0f;
 		if (deceleration > FLT_EPSILON)
 			deceleration = Math::Max(
-				0.1f, (m_speed * m_speed) / (2.0f * distanceToStopSign));
-		m_acceleration = Math::Min(m_acceleration, -deceleration);
+				0.1f, (speed * speed) / (2.0f * distanceToStopSign));
+		acceleration = Math::Min(acceleration, -deceleration);
 		if (distanceToStopSign < 0.1f)
 		{
-			m_speed = 0.0f;
-			m_state = DriverState::STOPPED;
+			speed = 0.0f;
+			state = DriverState::STOPPED;
 			m_stopTimer = 1.0f;
 		}
-		if (m_currentStopNode->GetSignal() != TrafficLightSignal::STOP &&
-			m_currentStopNode->GetSignal() != TrafficLightSignal::STOP_SIGN &&
-			m_currentStopNode->GetSignal() != TrafficLightSignal::YELLOW)
+		if (m_currentStopNode.Get()->GetSignal() != TrafficLightSignal::STOP &&
+			m_currentStopNode.Get()->GetSignal() != TrafficLightSignal::STOP_SIGN &&
+			m_currentStopNode.Get()->GetSignal() != TrafficLightSignal::YELLOW)
 		{
-			m_state = DriverState::DRIVING;
-			m_currentStopNode = nullptr;
+			state = DriverState::DRIVING;
+			m_currentStopNode = NodeRef();
 		}
 	}
-	if (m_state == DriverState::STOPPED)
+	if (state == DriverState::STOPPED)
 	{
-		m_acceleration = 0.0f;
+		acceleration = 0.0f;
 		m_stopTimer -= dt;
-		if (m_currentStopNode->GetSignal() != TrafficLightSignal::STOP &&
-			m_currentStopNode->GetSignal() != TrafficLightSignal::STOP_SIGN &&
-			m_currentStopNode->GetSignal() != TrafficLightSignal::YELLOW)
+		if (m_currentStopNode.Get()->GetSignal() != TrafficLightSignal::STOP &&
+			m_currentStopNode.Get()->GetSignal() != TrafficLightSignal::STOP_SIGN &&
+			m_currentStopNode.Get()->GetSignal() != TrafficLightSignal::YELLOW)
 		{
-			m_state = DriverState::DRIVING;
-			m_currentStopNode = nullptr;
+			state = DriverState::DRIVING;
+			m_currentStopNode = NodeRef();
 		}
 		else if (m_stopTimer <= 0.0f &&
-			m_currentStopNode->GetSignal() == TrafficLightSignal::STOP_SIGN)
+			m_currentStopNode.Get()->GetSignal() == TrafficLightSignal::STOP_SIGN)
 		{
-			if (stopNode != m_currentStopNode)
+			if (stopNode != m_currentStopNode.Get())
 			{
-				m_currentStopNode = nullptr;
-				m_state = DriverState::DRIVING;
+				m_currentStopNode = NodeRef();
+				state = DriverState::DRIVING;
 			}
 		}
 		else
 		{
-			m_speed = 0.0f;
+			speed = 0.0f;
 		}
 	}
 
-	CMG_ASSERT(!std::isnan(m_acceleration));
+	CMG_ASSERT(!std::isnan(acceleration));
 
-	m_speed += m_acceleration * dt;
-	if (m_speed < 0.0f)
-		m_speed = 0.0f;
+	speed += acceleration * dt;
+	if (speed < 0.0f)
+		speed = 0.0f;
 
-	if (m_path.size() > 0)
+	// Advance along the path. Extending the path and changing surfaces
+	// touch shared state, so those are deferred to CommitUpdate().
+	m_rerouteTimer -= dt;
+	if (!m_path.IsEmpty())
 	{
-		if (m_path.size() < 4)
-			Next();
-
-		m_distance += m_speed * dt;
+		distance += speed * dt;
+		m_pathNodeTime += dt;
 
-		DriverPathNode pathNode = m_path.front();
-		RoadCurveLine drivingLine = pathNode.GetDrivingLine();
-		Meters length = drivingLine.Length();
+		const RoadCurveLine* drivingLine = &m_path.Front().GetDrivingLine();
+		Meters length = drivingLine->Length();
 
-		if (m_distance >= length)
+		if (distance >= length)
 		{
-			m_distance -= length;
-			m_position = drivingLine.End();
-			m_nodeCurrent = pathNode.GetEndNode();
-			m_path.erase(m_path.begin());
-			m_surface->RemoveDriver(this);
-			m_surface = nullptr;
-			Next();
-			if (m_path.size() == 0)
-				m_destroy = true;
+			distance -= length;
+			position = drivingLine->End();
+			m_nodeCurrent = m_path.Front().GetEndNodeRef();
+			m_traversedEdge = m_path.Front().GetLaneGraphEdge();
+			m_traversedTime = m_pathNodeTime;
+			m_pathNodeTime = 0.0f;
+			m_path.PopFront();
+			if (m_nextStopIndex == 0)
+				m_isNextStopValid = false;
+			else if (m_nextStopIndex > 0)
+				m_nextStopIndex--;
 		}
 
-		if (m_path.size() > 0)
+		if (!m_path.IsEmpty())
 		{
-			pathNode = m_path.front();
-			drivingLine = pathNode.GetDrivingLine();
-			length = drivingLine.Length();
-			float t = m_distance / length;
-			m_position = drivingLine.GetPoint(m_distance);
-			m_direction = drivingLine.horizontalCurve.GetTangent(m_distance);
-			Vector3f forward = drivingLine.GetTangent(m_distance);
+			drivingLine = &m_path.Front().GetDrivingLine();
+			position = drivingLine->GetPoint(distance);
+			direction = drivingLine->horizontalCurve.GetTangent(distance);
+			Vector3f forward = drivingLine->GetTangent(distance);
 			m_orientation = Matrix3f::CreateLookAt(forward, Vector3f::UNITZ);
-			if (m_surface != pathNode.GetSurface())
-			{
-				if (m_surface != nullptr) 
-					m_surface->RemoveDriver(this);
-				m_surface = pathNode.GetSurface();
-					m_surface->AddDriver(this);
-			}
 		}
 	}
-	else
-	{
-		Next();
-	}
-
-	if (m_path.size() == 0 && m_surface != nullptr) 
-		m_surface->RemoveDriver(this);
 
 	// Update brake light state
 
-	m_speedSamples.push_back(m_speed);
+	m_speedSamples.push_back(speed);
 	if (m_speedSamples.size() > 8)
 		m_speedSamples.erase(m_speedSamples.begin());
 	MetersPerSecond avgSpeed = 0.0f;
@@ -552,7 +971,7 @@ void Driver::Update(float dt)
 	
 	m_lightState.leftBlinker = false;
 	m_lightState.rightBlinker = false;
-	if (m_path.size() > 0)
+	if (!m_path.IsEmpty())
 	{
 		int laneShift = m_path[0].GetLaneShift();
 		if (laneShift < 0)
@@ -564,7 +983,7 @@ void Driver::Update(float dt)
 	if (m_blinkerTimer < -0.3f)
 		m_blinkerTimer += 0.6f;
 
-	if (deltaSpeed < -20.0f || m_speed < mphToMetersPerSecond(0.3f))
+	if (deltaSpeed < -20.0f || speed < mphToMetersPerSecond(0.3f))
 		m_brakeLightTimer = 0.5f;
 	if (m_brakeLightTimer > 0.0f)
 	{
@@ -575,82 +994,152 @@ void Driver::Update(float dt)
 	{
 		m_lightState.braking = false;
 	}
-	m_speedPrev = m_speed;
+	m_speedPrev = speed;
+}
+
+void Driver::CommitUpdate()
+{
+	if (m_traversedEdge >= 0)
+	{
+		m_drivingSystem->GetTrafficAssignment().RecordTraversal(
+			m_traversedEdge, m_traversedTime);
+		m_traversedEdge = -1;
+	}
 
-	UpdateFutureStates();
+	// Extend the path to the look-ahead length
+	while (m_path.GetCount() < DRIVER_PATH_LOOK_AHEAD)
+	{
+		int pathLength = m_path.GetCount();
+		Next();
+		if (m_path.GetCount() == pathLength)
+			break;
+	}
+	if (m_path.IsEmpty())
+		m_destroy = true;
+
+	// Move to the surface lane of the current path node, or keep this
+	// driver's place in its lane sorted
+	RoadSurface* surface = nullptr;
+	NodeRef startNode;
+	NodeRef endNode;
+	if (!m_path.IsEmpty())
+	{
+		surface = m_path.Front().GetSurface();
+		startNode = m_path.Front().GetStartNodeRef();
+		endNode = m_path.Front().GetEndNodeRef();
+	}
+	if (m_surface != nullptr && m_surface == surface &&
+		m_surface->GetLane(m_surfaceLane).startNode == startNode &&
+		m_surface->GetLane(m_surfaceLane).endNode == endNode)
+	{
+		m_surface->SortDriver(this);
+	}
+	else
+	{
+		if (m_surface != nullptr)
+			m_surface->RemoveDriver(this);
+		m_surface = surface;
+		if (m_surface != nullptr)
+			m_surface->AddDriver(this, startNode, endNode);
+	}
 }
 
 void Driver::UpdateFutureStates()
 {
+	// Only the current state is computed every tick, as the trailers are
+	// integrated from where they were last tick. The rest of the horizon is
+	// predicted when a collision check first needs it.
 	DriverCollisionState prevState = m_futureStates[0];
+	DriverCollisionState& state = m_futureStates[0];
+	state.time = 0.0f;
+	state.position[0] = GetPosition();
+	state.direction[0] = GetDirection();
+	state.count = m_vehicleParams.trailerCount;
+	UpdateTrailerStates(state, prevState);
+
+	// Overlap pushes after this move the prediction's start along with them
+	m_predictionSpeed = GetSpeed();
+	m_predictionDistance = m_store->m_distance[m_slot];
+	m_isPredicted.store(false, std::memory_order_release);
+	UpdateCollisionBoxes(0);
+}
 
-	m_futureStates[0].time = 0.0f;
-	m_futureStates[0].position[0] = m_position;
-	m_futureStates[0].direction[0] = m_direction;
-	m_futureStates[0].count = m_vehicleParams.trailerCount;
-
-	Meters currentDistance = -m_distance;
-	unsigned int pathIndex = 0;
+void Driver::PredictFutureStates()
+{
+	// Neighbors may ask for the prediction from other threads, so it is
+	// made once under a lock, from inputs saved at the end of the last tick
+	if (m_isPredicted.load(std::memory_order_acquire))
+		return;
+	std::lock_guard<std::mutex> lock(m_predictionMutex);
+	if (m_isPredicted.load(std::memory_order_relaxed))
+		return;
 
 	for (int futureIndex = 1; futureIndex < DRIVER_MAX_FUTURE_STATES; futureIndex++)
 	{
+		const DriverCollisionState& prevState = m_futureStates[futureIndex - 1];
 		DriverCollisionState& state = m_futureStates[futureIndex];
-		state = m_futureStates[futureIndex - 1];
+		state = prevState;
 		state.time += DRIVER_FUTURE_STATE_TIME_DELTA;
-		float distance = state.time * m_speed;
-
-		for (; pathIndex < m_path.size(); pathIndex++)
+		Meters distance = m_predictionDistance + (state.time * m_predictionSpeed);
+		int pathIndex = m_path.Find(distance);
+		if (pathIndex >= 0)
 		{
-			if (currentDistance + m_path[pathIndex].GetDistance() >= distance)
-			{
-				Meters distOnNode = distance - currentDistance;
-				state.position[0] = Vector3f::ZERO;
-				state.position[0] =
-					m_path[pathIndex].GetDrivingLine().GetPoint(distOnNode);
-				state.direction[0] = 
-					m_path[pathIndex].GetDrivingLine().horizontalCurve.GetTangent(distOnNode);
-				break;
-			}
-			currentDistance += m_path[pathIndex].GetDistance();
+			const RoadCurveLine& drivingLine = m_path[pathIndex].GetDrivingLine();
+			Meters distOnNode = distance - m_path.GetStartDistance(pathIndex);
+			state.position[0] = drivingLine.GetPoint(distOnNode);
+			state.direction[0] = drivingLine.horizontalCurve.GetTangent(distOnNode);
 		}
 
-		// Update trailer positions/orientations
-		for (int futureIndex = 0; futureIndex < DRIVER_MAX_FUTURE_STATES; futureIndex++)
-		{
-			DriverCollisionState& state = m_futureStates[futureIndex];
-			DriverCollisionState* prevTrailerState = &prevState;
-			if (futureIndex > 0)
-				prevTrailerState = &m_futureStates[futureIndex - 1];
-			state.count = m_vehicleParams.trailerCount;
+		UpdateTrailerStates(state, prevState);
+		UpdateCollisionBoxes(futureIndex);
+	}
 
-			for (int i = 1; i < m_vehicleParams.trailerCount; i++)
-			{
-				Vector2f a = state.position[i - 1].xy -
-					state.direction[i - 1] * ((m_vehicleParams.size[i - 1].x * 0.5f) +
-						m_vehicleParams.pivotOffset[i - 1]);
-				Vector2f b = (prevTrailerState->position[i].xy -
-					prevTrailerState->direction[i] * ((m_vehicleParams.size[i].x * 0.25f) +
-						m_vehicleParams.pivotOffset[i - 1]));
-				state.direction[i] = Vector2f::Normalize(a - b);
-				state.position[i].xy = a - state.direction[i] *
-					((m_vehicleParams.size[i].x * 0.5f) +
-						m_vehicleParams.pivotOffset[i - 1]);
-				state.position[i].z = state.position[0].z;
-			}
-		}
+	m_isPredicted.store(true, std::memory_order_release);
+}
+
+void Driver::UpdateTrailerStates(DriverCollisionState& state,
+	const DriverCollisionState& prevState)
+{
+	// Each trailer is pulled toward its hitch on the vehicle in front
+	state.count = m_vehicleParams.trailerCount;
+	for (int i = 1; i < m_vehicleParams.trailerCount; i++)
+	{
+		Vector2f a = state.position[i - 1].xy -
+			state.direction[i - 1] * ((m_vehicleParams.size[i - 1].x * 0.5f) +
+				m_vehicleParams.pivotOffset[i - 1]);
+		Vector2f b = (prevState.position[i].xy -
+			prevState.direction[i] * ((m_vehicleParams.size[i].x * 0.25f) +
+				m_vehicleParams.pivotOffset[i - 1]));
+		state.direction[i] = Vector2f::Normalize(a - b);
+		state.position[i].xy = a - state.direction[i] *
+			((m_vehicleParams.size[i].x * 0.5f) +
+				m_vehicleParams.pivotOffset[i - 1]);
+		state.position[i].z = state.position[0].z;
+	}
+}
+
+void Driver::UpdateCollisionBoxes(int futureIndex)
+{
+	const DriverCollisionState& state = m_futureStates[futureIndex];
+	Vector2f stretch(DRIVER_COLLISION_STRETCH_X, DRIVER_COLLISION_STRETCH_Y);
+	for (int i = 0; i < m_vehicleParams.trailerCount; i++)
+	{
+		OrientedBox box;
+		box.center = state.position[i].xy;
+		box.axis = state.direction[i];
+		box.halfSize = m_vehicleParams.size[i].xy * 0.5f * stretch;
+		m_collisionBoxes.Set(i * DRIVER_MAX_FUTURE_STATES + futureIndex, box);
 	}
 }
 
 void Driver::IntegrateVelocity(float dt)
 {
-	if (m_path.size() == 0)
+	if (m_path.IsEmpty())
 		return;
-	m_acceleration = 0.0f;
+	m_store->m_acceleration[m_slot] = 0.0f;
 
 	// Reset collision debug info
 	m_isColliding = false;
 	m_collisionIndex = -1;
 	m_collisions.clear();
-
-	UpdateFutureStates();
 }
@@ -2,14 +2,43 @@
 
 #include "NodeGroupConnection.h"
 #include "DriverPath.h"
+#include "DriverStore.h"
+#include "SimulationRandom.h"
+#include "OrientedBox.h"
+#include <atomic>
+#include <mutex>
 
 class DrivingSystem;
+class TrafficLightProgram;
 
 
 constexpr auto MAX_VEHICLE_TRAILERS = 3;
 constexpr auto DRIVER_MAX_FUTURE_STATES = 8;
 constexpr Seconds DRIVER_FUTURE_STATE_TIME_DELTA = 0.25f;
 constexpr Seconds DRIVER_COLLISION_LOOK_AHEAD = 1.0f;
+constexpr auto DRIVER_PATH_LOOK_AHEAD = 4;
+static_assert(DRIVER_PATH_LOOK_AHEAD <= DRIVER_PATH_CAPACITY,
+	"The path look-ahead must fit in the driver path");
+constexpr float DRIVER_COLLISION_STRETCH_X = 1.3f; // Margin around vehicle boxes
+constexpr float DRIVER_COLLISION_STRETCH_Y = 1.1f;
+constexpr Meters DRIVER_FOLLOWING_MIN_GAP = 2.0f; // Gap to the leader when stopped
+constexpr Seconds DRIVER_FOLLOWING_TIME_GAP = 1.5f; // Time headway to the leader
+constexpr Meters DRIVER_FOLLOWING_LOOK_AHEAD = 100.0f; // Farthest to look for a leader
+constexpr Seconds DRIVER_CONFLICT_LOOK_AHEAD = 4.0f; // Soonest to yield before a conflict zone
+constexpr Seconds DRIVER_CONFLICT_TIME_MARGIN = 1.0f; // Time kept between two drivers in a zone
+constexpr MetersPerSecond DRIVER_CONFLICT_MIN_SPEED = 0.5f; // Speed assumed for arrival times
+
+
+enum class CarFollowingModel
+{
+	// Brake for every predicted overlap of vehicle boxes
+	COLLISION_BOXES = 0,
+
+	// Follow the leader in the same lane with the intelligent driver
+	// model, yield at the intersections' conflict zones, and test boxes
+	// only against other lanes that cross or merge
+	INTELLIGENT_DRIVER = 1,
+};
 
 
 struct DriverCollisionState
@@ -55,62 +84,101 @@ struct DriverLightState
 	bool rightBlinker;
 };
 
-enum class DriverState
-{
-	DRIVING = 0,
-	STOPPING = 1,
-	STOPPED = 2,
-};
-
 class Driver
 {
 public:
 	friend class DrivingSystem;
+	friend class DriverGrid;
+	friend class DriverStore;
+	friend class RoadSurface;
 
 public:
 	Driver();
-	Driver(RoadNetwork* network, DrivingSystem* drivingSystem, Node* node, int id);
 	~Driver();
 
+	void Initialize(RoadNetwork* network, DrivingSystem* drivingSystem, Node* node, int id);
+	void Release();
+	bool SyncWithNetwork();
+
 	inline Vector3f GetFrontPostion() const
 	{
-		return Vector3f(m_position.xy + (m_direction *
-			m_vehicleParams.size[0].x * 0.5f), m_position.z);
+		const Vector3f& position = GetPosition();
+		return Vector3f(position.xy + (GetDirection() *
+			m_vehicleParams.size[0].x * 0.5f), position.z);
 	}
 
 	inline const Vector3f& GetPosition() const
 	{
-		return m_position;
+		return m_store->m_position[m_slot];
 	}
 
 	inline const Vector2f& GetDirection() const
 	{
-		return m_direction;
+		return m_store->m_direction[m_slot];
 	}
 
 	inline Vector2f GetVelocity() const
 	{
-		return m_direction * m_speed;
+		return GetDirection() * GetSpeed();
 	}
 
 	inline float GetSlowDownPercent() const
 	{
-		return 1.0f - (m_speed / m_desiredSpeed);
+		return 1.0f - (GetSpeed() / m_desiredSpeed);
 	}
 
 	inline MetersPerSecond GetSpeed() const
 	{
-		return m_speed;
+		return m_store->m_speed[m_slot];
+	}
+
+	inline Meters GetDistance() const
+	{
+		return m_store->m_distance[m_slot];
+	}
+
+	// Other drivers are read through the snapshot during parallel phases
+
+	inline const Vector3f& GetSnapshotPosition() const
+	{
+		return m_store->m_snapshotPosition[m_slot];
+	}
+
+	inline const Vector2f& GetSnapshotDirection() const
+	{
+		return m_store->m_snapshotDirection[m_slot];
+	}
+
+	inline Vector3f GetSnapshotFrontPosition() const
+	{
+		const Vector3f& position = GetSnapshotPosition();
+		return Vector3f(position.xy + (GetSnapshotDirection() *
+			m_vehicleParams.size[0].x * 0.5f), position.z);
+	}
+
+	inline MetersPerSecond GetSnapshotSpeed() const
+	{
+		return m_store->m_snapshotSpeed[m_slot];
+	}
+
+	inline Meters GetSnapshotDistance() const
+	{
+		return m_store->m_snapshotDistance[m_slot];
 	}
 
 	inline MetersPerSecondSq GetAcceleration() const
 	{
-		return m_acceleration;
+		return m_store->m_acceleration[m_slot];
 	}
 
 	inline void SetSpeed(MetersPerSecond speed)
 	{
-		m_speed = speed;
+		m_store->m_speed[m_slot] = speed;
+	}
+
+	inline int GetSlot() const
+	{
+		return m_slot;
 	}
 
 	inline const RoadCurveLine& GetDrivingLine() const
@@ -118,7 +186,7 @@ public:
 		return m_path[0].GetDrivingLine();
 	}
 
-	inline const Array<DriverPathNode>& GetPath() const
+	inline const DriverPath& GetPath() const
 	{
 		return m_path;
 	}
@@ -128,13 +196,24 @@ public:
 		return m_vehicleParams;
 	}
 
+	// States past the first are only valid after PredictFutureStates
 	inline const DriverCollisionState& GetState(int index = 0) const
 	{
 		return m_futureStates[index];
 	}
+	inline Driver* GetDriverAhead() const
+	{
+		return m_driverAhead;
+	}
+
+	inline Driver* GetDriverBehind() const
+	{
+		return m_driverBehind;
+	}
+
 	inline DriverState GetMovementState() const
 	{
-		return m_state;
+		return m_store->m_state[m_slot];
 	}
 
 	inline const Matrix3f& GetOrientation() const
@@ -142,21 +221,44 @@ public:
 		return m_orientation;
 	}
 
-	inline void Push(Meters amount) { m_distance = Math::Max(0.0f, m_distance + amount); }
+	inline void Push(Meters amount)
+	{
+		Meters& distance = m_store->m_distance[m_slot];
+		distance = Math::Max(0.0f, distance + amount);
+		m_predictionDistance = distance;
+	}
 	inline bool IsColliding() const { return m_isColliding; }
 	inline const DriverLightState& GetLightState() const { return m_lightState; }
 	inline int GetId() const { return m_id; }
+	inline Node* GetDestination() const { return m_destination.Get(); }
+
+	void SetDestination(Node* destination);
+	void SetRoute(const Array<int>& route);
+	bool PollReroute(int& outOriginLane, int& outDestinationLane, Array<int>& outRoute);
 
 	bool GetFuturePosition(Meters distance, Vector3f& position, Vector2f& direction);
 	void GetNextStop(Meters& outDistance, Node*& outNode, TrafficLightSignal& outSignal);
+	bool IsNextStopValid() const;
+	void FindNextStop();
 
 	void Next();
 	DriverPathNode Next(Node* node);
+	bool UpdateRoute(int lane);
+	bool FindLeader(Driver*& outLeader, Meters& outGap) const;
+	Meters GetRearOffset() const;
+	MetersPerSecondSq GetFollowingAcceleration() const;
+	MetersPerSecondSq GetFollowingAcceleration(Meters gap, MetersPerSecond leaderSpeed) const;
 	void CheckAvoidance();
 	void CheckAvoidance(RoadSurface* surface);
+	void CheckConflicts(RoadIntersection* intersection, int pathIndex);
 	void CheckAvoidance(Driver* driver);
 	void Update(float dt);
+	void CommitUpdate();
 	void UpdateFutureStates();
+	void PredictFutureStates();
+	void UpdateTrailerStates(DriverCollisionState& state,
+		const DriverCollisionState& prevState);
+	void UpdateCollisionBoxes(int futureIndex);
 	void IntegrateVelocity(float dt);
 
 	static bool CheckCollision(
@@ -166,14 +268,19 @@ public:
 		const DriverCollisionState& b);
 
 private:
+	DriverStore* m_store;
+	int m_slot;
 	int m_id;
-	Node* m_nodeCurrent;
+	NodeRef m_nodeCurrent;
 	int m_laneIndexCurrent;
 	int m_laneIndexTarget; // Relative to node group lanes
 	RoadNetwork* m_roadNetwork;
 	DrivingSystem* m_drivingSystem;
-	Array<DriverPathNode> m_path;
+	DriverPath m_path;
 	RoadSurface* m_surface;
+	int m_surfaceLane; // Neighbors in the surface lane, kept by the surface
+	Driver* m_driverAhead;
+	Driver* m_driverBehind;
 	bool m_destroy;
 	DriverLightState m_lightState;
 	Seconds m_brakeLightTimer;
@@ -181,22 +288,55 @@ private:
 	MetersPerSecond m_speedPrev;
 	Array<MetersPerSecond> m_speedSamples;
 
-	DriverState m_state;
 	Seconds m_stopTimer;
-	Node* m_currentStopNode;
-
-	Meters m_distance;
-	MetersPerSecond m_speed;
-	MetersPerSecondSq m_acceleration;
-	Vector3f m_position;
-	Vector2f m_direction;
-	Vector2f m_velocity;
+	NodeRef m_currentStopNode;
+
+	// Next stop along the path, kept until the path changes or one of the
+	// traffic lights before it changes its signals
+	bool m_isNextStopValid;
+	int m_nextStopIndex; // Path index, or -1 if there is no stop
+	TrafficLightSignal m_nextStopSignal;
+	uint32 m_nextStopGraphVersion;
+	const TrafficLightProgram* m_nextStopPrograms[DRIVER_PATH_CAPACITY];
+	uint32 m_nextStopProgramVersions[DRIVER_PATH_CAPACITY];
+	int m_nextStopProgramCount;
+
+	// Cold state (hot kinematic state lives in the driver store)
 	Matrix3f m_orientation;
 	DriverCollisionState m_futureStates[DRIVER_MAX_FUTURE_STATES];
+	OrientedBoxBatch m_collisionBoxes; // By trailer, then by future state
+
+	// Inputs for predicting the future states past the current one
+	MetersPerSecond m_predictionSpeed;
+	Meters m_predictionDistance;
+	std::atomic<bool> m_isPredicted;
+	std::mutex m_predictionMutex;
 
 	DriverVehicleParams m_vehicleParams; // length, width, height
 
 	MetersPerSecond m_desiredSpeed;
+
+	// Random stream for this driver's choices, keyed by its ID
+	RandomStream m_random;
+
+	// Route to the destination, as lane graph edges. Without a destination
+	// the driver picks a random way at each fork.
+	NodeRef m_destination;
+	int m_destinationLane;
+	Array<int> m_route;
+	int m_routeIndex;
+	uint32 m_routeVersion;
+	Seconds m_rerouteTimer;
+
+	// Time spent on the front path node, and the last path node finished,
+	// for the traffic assignment's travel times
+	Seconds m_pathNodeTime;
+	int m_traversedEdge;
+	Seconds m_traversedTime;
+
+	// Broadphase cell membership
+	uint64 m_gridCell;
+	int m_gridIndex;
 public:
 
 	// Debug
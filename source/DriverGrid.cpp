@@ -0,0 +1,127 @@
+#include "DriverGrid.h"
+#include "Driver.h"
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+DriverGrid::DriverGrid(Meters cellSize)
+	: m_cellSize(cellSize)
+{
+}
+
+DriverGrid::~DriverGrid()
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+Meters DriverGrid::GetCellSize() const
+{
+	return m_cellSize;
+}
+
+int DriverGrid::GetNumCells() const
+{
+	return (int) m_cells.size();
+}
+
+void DriverGrid::Query(const Vector2f& position, Meters radius,
+	Array<Driver*>& outDrivers) const
+{
+	// Collect the drivers in every cell overlapped by the query circle's
+	// bounding box. This is a broadphase, so candidates are not culled by
+	// their exact distance.
+	int minX = (int) Math::Floor((position.x - radius) / m_cellSize);
+	int minY = (int) Math::Floor((position.y - radius) / m_cellSize);
+	int maxX = (int) Math::Floor((position.x + radius) / m_cellSize);
+	int maxY = (int) Math::Floor((position.y + radius) / m_cellSize);
+	for (int x = minX; x <= maxX; x++)
+	{
+		for (int y = minY; y <= maxY; y++)
+		{
+			auto it = m_cells.find(GetCellKey(x, y));
+			if (it != m_cells.end())
+			{
+				outDrivers.insert(outDrivers.end(),
+					it->second.begin(), it->second.end());
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+void DriverGrid::Clear()
+{
+	for (auto it = m_cells.begin(); it != m_cells.end(); it++)
+	{
+		for (Driver* driver : it->second)
+			driver->m_gridIndex = -1;
+	}
+	m_cells.clear();
+}
+
+void DriverGrid::Insert(Driver* driver)
+{
+	CellKey key = GetCellKey(driver->GetPosition().xy);
+	Array<Driver*>& cell = m_cells[key];
+	driver->m_gridCell = key;
+	driver->m_gridIndex = (int) cell.size();
+	cell.push_back(driver);
+}
+
+void DriverGrid::Remove(Driver* driver)
+{
+	if (driver->m_gridIndex >= 0)
+		RemoveFromCell(driver);
+}
+
+void DriverGrid::Update(Driver* driver)
+{
+	// Only re-bucket the driver when it has crossed into a new cell
+	CellKey key = GetCellKey(driver->GetPosition().xy);
+	if (driver->m_gridIndex >= 0 && driver->m_gridCell == key)
+		return;
+	Remove(driver);
+	Insert(driver);
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+DriverGrid::CellKey DriverGrid::GetCellKey(int x, int y) const
+{
+	return (((CellKey) (uint32) x) << 32) | ((CellKey) (uint32) y);
+}
+
+DriverGrid::CellKey DriverGrid::GetCellKey(const Vector2f& position) const
+{
+	return GetCellKey(
+		(int) Math::Floor(position.x / m_cellSize),
+		(int) Math::Floor(position.y / m_cellSize));
+}
+
+void DriverGrid::RemoveFromCell(Driver* driver)
+{
+	// Swap-remove the driver from its cell, patching the index of the
+	// driver that takes its slot
+	auto it = m_cells.find(driver->m_gridCell);
+	Array<Driver*>& cell = it->second;
+	Driver* last = cell.back();
+	cell[driver->m_gridIndex] = last;
+	last->m_gridIndex = driver->m_gridIndex;
+	cell.pop_back();
+	if (cell.empty())
+		m_cells.erase(it);
+	driver->m_gridIndex = -1;
+}
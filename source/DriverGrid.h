@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include <cmgMath/cmg_math.h>
+#include "CommonTypes.h"
+#include <unordered_map>
+
+class Driver;
+
+
+//-----------------------------------------------------------------------------
+// Class:   DriverGrid
+// Purpose: Uniform spatial hash of drivers keyed on their XY position, used
+//          as the broadphase for pairwise driver queries by distance.
+//          Avoidance and conflict checks go by lane instead.
+//-----------------------------------------------------------------------------
+class DriverGrid
+{
+public:
+	// Constructors
+
+	DriverGrid(Meters cellSize = 8.0f);
+	~DriverGrid();
+
+	// Getters
+
+	Meters GetCellSize() const;
+	int GetNumCells() const;
+	void Query(const Vector2f& position, Meters radius,
+		Array<Driver*>& outDrivers) const;
+
+	// Setters
+
+	void Clear();
+	void Insert(Driver* driver);
+	void Remove(Driver* driver);
+	void Update(Driver* driver);
+
+private:
+	typedef uint64 CellKey;
+
+	CellKey GetCellKey(int x, int y) const;
+	CellKey GetCellKey(const Vector2f& position) const;
+	void RemoveFromCell(Driver* driver);
+
+	Meters m_cellSize;
+	std::unordered_map<CellKey, Array<Driver*>> m_cells;
+};
+
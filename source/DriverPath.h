@@ -11,67 +11,242 @@ class DriverPathNode
 public:
 	DriverPathNode()
 		: m_connection(nullptr)
+		, m_surface(nullptr)
+		, m_surfaceId(0)
+		, m_drivingLine(nullptr)
+		, m_laneGraphEdge(-1)
 	{}
 	DriverPathNode(NodeGroupConnection* connection,
 		int startLaneIndex, int endLaneIndex, int laneShift) 
 		: m_connection(connection)
 		, m_surface(connection)
+		, m_surfaceId(connection->GetId())
 		, m_laneIndexStart(startLaneIndex)
 		, m_laneIndexEnd(endLaneIndex)
 		, m_laneShift(laneShift)
+		, m_drivingLine(nullptr)
+		, m_laneGraphEdge(-1)
 	{
 		m_nodeStart = m_connection->GetInput().GetNode(m_laneIndexStart);
 		m_nodeEnd = m_connection->GetOutput().GetNode(m_laneIndexEnd);
-		m_drivingLine = m_connection->GetDrivingLine(
-			startLaneIndex, endLaneIndex);
 	}
 
 	DriverPathNode(RoadIntersection* intersection,
 		Node* startNode, Node* endNode, int laneShift=0)
 		: m_connection(nullptr)
 		, m_surface(intersection)
+		, m_surfaceId(intersection->GetId())
+		, m_nodeStart(startNode)
+		, m_nodeEnd(endNode)
 		, m_laneIndexStart(startNode->GetIndex())
 		, m_laneIndexEnd(endNode->GetIndex())
 		, m_laneShift(laneShift)
-		, m_nodeStart(startNode)
-		, m_nodeEnd(endNode)
+		, m_laneGraphEdge(-1)
 	{
-		m_drivingLine.horizontalCurve = BiarcPair::Interpolate(
-			startNode->GetCenter().xy, startNode->GetDirection(),
-			endNode->GetCenter().xy, endNode->GetDirection());
-		m_drivingLine.verticalCurve = VerticalCurve(
-			startNode->GetCenter().z, endNode->GetCenter().z);
-		m_drivingLine.verticalCurve.LinearInterpolatation(
-			m_drivingLine.horizontalCurve.Length());
+		m_drivingLine = &intersection->GetDrivingLine(m_nodeStart, m_nodeEnd);
 	}
 
 	inline Node* GetStartNode() const {
-		return m_nodeStart;
+		return m_nodeStart.Get();
 	}
 	inline Node* GetEndNode() const {
+		return m_nodeEnd.Get();
+	}
+	inline const NodeRef& GetStartNodeRef() const {
+		return m_nodeStart;
+	}
+	inline const NodeRef& GetEndNodeRef() const {
 		return m_nodeEnd;
 	}
 	inline RoadSurface* GetSurface() const {
 		return m_surface;
 	}
+	inline int GetSurfaceId() const {
+		return m_surfaceId;
+	}
+	inline NodeGroupConnection* GetConnection() const {
+		return m_connection;
+	}
+	inline RoadIntersection* GetIntersection() const {
+		return (m_connection == nullptr ?
+			static_cast<RoadIntersection*>(m_surface) : nullptr);
+	}
 	inline const RoadCurveLine& GetDrivingLine() const {
-		return m_drivingLine;
+		// Connection lines are looked up by lane index, as the connection's
+		// line cache may be reallocated when its lanes change
+		if (m_connection != nullptr)
+			return m_connection->GetDrivingLine(m_laneIndexStart, m_laneIndexEnd);
+		return *m_drivingLine;
 	}
 	inline Meters GetDistance() const {
-		return m_drivingLine.Length();
+		return GetDrivingLine().Length();
 	}
 	inline int GetLaneShift() const {
 		return m_laneShift;
 	}
+	inline int GetLaneGraphEdge() const {
+		return m_laneGraphEdge;
+	}
+
+	inline void SetLaneGraphEdge(int edge) {
+		m_laneGraphEdge = edge;
+	}
+
+	// Looks the driving line up again after the intersection's lines were
+	// updated, which erases the lines of lanes that left it. Returns false
+	// if the movement is gone.
+	inline bool ResolveDrivingLine() {
+		if (m_connection != nullptr)
+			return true;
+		m_drivingLine = GetIntersection()->FindDrivingLine(m_nodeStart, m_nodeEnd);
+		return (m_drivingLine != nullptr);
+	}
 
 private:
 	NodeGroupConnection* m_connection;
 	RoadSurface* m_surface;
-	Node* m_nodeStart;
-	Node* m_nodeEnd;
+	int m_surfaceId; // Tells a deleted surface apart from one in its place
+	NodeRef m_nodeStart;
+	NodeRef m_nodeEnd;
 	int m_laneIndexStart;
 	int m_laneIndexEnd; // Relative to connection left lane
 	int m_laneShift;
-	RoadCurveLine m_drivingLine;
+	const RoadCurveLine* m_drivingLine; // Line in the intersection's cache
+	int m_laneGraphEdge; // Edge this node was created from, if any
 };
 
+
+
+// Maximum number of nodes a driver's path can hold. Must be a power of two.
+constexpr auto DRIVER_PATH_CAPACITY = 8;
+
+// Distances are kept relative to the last rebase, to keep their precision
+constexpr Meters DRIVER_PATH_REBASE_DISTANCE = 1000.0f;
+
+
+//-----------------------------------------------------------------------------
+// Class:   DriverPath
+// Purpose: Fixed-capacity ring buffer of the path nodes a driver is about to
+//          drive along. The distance to the end of each node is stored as a
+//          running sum, so finding the node at a distance along the path is
+//          a binary search, and removing the front node is O(1).
+//
+//          Distances are measured from the start of the front node.
+//-----------------------------------------------------------------------------
+class DriverPath
+{
+public:
+	DriverPath()
+		: m_head(0)
+		, m_count(0)
+		, m_baseDistance(0.0f)
+	{}
+
+	inline int GetCount() const {
+		return m_count;
+	}
+	inline bool IsEmpty() const {
+		return (m_count == 0);
+	}
+	inline bool IsFull() const {
+		return (m_count == DRIVER_PATH_CAPACITY);
+	}
+	inline const DriverPathNode& operator[](int index) const {
+		return m_nodes[GetSlot(index)];
+	}
+	inline const DriverPathNode& Front() const {
+		return m_nodes[m_head];
+	}
+	inline const DriverPathNode& Back() const {
+		return m_nodes[GetSlot(m_count - 1)];
+	}
+	inline Meters GetStartDistance(int index) const {
+		return (index == 0 ? 0.0f : GetEndDistance(index - 1));
+	}
+	inline Meters GetEndDistance(int index) const {
+		return m_endDistances[GetSlot(index)] - m_baseDistance;
+	}
+	inline Meters GetLength() const {
+		return (m_count == 0 ? 0.0f : GetEndDistance(m_count - 1));
+	}
+
+	// Returns the index of the node containing the given distance, or -1 if
+	// it is past the end of the path
+	inline int Find(Meters distance) const {
+		int low = 0;
+		int high = m_count;
+		while (low < high)
+		{
+			int middle = (low + high) / 2;
+			if (GetEndDistance(middle) >= distance)
+				high = middle;
+			else
+				low = middle + 1;
+		}
+		return (low < m_count ? low : -1);
+	}
+
+	inline void Clear() {
+		m_head = 0;
+		m_count = 0;
+		m_baseDistance = 0.0f;
+	}
+
+	inline void PushBack(const DriverPathNode& node) {
+		CMG_ASSERT(!IsFull());
+		Meters endDistance = (m_count == 0 ? m_baseDistance :
+			m_endDistances[GetSlot(m_count - 1)]);
+		int slot = GetSlot(m_count);
+		m_nodes[slot] = node;
+		m_endDistances[slot] = endDistance + node.GetDistance();
+		m_count++;
+	}
+
+	// Looks up the intersection driving lines of the nodes again, after
+	// the network changed. Returns false if any of them is gone.
+	inline bool ResolveDrivingLines() {
+		for (int i = 0; i < m_count; i++)
+		{
+			if (!m_nodes[GetSlot(i)].ResolveDrivingLine())
+				return false;
+		}
+		return true;
+	}
+
+	// Sums the node lengths again, after the network changed the shape of
+	// their driving lines
+	inline void UpdateDistances() {
+		Meters endDistance = 0.0f;
+		for (int i = 0; i < m_count; i++)
+		{
+			int slot = GetSlot(i);
+			endDistance += m_nodes[slot].GetDistance();
+			m_endDistances[slot] = endDistance;
+		}
+		m_baseDistance = 0.0f;
+	}
+
+	inline void PopFront() {
+		CMG_ASSERT(!IsEmpty());
+		m_baseDistance = m_endDistances[m_head];
+		m_head = (m_head + 1) & (DRIVER_PATH_CAPACITY - 1);
+		m_count--;
+		if (m_baseDistance > DRIVER_PATH_REBASE_DISTANCE)
+		{
+			for (int i = 0; i < m_count; i++)
+				m_endDistances[GetSlot(i)] -= m_baseDistance;
+			m_baseDistance = 0.0f;
+		}
+	}
+
+private:
+	inline int GetSlot(int index) const {
+		return (m_head + index) & (DRIVER_PATH_CAPACITY - 1);
+	}
+
+	DriverPathNode m_nodes[DRIVER_PATH_CAPACITY];
+	Meters m_endDistances[DRIVER_PATH_CAPACITY];
+	int m_head;
+	int m_count;
+	Meters m_baseDistance;
+};
@@ -0,0 +1,99 @@
+#include "DriverStore.h"
+#include "Driver.h"
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+DriverStore::DriverStore()
+	: m_numActive(0)
+{
+}
+
+DriverStore::~DriverStore()
+{
+	for (Driver* block : m_blocks)
+		delete [] block;
+	m_blocks.clear();
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+int DriverStore::GetCapacity() const
+{
+	return (int) m_blocks.size() * DRIVER_STORE_BLOCK_SIZE;
+}
+
+int DriverStore::GetNumActive() const
+{
+	return m_numActive;
+}
+
+Driver* DriverStore::GetDriver(int slot)
+{
+	return &m_blocks[slot / DRIVER_STORE_BLOCK_SIZE][
+		slot % DRIVER_STORE_BLOCK_SIZE];
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+Driver* DriverStore::Allocate()
+{
+	if (m_freeSlots.empty())
+		AddBlock();
+	int slot = m_freeSlots.back();
+	m_freeSlots.pop_back();
+	m_numActive++;
+	return GetDriver(slot);
+}
+
+void DriverStore::Free(Driver* driver)
+{
+	driver->Release();
+	m_freeSlots.push_back(driver->m_slot);
+	m_numActive--;
+}
+
+
+void DriverStore::TakeSnapshot()
+{
+	m_snapshotDistance = m_distance;
+	m_snapshotSpeed = m_speed;
+	m_snapshotPosition = m_position;
+	m_snapshotDirection = m_direction;
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+void DriverStore::AddBlock()
+{
+	int first = GetCapacity();
+	int capacity = first + DRIVER_STORE_BLOCK_SIZE;
+	m_distance.resize(capacity, 0.0f);
+	m_speed.resize(capacity, 0.0f);
+	m_acceleration.resize(capacity, 0.0f);
+	m_position.resize(capacity, Vector3f::ZERO);
+	m_direction.resize(capacity, Vector2f::UNITX);
+	m_state.resize(capacity, DriverState::DRIVING);
+
+	Driver* block = new Driver[DRIVER_STORE_BLOCK_SIZE];
+	m_blocks.push_back(block);
+
+	// Push the new slots so that lower slots are handed out first
+	for (int i = DRIVER_STORE_BLOCK_SIZE - 1; i >= 0; i--)
+	{
+		block[i].m_store = this;
+		block[i].m_slot = first + i;
+		m_freeSlots.push_back(first + i);
+	}
+}
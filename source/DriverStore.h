@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include <cmgMath/cmg_math.h>
+#include "CommonTypes.h"
+
+class Driver;
+
+
+constexpr auto DRIVER_STORE_BLOCK_SIZE = 256;
+
+
+enum class DriverState
+{
+	DRIVING = 0,
+	STOPPING = 1,
+	STOPPED = 2,
+};
+
+
+//-----------------------------------------------------------------------------
+// Class:   DriverStore
+// Purpose: Pooled storage for drivers. Hot kinematic state is kept in
+//          parallel arrays indexed by driver slot, while the Driver objects
+//          themselves hold the cold per-driver data. Driver objects are
+//          allocated in fixed-size blocks and their slots are recycled
+//          through a free list.
+//-----------------------------------------------------------------------------
+class DriverStore
+{
+public:
+	// Constructors
+
+	DriverStore();
+	~DriverStore();
+
+	// Getters
+
+	int GetCapacity() const;
+	int GetNumActive() const;
+	Driver* GetDriver(int slot);
+
+	// Setters
+
+	Driver* Allocate();
+	void Free(Driver* driver);
+	void TakeSnapshot();
+
+public:
+	// Hot kinematic state, indexed by slot
+	Array<Meters> m_distance;
+	Array<MetersPerSecond> m_speed;
+	Array<MetersPerSecondSq> m_acceleration;
+	Array<Vector3f> m_position;
+	Array<Vector2f> m_direction;
+	Array<DriverState> m_state;
+
+	// Copy of the hot state taken before each parallel phase which reads
+	// other drivers, so that they are read as they were when it started
+	// rather than as they are being written
+	Array<Meters> m_snapshotDistance;
+	Array<MetersPerSecond> m_snapshotSpeed;
+	Array<Vector3f> m_snapshotPosition;
+	Array<Vector2f> m_snapshotDirection;
+
+private:
+	void AddBlock();
+
+	Array<Driver*> m_blocks;
+	Array<int> m_freeSlots;
+	int m_numActive;
+};
+
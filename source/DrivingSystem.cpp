@@ -1,5 +1,7 @@
 #include "DrivingSystem.h"
 #include "RoadNetwork.h"
+#include <algorithm>
+#include <cstring>
 
 
 //-----------------------------------------------------------------------------
@@ -8,21 +10,43 @@
 
 DrivingSystem::DrivingSystem(RoadNetwork* network)
 	: m_network(network)
+	, m_threadPool(nullptr)
+	, m_eventLog(nullptr)
+	, m_router(&network->GetLaneGraph())
+	, m_trafficAssignment(&network->GetLaneGraph())
+	, m_carFollowingModel(CarFollowingModel::COLLISION_BOXES)
+	, m_destinationLanesVersion(0)
+	, m_syncedGraphVersion(network->GetLaneGraph().GetVersion())
 {
+	m_spawnRandom = m_random.CreateStream(0);
+	m_neighborBuffers.resize(1);
 	m_trafficPercent = 0.0f;
+	m_finishedCount = 0;
 	m_driverIdCounter = 1;
 }
 
 DrivingSystem::~DrivingSystem()
 {
+	// Tearing down is not an event of the recorded run
+	m_eventLog = nullptr;
 	Clear();
+	delete m_threadPool;
+	m_threadPool = nullptr;
 }
 
 void DrivingSystem::Clear()
 {
+	RecordEvent(SimulationEvent(SimulationEventType::CLEAR));
+	m_grid.Clear();
 	for (Driver* driver : m_drivers)
-		delete driver;
+		m_store.Free(driver);
 	m_drivers.clear();
+
+	// Restart the driver IDs and the spawn stream so that a cleared system
+	// behaves the same as a new one
+	m_driverIdCounter = 1;
+	m_spawnRandom = m_random.CreateStream(0);
+	m_trafficAssignment.Clear();
 }
 
 float DrivingSystem::GetTrafficPercent()
@@ -30,15 +54,91 @@ float DrivingSystem::GetTrafficPercent()
 	return m_trafficPercent;
 }
 
+int DrivingSystem::GetFinishedCount() const
+{
+	return m_finishedCount;
+}
+
+int DrivingSystem::GetThreadCount() const
+{
+	if (m_threadPool == nullptr)
+		return 1;
+	return m_threadPool->GetThreadCount();
+}
+
+Driver* DrivingSystem::GetDriverById(int id)
+{
+	for (Driver* driver : m_drivers)
+	{
+		if (driver->GetId() == id)
+			return driver;
+	}
+	return nullptr;
+}
+
+uint64 DrivingSystem::ComputeChecksum() const
+{
+	// Hash the exact bits of each driver's kinematic state
+	uint64 checksum = RandomStream::Mix(m_drivers.size());
+	for (const Driver* driver : m_drivers)
+	{
+		uint32 distance, speed;
+		Meters driverDistance = m_store.m_distance[driver->GetSlot()];
+		MetersPerSecond driverSpeed = driver->GetSpeed();
+		memcpy(&distance, &driverDistance, sizeof(uint32));
+		memcpy(&speed, &driverSpeed, sizeof(uint32));
+		checksum = RandomStream::Mix(checksum ^ (uint64) driver->GetId());
+		checksum = RandomStream::Mix(checksum ^ (((uint64) distance << 32) | speed));
+	}
+	return checksum;
+}
+
+void DrivingSystem::SetThreadCount(int threadCount)
+{
+	delete m_threadPool;
+	m_threadPool = nullptr;
+	if (threadCount > 1)
+		m_threadPool = new ThreadPool(threadCount);
+	m_neighborBuffers.resize(GetThreadCount());
+}
+
+void DrivingSystem::SetRandom(const SimulationRandom& random)
+{
+	m_random = random;
+	m_spawnRandom = m_random.CreateStream(0);
+	RecordEvent(SimulationEvent(SimulationEventType::SEED,
+		0, 0.0f, m_random.GetSeed()));
+}
+
+void DrivingSystem::SetCarFollowingModel(CarFollowingModel model)
+{
+	m_carFollowingModel = model;
+}
+
+void DrivingSystem::SetEventLog(SimulationLog* eventLog)
+{
+	// The log should be set before any drivers are spawned, so that it
+	// starts from the current seed with a fresh spawn stream
+	m_eventLog = eventLog;
+	RecordEvent(SimulationEvent(SimulationEventType::SEED,
+		0, 0.0f, m_random.GetSeed()));
+}
+
 void DrivingSystem::SpawnDriver()
 {
-	/*NodeGroup* nodeGroup = Random::ChooseFromSet(m_network->GetNodeGroups());
-	int index = Random::NextInt(nodeGroup->GetNumNodes());
-	Node* node = nodeGroup->GetNode(index);
-	Driver* driver = new Driver(m_network, node);
-	m_drivers.push_back(driver);*/
+	Driver* driver = CreateDriver();
+	if (driver != nullptr)
+	{
+		RecordEvent(SimulationEvent(
+			SimulationEventType::SPAWN_DRIVER, driver->GetId()));
+	}
+}
 
-	Set<Node*> nodes;
+Driver* DrivingSystem::CreateDriver()
+{
+	// Gather the spawn nodes in ID order, as the network's sets are ordered
+	// by address which would make the choice differ between runs
+	Array<Node*> nodes;
 	for (NodeGroupConnection* connection : m_network->GetNodeGroupConnections())
 	{
 		if (!connection->IsGhost())
@@ -48,104 +148,234 @@ void DrivingSystem::SpawnDriver()
 				NodeGroup* nodeGroup = connection->GetInput().group;
 				if (nodeGroup->GetInputs().size() == 0 &&
 						nodeGroup->GetIntersection(IOType::INPUT) == nullptr)
-					nodes.insert(connection->GetInput().GetNode(i));
+					nodes.push_back(connection->GetInput().GetNode(i));
 			}
 		}
 	}
-	if (nodes.size() > 0)
+	if (nodes.size() == 0)
+		return nullptr;
+	std::sort(nodes.begin(), nodes.end(), [](Node* a, Node* b) {
+		if (a->GetNodeGroup()->GetId() != b->GetNodeGroup()->GetId())
+			return (a->GetNodeGroup()->GetId() < b->GetNodeGroup()->GetId());
+		return (a->GetIndex() < b->GetIndex());
+	});
+	nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+
+	Node* node = m_spawnRandom.Choose(nodes);
+	return InsertDriver(node, ChooseDestination(node));
+}
+
+Driver* DrivingSystem::InsertDriver(Node* node, Node* destination)
+{
+	// Drivers inserted from outside, such as by the mesoscopic system, are
+	// not recorded in the event log
+	Driver* driver = m_store.Allocate();
+	driver->Initialize(m_network, this, node, m_driverIdCounter);
+	driver->SetDestination(destination);
+	m_driverIdCounter++;
+	m_drivers.push_back(driver);
+	m_grid.Insert(driver);
+	return driver;
+}
+
+Node* DrivingSystem::ChooseDestination(Node* origin)
+{
+	// Destinations are lanes where the road network ends, in lane ID order
+	const LaneGraph& laneGraph = m_network->GetLaneGraph();
+	if (m_destinationLanes.empty() ||
+		m_destinationLanesVersion != laneGraph.GetVersion())
+	{
+		m_destinationLanesVersion = laneGraph.GetVersion();
+		m_destinationLanes.clear();
+		for (int lane = 0; lane < laneGraph.GetLaneCount(); lane++)
+		{
+			if (laneGraph.GetEdgeBegin(lane) == laneGraph.GetEdgeEnd(lane))
+				m_destinationLanes.push_back(lane);
+		}
+	}
+	int originLane = laneGraph.GetLaneId(origin);
+	if (originLane < 0 || m_destinationLanes.empty())
+		return nullptr;
+
+	// Pick a random destination which can be reached from the origin. The
+	// found route is cached for when the driver starts following it.
+	for (int i = 0; i < DRIVER_DESTINATION_ATTEMPTS; i++)
 	{
-		Node* node = Random::ChooseFromSet(nodes);
-		Driver* driver = new Driver(m_network, this, node, m_driverIdCounter);
-		m_driverIdCounter++;
-		m_drivers.push_back(driver);
+		int lane = m_spawnRandom.Choose(m_destinationLanes);
+		if (m_router.FindRoute(originLane, lane) != nullptr)
+			return laneGraph.GetLane(lane);
 	}
+	return nullptr;
 }
 
 void DrivingSystem::DeleteDriver(Driver* driver)
 {
+	RecordEvent(SimulationEvent(
+		SimulationEventType::DELETE_DRIVER, driver->GetId()));
+	RemoveDriver(driver);
+}
+
+void DrivingSystem::RemoveDriver(Driver* driver)
+{
+	// The counterpart of InsertDriver, which is not recorded in the event
+	// log either, as replaying the steps removes the driver again
 	auto it = std::find(m_drivers.begin(), m_drivers.end(), driver);
 	if (it != m_drivers.end())
 		m_drivers.erase(it);
-	delete driver;
+	m_grid.Remove(driver);
+	m_store.Free(driver);
 }
 
+void DrivingSystem::SyncWithNetwork()
+{
+	// The lane graph is rebuilt after every change to the road network.
+	// Drivers whose roads or lanes were removed by the change are taken off
+	// the road without being logged, as edits are not part of a recorded
+	// simulation.
+	uint32 version = m_network->GetLaneGraph().GetVersion();
+	if (version == m_syncedGraphVersion)
+		return;
+	m_syncedGraphVersion = version;
+	for (unsigned int i = 0; i < m_drivers.size(); i++)
+	{
+		if (!m_drivers[i]->SyncWithNetwork())
+		{
+			m_grid.Remove(m_drivers[i]);
+			m_store.Free(m_drivers[i]);
+			m_drivers.erase(m_drivers.begin() + i);
+			i--;
+		}
+	}
+
+	// Then drop the surface lanes of the removed lanes, which are empty now
+	for (NodeGroupConnection* connection : m_network->GetNodeGroupConnections())
+		connection->RemoveStaleLanes(*m_network);
+	for (RoadIntersection* intersection : m_network->GetIntersections())
+		intersection->RemoveStaleLanes(*m_network);
+}
 
 void DrivingSystem::Update(float dt)
 {
+	SyncWithNetwork();
+
 	int destroyCount = 0;
 	for (unsigned int i = 0; i < m_drivers.size(); i++)
 	{
 		if (m_drivers[i]->m_destroy)
 		{
-			delete m_drivers[i];
+			m_grid.Remove(m_drivers[i]);
+			m_store.Free(m_drivers[i]);
 			m_drivers.erase(m_drivers.begin() + i);
 			i--;
 			destroyCount++;
 		}
 	}
 	for (int i = 0; i < destroyCount; i++)
-		SpawnDriver();
+		CreateDriver();
+	m_finishedCount = destroyCount;
 
-	for (Driver* driver : m_drivers)
+	// Each parallel phase only writes the state of the driver it visits.
+	// Phases which read other drivers read them from a snapshot taken when
+	// the phase starts, so the results do not depend on the number of
+	// threads. The one exception
+	// is the lazy future state prediction, which a neighbor may trigger, but
+	// it is made under a lock from inputs fixed at the end of the last tick.
+	// Anything touching shared state (random path extension, surface driver
+	// sets, the grid, travel time statistics) is done serially in driver
+	// order.
+	ForEachDriver([dt](Driver* driver) {
 		driver->IntegrateVelocity(dt);
-	for (Driver* driver : m_drivers)
+	});
+	m_store.TakeSnapshot();
+	ForEachDriver([](Driver* driver) {
 		driver->CheckAvoidance();
-	for (Driver* driver : m_drivers)
+	});
+	ForEachDriver([dt](Driver* driver) {
 		driver->Update(dt);
+	});
+	for (Driver* driver : m_drivers)
+		driver->CommitUpdate();
+
+	// Reroute drivers out of congestion in batches, off the driver update
+	m_trafficAssignment.Update(dt, m_drivers, m_threadPool);
+	ForEachDriver([](Driver* driver) {
+		driver->UpdateFutureStates();
+	});
+
 	m_trafficPercent = 0.0f;
 	for (Driver* driver : m_drivers)
 		m_trafficPercent += driver->GetSlowDownPercent();
 	if (m_drivers.size() > 0)
 		m_trafficPercent /= m_drivers.size();
 
-	for (Driver* a: m_drivers)
+	// Move drivers which changed cells, then resolve overlaps
+	for (Driver* driver : m_drivers)
+		m_grid.Update(driver);
+	PushOverlappingDrivers(dt);
+
+	if (m_eventLog != nullptr)
+	{
+		m_eventLog->Record(SimulationEvent(
+			SimulationEventType::STEP, 0, dt, ComputeChecksum()));
+	}
+}
+
+void DrivingSystem::RecordEvent(const SimulationEvent& event)
+{
+	if (m_eventLog != nullptr)
+		m_eventLog->Record(event);
+}
+
+void DrivingSystem::ForEachDriver(const std::function<void(Driver*)>& function)
+{
+	if (m_threadPool == nullptr)
 	{
-		for (Driver* b: m_drivers)
+		for (Driver* driver : m_drivers)
+			function(driver);
+		return;
+	}
+	m_threadPool->ParallelFor((int) m_drivers.size(), DRIVER_UPDATE_GRAIN_SIZE,
+		[this, &function](int begin, int end) {
+			for (int i = begin; i < end; i++)
+				function(m_drivers[i]);
+		});
+}
+
+void DrivingSystem::PushOverlappingDrivers(float dt)
+{
+	// Each driver only pushes itself: the trailing driver of an overlapping
+	// pair moves back and the leading driver moves forward. This keeps the
+	// net effect of the old serial loop over ordered pairs, which saw each
+	// pair from both sides: each side moves twice the push amount, level
+	// pairs don't move, and pushes from several neighbors add up. Unlike
+	// that loop, positions are read from the snapshot rather than after
+	// the pushes earlier in the loop, so the order no longer matters.
+	m_store.TakeSnapshot();
+	ForEachDriver([this, dt](Driver* a) {
+		Array<Driver*>& neighbors =
+			m_neighborBuffers[ThreadPool::GetWorkerIndex()];
+		neighbors.clear();
+		Vector2f aPosition = a->GetSnapshotPosition().xy;
+		Vector2f aDirection = a->GetSnapshotDirection();
+		m_grid.Query(aPosition, DRIVER_PUSH_DISTANCE, neighbors);
+		Meters push = 0.0f;
+		for (Driver* b : neighbors)
 		{
-			Driver* fast;
-			Driver* slow;
-			float bd = b->GetPosition().xy.Dot(a->GetDirection()) - a->GetPosition().xy.Dot(a->GetDirection());
-			float ad = a->GetPosition().xy.Dot(b->GetDirection()) - b->GetPosition().xy.Dot(b->GetDirection());
+			if (b == a)
+				continue;
+			Vector2f bPosition = b->GetSnapshotPosition().xy;
+			Vector2f bDirection = b->GetSnapshotDirection();
+			Meters dist = Vector2f::Dist(aPosition, bPosition);
+			if (dist >= DRIVER_PUSH_DISTANCE)
+				continue;
+			float bd = bPosition.Dot(aDirection) - aPosition.Dot(aDirection);
+			float ad = aPosition.Dot(bDirection) - bPosition.Dot(bDirection);
 			if (bd > ad)
-			{
-				fast = a;
-				slow = b;
-			}
-			else
-			{
-				fast = b;
-				slow = a;
-			}
-			Meters dist = Vector2f::Dist(a->GetPosition().xy, b->GetPosition().xy);
-			if (dist < 1.0f)
-			{
-				fast->Push(-1.0f * dt);
-				slow->Push(1.0f * dt);
-			}
-			continue;
-
-			if (dist < 3.0)
-			{
-				Vector2f v = slow->GetPosition().xy - fast->GetPosition().xy;
-				v.Normalize();
-				Vector2f dx = slow->GetPosition().xy - fast->GetPosition().xy;
-				Vector2f dv = fast->GetVelocity() - slow->GetVelocity();
-				float dot = Vector2f::Dot(dx, dv);
-				if (dot > 0.0f)
-				{
-					float slowDown = dv.Dot(v) / Vector2f::Normalize(fast->GetVelocity()).Dot(v);
-					if (dist > 3.0)
-						slowDown = fast->GetVehicleParams().deceleration * dt;
-					else
-						slowDown += 1.0f;
-					fast->SetSpeed(Math::Max(0.0f, fast->GetSpeed() - slowDown));
-					if (dist < 1.5f)
-					{
-						fast->Push(-1.0f * dt);
-						slow->Push(1.0f * dt);
-					}
-				}
-			}
+				push -= 2.0f * dt;
+			else if (ad > bd)
+				push += 2.0f * dt;
 		}
-	}
+		if (push != 0.0f)
+			a->Push(push);
+	});
 }
@@ -1,6 +1,16 @@
 #pragma once
 
 #include "Driver.h"
+#include "DriverGrid.h"
+#include "ThreadPool.h"
+#include "SimulationRandom.h"
+#include "SimulationLog.h"
+#include "Router.h"
+#include "TrafficAssignment.h"
+
+constexpr Meters DRIVER_PUSH_DISTANCE = 1.0f;
+constexpr auto DRIVER_UPDATE_GRAIN_SIZE = 64;
+constexpr auto DRIVER_DESTINATION_ATTEMPTS = 4;
 
 
 class DrivingSystem
@@ -15,16 +25,78 @@ public:
 		return m_drivers;
 	}
 
+	inline DriverStore& GetStore()
+	{
+		return m_store;
+	}
+
+	inline const DriverGrid& GetGrid() const
+	{
+		return m_grid;
+	}
+
+	inline const SimulationRandom& GetRandom() const
+	{
+		return m_random;
+	}
+
+	inline Router& GetRouter()
+	{
+		return m_router;
+	}
+
+	inline TrafficAssignment& GetTrafficAssignment()
+	{
+		return m_trafficAssignment;
+	}
+
+	inline CarFollowingModel GetCarFollowingModel() const
+	{
+		return m_carFollowingModel;
+	}
+
 	float GetTrafficPercent();
+	int GetFinishedCount() const;
+	int GetThreadCount() const;
+	Driver* GetDriverById(int id);
+	uint64 ComputeChecksum() const;
+
+	void SetThreadCount(int threadCount);
+	void SetRandom(const SimulationRandom& random);
+	void SetEventLog(SimulationLog* eventLog);
+	void SetCarFollowingModel(CarFollowingModel model);
 
 	void Clear();
 	void SpawnDriver();
+	Driver* InsertDriver(Node* node, Node* destination);
 	void DeleteDriver(Driver* driver);
+	void RemoveDriver(Driver* driver);
+	void SyncWithNetwork();
 	void Update(float dt);
 
 private:
+	Driver* CreateDriver();
+	Node* ChooseDestination(Node* origin);
+	void RecordEvent(const SimulationEvent& event);
+	void ForEachDriver(const std::function<void(Driver*)>& function);
+	void PushOverlappingDrivers(float dt);
+
 	RoadNetwork* m_network;
 	Array<Driver*> m_drivers;
+	DriverStore m_store;
+	DriverGrid m_grid;
+	ThreadPool* m_threadPool;
+	Array<Array<Driver*>> m_neighborBuffers; // Grid query scratch per worker
+	SimulationRandom m_random;
+	RandomStream m_spawnRandom;
+	SimulationLog* m_eventLog;
+	Router m_router;
+	TrafficAssignment m_trafficAssignment;
+	CarFollowingModel m_carFollowingModel;
+	Array<int> m_destinationLanes;
+	uint32 m_destinationLanesVersion;
+	uint32 m_syncedGraphVersion; // Lane graph the drivers were last checked against
 	float m_trafficPercent;
+	int m_finishedCount; // Drivers which reached the end of the road last update
 	int m_driverIdCounter;
 };
@@ -0,0 +1,221 @@
+#include "LaneGraph.h"
+#include "RoadNetwork.h"
+#include <algorithm>
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+LaneGraph::LaneGraph()
+	: m_version(0)
+{
+	Clear();
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+uint32 LaneGraph::GetVersion() const
+{
+	return m_version;
+}
+
+int LaneGraph::GetLaneCount() const
+{
+	return (int) m_lanes.size();
+}
+
+int LaneGraph::GetBranchCount() const
+{
+	return (int) m_branchEdgeOffsets.size() - 1;
+}
+
+int LaneGraph::GetEdgeCount() const
+{
+	return (int) m_edges.size();
+}
+
+Node* LaneGraph::GetLane(int lane) const
+{
+	return m_lanes[lane].Get();
+}
+
+int LaneGraph::GetLaneId(const Node* node) const
+{
+	// Nodes created since the graph was built are not part of it
+	int lane = node->m_laneId;
+	if (lane < 0 || lane >= (int) m_lanes.size() ||
+		m_lanes[lane].Get() != node)
+		return -1;
+	return lane;
+}
+
+int LaneGraph::GetBranchBegin(int lane) const
+{
+	return m_laneBranchOffsets[lane];
+}
+
+int LaneGraph::GetBranchEnd(int lane) const
+{
+	return m_laneBranchOffsets[lane + 1];
+}
+
+int LaneGraph::GetBranchEdgeBegin(int branch) const
+{
+	return m_branchEdgeOffsets[branch];
+}
+
+int LaneGraph::GetBranchEdgeEnd(int branch) const
+{
+	return m_branchEdgeOffsets[branch + 1];
+}
+
+int LaneGraph::GetEdgeBegin(int lane) const
+{
+	return m_branchEdgeOffsets[m_laneBranchOffsets[lane]];
+}
+
+int LaneGraph::GetEdgeEnd(int lane) const
+{
+	return m_branchEdgeOffsets[m_laneBranchOffsets[lane + 1]];
+}
+
+const LaneGraphEdge& LaneGraph::GetEdge(int edge) const
+{
+	return m_edges[edge];
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+void LaneGraph::Clear()
+{
+	m_lanes.clear();
+	m_edges.clear();
+	m_laneBranchOffsets.assign(1, 0);
+	m_branchEdgeOffsets.assign(1, 0);
+	m_version++;
+}
+
+void LaneGraph::Build(RoadNetwork& network)
+{
+	m_lanes.clear();
+	m_edges.clear();
+	m_laneBranchOffsets.clear();
+	m_branchEdgeOffsets.clear();
+
+	// Number the lanes in node group ID order so lane IDs do not depend
+	// on where the node groups were allocated
+	Array<NodeGroup*> nodeGroups(network.GetNodeGroups().begin(),
+		network.GetNodeGroups().end());
+	std::sort(nodeGroups.begin(), nodeGroups.end(),
+		[](NodeGroup* a, NodeGroup* b) -> bool {
+		return (a->GetId() < b->GetId());
+	});
+	for (NodeGroup* group : nodeGroups)
+	{
+		for (int i = 0; i < group->GetNumNodes(); i++)
+		{
+			Node* node = group->GetNode(i);
+			node->m_laneId = (int) m_lanes.size();
+			m_lanes.push_back(node);
+		}
+	}
+
+	// Add the outgoing edges of each lane
+	m_laneBranchOffsets.reserve(m_lanes.size() + 1);
+	for (const NodeRef& lane : m_lanes)
+	{
+		m_laneBranchOffsets.push_back((int) m_branchEdgeOffsets.size());
+		AddBranches(lane.Get());
+	}
+	m_laneBranchOffsets.push_back((int) m_branchEdgeOffsets.size());
+	m_branchEdgeOffsets.push_back((int) m_edges.size());
+	m_version++;
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+void LaneGraph::AddBranches(Node* node)
+{
+	NodeGroup* nodeGroup = node->GetNodeGroup();
+	if (nodeGroup->GetIntersection() != nullptr &&
+		nodeGroup->GetOutputs().size() == 0)
+		AddIntersectionBranches(node, nodeGroup->GetIntersection());
+	else
+		AddConnectionBranches(node);
+}
+
+void LaneGraph::AddIntersectionBranches(Node* node, RoadIntersection* intersection)
+{
+	// Any lane of any node group leaving the intersection
+	for (RoadIntersectionPoint* point : intersection->GetPoints())
+	{
+		if (point->GetIOType() != IOType::OUTPUT)
+			continue;
+		m_branchEdgeOffsets.push_back((int) m_edges.size());
+		NodeGroup* nextGroup = point->GetNodeGroup();
+		for (int i = 0; i < nextGroup->GetNumNodes(); i++)
+		{
+			Node* nextNode = nextGroup->GetNode(i);
+			LaneGraphEdge edge;
+			edge.fromLane = node->m_laneId;
+			edge.toLane = nextNode->m_laneId;
+			edge.length = intersection->GetDrivingLine(node, nextNode).Length();
+			edge.connection = nullptr;
+			edge.intersection = intersection;
+			edge.fromLaneIndex = node->GetIndex();
+			edge.toLaneIndex = nextNode->GetIndex();
+			edge.laneShift = 0;
+			m_edges.push_back(edge);
+		}
+	}
+}
+
+void LaneGraph::AddConnectionBranches(Node* node)
+{
+	for (NodeGroupConnection* connection : node->GetNodeGroup()->GetOutputs())
+	{
+		const NodeSubGroup& input = connection->GetInput();
+		if (connection->IsGhost() ||
+			node->GetIndex() < input.index ||
+			node->GetIndex() >= input.index + input.count)
+			continue;
+
+		// The lanes this lane splits or merges into, plus one lane change
+		// to either side
+		m_branchEdgeOffsets.push_back((int) m_edges.size());
+		int fromLaneIndex = node->GetIndex() - input.index;
+		int toLaneFirst, toLaneCount;
+		NodeSubGroup output = connection->GetOutput();
+		connection->GetLaneOutputRange(fromLaneIndex, toLaneFirst, toLaneCount);
+		int toLaneNextFirst = Math::Max(0, toLaneFirst - 1);
+		int toLaneNextLast = Math::Min(output.count - 1, toLaneFirst + toLaneCount);
+		for (int toLaneIndex = toLaneNextFirst; toLaneIndex <= toLaneNextLast; toLaneIndex++)
+		{
+			LaneGraphEdge edge;
+			edge.fromLane = node->m_laneId;
+			edge.toLane = output.GetNode(toLaneIndex)->m_laneId;
+			edge.length = connection->GetDrivingLine(
+				fromLaneIndex, toLaneIndex).Length();
+			edge.connection = connection;
+			edge.intersection = nullptr;
+			edge.fromLaneIndex = fromLaneIndex;
+			edge.toLaneIndex = toLaneIndex;
+			edge.laneShift = 0;
+			if (toLaneIndex < toLaneFirst)
+				edge.laneShift = -1;
+			else if (toLaneIndex >= toLaneFirst + toLaneCount)
+				edge.laneShift = 1;
+			m_edges.push_back(edge);
+		}
+	}
+}
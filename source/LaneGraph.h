@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include <cmgMath/cmg_math.h>
+#include "CommonTypes.h"
+#include "Node.h"
+
+class NodeGroup;
+class NodeGroupConnection;
+class RoadIntersection;
+class RoadNetwork;
+
+
+//-----------------------------------------------------------------------------
+// Struct:  LaneGraphEdge
+// Purpose: A movement from one lane to another, either along a node group
+//          connection or through an intersection.
+//-----------------------------------------------------------------------------
+struct LaneGraphEdge
+{
+	int fromLane;
+	int toLane;
+	Meters length; // Length of the driving line
+	NodeGroupConnection* connection; // Null for intersection movements
+	RoadIntersection* intersection; // Null for connection movements
+	int fromLaneIndex; // Relative to the connection's input sub-group
+	int toLaneIndex; // Relative to the connection's output sub-group
+	int laneShift;
+};
+
+
+//-----------------------------------------------------------------------------
+// Class:   LaneGraph
+// Purpose: Compiled, read-only graph of lanes (nodes) and the movements
+//          between them, stored as flat CSR arrays.
+//
+//          A lane's outgoing edges are split into branches: one per
+//          connection leaving the lane, or one per output node group of the
+//          intersection it enters. The edges of a lane are contiguous, so
+//          they can be walked either per branch or all at once.
+//-----------------------------------------------------------------------------
+class LaneGraph
+{
+public:
+	// Constructors
+
+	LaneGraph();
+
+	// Getters
+
+	uint32 GetVersion() const;
+	int GetLaneCount() const;
+	int GetBranchCount() const;
+	int GetEdgeCount() const;
+	Node* GetLane(int lane) const;
+	int GetLaneId(const Node* node) const;
+	int GetBranchBegin(int lane) const;
+	int GetBranchEnd(int lane) const;
+	int GetBranchEdgeBegin(int branch) const;
+	int GetBranchEdgeEnd(int branch) const;
+	int GetEdgeBegin(int lane) const;
+	int GetEdgeEnd(int lane) const;
+	const LaneGraphEdge& GetEdge(int edge) const;
+
+	// Setters
+
+	void Clear();
+	void Build(RoadNetwork& network);
+
+private:
+	void AddBranches(Node* node);
+	void AddIntersectionBranches(Node* node, RoadIntersection* intersection);
+	void AddConnectionBranches(Node* node);
+
+	Array<NodeRef> m_lanes;
+	Array<int> m_laneBranchOffsets; // Indexed by lane, plus one
+	Array<int> m_branchEdgeOffsets; // Indexed by branch, plus one
+	Array<LaneGraphEdge> m_edges;
+	uint32 m_version; // Incremented each time the graph changes
+};
@@ -14,6 +14,7 @@ using namespace cmg;
 
 MainApp::MainApp()
 	: m_profiling("root")
+	, m_seed(0)
 {
 	m_debugOptions.push_back(m_showRoadMarkings = new DebugOption("Markings", true));
 	m_debugOptions.push_back(m_showEdgeLines = new DebugOption("Edges", true));
@@ -81,6 +82,7 @@ void MainApp::OnInitialize()
 	m_debugDraw = new DebugDraw();
 	m_network = new RoadNetwork(m_ecs);
 	m_drivingSystem = new DrivingSystem(m_network);
+	m_drivingSystem->SetRandom(SimulationRandom(m_seed));
 	m_backgroundTexture = nullptr;
 
 	// Load assets
@@ -162,6 +164,12 @@ void MainApp::Reset()
 {
 }
 
+void MainApp::SetSeed(uint64 seed)
+{
+	// Takes effect when the driving system is created on initialization
+	m_seed = seed;
+}
+
 void MainApp::CreateTestNetwork()
 {
 
@@ -520,6 +528,7 @@ void MainApp::OnUpdate(float dt)
 	// Ctrl+S: Load
 	if (ctrl && keyboard->IsKeyPressed(Keys::l))
 	{
+		m_drivingSystem->Clear();
 		m_network->Load(SAVE_FILE_PATH);
 		std::cout << "Loaded " << SAVE_FILE_PATH << std::endl;
 	}
@@ -550,6 +559,7 @@ void MainApp::OnUpdate(float dt)
 	if (!ctrl && keyboard->IsKeyPressed(Keys::t))
 	{
 		m_toolDraw->CancelDragging();
+		m_drivingSystem->Clear();
 		m_network->ClearNodes();
 		CreateTestNetwork();
 	}
@@ -616,6 +626,10 @@ void MainApp::OnUpdate(float dt)
 	m_network->UpdateNodeGeometry();
 	m_profileGeometry->StopInvocation();
 
+	// Drivers are still drawn while paused, so drop the ones whose lanes
+	// were removed by this frame's edits right away
+	m_drivingSystem->SyncWithNetwork();
+
 	if (!m_paused)
 	{
 		m_profileNetworkSimulation->StartInvocation();
@@ -1051,6 +1065,7 @@ void MainApp::OnRender()
 
 		if (m_showCollisions->enabled)
 		{
+			driver->PredictFutureStates();
 			for (int i = 0; i < DRIVER_MAX_FUTURE_STATES; i++)
 			{
 				auto state = driver->GetState(i);
@@ -1135,10 +1150,10 @@ void MainApp::OnRender()
 	{
 		for (Driver* driver : m_drivingSystem->GetDrivers())
 		{
-			const Array<DriverPathNode>& path = driver->GetPath();
-			if (path.size() > 0)
+			const DriverPath& path = driver->GetPath();
+			if (!path.IsEmpty())
 			{
-				for (unsigned int i = 0; i < 1; i++)
+				for (int i = 0; i < 1; i++)
 					DrawCurveLine(g, path[i].GetDrivingLine(), Color::MAGENTA);
 			}
 		}
@@ -1243,6 +1258,7 @@ void MainApp::OnRender()
 	ss << "Ties:          " << tieCount << endl;
 	ss << "Intersections: " << intersectionCount << endl;
 	ss << "Drivers:       " << m_drivingSystem->GetDrivers().size() << endl;
+	ss << "Seed:          " << m_drivingSystem->GetRandom().GetSeed() << endl;
 	ss << "---------------------------" << endl;
 
 	for (unsigned int i = 0; i < m_debugOptions.size(); i++)
@@ -39,6 +39,8 @@ public:
 
 	void Reset();
 
+	void SetSeed(uint64 seed);
+
 	void CreateTestNetwork();
 
 	void SetTool(EditorTool* tool);
@@ -90,6 +92,7 @@ private:
 	};
 
 	bool m_paused;
+	uint64 m_seed;
 
 	Array<DebugOption*> m_debugOptions;
 	DebugOption* m_showDebug;
@@ -0,0 +1,517 @@
+#include "MesoscopicSystem.h"
+#include "DrivingSystem.h"
+#include "RoadNetwork.h"
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+MesoscopicSystem::MesoscopicSystem(RoadNetwork* network, DrivingSystem* drivingSystem)
+	: m_network(network)
+	, m_drivingSystem(drivingSystem)
+	, m_laneGraph(&network->GetLaneGraph())
+	, m_graphVersion(0)
+	, m_isBuilt(false)
+	, m_time(0.0f)
+	, m_vehicleCount(0)
+	, m_hasFocusArea(false)
+	, m_focusCenter(Vector2f::ZERO)
+	, m_focusRadius(0.0f)
+	, m_finishedCount(0)
+	, m_handoffCount(0)
+	, m_handbackCount(0)
+{
+	m_spawnRandom = m_random.CreateStream(MESO_RANDOM_STREAM);
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+int MesoscopicSystem::GetVehicleCount() const
+{
+	return m_vehicleCount;
+}
+
+int MesoscopicSystem::GetQueuedCount(int edge) const
+{
+	if (edge < 0 || edge >= (int) m_queues.size())
+		return 0;
+	return m_queues[edge].count;
+}
+
+int MesoscopicSystem::GetFinishedCount() const
+{
+	return m_finishedCount;
+}
+
+int MesoscopicSystem::GetHandoffCount() const
+{
+	return m_handoffCount;
+}
+
+int MesoscopicSystem::GetHandbackCount() const
+{
+	return m_handbackCount;
+}
+
+bool MesoscopicSystem::HasFocusArea() const
+{
+	return m_hasFocusArea;
+}
+
+bool MesoscopicSystem::IsInFocusArea(int lane) const
+{
+	if (lane < 0 || lane >= (int) m_laneInFocus.size())
+		return false;
+	return m_laneInFocus[lane];
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+void MesoscopicSystem::Clear()
+{
+	m_vehicles.clear();
+	m_freeVehicles.clear();
+	for (std::deque<int>& waiting : m_waitingVehicles)
+		waiting.clear();
+	m_vehicleCount = 0;
+	m_handedOffDrivers.clear();
+	for (Queue& queue : m_queues)
+	{
+		queue.head = 0;
+		queue.count = 0;
+	}
+	m_spawnRandom = m_random.CreateStream(MESO_RANDOM_STREAM);
+	m_time = 0.0f;
+}
+
+void MesoscopicSystem::SetRandom(const SimulationRandom& random)
+{
+	m_random = random;
+	m_spawnRandom = m_random.CreateStream(MESO_RANDOM_STREAM);
+}
+
+void MesoscopicSystem::SetFocusArea(const Vector2f& center, Meters radius)
+{
+	m_hasFocusArea = true;
+	m_focusCenter = center;
+	m_focusRadius = radius;
+	UpdateFocusArea();
+}
+
+void MesoscopicSystem::ClearFocusArea()
+{
+	m_hasFocusArea = false;
+	UpdateFocusArea();
+}
+
+void MesoscopicSystem::SpawnVehicle()
+{
+	if (!m_isBuilt || m_graphVersion != m_laneGraph->GetVersion())
+		Reset();
+	if (m_originLanes.empty())
+		return;
+	int lane = m_spawnRandom.Choose(m_originLanes);
+	int destinationLane = ChooseDestination(lane);
+	if (destinationLane < 0)
+		return;
+	int vehicle = CreateVehicle(lane, destinationLane);
+	if (vehicle >= 0)
+		m_waitingVehicles[lane].push_back(vehicle);
+}
+
+void MesoscopicSystem::Update(Seconds dt)
+{
+	m_finishedCount = 0;
+	m_handoffCount = 0;
+	m_handbackCount = 0;
+	if (m_vehicleCount == 0 && !m_hasFocusArea)
+		return;
+	if (!m_isBuilt || m_graphVersion != m_laneGraph->GetVersion())
+		Reset();
+	m_time += dt;
+
+	// Each lane can serve one vehicle per saturation headway, banking at
+	// most one step's worth
+	float service = dt / MESO_SATURATION_HEADWAY;
+	float maxService = Math::Max(1.0f, service);
+	for (float& laneService : m_laneService)
+		laneService = Math::Min(laneService + service, maxService);
+
+	// Move waiting vehicles onto their first edge, in the order they
+	// arrived at each origin lane
+	for (int lane : m_originLanes)
+	{
+		std::deque<int>& waiting = m_waitingVehicles[lane];
+		while (!waiting.empty())
+		{
+			int vehicle = waiting.front();
+			int edge = GetNextEdge(m_vehicles[vehicle]);
+			if (m_laneInFocus[lane])
+			{
+				if (!HandOff(vehicle, lane))
+					break;
+			}
+			else if (edge < 0)
+			{
+				DestroyVehicle(vehicle);
+			}
+			else
+			{
+				if (!Push(edge, vehicle, m_time + m_queues[edge].freeFlowTime))
+					break;
+				m_vehicles[vehicle].edge = edge;
+				m_vehicles[vehicle].routeIndex++;
+			}
+			waiting.pop_front();
+		}
+	}
+
+	// Move vehicles from the front of each queue into the next one. A
+	// vehicle moved into a later edge can't move again this update, as it
+	// has yet to cross it.
+	for (int edge = 0; edge < (int) m_queues.size(); edge++)
+	{
+		const Queue& queue = m_queues[edge];
+		int lane = m_laneGraph->GetEdge(edge).toLane;
+		while (queue.count > 0 && CanLeaveLane(lane))
+		{
+			int vehicle = m_queueSlots[queue.offset + queue.head];
+			if (m_vehicles[vehicle].exitTime > m_time)
+				break;
+			int nextEdge = GetNextEdge(m_vehicles[vehicle]);
+			if (nextEdge < 0)
+			{
+				Pop(edge);
+				DestroyVehicle(vehicle);
+				m_finishedCount++;
+			}
+			else if (m_laneInFocus[lane])
+			{
+				if (!HandOff(vehicle, lane))
+					break;
+				Pop(edge);
+			}
+			else
+			{
+				if (!Push(nextEdge, vehicle, m_time + m_queues[nextEdge].freeFlowTime))
+					break;
+				Pop(edge);
+				m_vehicles[vehicle].edge = nextEdge;
+				m_vehicles[vehicle].routeIndex++;
+			}
+			m_laneService[lane] -= 1.0f;
+		}
+	}
+
+	// Keep the number of vehicles steady, as the driving system does
+	for (int i = 0; i < m_finishedCount; i++)
+		SpawnVehicle();
+
+	if (m_hasFocusArea)
+		HandBack();
+	UpdateDetectors();
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+void MesoscopicSystem::Reset()
+{
+	// Vehicles refer to lane graph edges, so when the graph is rebuilt they
+	// are spawned again from scratch
+	int vehicleCount = m_vehicleCount;
+	m_graphVersion = m_laneGraph->GetVersion();
+	m_isBuilt = true;
+	m_vehicles.clear();
+	m_freeVehicles.clear();
+	m_vehicleCount = 0;
+	m_routeIndices.clear();
+	m_routes.clear();
+	m_routeEdges.clear();
+
+	int edgeCount = m_laneGraph->GetEdgeCount();
+	m_queues.resize(edgeCount);
+	int offset = 0;
+	for (int edge = 0; edge < edgeCount; edge++)
+	{
+		Meters length = m_laneGraph->GetEdge(edge).length;
+		Queue& queue = m_queues[edge];
+		queue.offset = offset;
+		queue.capacity = Math::Max(1, (int) (length / MESO_JAM_SPACING));
+		queue.head = 0;
+		queue.count = 0;
+		queue.freeFlowTime = length / TRAFFIC_FREE_FLOW_SPEED;
+		offset += queue.capacity;
+	}
+	m_queueSlots.assign(offset, -1);
+
+	// Vehicles start where the network begins and end where it ends, in
+	// lane ID order
+	int laneCount = m_laneGraph->GetLaneCount();
+	Array<bool> hasInputs(laneCount, false);
+	for (int edge = 0; edge < edgeCount; edge++)
+		hasInputs[m_laneGraph->GetEdge(edge).toLane] = true;
+	m_waitingVehicles.assign(laneCount, std::deque<int>());
+	m_laneService.assign(laneCount, 1.0f);
+	m_lanePrograms.assign(laneCount, nullptr);
+	m_originLanes.clear();
+	m_destinationLanes.clear();
+	for (int lane = 0; lane < laneCount; lane++)
+	{
+		RoadIntersection* intersection =
+			m_laneGraph->GetLane(lane)->GetNodeGroup()->GetIntersection();
+		if (intersection != nullptr)
+			m_lanePrograms[lane] = intersection->GetTrafficLightProgram();
+		bool hasOutputs = (m_laneGraph->GetEdgeBegin(lane) != m_laneGraph->GetEdgeEnd(lane));
+		if (!hasOutputs)
+			m_destinationLanes.push_back(lane);
+		else if (!hasInputs[lane])
+			m_originLanes.push_back(lane);
+	}
+	UpdateFocusArea();
+
+	for (int i = 0; i < vehicleCount; i++)
+		SpawnVehicle();
+}
+
+void MesoscopicSystem::UpdateFocusArea()
+{
+	int laneCount = (m_isBuilt ? m_laneGraph->GetLaneCount() : 0);
+	m_laneInFocus.assign(laneCount, false);
+	if (!m_hasFocusArea)
+		return;
+	for (int lane = 0; lane < laneCount; lane++)
+	{
+		Vector2f position = m_laneGraph->GetLane(lane)->GetCenter().xy;
+		m_laneInFocus[lane] = (position.DistToSqr(m_focusCenter) <=
+			m_focusRadius * m_focusRadius);
+	}
+}
+
+int MesoscopicSystem::CreateVehicle(int lane, int destinationLane)
+{
+	int route = FindRoute(lane, destinationLane);
+	if (route < 0)
+		return -1;
+	int vehicle;
+	if (!m_freeVehicles.empty())
+	{
+		vehicle = m_freeVehicles.back();
+		m_freeVehicles.pop_back();
+	}
+	else
+	{
+		vehicle = (int) m_vehicles.size();
+		m_vehicles.push_back(Vehicle());
+	}
+	Vehicle& v = m_vehicles[vehicle];
+	v.edge = -1;
+	v.route = route;
+	v.routeIndex = 0;
+	v.exitTime = m_time;
+	m_vehicleCount++;
+	return vehicle;
+}
+
+void MesoscopicSystem::DestroyVehicle(int vehicle)
+{
+	m_vehicles[vehicle].edge = -1;
+	m_vehicles[vehicle].route = -1;
+	m_freeVehicles.push_back(vehicle);
+	m_vehicleCount--;
+}
+
+int MesoscopicSystem::FindRoute(int originLane, int destinationLane)
+{
+	// Routes are kept for as long as the graph, and shared by every vehicle
+	// with the same origin and destination
+	uint64 key = ((uint64) (uint32) originLane << 32) | (uint32) destinationLane;
+	auto it = m_routeIndices.find(key);
+	if (it != m_routeIndices.end())
+		return it->second;
+	int index = -1;
+	const Route* route = m_drivingSystem->GetRouter().FindRoute(originLane, destinationLane);
+	if (route != nullptr)
+	{
+		VehicleRoute vehicleRoute;
+		vehicleRoute.begin = (int) m_routeEdges.size();
+		m_routeEdges.insert(m_routeEdges.end(), route->edges.begin(), route->edges.end());
+		vehicleRoute.end = (int) m_routeEdges.size();
+		vehicleRoute.destinationLane = destinationLane;
+		index = (int) m_routes.size();
+		m_routes.push_back(vehicleRoute);
+	}
+	m_routeIndices[key] = index;
+	return index;
+}
+
+int MesoscopicSystem::ChooseDestination(int originLane)
+{
+	if (m_destinationLanes.empty())
+		return -1;
+	for (int i = 0; i < MESO_DESTINATION_ATTEMPTS; i++)
+	{
+		int lane = m_spawnRandom.Choose(m_destinationLanes);
+		if (FindRoute(originLane, lane) >= 0)
+			return lane;
+	}
+	return -1;
+}
+
+int MesoscopicSystem::GetNextEdge(const Vehicle& vehicle) const
+{
+	const VehicleRoute& route = m_routes[vehicle.route];
+	int index = route.begin + vehicle.routeIndex;
+	return (index < route.end ? m_routeEdges[index] : -1);
+}
+
+bool MesoscopicSystem::CanLeaveLane(int lane) const
+{
+	if (m_laneService[lane] < 1.0f)
+		return false;
+	const TrafficLightProgram* program = m_lanePrograms[lane];
+	if (program == nullptr)
+		return true;
+	TrafficLightSignal signal = program->GetSignal(m_laneGraph->GetLane(lane));
+	return (signal != TrafficLightSignal::STOP &&
+		signal != TrafficLightSignal::YELLOW);
+}
+
+bool MesoscopicSystem::Push(int edge, int vehicle, Seconds exitTime)
+{
+	Queue& queue = m_queues[edge];
+	if (queue.count >= queue.capacity)
+		return false;
+	int slot = queue.head + queue.count;
+	if (slot >= queue.capacity)
+		slot -= queue.capacity;
+	m_queueSlots[queue.offset + slot] = vehicle;
+	queue.count++;
+
+	// Vehicles can't pass each other within a queue
+	if (queue.count > 1)
+	{
+		int ahead = m_queueSlots[queue.offset + (slot == 0 ? queue.capacity : slot) - 1];
+		exitTime = Math::Max(exitTime, m_vehicles[ahead].exitTime);
+	}
+	m_vehicles[vehicle].exitTime = exitTime;
+	return true;
+}
+
+void MesoscopicSystem::Pop(int edge)
+{
+	Queue& queue = m_queues[edge];
+	queue.head++;
+	if (queue.head >= queue.capacity)
+		queue.head = 0;
+	queue.count--;
+}
+
+bool MesoscopicSystem::HandOff(int vehicle, int lane)
+{
+	// Give the vehicle to the driving system as a driver at the start of
+	// the lane, once there is room for it there
+	Node* node = m_laneGraph->GetLane(lane);
+	Array<Driver*> neighbors;
+	m_drivingSystem->GetGrid().Query(node->GetCenter().xy,
+		MESO_HANDOFF_CLEARANCE, neighbors);
+	if (!neighbors.empty())
+		return false;
+	int destinationLane = m_routes[m_vehicles[vehicle].route].destinationLane;
+	Driver* driver = m_drivingSystem->InsertDriver(
+		node, m_laneGraph->GetLane(destinationLane));
+	m_handedOffDrivers.insert(driver->GetId());
+	DestroyVehicle(vehicle);
+	m_handoffCount++;
+	return true;
+}
+
+void MesoscopicSystem::HandBack()
+{
+	// Handed off drivers which have left the focus area go back into the
+	// queue of the edge they are driving along, as far through it as they
+	// have driven. Drivers spawned by the driving system itself stay there.
+	Array<Driver*> drivers;
+	Set<int> handedOffDrivers;
+	for (Driver* driver : m_drivingSystem->GetDrivers())
+	{
+		if (m_handedOffDrivers.count(driver->GetId()) == 0)
+			continue;
+		handedOffDrivers.insert(driver->GetId());
+		const DriverPath& path = driver->GetPath();
+		if (path.IsEmpty())
+			continue;
+		int lane = m_laneGraph->GetLaneId(path[0].GetStartNode());
+		int toLane = m_laneGraph->GetLaneId(path[0].GetEndNode());
+		if (lane < 0 || toLane < 0 || m_laneInFocus[lane])
+			continue;
+		int edge = path[0].GetLaneGraphEdge();
+		if (edge < 0 || edge >= m_laneGraph->GetEdgeCount() ||
+			m_laneGraph->GetEdge(edge).toLane != toLane)
+		{
+			edge = -1;
+			for (int i = m_laneGraph->GetEdgeBegin(lane); i < m_laneGraph->GetEdgeEnd(lane); i++)
+			{
+				if (m_laneGraph->GetEdge(i).toLane == toLane)
+					edge = i;
+			}
+		}
+		if (edge < 0 || m_queues[edge].count >= m_queues[edge].capacity)
+			continue;
+
+		int destinationLane = -1;
+		if (driver->GetDestination() != nullptr)
+			destinationLane = m_laneGraph->GetLaneId(driver->GetDestination());
+		if (destinationLane < 0 || FindRoute(toLane, destinationLane) < 0)
+			destinationLane = ChooseDestination(toLane);
+		int vehicle = (destinationLane >= 0 ? CreateVehicle(toLane, destinationLane) : -1);
+		if (vehicle < 0)
+			continue;
+		Meters length = Math::Max(path.GetEndDistance(0), 0.001f);
+		float remaining = Math::Max(0.0f, 1.0f - (driver->GetDistance() / length));
+		Push(edge, vehicle, m_time + (m_queues[edge].freeFlowTime * remaining));
+		m_vehicles[vehicle].edge = edge;
+		drivers.push_back(driver);
+	}
+	for (Driver* driver : drivers)
+	{
+		handedOffDrivers.erase(driver->GetId());
+		m_drivingSystem->RemoveDriver(driver);
+	}
+	m_handedOffDrivers.swap(handedOffDrivers);
+	m_handbackCount = (int) drivers.size();
+}
+
+void MesoscopicSystem::UpdateDetectors()
+{
+	// Count the queued vehicles within a detector's length of each
+	// signalled lane, for the traffic lights' next update
+	Seconds detectorTime = TRAFFIC_LIGHT_DETECTOR_LENGTH / TRAFFIC_FREE_FLOW_SPEED;
+	for (int edge = 0; edge < (int) m_queues.size(); edge++)
+	{
+		const Queue& queue = m_queues[edge];
+		int lane = m_laneGraph->GetEdge(edge).toLane;
+		TrafficLightProgram* program = m_lanePrograms[lane];
+		if (program == nullptr || queue.count == 0)
+			continue;
+		Node* node = m_laneGraph->GetLane(lane);
+		for (int i = 0; i < queue.count; i++)
+		{
+			int slot = queue.head + i;
+			if (slot >= queue.capacity)
+				slot -= queue.capacity;
+			if (m_vehicles[m_queueSlots[queue.offset + slot]].exitTime - m_time > detectorTime)
+				break;
+			program->AddDetection(node);
+		}
+	}
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include <cmgMath/cmg_math.h>
+#include "CommonTypes.h"
+#include "LaneGraph.h"
+#include "SimulationRandom.h"
+#include <deque>
+
+class DrivingSystem;
+class RoadNetwork;
+class TrafficLightProgram;
+
+
+constexpr Meters MESO_JAM_SPACING = 7.5f; // Length of lane each queued vehicle takes up
+constexpr Seconds MESO_SATURATION_HEADWAY = 2.0f; // Time between vehicles leaving a lane
+constexpr Meters MESO_HANDOFF_CLEARANCE = 8.0f; // Room needed to place a driver in the focus area
+constexpr auto MESO_DESTINATION_ATTEMPTS = 4;
+constexpr uint64 MESO_RANDOM_STREAM = ~0ull; // Apart from the driver streams, keyed by ID
+
+
+//-----------------------------------------------------------------------------
+// Class:   MesoscopicSystem
+// Purpose: Queue based traffic simulation over the lane graph, for regions
+//          too large to drive every vehicle individually. Each lane graph
+//          edge is a FIFO queue holding as many vehicles as fit along it,
+//          which a vehicle takes the free flow time to cross. A vehicle
+//          leaves the front of its queue once it has crossed, its lane has
+//          served the last vehicle a saturation headway ago, the traffic
+//          light at the lane shows green, and the next queue has room.
+//
+//          Inside the focus area, if there is one, vehicles are handed to
+//          the driving system as drivers, and those drivers are handed back
+//          once they leave it. Handing over is not in the driving system's
+//          event log, as replaying the steps hands the same vehicles over.
+//-----------------------------------------------------------------------------
+class MesoscopicSystem
+{
+public:
+	// Constructors
+
+	MesoscopicSystem(RoadNetwork* network, DrivingSystem* drivingSystem);
+
+	// Getters
+
+	int GetVehicleCount() const;
+	int GetQueuedCount(int edge) const;
+	int GetFinishedCount() const;
+	int GetHandoffCount() const;
+	int GetHandbackCount() const;
+	bool HasFocusArea() const;
+	bool IsInFocusArea(int lane) const;
+
+	// Setters
+
+	void Clear();
+	void SetRandom(const SimulationRandom& random);
+	void SetFocusArea(const Vector2f& center, Meters radius);
+	void ClearFocusArea();
+	void SpawnVehicle();
+	void Update(Seconds dt);
+
+private:
+	struct Vehicle
+	{
+		int edge; // Edge whose queue holds the vehicle, or -1 before it enters
+		int route;
+		int routeIndex; // Next edge to take, as an index into the route
+		Seconds exitTime; // When the vehicle reaches the end of its edge
+	};
+
+	struct Queue
+	{
+		int offset; // Into the queue slots
+		int capacity;
+		int head;
+		int count;
+		Seconds freeFlowTime;
+	};
+
+	struct VehicleRoute
+	{
+		int begin; // Into the route edges
+		int end;
+		int destinationLane;
+	};
+
+	void Reset();
+	void UpdateFocusArea();
+	int CreateVehicle(int lane, int destinationLane);
+	void DestroyVehicle(int vehicle);
+	int FindRoute(int originLane, int destinationLane);
+	int ChooseDestination(int originLane);
+	int GetNextEdge(const Vehicle& vehicle) const;
+	bool CanLeaveLane(int lane) const;
+	bool Push(int edge, int vehicle, Seconds exitTime);
+	void Pop(int edge);
+	bool HandOff(int vehicle, int lane);
+	void HandBack();
+	void UpdateDetectors();
+
+	RoadNetwork* m_network;
+	DrivingSystem* m_drivingSystem;
+	const LaneGraph* m_laneGraph;
+	uint32 m_graphVersion;
+	bool m_isBuilt; // Whether the queues were built for the graph version
+	SimulationRandom m_random;
+	RandomStream m_spawnRandom;
+	Seconds m_time;
+
+	// Vehicle pool, and the vehicles waiting at each origin lane to enter
+	// their first edge
+	Array<Vehicle> m_vehicles;
+	Array<int> m_freeVehicles;
+	Array<std::deque<int>> m_waitingVehicles;
+	int m_vehicleCount;
+
+	// One ring buffer of vehicles per edge, packed into the queue slots
+	Array<Queue> m_queues;
+	Array<int> m_queueSlots;
+
+	// Per lane service capacity, in vehicles, and its traffic light
+	Array<float> m_laneService;
+	Array<TrafficLightProgram*> m_lanePrograms;
+	Array<bool> m_laneInFocus;
+
+	// Routes by origin and destination lane, as edges
+	Map<uint64, int> m_routeIndices;
+	Array<VehicleRoute> m_routes;
+	Array<int> m_routeEdges;
+	Array<int> m_originLanes;
+	Array<int> m_destinationLanes;
+
+	// IDs of the drivers made from handed off vehicles, which are the only
+	// ones handed back
+	Set<int> m_handedOffDrivers;
+
+	bool m_hasFocusArea;
+	Vector2f m_focusCenter;
+	Meters m_focusRadius;
+
+	int m_finishedCount; // Vehicles which reached their destination last update
+	int m_handoffCount; // Vehicles handed to the driving system last update
+	int m_handbackCount; // Drivers handed back last update
+};
@@ -1,5 +1,4 @@
 #include "Node.h"
-#include "Connection.h"
 #include "NodeGroup.h"
 #include "RoadIntersection.h"
 
@@ -9,12 +8,12 @@
 //-----------------------------------------------------------------------------
 
 Node::Node()
-	: m_position(Vector3f::ZERO)
-	, m_direction(Vector2f::UNITX)
+	: m_nodeGroup(nullptr)
 	, m_width(1.0f)
-	, m_leftDivider(LaneDivider::DASHED)
-	, m_nodeGroup(nullptr)
 	, m_index(0)
+	, m_laneId(-1)
+	, m_signalSlot(-1)
+	, m_leftDivider(LaneDivider::DASHED)
 	, m_hasStopSign(false)
 {
 }
@@ -34,11 +33,6 @@ NodeGroup* Node::GetNodeGroup()
 	return m_nodeGroup;
 }
 
-const RoadMetrics* Node::GetMetrics() const
-{
-	return m_metrics;
-}
-
 float Node::GetWidth() const
 {
 	return m_width;
@@ -46,43 +40,45 @@ float Node::GetWidth() const
 
 Vector2f Node::GetDirection() const
 {
-	return m_direction;
+	return m_nodeGroup->GetDirection();
 }
 
 Vector2f Node::GetEndTangent() const
 {
-	return RightPerpendicular(m_direction);
+	return m_nodeGroup->GetRightDirection();
 }
 
 Vector3f Node::GetPosition() const
 {
-	return m_position;
+	return m_nodeGroup->GetNodePosition(m_index);
 }
 
 Vector3f Node::GetLeftEdge() const
 {
-	return m_position;
+	return GetPosition();
 }
 
 Vector3f Node::GetRightEdge() const
 {
-	return Vector3f(m_position.xy + (GetEndTangent() * m_width), m_position.z);
+	Vector3f position = GetPosition();
+	return Vector3f(position.xy + (GetEndTangent() * m_width), position.z);
 }
 
 Vector2f Node::GetLeftEdgeTangent() const
 {
-	return m_direction;
+	return GetDirection();
 }
 
 Vector2f Node::GetRightEdgeTangent() const
 {
-	return m_direction;
+	return GetDirection();
 }
 
 Vector3f Node::GetCenter() const
 {
-	return Vector3f(m_position.xy + (GetEndTangent() * m_width * 0.5f),
-		m_position.z);
+	Vector3f position = GetPosition();
+	return Vector3f(position.xy + (GetEndTangent() * m_width * 0.5f),
+		position.z);
 }
 
 Node* Node::GetLeftNode() const
@@ -101,132 +97,113 @@ Node* Node::GetRightNode() const
 		return m_nodeGroup->GetNode(m_index + 1);
 }
 
-int Node::GetNumInputs() const
-{
-	return m_inputs.size();
-}
-
-int Node::GetNumOutputs() const
-{
-	return m_outputs.size();
-}
-
-int Node::GetNumConnections(InputOutput type) const
-{
-	if (type == InputOutput::INPUT)
-		return m_inputs.size();
-	else if (type == InputOutput::OUTPUT)
-		return m_outputs.size();
-	else
-		return (m_inputs.size() + m_outputs.size());
-}
-
-std::set<Connection*>& Node::GetConnections(InputOutput type)
+bool Node::IsLeftMostLane() const
 {
-	if (type == InputOutput::INPUT)
-		return m_inputs;
-	else
-		return m_outputs;
+	return (m_index == 0);
 }
 
-std::set<Connection*>& Node::GetInputs()
+bool Node::IsRightMostLane() const
 {
-	return m_inputs;
+	return (m_index == m_nodeGroup->GetNumNodes() - 1);
 }
 
-std::set<Connection*>& Node::GetOutputs()
-{
-	return m_outputs;
-}
 
-bool Node::HasInput(Node* node) const
+bool Node::HasStopSign() const
 {
-	return (GetInputConnection(node) != nullptr);
+	return m_hasStopSign;
 }
 
-bool Node::HasOutput(Node* node) const
+int Node::GetSignalSlot() const
 {
-	return (GetOutputConnection(node) != nullptr);
+	return m_signalSlot;
 }
 
-Connection* Node::GetInputConnection(Node* node) const
+TrafficLightSignal Node::GetSignal() const
 {
-	for (Connection* connection : m_inputs)
+	if (m_nodeGroup->GetIntersection() != nullptr &&
+		m_nodeGroup->GetIntersection()->GetTrafficLightProgram() != nullptr)
 	{
-		if (connection->GetInput() == node)
-			return connection;
+		return m_nodeGroup->GetIntersection()->GetTrafficLightProgram()->GetSignal(this);
 	}
-	return nullptr;
+	return TrafficLightSignal::NONE;
 }
 
-Connection* Node::GetOutputConnection(Node* node) const
-{
-	for (Connection* connection : m_outputs)
-	{
-		if (connection->GetOutput() == node)
-			return connection;
-	}
-	return nullptr;
-}
 
-LaneDivider Node::GetLeftLaneDivider() const
-{
-	return LaneDivider::SOLID;
-}
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
 
-LaneDivider Node::GetRightLaneDivider() const
+void Node::SetWidth(float width)
 {
-	return LaneDivider::SOLID;
-}
+	m_width = width;
 
-bool Node::IsLeftMostLane() const
-{
-	return (m_index == 0);
+	// Lane widths shape the node group and everything built off it
+	if (m_nodeGroup != nullptr)
+		m_nodeGroup->MarkGeometryDirty();
 }
 
-bool Node::IsRightMostLane() const
-{
-	return (m_index == m_nodeGroup->GetNumNodes() - 1);
-}
 
+//-----------------------------------------------------------------------------
+// NodeRef
+//-----------------------------------------------------------------------------
 
-bool Node::HasStopSign() const
+NodeRef::NodeRef()
+	: group(nullptr)
+	, groupId(0)
+	, laneGeneration(0)
+	, index(0)
 {
-	return m_hasStopSign;
 }
 
-TrafficLightSignal Node::GetSignal() const
+NodeRef::NodeRef(Node* node)
+	: group(nullptr)
+	, groupId(0)
+	, laneGeneration(0)
+	, index(0)
 {
-	if (m_nodeGroup->GetIntersection() != nullptr &&
-		m_nodeGroup->GetIntersection()->GetTrafficLightProgram() != nullptr)
+	if (node != nullptr)
 	{
-		return m_nodeGroup->GetIntersection()->GetTrafficLightProgram()->GetSignal(this);
+		group = node->m_nodeGroup;
+		groupId = group->GetId();
+		laneGeneration = group->GetLaneGeneration();
+		index = node->m_index;
 	}
-	return TrafficLightSignal::NONE;
 }
 
+Node* NodeRef::Get() const
+{
+	// Lanes removed from the right of the group are gone, and lanes added
+	// on its left have moved the rest
+	if (group == nullptr || group->GetId() != groupId ||
+		group->GetLaneGeneration() != laneGeneration ||
+		index >= group->GetNumNodes())
+		return nullptr;
+	return group->GetNode(index);
+}
 
-//-----------------------------------------------------------------------------
-// Setters
-//-----------------------------------------------------------------------------
-
-void Node::SetWidth(float width)
+bool NodeRef::IsNull() const
 {
-	m_width = width;
+	return (group == nullptr);
 }
 
-void Node::SetLeftPosition(const Vector3f& position)
+bool NodeRef::operator==(const NodeRef& other) const
 {
-	m_position = position;
+	return (group == other.group && groupId == other.groupId &&
+		laneGeneration == other.laneGeneration && index == other.index);
 }
 
-void Node::SetCenterPosition(const Vector3f& center)
+bool NodeRef::operator!=(const NodeRef& other) const
 {
-	m_position = Vector3f(
-		center.xy - (GetEndTangent() * m_width * 0.5f), center.z);
+	return !(*this == other);
 }
 
-void Node::SetEndNormal(const Vector2f& normal)
+bool NodeRef::operator<(const NodeRef& other) const
 {
-	m_direction = normal;
+	if (groupId != other.groupId)
+		return (groupId < other.groupId);
+	if (laneGeneration != other.laneGeneration)
+		return (laneGeneration < other.laneGeneration);
+	if (index != other.index)
+		return (index < other.index);
+	return (group < other.group);
 }
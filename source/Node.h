@@ -7,17 +7,24 @@
 #include "Biarc.h"
 #include <set>
 
-class Connection;
 class NodeGroup;
-class NodeGroupConnection;
 
 
+//-----------------------------------------------------------------------------
+// Class:   Node
+// Purpose: A single lane of a node group. Lanes are stored by value in their
+//          node group, left to right, so a node pointer is only valid until
+//          the group's lane count changes. Lanes held from one frame to the
+//          next are held by NodeRef instead. Position and direction are
+//          derived from the group.
+//-----------------------------------------------------------------------------
 class Node
 {
-	friend class Connection;
 	friend class RoadNetwork;
 	friend class NodeGroup;
 	friend class NodeGroupConnection;
+	friend class LaneGraph;
+	friend class TrafficLightProgram;
 
 public:
 	// Constructors
@@ -28,7 +35,6 @@ public:
 
 	int GetIndex() const;
 	NodeGroup* GetNodeGroup();
-	const RoadMetrics* GetMetrics() const;
 	float GetWidth() const;
 	Vector2f GetDirection() const;
 	Vector2f GetEndTangent() const;
@@ -43,49 +49,58 @@ public:
 	bool IsLeftMostLane() const;
 	bool IsRightMostLane() const;
 	bool HasStopSign() const;
+	int GetSignalSlot() const;
 	TrafficLightSignal GetSignal() const;
 
 	// Setters
 
 	void SetWidth(float width);
-	void SetLeftPosition(const Vector3f& position);
-	void SetCenterPosition(const Vector3f& center);
-	void SetEndNormal(const Vector2f& normal);
-	
-private:
-	int GetNumInputs() const;
-	int GetNumOutputs() const;
-	int GetNumConnections(InputOutput type) const;
-	std::set<Connection*>& GetConnections(InputOutput type);
-	std::set<Connection*>& GetInputs();
-	std::set<Connection*>& GetOutputs();
-	bool HasInput(Node* node) const;
-	bool HasOutput(Node* node) const;
-	Connection* GetInputConnection(Node* node) const;
-	Connection* GetOutputConnection(Node* node) const;
-	LaneDivider GetLeftLaneDivider() const;
-	LaneDivider GetRightLaneDivider() const;
 
 private:
+	NodeGroup* m_nodeGroup;
 	Meters m_width;
-	Vector3f m_position;
-	Vector2f m_direction;
+	int m_index;
+	int m_laneId; // Assigned by the lane graph
+	int m_signalSlot; // Assigned by the traffic light program
 	LaneDivider m_leftDivider;
+	bool m_hasStopSign;
+};
 
-	int m_index;
 
-	void* m_laneMarking;
-	bool m_hasStopSign;
+//-----------------------------------------------------------------------------
+// Struct:  NodeRef
+// Purpose: Handle to a lane, as its node group and its index in the group.
+//          It survives the group's lanes being reallocated. The group's ID
+//          and lane generation tell whether the lane it refers to still
+//          exists at that index: adding lanes on the left shifts the index
+//          of every lane, which makes handles taken before stale. Handles
+//          sort by group ID, so their order survives a save and load.
+//-----------------------------------------------------------------------------
+struct NodeRef
+{
+public:
+	NodeGroup* group;
+	int groupId;
+	uint32 laneGeneration;
+	int index;
 
-	const RoadMetrics* m_metrics;
-	NodeGroup* m_nodeGroup;
+public:
+	// Constructors
+
+	NodeRef();
+	NodeRef(Node* node);
+
+	// Getters
+
+	Node* Get() const;
+	bool IsNull() const;
 
-	Array<Vector2f> m_vertices[3];
+	// Operators
 
-	// UNUSED
-	Set<Connection*> m_outputs;
-	Set<Connection*> m_inputs;
+	bool operator==(const NodeRef& other) const;
+	bool operator!=(const NodeRef& other) const;
+	bool operator<(const NodeRef& other) const;
 };
 
 
-#endif // _NODE_H_
\ No newline at end of file
+#endif // _NODE_H_
@@ -78,16 +78,15 @@ NodeGroup::NodeGroup()
 	, m_rightOfWay(RightOfWay::NONE)
 	, m_rightShoulderWidth(0.0f)
 	, m_leftShoulderWidth(0.0f)
+	, m_slope(0.0f)
+	, m_isGeometryDirty(true)
+	, m_laneGeneration(0)
 {
 	//m_rightOfWay = Random::NextBool() ? RightOfWay::NONE : RightOfWay::GIVE_WAY;
 }
 
 NodeGroup::~NodeGroup()
 {
-	// Delete all nodes in the node group
-	for (unsigned int i = 0; i < m_nodes.size(); i++)
-		delete m_nodes[i];
-	m_nodes.clear();
 }
 
 
@@ -95,6 +94,16 @@ NodeGroup::~NodeGroup()
 // Getters
 //-----------------------------------------------------------------------------
 
+int NodeGroup::GetId() const
+{
+	return m_id;
+}
+
+uint32 NodeGroup::GetLaneGeneration() const
+{
+	return m_laneGeneration;
+}
+
 const Vector3f& NodeGroup::GetPosition() const
 {
 	return m_position;
@@ -132,25 +141,35 @@ RoadIntersection* NodeGroup::GetIntersection(IOType type) const
 	return m_inputIntersection;
 }
 
-Node* NodeGroup::GetLeftNode() const
+Node* NodeGroup::GetLeftNode()
 {
 	if (m_nodes.empty())
 		return nullptr;
 	else
-		return m_nodes.front();
+		return &m_nodes.front();
 }
 
-Node* NodeGroup::GetRightNode() const
+Node* NodeGroup::GetRightNode()
 {
 	if (m_nodes.empty())
 		return nullptr;
 	else
-		return m_nodes.back();
+		return &m_nodes.back();
 }
 
 Node* NodeGroup::GetNode(int index)
 {
-	return m_nodes[index];
+	return &m_nodes[index];
+}
+
+Vector3f NodeGroup::GetNodePosition(int index) const
+{
+	// Lanes are laid out to the right of the group's position
+	Meters offset = 0.0f;
+	for (int i = 0; i < index; i++)
+		offset += m_nodes[i].m_width;
+	return Vector3f(m_position.xy + (GetRightDirection() * offset),
+		m_position.z);
 }
 
 NodeGroupTie* NodeGroup::GetTie()
@@ -167,7 +186,7 @@ Meters NodeGroup::GetWidth() const
 {
 	float width = 0.0f;
 	for (unsigned int i = 0; i < m_nodes.size(); i++)
-		width += m_nodes[i]->m_width;
+		width += m_nodes[i].m_width;
 	return width;
 }
 
@@ -229,6 +248,11 @@ float NodeGroup::GetSlope() const
 	return m_slope;
 }
 
+bool NodeGroup::IsGeometryDirty() const
+{
+	return m_isGeometryDirty;
+}
+
 
 //-----------------------------------------------------------------------------
 // Setters
@@ -237,16 +261,19 @@ float NodeGroup::GetSlope() const
 void NodeGroup::SetPosition(const Vector3f& position)
 {
 	m_position = position;
+	m_isGeometryDirty = true;
 }
 
 void NodeGroup::SetAltitude(float z)
 {
 	m_position.z = z;
+	m_isGeometryDirty = true;
 }
 
 void NodeGroup::SetDirection(const Vector2f& direction)
 {
 	m_direction = direction;
+	m_isGeometryDirty = true;
 }
 
 void NodeGroup::SetDirectionFromCenter(const Vector2f& direction)
@@ -257,6 +284,7 @@ void NodeGroup::SetDirectionFromCenter(const Vector2f& direction)
 	m_direction = direction;
 	right = RightPerpendicular(direction);
 	m_position.xy = center - (right * width * 0.5f);
+	m_isGeometryDirty = true;
 }
 
 void NodeGroup::SetRightOfWay(RightOfWay rightOfWay)
@@ -264,6 +292,11 @@ void NodeGroup::SetRightOfWay(RightOfWay rightOfWay)
 	m_rightOfWay = rightOfWay;
 }
 
+void NodeGroup::MarkGeometryDirty()
+{
+	m_isGeometryDirty = true;
+}
+
 
 //-----------------------------------------------------------------------------
 // Geometry
@@ -459,24 +492,19 @@ bool NodeGroup::IntersectEdgeLines(
 
 void NodeGroup::UpdateGeometry()
 {
-	// Adjust the node positions relative to the node group's center
-	Vector3f nodePosition = m_position;
-	Vector2f right = RightPerpendicular(m_direction);
-	for (unsigned int i = 0; i < m_nodes.size(); i++)
-	{
-		Node* node = m_nodes[i];
-		node->m_position = nodePosition;
-		node->m_direction = m_direction;
-		nodePosition.xy += node->m_width * right;
-	}
-
 	// Determine the slope
-	m_slope = 0.0f;
+	m_slope = CalcSlope();
+	m_isGeometryDirty = false;
+}
+
+float NodeGroup::CalcSlope() const
+{
+	float slope = 0.0f;
 	if (!m_connections[0].empty() && !m_connections[1].empty())
 	{
 		// The node group's slope will be most gradual linear slope
 		// of all its connections
-		m_slope = m_connections[1][0]->GetLinearSlope();
+		slope = m_connections[1][0]->GetLinearSlope();
 		bool up = false;
 		bool down = false;
 		for (unsigned int side = 0; side < 2; side++)
@@ -488,15 +516,16 @@ void NodeGroup::UpdateGeometry()
 					up = true;
 				else
 					down = true;
-				if (Math::Abs(connectionSlope) < Math::Abs(m_slope))
-					m_slope = connectionSlope;
+				if (Math::Abs(connectionSlope) < Math::Abs(slope))
+					slope = connectionSlope;
 			}
 		}
 
 		// If grade direction changes between any connections then use a flat slope
 		if (up && down)
-			m_slope = 0.0f;
+			slope = 0.0f;
 	}
+	return slope;
 }
 
 void NodeGroup::UpdateIntersectionGeometry()
@@ -634,11 +663,13 @@ void NodeGroup::InsertConnection(NodeGroupConnection* connection, int direction)
 			connections[i]->GetTwin() == nullptr)
 		{
 			connections.insert(connections.begin() + i, connection);
+			m_isGeometryDirty = true;
 			return;
 		}
 	}
 
 	connections.push_back(connection);
+	m_isGeometryDirty = true;
 }
 
 void NodeGroup::UpdateConnectionSorting(bool search)
@@ -668,6 +699,17 @@ void NodeGroup::UpdateConnectionSorting(bool search)
 	}
 }
 
+void NodeGroup::UpdateNodeIndices()
+{
+	// Lanes are stored by value, so they must be pointed back at their slot
+	// whenever lanes are inserted or removed
+	for (unsigned int i = 0; i < m_nodes.size(); i++)
+	{
+		m_nodes[i].m_nodeGroup = this;
+		m_nodes[i].m_index = (int) i;
+	}
+}
+
 void NodeGroup::RemoveInput(NodeGroupConnection* input)
 {
 	RemoveConnection(input, 0);
@@ -684,4 +726,5 @@ void NodeGroup::RemoveConnection(NodeGroupConnection* connection, int direction)
 	auto it = std::find(connections.begin(), connections.end(), connection);
 	if (it != connections.end())
 		connections.erase(it);
+	m_isGeometryDirty = true;
 }
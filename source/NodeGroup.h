@@ -61,6 +61,8 @@ public:
 
 	// Getters
 
+	int GetId() const;
+	uint32 GetLaneGeneration() const;
 	const Vector3f& GetPosition() const;
 	const Vector2f& GetDirection() const;
 	Vector2f GetLeftDirection() const;
@@ -68,9 +70,10 @@ public:
 	const RoadMetrics* GetMetrics() const;
 	NodeGroup* GetTwin() const;
 	RoadIntersection* GetIntersection(IOType type = IOType::OUTPUT) const;
-	Node* GetLeftNode() const;
-	Node* GetRightNode() const;
+	Node* GetLeftNode();
+	Node* GetRightNode();
 	Node* GetNode(int index);
+	Vector3f GetNodePosition(int index) const;
 	NodeGroupTie* GetTie();
 	int GetNumNodes() const;
 	Meters GetWidth() const;
@@ -84,6 +87,7 @@ public:
 	bool IsTied() const;
 	RightOfWay GetRightOfWay() const;
 	float GetSlope() const;
+	bool IsGeometryDirty() const;
 
 	// Setters
 
@@ -92,6 +96,7 @@ public:
 	void SetDirection(const Vector2f& direction);
 	void SetDirectionFromCenter(const Vector2f& direction);
 	void SetRightOfWay(RightOfWay rightOfWay);
+	void MarkGeometryDirty();
 
 	// Geometry
 
@@ -109,6 +114,8 @@ private:
 	void RemoveOutput(NodeGroupConnection* output);
 	void RemoveConnection(NodeGroupConnection* connection, int direction);
 	void UpdateConnectionSorting(bool search = true);
+	void UpdateNodeIndices();
+	float CalcSlope() const;
 
 private:
 	int m_id;
@@ -117,9 +124,11 @@ private:
 	Vector3f m_position;
 	Vector2f m_direction;
 	float m_slope;
+	bool m_isGeometryDirty;
 
 	// Connections
-	Array<Node*> m_nodes;
+	Array<Node> m_nodes; // Lanes, left to right
+	uint32 m_laneGeneration; // Incremented when lanes move to other indices
 	NodeGroup* m_twin;
 	NodeGroupTie* m_tie;
 	RoadIntersection* m_intersection;
@@ -1,6 +1,9 @@
 #include "NodeGroupConnection.h"
 #include "NodeGroupTie.h"
+#include "RoadNetworkFile.h"
+#ifndef ROAD_MIND_HEADLESS
 #include "Geometry.h"
+#endif
 
 
 //-----------------------------------------------------------------------------
@@ -10,15 +13,21 @@
 NodeGroupConnection::NodeGroupConnection()
 	: m_metrics(nullptr)
 	, m_isGhost(false)
-	, m_mesh(nullptr)
+	, m_drivingLines(1)
 {
+	m_drivingLineLaneCounts[0] = 0;
+	m_drivingLineLaneCounts[1] = 0;
+#ifndef ROAD_MIND_HEADLESS
 	m_mesh = new Mesh();
+#endif
 }
 
 NodeGroupConnection::~NodeGroupConnection()
 {
+#ifndef ROAD_MIND_HEADLESS
 	delete m_mesh;
 	m_mesh = nullptr;
+#endif
 }
 
 
@@ -132,35 +141,19 @@ Array<RoadCurveLine>& NodeGroupConnection::GetEdgeSeams(IOType type, LaneSide si
 	return m_edgeSeams[(int) type][(int) side];
 }
 
-RoadCurveLine NodeGroupConnection::GetDrivingLine(int fromLaneIndex, int toLaneIndex)
+const RoadCurveLine& NodeGroupConnection::GetDrivingLine(
+	int fromLaneIndex, int toLaneIndex) const
 {
-	// Get the endpoint offsets from the left-most lane edge
-	Meters offsets[2] = {0, 0};
-	Meters widths[2] = {0, 0};
-	for (int i = 0; i <= fromLaneIndex; i++)
-	{
-		widths[0] = GetInput().group->GetNode(i)->GetWidth();
-		offsets[0] += widths[0];
-	}
-	for (int i = 0; i <= toLaneIndex; i++)
-	{
-		widths[1] = GetOutput().group->GetNode(i)->GetWidth();
-		offsets[1] += widths[1];
-	}
-
-	// Create the horizontal and vertical curve
-	BiarcPair horizontal = BiarcPair::CreateParallel(
-		m_leftLaneEdge.horizontalCurve,
-		offsets[0] - (widths[0] * 0.5f),
-		offsets[1] - (widths[1] * 0.5f));
-	Meters h1 = GetInput().group->GetPosition().z;
-	Meters h2 = GetOutput().group->GetPosition().z;
-	float slope1 = GetInput().group->GetSlope();
-	float slope2 = GetOutput().group->GetSlope();
-	return RoadCurveLine(horizontal, h1, h2, slope1, slope2);
+	// Clamp the lanes to the ones the lines were made for, as lanes may
+	// have been added or removed since, until the geometry is updated
+	int fromLaneCount = Math::Max(1, m_drivingLineLaneCounts[0]);
+	int toLaneCount = Math::Max(1, m_drivingLineLaneCounts[1]);
+	fromLaneIndex = Math::Clamp(fromLaneIndex, 0, fromLaneCount - 1);
+	toLaneIndex = Math::Clamp(toLaneIndex, 0, toLaneCount - 1);
+	return m_drivingLines[(fromLaneIndex * toLaneCount) + toLaneIndex];
 }
 
-RoadCurveLine NodeGroupConnection::GetDrivingLine(int laneIndex)
+const RoadCurveLine& NodeGroupConnection::GetDrivingLine(int laneIndex) const
 {
 	return GetDrivingLine(laneIndex, laneIndex);
 }
@@ -223,10 +216,12 @@ float NodeGroupConnection::GetLinearSlope() const
 		return dy / dx;
 }
 
+#ifndef ROAD_MIND_HEADLESS
 Mesh* NodeGroupConnection::GetMesh()
 {
 	return m_mesh;
 }
+#endif
 
 bool NodeGroupConnection::ContainsPoint(const Vector2f& point)
 {
@@ -241,15 +236,20 @@ bool NodeGroupConnection::ContainsPoint(const Vector2f& point)
 void NodeGroupConnection::SetInput(const NodeSubGroup& input)
 {
 	m_groups[(int) InputOutput::INPUT] = input;
+	m_isGeometryDirty = true;
 }
 
 void NodeGroupConnection::SetOutput(const NodeSubGroup& output)
 {
 	m_groups[(int) InputOutput::OUTPUT] = output;
+	m_isGeometryDirty = true;
 }
 
 void NodeGroupConnection::SetGhost(bool ghost)
 {
+	// Ghost connections are left out of the lane graph
+	if (ghost != m_isGhost)
+		m_isGeometryDirty = true;
 	m_isGhost = ghost;
 }
 
@@ -264,6 +264,7 @@ void NodeGroupConnection::CycleLaneSplit()
 
 	m_laneSplit.push_back(m_laneSplit[0]);
 	m_laneSplit.erase(m_laneSplit.begin());
+	m_isGeometryDirty = true;
 }
 
 void NodeGroupConnection::ConstrainLaneSplit()
@@ -332,8 +333,8 @@ void NodeGroupConnection::UpdateGeometry()
 	nodes[1] = GetOutput().group->GetNode(GetOutput().index);
 	BiarcPair prev, curr;
 	prev = BiarcPair::Interpolate(
-		nodes[0]->m_position.xy, GetInput().group->GetDirection(),
-		nodes[1]->m_position.xy, GetOutput().group->GetDirection());
+		nodes[0]->GetPosition().xy, GetInput().group->GetDirection(),
+		nodes[1]->GetPosition().xy, GetOutput().group->GetDirection());
 	m_visualDividerLines.push_back(RoadCurveLine(prev));
 
 	// Determine side with less nodes
@@ -403,11 +404,118 @@ void NodeGroupConnection::UpdateGeometry()
 		h1, h2, m_visualShoulderLines[0].horizontalCurve.Length(), slope1, slope2);
 	m_visualShoulderLines[1].verticalCurve = VerticalCurve(
 		h1, h2, m_visualShoulderLines[1].horizontalCurve.Length(), slope1, slope2);
+
+	// Keep the untrimmed lines so the node groups can redo their
+	// intersection geometry without this connection being rebuilt
+	m_untrimmedDividerLines = m_visualDividerLines;
+	m_untrimmedShoulderLines[0] = m_visualShoulderLines[0];
+	m_untrimmedShoulderLines[1] = m_visualShoulderLines[1];
+
+	UpdateDrivingLines();
+	m_isGeometryDirty = false;
 }
 
-void NodeGroupConnection::CreateMesh()
+void NodeGroupConnection::ResetIntersectionGeometry()
+{
+	// Undo the trimming done by NodeGroup::UpdateIntersectionGeometry()
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		for (unsigned int j = 0; j < 2; j++)
+		{
+			m_seams[i][j].clear();
+			m_edgeSeams[i][j].clear();
+		}
+	}
+	m_visualDividerLines = m_untrimmedDividerLines;
+	m_visualShoulderLines[0] = m_untrimmedShoulderLines[0];
+	m_visualShoulderLines[1] = m_untrimmedShoulderLines[1];
+	m_visualEdgeLines[0] = &m_visualDividerLines[0];
+	m_visualEdgeLines[1] = &m_visualDividerLines[m_visualDividerLines.size() - 1];
+}
+
+uint64 NodeGroupConnection::GetIntersectionGeometryHash() const
+{
+	// FNV-1a over the trimmed lines and seams, used to tell whether the
+	// mesh needs to be rebuilt. Lines are hashed field by field, as the
+	// bytes of any padding between them are undefined.
+	uint64 hash = ROAD_NETWORK_FILE_HASH_SEED;
+	auto hashLines = [&](const RoadCurveLine* lines, unsigned int count) {
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const RoadCurveLine& line = lines[i];
+			for (const Biarc& arc : line.horizontalCurve.arcs)
+			{
+				hash = HashFileFloats({ arc.center.x, arc.center.y,
+					arc.start.x, arc.start.y, arc.end.x, arc.end.y,
+					arc.radius, arc.angle, arc.length }, hash);
+			}
+			const VerticalCurve& curve = line.verticalCurve;
+			hash = HashFileFloats({ curve.height1, curve.height2,
+				curve.slope1, curve.slope2, curve.length, curve.a, curve.b,
+				curve.offset, line.t1, line.t2 }, hash);
+		}
+		hash = HashFileValue(count, hash);
+	};
+	hashLines(m_visualDividerLines.data(), m_visualDividerLines.size());
+	hashLines(m_visualShoulderLines, 2);
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		for (unsigned int j = 0; j < 2; j++)
+		{
+			hashLines(m_seams[i][j].data(), m_seams[i][j].size());
+			hashLines(m_edgeSeams[i][j].data(), m_edgeSeams[i][j].size());
+		}
+	}
+	return hash;
+}
+
+void NodeGroupConnection::UpdateDrivingLines()
 {
+	// Cache the driving line for every pair of input and output lanes
+	int fromLaneCount = m_groups[0].count;
+	int toLaneCount = m_groups[1].count;
+	m_drivingLines.resize(Math::Max(1, fromLaneCount * toLaneCount));
+	m_drivingLineLaneCounts[0] = fromLaneCount;
+	m_drivingLineLaneCounts[1] = toLaneCount;
+	for (int i = 0; i < fromLaneCount; i++)
+	{
+		for (int j = 0; j < toLaneCount; j++)
+			m_drivingLines[(i * toLaneCount) + j] = CreateDrivingLine(i, j);
+	}
+}
+
+RoadCurveLine NodeGroupConnection::CreateDrivingLine(int fromLaneIndex, int toLaneIndex)
+{
+	// Get the endpoint offsets from the left-most lane edge
+	Meters offsets[2] = {0, 0};
+	Meters widths[2] = {0, 0};
+	for (int i = 0; i <= fromLaneIndex; i++)
+	{
+		widths[0] = GetInput().group->GetNode(i)->GetWidth();
+		offsets[0] += widths[0];
+	}
+	for (int i = 0; i <= toLaneIndex; i++)
+	{
+		widths[1] = GetOutput().group->GetNode(i)->GetWidth();
+		offsets[1] += widths[1];
+	}
 
+	// Create the horizontal and vertical curve
+	BiarcPair horizontal = BiarcPair::CreateParallel(
+		m_leftLaneEdge.horizontalCurve,
+		offsets[0] - (widths[0] * 0.5f),
+		offsets[1] - (widths[1] * 0.5f));
+	Meters h1 = GetInput().group->GetPosition().z;
+	Meters h2 = GetOutput().group->GetPosition().z;
+	float slope1 = GetInput().group->GetSlope();
+	float slope2 = GetOutput().group->GetSlope();
+	return RoadCurveLine(horizontal, h1, h2, slope1, slope2);
+}
+
+#ifndef ROAD_MIND_HEADLESS
+void NodeGroupConnection::BuildMesh(Array<VertexPosNorm>& outVertices,
+	Array<unsigned int>& outIndices)
+{
 	NodeGroupConnection* twin = GetTwin();
 	RoadCurveLine leftEdge;
 	RoadCurveLine rightEdge = GetRightVisualShoulderLine();
@@ -423,20 +531,18 @@ void NodeGroupConnection::CreateMesh()
 	Array<RoadCurveLine> rightContour;
 	leftContour.resize(1);
 	rightContour.resize(1);
-	Array<VertexPosNorm> vertices;
-	Array<unsigned int> indices;
 
 	// Right shoulder
 	leftContour[0] = m_visualDividerLines.back();
 	rightContour[0] = m_visualShoulderLines[1];
-	Geometry::ZipArcs(vertices, indices, leftContour, rightContour);
+	Geometry::ZipArcs(outVertices, outIndices, leftContour, rightContour);
 
 	// Left shoulder
 	if (twin == nullptr)
 	{
 		leftContour[0] = m_visualShoulderLines[0];
 		rightContour[0] = m_visualDividerLines[0];
-		Geometry::ZipArcs(vertices, indices, leftContour, rightContour);
+		Geometry::ZipArcs(outVertices, outIndices, leftContour, rightContour);
 	}
 
 	// Lane surface
@@ -452,10 +558,22 @@ void NodeGroupConnection::CreateMesh()
 	rightContour.push_back(GetRightVisualEdgeLine());
 	for (auto it = seamsOR.begin(); it != seamsOR.end(); it++)
 		rightContour.push_back(*it);
-	Geometry::ZipArcs(vertices, indices, leftContour, rightContour);
+	Geometry::ZipArcs(outVertices, outIndices, leftContour, rightContour);
+}
 
+void NodeGroupConnection::CreateMesh()
+{
+	Array<VertexPosNorm> vertices;
+	Array<unsigned int> indices;
+	BuildMesh(vertices, indices);
+	CreateMesh(vertices, indices);
+}
+
+void NodeGroupConnection::CreateMesh(const Array<VertexPosNorm>& vertices,
+	const Array<unsigned int>& indices)
+{
 	m_mesh->GetVertexData()->BufferVertices(vertices);
 	m_mesh->GetIndexData()->BufferIndices(indices);
 	m_mesh->SetIndices(0, indices.size());
-	return;
 }
+#endif
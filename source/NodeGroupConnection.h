@@ -3,7 +3,9 @@
 
 #include <cmgCore/cmg_core.h>
 #include <cmgMath/cmg_math.h>
+#ifndef ROAD_MIND_HEADLESS
 #include <cmgGraphics/cmg_graphics.h>
+#endif
 #include "CommonTypes.h"
 #include "NodeGroup.h"
 #include "Biarc3.h"
@@ -48,12 +50,14 @@ public:
 	Array<RoadCurveLine>& GetSeams(IOType type, LaneSide side);
 	const Array<RoadCurveLine>& GetEdgeSeams(IOType type, LaneSide side) const;
 	Array<RoadCurveLine>& GetEdgeSeams(IOType type, LaneSide side);
-	RoadCurveLine GetDrivingLine(int fromLaneIndex, int toLaneIndex);
-	RoadCurveLine GetDrivingLine(int laneIndex);
+	const RoadCurveLine& GetDrivingLine(int fromLaneIndex, int toLaneIndex) const;
+	const RoadCurveLine& GetDrivingLine(int laneIndex) const;
 	void GetLaneOutputRange(int fromLaneIndex, int& outToLaneIndex, int& outToLaneCount);
 	bool IsGhost() const;
 	float GetLinearSlope() const;
+#ifndef ROAD_MIND_HEADLESS
 	Mesh* GetMesh();
+#endif
 	bool ContainsPoint(const Vector2f& point);
 
 	// Setters
@@ -66,7 +70,13 @@ public:
 	// Geometry
 
 	virtual void UpdateGeometry() override;
+	void ResetIntersectionGeometry();
+	uint64 GetIntersectionGeometryHash() const;
+#ifndef ROAD_MIND_HEADLESS
+	void BuildMesh(Array<VertexPosNorm>& outVertices, Array<unsigned int>& outIndices);
 	void CreateMesh();
+	void CreateMesh(const Array<VertexPosNorm>& vertices, const Array<unsigned int>& indices);
+#endif
 
 public:
 	int m_id;
@@ -78,6 +88,8 @@ private:
 	void SetEdgeSeam(IOType end, LaneSide side, const RoadCurveLine& seam);
 	void AddEdgeSeam(IOType end, LaneSide side, const RoadCurveLine& seam);
 	void ConstrainLaneSplit();
+	RoadCurveLine CreateDrivingLine(int fromLaneIndex, int toLaneIndex);
+	void UpdateDrivingLines();
 
 
 public:
@@ -93,9 +105,17 @@ public:
 	RoadCurveLine m_visualShoulderLines[2];
 	Array<RoadCurveLine> m_seams[2][2];
 	Array<RoadCurveLine> m_edgeSeams[2][2];
+	Array<RoadCurveLine> m_drivingLines; // Indexed by [fromLane][toLane]
+	int m_drivingLineLaneCounts[2]; // Input and output lanes the lines were made for
 
+	// Lines before they were trimmed against neighboring connections
+	Array<RoadCurveLine> m_untrimmedDividerLines;
+	RoadCurveLine m_untrimmedShoulderLines[2];
+
+#ifndef ROAD_MIND_HEADLESS
 	// Meshes
 	Mesh* m_mesh;
+#endif
 };
 
 
@@ -10,6 +10,7 @@ NodeGroupTie::NodeGroupTie()
 	, m_position(Vector3f::ZERO)
 	, m_direction(Vector2f::UNITX)
 	, m_nodeGroup(nullptr)
+	, m_isGeometryDirty(true)
 {
 }
 
@@ -52,6 +53,11 @@ bool NodeGroupTie::IsDivided() const
 	return false; // TODO
 }
 
+bool NodeGroupTie::IsGeometryDirty() const
+{
+	return m_isGeometryDirty;
+}
+
 
 //-----------------------------------------------------------------------------
 // Setters
@@ -60,16 +66,24 @@ bool NodeGroupTie::IsDivided() const
 void NodeGroupTie::SetPosition(const Vector3f& position)
 {
 	m_position = position;
+	m_isGeometryDirty = true;
 }
 
 void NodeGroupTie::SetDirection(const Vector2f& direction)
 {
 	m_direction = direction;
+	m_isGeometryDirty = true;
 }
 
 void NodeGroupTie::SetCenterWidth(Meters centerWidth)
 {
 	m_centerDividerWidth = centerWidth;
+	m_isGeometryDirty = true;
+}
+
+void NodeGroupTie::MarkGeometryDirty()
+{
+	m_isGeometryDirty = true;
 }
 
 
@@ -89,6 +103,7 @@ void NodeGroupTie::UpdateGeometry()
 	twin->m_position = Vector3f(
 		m_position.xy - (normal * m_centerDividerWidth * 0.5f), m_position.z);
 	twin->m_direction = -m_direction;
+	m_isGeometryDirty = false;
 }
 
 
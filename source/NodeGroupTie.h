@@ -27,11 +27,13 @@ public:
 	const Vector2f& GetDirection() const;
 	Meters GetCenterWidth() const;
 	bool IsDivided() const;
+	bool IsGeometryDirty() const;
 
 	// Setters
 	void SetPosition(const Vector3f& position);
 	void SetDirection(const Vector2f& direction);
 	void SetCenterWidth(Meters centerWidth);
+	void MarkGeometryDirty();
 
 	// Geometry
 	void UpdateGeometry();
@@ -42,6 +44,7 @@ private:
 	Vector2f m_direction;
 	NodeGroup* m_nodeGroup;
 	Meters m_centerDividerWidth;
+	bool m_isGeometryDirty;
 };
 
 
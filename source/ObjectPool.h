@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+constexpr auto OBJECT_POOL_BLOCK_SIZE = 256;
+
+
+//-----------------------------------------------------------------------------
+// Class:   ObjectPool
+// Purpose: Owns the objects of one type, allocated in fixed-size blocks so
+//          they sit together in memory. Blocks never move, so an object keeps
+//          its address, which serves as its handle, for as long as it lives.
+//          Iteration visits live objects in slot order. Slots are handed out
+//          in creation order, and a destroyed object's slot goes to the next
+//          object created. Clear destroys every object at once but keeps the
+//          blocks for the next objects.
+//-----------------------------------------------------------------------------
+template <typename T>
+class ObjectPool
+{
+public:
+	class Iterator
+	{
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef T* value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef T* const* pointer;
+		typedef T* reference;
+
+		Iterator(const ObjectPool* pool, int slot)
+			: m_pool(pool)
+			, m_slot(slot)
+		{
+		}
+
+		T* operator*() const
+		{
+			return m_pool->GetObject(m_slot);
+		}
+		Iterator& operator++()
+		{
+			m_slot = m_pool->FindLiveSlot(m_slot + 1);
+			return *this;
+		}
+		Iterator operator++(int)
+		{
+			Iterator result = *this;
+			++(*this);
+			return result;
+		}
+		bool operator==(const Iterator& other) const
+		{
+			return (m_slot == other.m_slot);
+		}
+		bool operator!=(const Iterator& other) const
+		{
+			return (m_slot != other.m_slot);
+		}
+
+	private:
+		const ObjectPool* m_pool;
+		int m_slot;
+	};
+
+public:
+	// Constructors
+
+	ObjectPool()
+		: m_slotCount(0)
+		, m_count(0)
+	{
+	}
+
+	~ObjectPool()
+	{
+		Clear();
+		for (Storage* block : m_blocks)
+			delete [] block;
+		m_blocks.clear();
+	}
+
+	// Getters
+
+	int size() const
+	{
+		return m_count;
+	}
+	bool empty() const
+	{
+		return (m_count == 0);
+	}
+	Iterator begin() const
+	{
+		return Iterator(this, FindLiveSlot(0));
+	}
+	Iterator end() const
+	{
+		return Iterator(this, m_slotCount);
+	}
+
+	// Returns true if the address lies within a live object of the pool.
+	// Objects may be looked up by a pointer to one of their base classes.
+	bool Contains(const void* address) const
+	{
+		auto it = m_blockIndices.upper_bound(address);
+		if (it == m_blockIndices.begin())
+			return false;
+		int block = (--it)->second;
+		uintptr_t offset = (uintptr_t) address - (uintptr_t) m_blocks[block];
+		if (offset >= sizeof(Storage) * OBJECT_POOL_BLOCK_SIZE)
+			return false;
+		int slot = (block * OBJECT_POOL_BLOCK_SIZE) +
+			(int) (offset / sizeof(Storage));
+		return (slot < m_slotCount && m_isLive[slot] != 0);
+	}
+
+	// Setters
+
+	void Reserve(int count)
+	{
+		while ((int) m_blocks.size() * OBJECT_POOL_BLOCK_SIZE < count)
+			AddBlock();
+	}
+
+	template <typename... Args>
+	T* Create(Args&&... args)
+	{
+		int slot;
+		if (!m_freeSlots.empty())
+		{
+			slot = m_freeSlots.back();
+			m_freeSlots.pop_back();
+		}
+		else
+		{
+			slot = m_slotCount++;
+			if (slot >= (int) m_blocks.size() * OBJECT_POOL_BLOCK_SIZE)
+				AddBlock();
+		}
+		T* object = new (GetStorage(slot)) T(std::forward<Args>(args)...);
+		m_isLive[slot] = 1;
+		m_count++;
+		return object;
+	}
+
+	void Destroy(T* object)
+	{
+		// Find the block holding the object, by its start address
+		auto it = m_blockIndices.upper_bound((const void*) object);
+		CMG_ASSERT(it != m_blockIndices.begin());
+		int block = (--it)->second;
+		int slot = (block * OBJECT_POOL_BLOCK_SIZE) +
+			(int) ((Storage*) object - m_blocks[block]);
+		CMG_ASSERT(m_isLive[slot] != 0);
+		object->~T();
+		m_isLive[slot] = 0;
+		m_freeSlots.push_back(slot);
+		m_count--;
+	}
+
+	void Clear()
+	{
+		for (int slot = 0; slot < m_slotCount; slot++)
+		{
+			if (m_isLive[slot] != 0)
+				GetObject(slot)->~T();
+		}
+		m_isLive.assign(m_isLive.size(), 0);
+		m_freeSlots.clear();
+		m_slotCount = 0;
+		m_count = 0;
+	}
+
+private:
+	typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+
+	ObjectPool(const ObjectPool& copy);
+	ObjectPool& operator=(const ObjectPool& copy);
+
+	Storage* GetStorage(int slot) const
+	{
+		return &m_blocks[slot / OBJECT_POOL_BLOCK_SIZE][
+			slot % OBJECT_POOL_BLOCK_SIZE];
+	}
+	T* GetObject(int slot) const
+	{
+		return reinterpret_cast<T*>(GetStorage(slot));
+	}
+	int FindLiveSlot(int slot) const
+	{
+		while (slot < m_slotCount && m_isLive[slot] == 0)
+			slot++;
+		return slot;
+	}
+	void AddBlock()
+	{
+		Storage* block = new Storage[OBJECT_POOL_BLOCK_SIZE];
+		m_blockIndices[(const void*) block] = (int) m_blocks.size();
+		m_blocks.push_back(block);
+		m_isLive.resize(m_blocks.size() * OBJECT_POOL_BLOCK_SIZE, 0);
+	}
+
+	Array<Storage*> m_blocks;
+	Map<const void*, int> m_blockIndices; // Block index by start address
+	Array<uint8> m_isLive; // Per slot
+	Array<int> m_freeSlots;
+	int m_slotCount; // Slots handed out since the last clear
+	int m_count;
+};
@@ -0,0 +1,315 @@
+#include "OrientedBox.h"
+#include <cmath>
+
+#if !defined(ROAD_MIND_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define ORIENTED_BOX_SSE
+	#include <emmintrin.h>
+	#if defined(__AVX__)
+		#define ORIENTED_BOX_AVX
+		#include <immintrin.h>
+	#endif
+#endif
+
+// Padding past the last box, enough for one full set of AVX lanes
+static const int ORIENTED_BOX_PADDING = 8;
+
+
+//-----------------------------------------------------------------------------
+// Separating axis tests
+//-----------------------------------------------------------------------------
+
+// Two boxes overlap unless the distance between their centers along one of
+// the four box axes is larger than the sum of their extents along it. With
+// unit axes u and v = (u.y, -u.x), the cross terms reduce to |uA.uB| and
+// |uA.vB|.
+static inline bool OverlapLane(
+	float ax, float ay, float aux, float auy, float ahx, float ahy,
+	float bx, float by, float bux, float buy, float bhx, float bhy)
+{
+	float dx = bx - ax;
+	float dy = by - ay;
+	float cc = std::fabs(aux * bux + auy * buy);
+	float cs = std::fabs(aux * buy - auy * bux);
+	if (std::fabs(dx * aux + dy * auy) > ahx + (bhx * cc + bhy * cs))
+		return false;
+	if (std::fabs(dx * auy - dy * aux) > ahy + (bhx * cs + bhy * cc))
+		return false;
+	if (std::fabs(dx * bux + dy * buy) > bhx + (ahx * cc + ahy * cs))
+		return false;
+	if (std::fabs(dx * buy - dy * bux) > bhy + (ahx * cs + ahy * cc))
+		return false;
+	return true;
+}
+
+#ifdef ORIENTED_BOX_SSE
+// Returns a mask with each lane's bits set where the boxes are separated
+static inline __m128 SeparatedSSE(
+	__m128 ax, __m128 ay, __m128 aux, __m128 auy, __m128 ahx, __m128 ahy,
+	__m128 bx, __m128 by, __m128 bux, __m128 buy, __m128 bhx, __m128 bhy)
+{
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 dx = _mm_sub_ps(bx, ax);
+	__m128 dy = _mm_sub_ps(by, ay);
+	__m128 cc = _mm_and_ps(absMask, _mm_add_ps(_mm_mul_ps(aux, bux), _mm_mul_ps(auy, buy)));
+	__m128 cs = _mm_and_ps(absMask, _mm_sub_ps(_mm_mul_ps(aux, buy), _mm_mul_ps(auy, bux)));
+	__m128 separated = _mm_cmpgt_ps(
+		_mm_and_ps(absMask, _mm_add_ps(_mm_mul_ps(dx, aux), _mm_mul_ps(dy, auy))),
+		_mm_add_ps(ahx, _mm_add_ps(_mm_mul_ps(bhx, cc), _mm_mul_ps(bhy, cs))));
+	separated = _mm_or_ps(separated, _mm_cmpgt_ps(
+		_mm_and_ps(absMask, _mm_sub_ps(_mm_mul_ps(dx, auy), _mm_mul_ps(dy, aux))),
+		_mm_add_ps(ahy, _mm_add_ps(_mm_mul_ps(bhx, cs), _mm_mul_ps(bhy, cc)))));
+	separated = _mm_or_ps(separated, _mm_cmpgt_ps(
+		_mm_and_ps(absMask, _mm_add_ps(_mm_mul_ps(dx, bux), _mm_mul_ps(dy, buy))),
+		_mm_add_ps(bhx, _mm_add_ps(_mm_mul_ps(ahx, cc), _mm_mul_ps(ahy, cs)))));
+	separated = _mm_or_ps(separated, _mm_cmpgt_ps(
+		_mm_and_ps(absMask, _mm_sub_ps(_mm_mul_ps(dx, buy), _mm_mul_ps(dy, bux))),
+		_mm_add_ps(bhy, _mm_add_ps(_mm_mul_ps(ahx, cs), _mm_mul_ps(ahy, cc)))));
+	return separated;
+}
+#endif
+
+#ifdef ORIENTED_BOX_AVX
+static inline __m256 SeparatedAVX(
+	__m256 ax, __m256 ay, __m256 aux, __m256 auy, __m256 ahx, __m256 ahy,
+	__m256 bx, __m256 by, __m256 bux, __m256 buy, __m256 bhx, __m256 bhy)
+{
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+	__m256 dx = _mm256_sub_ps(bx, ax);
+	__m256 dy = _mm256_sub_ps(by, ay);
+	__m256 cc = _mm256_and_ps(absMask, _mm256_add_ps(_mm256_mul_ps(aux, bux), _mm256_mul_ps(auy, buy)));
+	__m256 cs = _mm256_and_ps(absMask, _mm256_sub_ps(_mm256_mul_ps(aux, buy), _mm256_mul_ps(auy, bux)));
+	__m256 separated = _mm256_cmp_ps(
+		_mm256_and_ps(absMask, _mm256_add_ps(_mm256_mul_ps(dx, aux), _mm256_mul_ps(dy, auy))),
+		_mm256_add_ps(ahx, _mm256_add_ps(_mm256_mul_ps(bhx, cc), _mm256_mul_ps(bhy, cs))), _CMP_GT_OQ);
+	separated = _mm256_or_ps(separated, _mm256_cmp_ps(
+		_mm256_and_ps(absMask, _mm256_sub_ps(_mm256_mul_ps(dx, auy), _mm256_mul_ps(dy, aux))),
+		_mm256_add_ps(ahy, _mm256_add_ps(_mm256_mul_ps(bhx, cs), _mm256_mul_ps(bhy, cc))), _CMP_GT_OQ));
+	separated = _mm256_or_ps(separated, _mm256_cmp_ps(
+		_mm256_and_ps(absMask, _mm256_add_ps(_mm256_mul_ps(dx, bux), _mm256_mul_ps(dy, buy))),
+		_mm256_add_ps(bhx, _mm256_add_ps(_mm256_mul_ps(ahx, cc), _mm256_mul_ps(ahy, cs))), _CMP_GT_OQ));
+	separated = _mm256_or_ps(separated, _mm256_cmp_ps(
+		_mm256_and_ps(absMask, _mm256_sub_ps(_mm256_mul_ps(dx, buy), _mm256_mul_ps(dy, bux))),
+		_mm256_add_ps(bhy, _mm256_add_ps(_mm256_mul_ps(ahx, cs), _mm256_mul_ps(ahy, cc))), _CMP_GT_OQ));
+	return separated;
+}
+#endif
+
+// Keeps only the bits for the boxes that were asked for
+static inline uint32 MaskCount(uint32 bits, int count)
+{
+	return (count >= 32 ? bits : bits & ((1u << count) - 1u));
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+OrientedBoxBatch::OrientedBoxBatch(int count)
+	: m_count(0)
+{
+	Resize(count);
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+int OrientedBoxBatch::GetCount() const
+{
+	return m_count;
+}
+
+OrientedBox OrientedBoxBatch::Get(int index) const
+{
+	OrientedBox box;
+	box.center = Vector2f(m_centerX[index], m_centerY[index]);
+	box.axis = Vector2f(m_axisX[index], m_axisY[index]);
+	box.halfSize = Vector2f(m_halfSizeX[index], m_halfSizeY[index]);
+	return box;
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+void OrientedBoxBatch::Resize(int count)
+{
+	m_count = count;
+	int size = count + ORIENTED_BOX_PADDING;
+	m_centerX.resize(size, 0.0f);
+	m_centerY.resize(size, 0.0f);
+	m_axisX.resize(size, 1.0f);
+	m_axisY.resize(size, 0.0f);
+	m_halfSizeX.resize(size, 0.0f);
+	m_halfSizeY.resize(size, 0.0f);
+}
+
+void OrientedBoxBatch::Set(int index, const OrientedBox& box)
+{
+	m_centerX[index] = box.center.x;
+	m_centerY[index] = box.center.y;
+	m_axisX[index] = box.axis.x;
+	m_axisY[index] = box.axis.y;
+	m_halfSizeX[index] = box.halfSize.x;
+	m_halfSizeY[index] = box.halfSize.y;
+}
+
+
+//-----------------------------------------------------------------------------
+// Overlap Tests
+//-----------------------------------------------------------------------------
+
+bool OrientedBoxBatch::Overlap(const OrientedBox& a, const OrientedBox& b)
+{
+	return OverlapLane(
+		a.center.x, a.center.y, a.axis.x, a.axis.y, a.halfSize.x, a.halfSize.y,
+		b.center.x, b.center.y, b.axis.x, b.axis.y, b.halfSize.x, b.halfSize.y);
+}
+
+uint32 OrientedBoxBatch::Overlap(const OrientedBox& box,
+	const OrientedBoxBatch& batch, int begin, int count)
+{
+#ifdef ORIENTED_BOX_SSE
+	CMG_ASSERT(count <= ORIENTED_BOX_MAX_TEST_COUNT);
+	uint32 separated = 0;
+	int i = 0;
+#ifdef ORIENTED_BOX_AVX
+	{
+		__m256 ax = _mm256_set1_ps(box.center.x);
+		__m256 ay = _mm256_set1_ps(box.center.y);
+		__m256 aux = _mm256_set1_ps(box.axis.x);
+		__m256 auy = _mm256_set1_ps(box.axis.y);
+		__m256 ahx = _mm256_set1_ps(box.halfSize.x);
+		__m256 ahy = _mm256_set1_ps(box.halfSize.y);
+		for (; i + 4 < count; i += 8)
+		{
+			int index = begin + i;
+			__m256 mask = SeparatedAVX(ax, ay, aux, auy, ahx, ahy,
+				_mm256_loadu_ps(&batch.m_centerX[index]),
+				_mm256_loadu_ps(&batch.m_centerY[index]),
+				_mm256_loadu_ps(&batch.m_axisX[index]),
+				_mm256_loadu_ps(&batch.m_axisY[index]),
+				_mm256_loadu_ps(&batch.m_halfSizeX[index]),
+				_mm256_loadu_ps(&batch.m_halfSizeY[index]));
+			separated |= (uint32) _mm256_movemask_ps(mask) << i;
+		}
+	}
+#endif
+	__m128 ax = _mm_set1_ps(box.center.x);
+	__m128 ay = _mm_set1_ps(box.center.y);
+	__m128 aux = _mm_set1_ps(box.axis.x);
+	__m128 auy = _mm_set1_ps(box.axis.y);
+	__m128 ahx = _mm_set1_ps(box.halfSize.x);
+	__m128 ahy = _mm_set1_ps(box.halfSize.y);
+	for (; i < count; i += 4)
+	{
+		int index = begin + i;
+		__m128 mask = SeparatedSSE(ax, ay, aux, auy, ahx, ahy,
+			_mm_loadu_ps(&batch.m_centerX[index]),
+			_mm_loadu_ps(&batch.m_centerY[index]),
+			_mm_loadu_ps(&batch.m_axisX[index]),
+			_mm_loadu_ps(&batch.m_axisY[index]),
+			_mm_loadu_ps(&batch.m_halfSizeX[index]),
+			_mm_loadu_ps(&batch.m_halfSizeY[index]));
+		separated |= (uint32) _mm_movemask_ps(mask) << i;
+	}
+	return MaskCount(~separated, count);
+#else
+	return OverlapScalar(box, batch, begin, count);
+#endif
+}
+
+uint32 OrientedBoxBatch::OverlapScalar(const OrientedBox& box,
+	const OrientedBoxBatch& batch, int begin, int count)
+{
+	CMG_ASSERT(count <= ORIENTED_BOX_MAX_TEST_COUNT);
+	uint32 overlaps = 0;
+	for (int i = 0; i < count; i++)
+	{
+		int index = begin + i;
+		if (OverlapLane(
+			box.center.x, box.center.y, box.axis.x, box.axis.y,
+			box.halfSize.x, box.halfSize.y,
+			batch.m_centerX[index], batch.m_centerY[index],
+			batch.m_axisX[index], batch.m_axisY[index],
+			batch.m_halfSizeX[index], batch.m_halfSizeY[index]))
+			overlaps |= (1u << i);
+	}
+	return overlaps;
+}
+
+uint32 OrientedBoxBatch::OverlapPairs(const OrientedBoxBatch& a, int aBegin,
+	const OrientedBoxBatch& b, int bBegin, int count)
+{
+#ifdef ORIENTED_BOX_SSE
+	CMG_ASSERT(count <= ORIENTED_BOX_MAX_TEST_COUNT);
+	uint32 separated = 0;
+	int i = 0;
+#ifdef ORIENTED_BOX_AVX
+	for (; i + 4 < count; i += 8)
+	{
+		int ai = aBegin + i;
+		int bi = bBegin + i;
+		__m256 mask = SeparatedAVX(
+			_mm256_loadu_ps(&a.m_centerX[ai]),
+			_mm256_loadu_ps(&a.m_centerY[ai]),
+			_mm256_loadu_ps(&a.m_axisX[ai]),
+			_mm256_loadu_ps(&a.m_axisY[ai]),
+			_mm256_loadu_ps(&a.m_halfSizeX[ai]),
+			_mm256_loadu_ps(&a.m_halfSizeY[ai]),
+			_mm256_loadu_ps(&b.m_centerX[bi]),
+			_mm256_loadu_ps(&b.m_centerY[bi]),
+			_mm256_loadu_ps(&b.m_axisX[bi]),
+			_mm256_loadu_ps(&b.m_axisY[bi]),
+			_mm256_loadu_ps(&b.m_halfSizeX[bi]),
+			_mm256_loadu_ps(&b.m_halfSizeY[bi]));
+		separated |= (uint32) _mm256_movemask_ps(mask) << i;
+	}
+#endif
+	for (; i < count; i += 4)
+	{
+		int ai = aBegin + i;
+		int bi = bBegin + i;
+		__m128 mask = SeparatedSSE(
+			_mm_loadu_ps(&a.m_centerX[ai]),
+			_mm_loadu_ps(&a.m_centerY[ai]),
+			_mm_loadu_ps(&a.m_axisX[ai]),
+			_mm_loadu_ps(&a.m_axisY[ai]),
+			_mm_loadu_ps(&a.m_halfSizeX[ai]),
+			_mm_loadu_ps(&a.m_halfSizeY[ai]),
+			_mm_loadu_ps(&b.m_centerX[bi]),
+			_mm_loadu_ps(&b.m_centerY[bi]),
+			_mm_loadu_ps(&b.m_axisX[bi]),
+			_mm_loadu_ps(&b.m_axisY[bi]),
+			_mm_loadu_ps(&b.m_halfSizeX[bi]),
+			_mm_loadu_ps(&b.m_halfSizeY[bi]));
+		separated |= (uint32) _mm_movemask_ps(mask) << i;
+	}
+	return MaskCount(~separated, count);
+#else
+	return OverlapPairsScalar(a, aBegin, b, bBegin, count);
+#endif
+}
+
+uint32 OrientedBoxBatch::OverlapPairsScalar(const OrientedBoxBatch& a, int aBegin,
+	const OrientedBoxBatch& b, int bBegin, int count)
+{
+	CMG_ASSERT(count <= ORIENTED_BOX_MAX_TEST_COUNT);
+	uint32 overlaps = 0;
+	for (int i = 0; i < count; i++)
+	{
+		int ai = aBegin + i;
+		int bi = bBegin + i;
+		if (OverlapLane(
+			a.m_centerX[ai], a.m_centerY[ai], a.m_axisX[ai], a.m_axisY[ai],
+			a.m_halfSizeX[ai], a.m_halfSizeY[ai],
+			b.m_centerX[bi], b.m_centerY[bi], b.m_axisX[bi], b.m_axisY[bi],
+			b.m_halfSizeX[bi], b.m_halfSizeY[bi]))
+			overlaps |= (1u << i);
+	}
+	return overlaps;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include <cmgMath/cmg_math.h>
+#include "CommonTypes.h"
+
+// The widest batch of boxes which can be tested in one call
+constexpr auto ORIENTED_BOX_MAX_TEST_COUNT = 32;
+
+
+//-----------------------------------------------------------------------------
+// Struct:  OrientedBox
+// Purpose: 2D box given by its center, the unit direction of its x axis, and
+//          its half size along its own axes.
+//-----------------------------------------------------------------------------
+struct OrientedBox
+{
+	Vector2f center;
+	Vector2f axis;
+	Vector2f halfSize;
+};
+
+
+//-----------------------------------------------------------------------------
+// Class:   OrientedBoxBatch
+// Purpose: Boxes stored as separate arrays of each component, so that
+//          overlap tests can run over several boxes at once with SSE or AVX.
+//          The arrays are padded past the last box, so a test may always
+//          read a full set of SIMD lanes.
+//
+//          Define ROAD_MIND_NO_SIMD to always use the scalar tests. Both
+//          paths do the same float operations in the same order, so they
+//          give the same results.
+//-----------------------------------------------------------------------------
+class OrientedBoxBatch
+{
+public:
+	// Constructors
+
+	OrientedBoxBatch(int count = 0);
+
+	// Getters
+
+	int GetCount() const;
+	OrientedBox Get(int index) const;
+
+	// Setters
+
+	void Resize(int count);
+	void Set(int index, const OrientedBox& box);
+
+	// Overlap tests. Each returns one bit per tested box, set for the boxes
+	// that overlap, starting at bit zero for box 'begin'.
+
+	static bool Overlap(const OrientedBox& a, const OrientedBox& b);
+	static uint32 Overlap(const OrientedBox& box,
+		const OrientedBoxBatch& batch, int begin, int count);
+	static uint32 OverlapScalar(const OrientedBox& box,
+		const OrientedBoxBatch& batch, int begin, int count);
+	static uint32 OverlapPairs(const OrientedBoxBatch& a, int aBegin,
+		const OrientedBoxBatch& b, int bBegin, int count);
+	static uint32 OverlapPairsScalar(const OrientedBoxBatch& a, int aBegin,
+		const OrientedBoxBatch& b, int bBegin, int count);
+
+private:
+	int m_count;
+	Array<float> m_centerX;
+	Array<float> m_centerY;
+	Array<float> m_axisX;
+	Array<float> m_axisY;
+	Array<float> m_halfSizeX;
+	Array<float> m_halfSizeY;
+};
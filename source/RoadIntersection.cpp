@@ -1,6 +1,10 @@
 #include "RoadIntersection.h"
 #include "NodeGroupConnection.h"
+#include "Driver.h"
+#include "RoadNetworkFile.h"
 #include <algorithm>
+#include <climits>
+#include <cmath>
 
 
 //-----------------------------------------------------------------------------
@@ -9,6 +13,8 @@
 
 RoadIntersection::RoadIntersection()
 	: m_trafficLightProgram(nullptr)
+	, m_drivingLinesHash(0)
+	, m_conflictsHash(0)
 {
 }
 
@@ -29,6 +35,11 @@ RoadIntersection::~RoadIntersection()
 // Getters
 //-----------------------------------------------------------------------------
 
+int RoadIntersection::GetId() const
+{
+	return m_id;
+}
+
 Vector2f RoadIntersection::GetCenterPosition() const
 {
 	return m_centerPosition;
@@ -49,6 +60,53 @@ const TrafficLightProgram* RoadIntersection::GetTrafficLightProgram() const
 	return m_trafficLightProgram;
 }
 
+TrafficLightProgram* RoadIntersection::GetTrafficLightProgram()
+{
+	return m_trafficLightProgram;
+}
+
+const RoadCurveLine& RoadIntersection::GetDrivingLine(
+	const NodeRef& fromNode, const NodeRef& toNode)
+{
+	auto key = std::make_pair(fromNode, toNode);
+	auto it = m_drivingLines.find(key);
+	if (it != m_drivingLines.end())
+		return it->second;
+	RoadCurveLine& drivingLine = m_drivingLines[key];
+	drivingLine = CreateDrivingLine(fromNode.Get(), toNode.Get());
+	return drivingLine;
+}
+
+const RoadCurveLine* RoadIntersection::FindDrivingLine(
+	const NodeRef& fromNode, const NodeRef& toNode) const
+{
+	auto it = m_drivingLines.find(std::make_pair(fromNode, toNode));
+	return (it != m_drivingLines.end() ? &it->second : nullptr);
+}
+
+int RoadIntersection::GetMovementCount() const
+{
+	return (int) m_movementIndices.size();
+}
+
+int RoadIntersection::GetMovementIndex(
+	const NodeRef& fromNode, const NodeRef& toNode) const
+{
+	auto it = m_movementIndices.find(std::make_pair(fromNode, toNode));
+	return (it != m_movementIndices.end() ? it->second : -1);
+}
+
+const RoadIntersectionConflict* RoadIntersection::GetConflict(
+	int movement, int otherMovement) const
+{
+	int count = GetMovementCount();
+	if (movement < 0 || movement >= count ||
+		otherMovement < 0 || otherMovement >= count)
+		return nullptr;
+	int index = m_conflictMatrix[(movement * count) + otherMovement];
+	return (index >= 0 ? &m_conflicts[index] : nullptr);
+}
+
 
 //-----------------------------------------------------------------------------
 // Setters
@@ -67,6 +125,7 @@ TrafficLightProgram* RoadIntersection::CreateTrafficLightProgram()
 			for (int j = 0; j < group->GetNumNodes(); j++)
 			{
 				Node* node = group->GetNode(j);
+				m_trafficLightProgram->AddNode(node);
 				phase.AddTrigger(node);
 				phase.SetSignal(node, TrafficLightSignal::GO);
 			}
@@ -131,6 +190,7 @@ void RoadIntersection::Construct(const Set<NodeGroup*>& nodeGroups)
 	}
 
 	CreateTrafficLightProgram();
+	m_isGeometryDirty = true;
 }
 
 RoadIntersectionPoint* RoadIntersection::AddPoint(NodeGroup* group, IOType type)
@@ -150,7 +210,46 @@ RoadIntersectionPoint* RoadIntersection::AddPoint(NodeGroup* group, IOType type)
 void RoadIntersection::Update(Seconds dt)
 {
 	if (m_trafficLightProgram != nullptr)
+	{
+		UpdateDetectors();
 		m_trafficLightProgram->Udpate(dt);
+		m_trafficLightProgram->ClearDetectors();
+	}
+}
+
+void RoadIntersection::UpdateDetectors()
+{
+	// Count the drivers near the end of each approach lane, as a loop
+	// detector placed before the stop line of the connection leading into
+	// the intersection would. Counts are cleared after each update, so
+	// detections added in between (by the mesoscopic system) are kept.
+	if (m_trafficLightProgram->GetMode() == TrafficLightMode::FIXED_TIME)
+		return;
+	for (RoadIntersectionPoint* point : m_points)
+	{
+		if (point->GetIOType() != IOType::INPUT)
+			continue;
+		NodeGroup* group = point->GetNodeGroup();
+		for (NodeGroupConnection* connection : group->GetInputs())
+		{
+			// Lanes are sorted, so stop at the first driver out of range
+			for (int i = 0; i < connection->GetLaneCount(); i++)
+			{
+				const RoadSurfaceLane& lane = connection->GetLane(i);
+				if (lane.endNode.group != group || lane.endNode.Get() == nullptr)
+					continue;
+				for (Driver* driver = lane.front; driver != nullptr;
+					driver = driver->GetDriverBehind())
+				{
+					const DriverPath& path = driver->GetPath();
+					Meters distance = path.GetEndDistance(0) - driver->GetDistance();
+					if (distance > TRAFFIC_LIGHT_DETECTOR_LENGTH)
+						break;
+					m_trafficLightProgram->AddDetection(lane.endNode.Get());
+				}
+			}
+		}
+	}
 }
 
 void RoadIntersection::UpdateGeometry()
@@ -218,23 +317,7 @@ void RoadIntersection::UpdateGeometry()
 		//	*edgeLines[k] = arcs[k];
 		//}
 
-		edge->m_shoulderEdge = shoulderEdge;
-		edge->m_laneEdge  = laneEdge;
-		if (shoulderEdge.first.IsStraight())
-		{
-			edge->m_line = &edge->m_shoulderEdge.first;
-			edge->m_arc = &edge->m_shoulderEdge.second;
-		}
-		else
-		{
-			edge->m_arc = &edge->m_shoulderEdge.first;
-			edge->m_line = &edge->m_shoulderEdge.second;
-		}
-
-		//edge.m_arc.
-		BiarcPair split = BiarcPair::Split(*edge->m_arc);
-		edge->m_halfArcs[0] = split.first;
-		edge->m_halfArcs[1] = split.second.Reverse();
+		edge->SetCurves(shoulderEdge, laneEdge);
 	}
 
 	//for (unsigned int i = 0; i < m_edges.size(); i++)
@@ -244,4 +327,239 @@ void RoadIntersection::UpdateGeometry()
 
 
 	//}
+
+	// Signal slots are held by lane index, so lanes added to or removed
+	// from an approach need a new program
+	if (m_trafficLightProgram != nullptr && IsTrafficLightProgramStale())
+		CreateTrafficLightProgram();
+
+	UpdateDrivingLines();
+	UpdateConflicts();
+	m_isGeometryDirty = false;
+}
+
+bool RoadIntersection::IsTrafficLightProgramStale() const
+{
+	int laneCount = 0;
+	for (RoadIntersectionPoint* point : m_points)
+	{
+		if (point->GetIOType() != IOType::INPUT)
+			continue;
+		NodeGroup* group = point->GetNodeGroup();
+		for (int i = 0; i < group->GetNumNodes(); i++)
+		{
+			if (!m_trafficLightProgram->HasSlot(group->GetNode(i)))
+				return true;
+		}
+		laneCount += group->GetNumNodes();
+	}
+	return (laneCount != m_trafficLightProgram->GetSlotCount());
+}
+
+void RoadIntersection::UpdateDrivingLines()
+{
+	// Recompute the line for every input node to output node pair. Each
+	// line depends only on the ends of its two lanes, which are hashed to
+	// tell when the conflicts between the lines need finding again.
+	Set<std::pair<NodeRef, NodeRef>> keys;
+	uint64 hash = ROAD_NETWORK_FILE_HASH_SEED;
+	for (RoadIntersectionPoint* input : m_points)
+	{
+		if (input->GetIOType() != IOType::INPUT)
+			continue;
+		NodeGroup* inputGroup = input->GetNodeGroup();
+		for (RoadIntersectionPoint* output : m_points)
+		{
+			if (output->GetIOType() != IOType::OUTPUT)
+				continue;
+			NodeGroup* outputGroup = output->GetNodeGroup();
+			for (int i = 0; i < inputGroup->GetNumNodes(); i++)
+			{
+				for (int j = 0; j < outputGroup->GetNumNodes(); j++)
+				{
+					Node* fromNode = inputGroup->GetNode(i);
+					Node* toNode = outputGroup->GetNode(j);
+					auto key = std::make_pair(NodeRef(fromNode), NodeRef(toNode));
+					m_drivingLines[key] = CreateDrivingLine(fromNode, toNode);
+					keys.insert(key);
+					Vector3f from = fromNode->GetCenter();
+					Vector3f to = toNode->GetCenter();
+					Vector2f fromDirection = fromNode->GetDirection();
+					Vector2f toDirection = toNode->GetDirection();
+					hash = HashFileValue((uint64) (uintptr_t) inputGroup, hash);
+					hash = HashFileValue(inputGroup->GetLaneGeneration(), hash);
+					hash = HashFileValue((uint64) (uintptr_t) outputGroup, hash);
+					hash = HashFileValue(outputGroup->GetLaneGeneration(), hash);
+					hash = HashFileValue((uint64) ((i << 16) | j), hash);
+					hash = HashFileFloats({ from.x, from.y, from.z,
+						fromDirection.x, fromDirection.y, to.x, to.y, to.z,
+						toDirection.x, toDirection.y }, hash);
+				}
+			}
+		}
+	}
+
+	// Remove lines for nodes which are no longer part of the intersection
+	for (auto it = m_drivingLines.begin(); it != m_drivingLines.end();)
+	{
+		if (keys.find(it->first) == keys.end())
+			it = m_drivingLines.erase(it);
+		else
+			it++;
+	}
+	m_drivingLinesHash = hash;
+}
+
+void RoadIntersection::UpdateConflicts()
+{
+	// Moving a road elsewhere in the network dirties every intersection it
+	// reaches, so only search again if the driving lines changed
+	if (m_conflictsHash == m_drivingLinesHash &&
+		m_movementIndices.size() == m_drivingLines.size())
+		return;
+	m_conflictsHash = m_drivingLinesHash;
+
+	// Sample each driving line at even spacing, and find its bounds, and
+	// those of each chunk of a few samples
+	struct Chunk
+	{
+		int begin; // Into the line's samples
+		int end;
+		Vector2f boundsMin;
+		Vector2f boundsMax;
+	};
+	int count = (int) m_drivingLines.size();
+	Array<Array<Vector2f>> points(count);
+	Array<Array<Chunk>> chunks(count);
+	Array<Meters> spacing(count);
+	Array<Vector2f> boundsMin(count);
+	Array<Vector2f> boundsMax(count);
+	m_movementIndices.clear();
+	int index = 0;
+	for (auto it = m_drivingLines.begin(); it != m_drivingLines.end(); it++, index++)
+	{
+		m_movementIndices[it->first] = index;
+		Meters length = it->second.Length();
+		int sampleCount = Math::Max(1, (int) std::ceil(
+			length / INTERSECTION_CONFLICT_SAMPLE_SPACING));
+		spacing[index] = length / sampleCount;
+		for (int i = 0; i <= sampleCount; i++)
+		{
+			Vector2f point = it->second.GetPoint(i * spacing[index]).xy;
+			if (i % INTERSECTION_CONFLICT_CHUNK_SIZE == 0)
+			{
+				Chunk chunk;
+				chunk.begin = i;
+				chunk.boundsMin = point;
+				chunk.boundsMax = point;
+				chunks[index].push_back(chunk);
+			}
+			Chunk& chunk = chunks[index].back();
+			chunk.end = i + 1;
+			chunk.boundsMin.x = Math::Min(chunk.boundsMin.x, point.x);
+			chunk.boundsMin.y = Math::Min(chunk.boundsMin.y, point.y);
+			chunk.boundsMax.x = Math::Max(chunk.boundsMax.x, point.x);
+			chunk.boundsMax.y = Math::Max(chunk.boundsMax.y, point.y);
+			points[index].push_back(point);
+		}
+		boundsMin[index] = chunks[index][0].boundsMin;
+		boundsMax[index] = chunks[index][0].boundsMax;
+		for (const Chunk& chunk : chunks[index])
+		{
+			boundsMin[index].x = Math::Min(boundsMin[index].x, chunk.boundsMin.x);
+			boundsMin[index].y = Math::Min(boundsMin[index].y, chunk.boundsMin.y);
+			boundsMax[index].x = Math::Max(boundsMax[index].x, chunk.boundsMax.x);
+			boundsMax[index].y = Math::Max(boundsMax[index].y, chunk.boundsMax.y);
+		}
+	}
+
+	// The conflict zone of two lines spans the samples of each which come
+	// within the clearance of the other. This covers lines which cross as
+	// well as lines which merge or split apart. Chunks whose bounds are too
+	// far apart are skipped, and chunks whose bounds are close throughout
+	// count whole, so samples are only compared where the lines come to
+	// the edge of the clearance.
+	const Meters clearance = INTERSECTION_CONFLICT_CLEARANCE;
+	m_conflicts.clear();
+	m_conflictMatrix.assign(count * count, -1);
+	for (int a = 0; a < count; a++)
+	{
+		for (int b = a + 1; b < count; b++)
+		{
+			if (boundsMin[a].x > boundsMax[b].x + clearance ||
+				boundsMin[b].x > boundsMax[a].x + clearance ||
+				boundsMin[a].y > boundsMax[b].y + clearance ||
+				boundsMin[b].y > boundsMax[a].y + clearance)
+				continue;
+
+			int enterA = INT_MAX, exitA = -1;
+			int enterB = INT_MAX, exitB = -1;
+			for (const Chunk& chunkA : chunks[a])
+			{
+				for (const Chunk& chunkB : chunks[b])
+				{
+					Vector2f gap(
+						Math::Max(0.0f, Math::Max(chunkA.boundsMin.x - chunkB.boundsMax.x,
+							chunkB.boundsMin.x - chunkA.boundsMax.x)),
+						Math::Max(0.0f, Math::Max(chunkA.boundsMin.y - chunkB.boundsMax.y,
+							chunkB.boundsMin.y - chunkA.boundsMax.y)));
+					if (gap.x * gap.x + gap.y * gap.y >= clearance * clearance)
+						continue;
+					Vector2f span(
+						Math::Max(chunkA.boundsMax.x - chunkB.boundsMin.x,
+							chunkB.boundsMax.x - chunkA.boundsMin.x),
+						Math::Max(chunkA.boundsMax.y - chunkB.boundsMin.y,
+							chunkB.boundsMax.y - chunkA.boundsMin.y));
+					if (span.x * span.x + span.y * span.y < clearance * clearance)
+					{
+						enterA = Math::Min(enterA, chunkA.begin);
+						exitA = Math::Max(exitA, chunkA.end - 1);
+						enterB = Math::Min(enterB, chunkB.begin);
+						exitB = Math::Max(exitB, chunkB.end - 1);
+						continue;
+					}
+					for (int i = chunkA.begin; i < chunkA.end; i++)
+					{
+						for (int j = chunkB.begin; j < chunkB.end; j++)
+						{
+							if (points[a][i].DistToSqr(points[b][j]) < clearance * clearance)
+							{
+								enterA = Math::Min(enterA, i);
+								exitA = Math::Max(exitA, i);
+								enterB = Math::Min(enterB, j);
+								exitB = Math::Max(exitB, j);
+							}
+						}
+					}
+				}
+			}
+			if (exitA < 0)
+				continue;
+
+			RoadIntersectionConflict conflict;
+			conflict.enter = enterA * spacing[a];
+			conflict.exit = exitA * spacing[a];
+			conflict.otherEnter = enterB * spacing[b];
+			conflict.otherExit = exitB * spacing[b];
+			m_conflictMatrix[(a * count) + b] = (int) m_conflicts.size();
+			m_conflicts.push_back(conflict);
+			std::swap(conflict.enter, conflict.otherEnter);
+			std::swap(conflict.exit, conflict.otherExit);
+			m_conflictMatrix[(b * count) + a] = (int) m_conflicts.size();
+			m_conflicts.push_back(conflict);
+		}
+	}
+}
+
+RoadCurveLine RoadIntersection::CreateDrivingLine(Node* fromNode, Node* toNode)
+{
+	RoadCurveLine drivingLine;
+	drivingLine.horizontalCurve = BiarcPair::Interpolate(
+		fromNode->GetCenter().xy, fromNode->GetDirection(),
+		toNode->GetCenter().xy, toNode->GetDirection());
+	drivingLine.verticalCurve = VerticalCurve(
+		fromNode->GetCenter().z, toNode->GetCenter().z);
+	drivingLine.verticalCurve.LinearInterpolatation(
+		drivingLine.horizontalCurve.Length());
+	return drivingLine;
 }
@@ -6,6 +6,7 @@
 #include "NodeGroup.h"
 #include "RoadSurface.h"
 #include "TrafficLight.h"
+#include "RoadCurves.h"
 #include <set>
 
 class Connection;
@@ -14,6 +15,25 @@ class NodeGroupConnection;
 class RoadIntersectionPoint;
 
 
+// Closest two driving lines can pass without vehicles on them touching
+constexpr Meters INTERSECTION_CONFLICT_CLEARANCE = 3.0f;
+constexpr Meters INTERSECTION_CONFLICT_SAMPLE_SPACING = 0.5f;
+constexpr auto INTERSECTION_CONFLICT_CHUNK_SIZE = 8; // Samples bounded together
+
+
+//-----------------------------------------------------------------------------
+// Struct:  RoadIntersectionConflict
+// Purpose: Stretch of two movements' driving lines, as distances along each
+//          line, where vehicles on the one could hit vehicles on the other.
+//-----------------------------------------------------------------------------
+struct RoadIntersectionConflict
+{
+	Meters enter; // Along the first movement's line
+	Meters exit;
+	Meters otherEnter; // Along the second movement's line
+	Meters otherExit;
+};
+
 class RoadIntersectionEdge
 {
 	friend class RoadIntersection;
@@ -52,6 +72,25 @@ public:
 		return m_laneEdge;
 	}
 
+	inline void SetCurves(const BiarcPair& shoulderEdge, const BiarcPair& laneEdge)
+	{
+		m_shoulderEdge = shoulderEdge;
+		m_laneEdge = laneEdge;
+		if (m_shoulderEdge.first.IsStraight())
+		{
+			m_line = &m_shoulderEdge.first;
+			m_arc = &m_shoulderEdge.second;
+		}
+		else
+		{
+			m_arc = &m_shoulderEdge.first;
+			m_line = &m_shoulderEdge.second;
+		}
+		BiarcPair split = BiarcPair::Split(*m_arc);
+		m_halfArcs[0] = split.first;
+		m_halfArcs[1] = split.second.Reverse();
+	}
+
 private:
 public:
 	RoadIntersectionPoint* m_points[2];
@@ -126,10 +165,17 @@ public:
 	~RoadIntersection();
 
 	// Getters
+	int GetId() const;
 	Vector2f GetCenterPosition() const;
 	Array<RoadIntersectionPoint*>& GetPoints();
 	Array<RoadIntersectionEdge*>& GetEdges();
 	const TrafficLightProgram* GetTrafficLightProgram() const;
+	TrafficLightProgram* GetTrafficLightProgram();
+	const RoadCurveLine& GetDrivingLine(const NodeRef& fromNode, const NodeRef& toNode);
+	const RoadCurveLine* FindDrivingLine(const NodeRef& fromNode, const NodeRef& toNode) const;
+	int GetMovementCount() const;
+	int GetMovementIndex(const NodeRef& fromNode, const NodeRef& toNode) const;
+	const RoadIntersectionConflict* GetConflict(int movement, int otherMovement) const;
 
 	// Setters
 	TrafficLightProgram* CreateTrafficLightProgram();
@@ -141,6 +187,11 @@ public:
 private:
 	void Construct(const Set<NodeGroup*>& nodeGroups);
 	RoadIntersectionPoint* AddPoint(NodeGroup* group, IOType type);
+	bool IsTrafficLightProgramStale() const;
+	void UpdateDrivingLines();
+	void UpdateConflicts();
+	void UpdateDetectors();
+	static RoadCurveLine CreateDrivingLine(Node* fromNode, Node* toNode);
 
 	int m_id;
 	Vector2f m_centerPosition;
@@ -149,5 +200,19 @@ private:
 	// Sorted in clockwise order
 	Array<RoadIntersectionPoint*> m_points;
 	Array<RoadIntersectionEdge*> m_edges;
+
+	// Driving lines from input nodes to output nodes. Entries are updated
+	// in place, but the lines of lanes which left the intersection are
+	// erased, so drivers look their lines up again after each change.
+	Map<std::pair<NodeRef, NodeRef>, RoadCurveLine> m_drivingLines;
+	uint64 m_drivingLinesHash; // Of the lanes the lines were made between
+	uint64 m_conflictsHash; // Driving lines hash the conflicts were found for
+
+	// Each driving line is a movement, numbered in the order of the map.
+	// The conflict matrix holds an index into the conflicts for each ordered
+	// pair of movements, or -1 if their lines never come close.
+	Map<std::pair<NodeRef, NodeRef>, int> m_movementIndices;
+	Array<int> m_conflictMatrix;
+	Array<RoadIntersectionConflict> m_conflicts;
 };
 
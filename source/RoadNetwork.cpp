@@ -1,6 +1,7 @@
 #include "RoadNetwork.h"
 #include <map>
 #include <algorithm>
+#include <cmath>
 
 
 //-----------------------------------------------------------------------------
@@ -8,7 +9,10 @@
 //-----------------------------------------------------------------------------
 
 RoadNetwork::RoadNetwork(ECS& ecs):
-	m_ecs(ecs)
+	m_ecs(ecs),
+	m_isLaneGraphDirty(true),
+	m_trafficLightMode(TrafficLightMode::FIXED_TIME),
+	m_signalCycleTime(0.0f)
 {
 	m_nodeGroupConnectionIdCounter = 1;
 	m_intersectionIdCounter = 1;
@@ -39,52 +43,34 @@ void RoadNetwork::ClearNodes()
 	m_intersectionIdCounter = 1;
 	m_nodeGroupIdCounter = 1;
 	m_tieIdCounter = 1;
-
-	for (RoadIntersection* intersection : m_intersections)
-		delete intersection;
-	m_intersections.clear();
-	for (NodeGroupConnection* surface : m_nodeGroupConnections)
-		delete surface;
-	m_nodeGroupConnections.clear();
-	for (NodeGroupTie* tie : m_nodeGroupTies)
-		delete tie;
-	m_nodeGroupTies.clear();
-	for (NodeGroup* nodeGroup : m_nodeGroups)
-		delete nodeGroup;
-	m_nodeGroups.clear();
+	m_signalCycleTime = 0.0f;
+
+	m_intersections.Clear();
+	m_nodeGroupConnections.Clear();
+	m_nodeGroupTies.Clear();
+	m_nodeGroups.Clear();
+	m_laneGraph.Clear();
+	m_isLaneGraphDirty = true;
 }
 
 NodeGroup* RoadNetwork::CreateNodeGroup(const Vector3f& position,
 	const Vector2f& direction, int laneCount)
 {
 	// Construct the node group
-	NodeGroup* group = new NodeGroup();
+	NodeGroup* group = m_nodeGroups.Create();
 	group->m_id = m_nodeGroupIdCounter++;
 	group->m_metrics = &m_metrics;
 	group->m_position = position;
 	group->m_direction = direction;
 	group->m_leftShoulderWidth = m_metrics.laneWidth * 0.25f;
 	group->m_rightShoulderWidth = m_metrics.laneWidth * 0.25f;
-	m_nodeGroups.insert(group);
+	m_isLaneGraphDirty = true;
 
-	// Create the left-most node
-	Node* node = new Node();
-	node->m_nodeGroup = group;
-	node->m_width = m_metrics.laneWidth;
-	node->m_index = 0;
-	group->m_nodes.push_back(node);
-
-	// Add nodes to the right
-	Node* prev = node;
-	for (int i = 1; i < laneCount; i++)
-	{
-		node = new Node();
-		node->m_index = i;
-		node->m_nodeGroup = group;
-		node->m_width = m_metrics.laneWidth;
-		prev = node;
-		group->m_nodes.push_back(node);
-	}
+	// Create the nodes, from left to right
+	group->m_nodes.resize(Math::Max(laneCount, 1));
+	for (Node& node : group->m_nodes)
+		node.m_width = m_metrics.laneWidth;
+	group->UpdateNodeIndices();
 
 	return group;
 }
@@ -92,10 +78,10 @@ NodeGroup* RoadNetwork::CreateNodeGroup(const Vector3f& position,
 RoadIntersection* RoadNetwork::CreateIntersection(
 	const Set<NodeGroup*>& nodeGroups)
 {
-	RoadIntersection* intersection = new RoadIntersection();
+	RoadIntersection* intersection = m_intersections.Create();
 	intersection->m_id = m_intersectionIdCounter++;
 	intersection->Construct(nodeGroups);
-	m_intersections.insert(intersection);
+	m_isLaneGraphDirty = true;
 	return intersection;
 }
 
@@ -126,24 +112,18 @@ bool RoadNetwork::GrowNodeGroup(NodeSubGroup& subGroup)
 
 Node* RoadNetwork::AddNodeToGroup(NodeGroup* group)
 {
-	Node* node = new Node();
-	node->m_width = m_metrics.laneWidth;
-	node->m_index = (int) group->m_nodes.size();
-	group->m_nodes.push_back(node);
-	return node;
+	AddNodesToGroup(group, 1);
+	return group->GetRightNode();
 }
 
 void RoadNetwork::AddNodesToGroup(NodeGroup* group, int count)
 {
-	for (int i = 0; i < count; i++)
-	{
-		Node* node = new Node();
-		node->m_width = m_metrics.laneWidth;
-		node->m_index = (int) group->m_nodes.size();
-		node->m_nodeGroup = group;
-
-		group->m_nodes.push_back(node);
-	}
+	Node node;
+	node.m_width = m_metrics.laneWidth;
+	group->m_nodes.insert(group->m_nodes.end(), count, node);
+	group->UpdateNodeIndices();
+	group->MarkGeometryDirty();
+	m_isLaneGraphDirty = true;
 }
 
 void RoadNetwork::AddNodesToLeftOfGroup(NodeGroup* group, int count)
@@ -159,18 +139,16 @@ void RoadNetwork::AddNodesToLeftOfGroup(NodeGroup* group, int count)
 		}
 	}
 
-	for (int i = 0; i < count; i++)
-	{
-		Node* node = new Node();
-		node->m_width = m_metrics.laneWidth;
-		node->m_index = (int) group->m_nodes.size();
-		node->m_nodeGroup = group;
-
-		group->m_nodes.insert(group->m_nodes.begin(), node);
+	Node node;
+	node.m_width = m_metrics.laneWidth;
+	group->m_nodes.insert(group->m_nodes.begin(), count, node);
+	group->UpdateNodeIndices();
+	group->m_laneGeneration++;
 
-		// Shift the node group's position
-		group->m_position.xy += group->GetLeftDirection() * node->m_width;
-	}
+	// Shift the node group's position
+	group->m_position.xy += group->GetLeftDirection() * (node.m_width * count);
+	group->MarkGeometryDirty();
+	m_isLaneGraphDirty = true;
 }
 
 void RoadNetwork::RemoveNodeFromGroup(NodeGroup* group, int count)
@@ -209,12 +187,9 @@ void RoadNetwork::RemoveNodeFromGroup(NodeGroup* group, int count)
 	}
 
 	// Delete the individual nodes from the group
-	for (int i = 0; i < count; i++)
-	{
-		Node* node = group->m_nodes.back();
-		group->m_nodes.pop_back();
-		delete node;
-	}
+	group->m_nodes.resize(group->m_nodes.size() - count);
+	group->MarkGeometryDirty();
+	m_isLaneGraphDirty = true;
 }
 
 NodeGroupConnection* RoadNetwork::ConnectNodeGroups(NodeGroup* from, NodeGroup* to)
@@ -254,20 +229,22 @@ NodeGroupConnection* RoadNetwork::ConnectNodeSubGroups(
 				connection->GetOutput().index, to.index);
 			connection->GetInput().count = end0 - connection->GetInput().index;
 			connection->GetOutput().count = end1 - connection->GetOutput().index;
+			connection->MarkGeometryDirty();
+			m_isLaneGraphDirty = true;
 			return connection;
 		}
 	}
 
 	// Construct the node group connection
-	NodeGroupConnection* connection = new NodeGroupConnection();
+	NodeGroupConnection* connection = m_nodeGroupConnections.Create();
 	connection->m_id = m_nodeGroupConnectionIdCounter++;
 	connection->SetInput(from);
 	connection->SetOutput(to);
 	connection->m_metrics = &m_metrics;
-	m_nodeGroupConnections.insert(connection);
 
 	from.group->InsertOutput(connection);
 	to.group->InsertInput(connection);
+	m_isLaneGraphDirty = true;
 
 	return connection;
 }
@@ -286,12 +263,11 @@ NodeGroupTie* RoadNetwork::TieNodeGroups(NodeGroup* a, NodeGroup* b)
 	}
 
 	// Construct the tie
-	NodeGroupTie* tie = new NodeGroupTie();
+	NodeGroupTie* tie = m_nodeGroupTies.Create();
 	tie->m_id = m_tieIdCounter++;
 	tie->m_position = b->m_position;
 	tie->m_direction = b->m_direction;
 	tie->m_nodeGroup = b;
-	m_nodeGroupTies.insert(tie);
 
 	// Link the two node groups to the tie
 	a->m_tie = tie;
@@ -300,18 +276,21 @@ NodeGroupTie* RoadNetwork::TieNodeGroups(NodeGroup* a, NodeGroup* b)
 	b->m_twin = a;
 	a->UpdateConnectionSorting();
 	b->UpdateConnectionSorting();
+	a->MarkGeometryDirty();
+	b->MarkGeometryDirty();
 	return tie;
 }
 
 void RoadNetwork::UntieNodeGroup(NodeGroup* nodeGroup)
 {
 	NodeGroupTie* tie = nodeGroup->m_tie;
+	nodeGroup->m_twin->MarkGeometryDirty();
+	nodeGroup->MarkGeometryDirty();
 	nodeGroup->m_twin->m_tie = nullptr;
 	nodeGroup->m_twin->m_twin = nullptr;
 	nodeGroup->m_tie = nullptr;
 	nodeGroup->m_twin = nullptr;
-	m_nodeGroupTies.erase(tie);
-	delete tie;
+	m_nodeGroupTies.Destroy(tie);
 }
 
 void RoadNetwork::DeleteNodeGroup(NodeGroup* nodeGroup)
@@ -331,8 +310,8 @@ void RoadNetwork::DeleteNodeGroup(NodeGroup* nodeGroup)
 		RemoveNodeGroupFromIntersection(nodeGroup);
 
 	// Delete the node group itself
-	m_nodeGroups.erase(nodeGroup);
-	delete nodeGroup;
+	m_nodeGroups.Destroy(nodeGroup);
+	m_isLaneGraphDirty = true;
 }
 
 void RoadNetwork::RemoveNodeGroupFromIntersection(NodeGroup* nodeGroup)
@@ -354,18 +333,28 @@ void RoadNetwork::RemoveNodeGroupFromIntersection(NodeGroup* nodeGroup)
 		}
 		intersection->Construct(groups);
 		nodeGroup->m_intersection = nullptr;
+		m_isLaneGraphDirty = true;
 	}
 }
 
 void RoadNetwork::DeleteIntersection(RoadIntersection* intersection)
 {
-	// Disconnect node groups from the intersection
+	// Disconnect node groups from the intersection. Their connections were
+	// trimmed against it, so they and their other intersections must be
+	// rebuilt.
 	for (RoadIntersectionPoint* point : intersection->GetPoints())
-		point->GetNodeGroup()->m_intersection = nullptr;
+	{
+		NodeGroup* group = point->GetNodeGroup();
+		if (group->m_intersection == intersection)
+			group->m_intersection = nullptr;
+		if (group->m_inputIntersection == intersection)
+			group->m_inputIntersection = nullptr;
+		group->MarkGeometryDirty();
+	}
 
 	// Delete the intersection itself
-	m_intersections.erase(intersection);
-	delete intersection;
+	m_intersections.Destroy(intersection);
+	m_isLaneGraphDirty = true;
 }
 
 void RoadNetwork::DeleteNodeGroupConnection(NodeGroupConnection* connection)
@@ -388,8 +377,8 @@ void RoadNetwork::DeleteNodeGroupConnection(NodeGroupConnection* connection)
 	output->RemoveInput(connection);
 
 	// Delete the node group connection itself
-	m_nodeGroupConnections.erase(connection);
-	delete connection;
+	m_nodeGroupConnections.Destroy(connection);
+	m_isLaneGraphDirty = true;
 }
 
 
@@ -402,48 +391,350 @@ const RoadMetrics& RoadNetwork::GetMetrics() const
 	return m_metrics;
 }
 
-Set<NodeGroup*>& RoadNetwork::GetNodeGroups()
+const LaneGraph& RoadNetwork::GetLaneGraph() const
+{
+	return m_laneGraph;
+}
+
+TrafficLightMode RoadNetwork::GetTrafficLightMode() const
+{
+	return m_trafficLightMode;
+}
+
+bool RoadNetwork::IsValid(const NodeRef& node) const
+{
+	// The group's slot may have been reused by a new group since
+	if (node.group == nullptr || !m_nodeGroups.Contains(node.group))
+		return false;
+	return (node.group->GetId() == node.groupId &&
+		node.group->GetLaneGeneration() == node.laneGeneration &&
+		node.index < node.group->GetNumNodes());
+}
+
+bool RoadNetwork::IsValid(const NodeGroupConnection* connection, int id) const
+{
+	return (m_nodeGroupConnections.Contains(connection) &&
+		connection->m_id == id);
+}
+
+bool RoadNetwork::IsValid(const RoadIntersection* intersection, int id) const
+{
+	return (m_intersections.Contains(intersection) &&
+		intersection->m_id == id);
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+void RoadNetwork::SetTrafficLightMode(TrafficLightMode mode)
+{
+	m_trafficLightMode = mode;
+	CoordinateTrafficLights();
+}
+
+ObjectPool<NodeGroup>& RoadNetwork::GetNodeGroups()
 {
 	return m_nodeGroups;
 }
 
-Set<NodeGroupTie*>& RoadNetwork::GetNodeGroupTies()
+ObjectPool<NodeGroupTie>& RoadNetwork::GetNodeGroupTies()
 {
 	return m_nodeGroupTies;
 }
 
-Set<NodeGroupConnection*>& RoadNetwork::GetNodeGroupConnections()
+ObjectPool<NodeGroupConnection>& RoadNetwork::GetNodeGroupConnections()
 {
 	return m_nodeGroupConnections;
 }
 
-Set<RoadIntersection*>& RoadNetwork::GetIntersections()
+ObjectPool<RoadIntersection>& RoadNetwork::GetIntersections()
 {
 	return m_intersections;
 }
 
 void RoadNetwork::UpdateNodeGeometry()
 {
+	// Ties position their node groups
 	for (NodeGroupTie* tie : m_nodeGroupTies)
-		tie->UpdateGeometry();
+	{
+		if (tie->IsGeometryDirty())
+		{
+			tie->UpdateGeometry();
+			tie->GetNodeGroup()->MarkGeometryDirty();
+			tie->GetNodeGroupTwin()->MarkGeometryDirty();
+		}
+	}
+
+	// Node groups affect the shape of their connections and intersections
 	for (NodeGroup* group : m_nodeGroups)
-		group->UpdateGeometry();
+	{
+		if (group->IsGeometryDirty())
+		{
+			group->UpdateGeometry();
+			for (int inOut = 0; inOut < 2; inOut++)
+			{
+				for (NodeGroupConnection* connection : group->m_connections[inOut])
+					connection->MarkGeometryDirty();
+			}
+			if (group->m_intersection != nullptr)
+				group->m_intersection->MarkGeometryDirty();
+			if (group->m_inputIntersection != nullptr)
+				group->m_inputIntersection->MarkGeometryDirty();
+		}
+	}
+
+	// Rebuild the shape of dirty connections
+	Array<NodeGroup*> groupsToVisit;
+	Set<NodeGroupConnection*> rebuiltConnections;
 	for (NodeGroupConnection* connection : m_nodeGroupConnections)
-		connection->UpdateGeometry();
-	for (NodeGroup* group : m_nodeGroups)
+	{
+		if (connection->IsGeometryDirty())
+		{
+			connection->UpdateGeometry();
+			rebuiltConnections.insert(connection);
+			m_isLaneGraphDirty = true;
+			groupsToVisit.push_back(connection->GetInput().group);
+			groupsToVisit.push_back(connection->GetOutput().group);
+		}
+	}
+
+	// Intersecting a node group's connections trims their lines at both
+	// ends, so any node group sharing a connection (or a tie) with one
+	// being redone must be redone too
+	Set<NodeGroup*> trimmedGroups;
+	Set<NodeGroupConnection*> trimmedConnections;
+	while (!groupsToVisit.empty())
+	{
+		NodeGroup* group = groupsToVisit.back();
+		groupsToVisit.pop_back();
+		if (trimmedGroups.find(group) != trimmedGroups.end())
+			continue;
+		trimmedGroups.insert(group);
+		if (group->m_twin != nullptr)
+			groupsToVisit.push_back(group->m_twin);
+		for (int inOut = 0; inOut < 2; inOut++)
+		{
+			for (NodeGroupConnection* connection : group->m_connections[inOut])
+			{
+				trimmedConnections.insert(connection);
+				groupsToVisit.push_back(connection->m_groups[inOut].group);
+			}
+		}
+	}
+
+	// Redo the trimming from the untrimmed lines
+	Map<NodeGroupConnection*, uint64> previousHashes;
+	for (NodeGroupConnection* connection : trimmedConnections)
+	{
+		previousHashes[connection] = connection->GetIntersectionGeometryHash();
+		connection->ResetIntersectionGeometry();
+	}
+	for (NodeGroup* group : trimmedGroups)
 		group->UpdateIntersectionGeometry();
-	for (NodeGroupConnection* connection : m_nodeGroupConnections)
+
+	// Only connections whose lines actually changed need new meshes
+	for (NodeGroupConnection* connection : trimmedConnections)
+	{
+		if (rebuiltConnections.find(connection) == rebuiltConnections.end() &&
+			connection->GetIntersectionGeometryHash() == previousHashes[connection])
+			continue;
+		m_isLaneGraphDirty = true;
+#ifndef ROAD_MIND_HEADLESS
 		connection->CreateMesh();
+#endif
+		for (int inOut = 0; inOut < 2; inOut++)
+		{
+			NodeGroup* group = connection->m_groups[inOut].group;
+			if (group->m_intersection != nullptr)
+				group->m_intersection->MarkGeometryDirty();
+			if (group->m_inputIntersection != nullptr)
+				group->m_inputIntersection->MarkGeometryDirty();
+
+			// A node group's slope depends on the lengths of its
+			// connections. Let it settle over the following frames.
+			if (group->CalcSlope() != group->m_slope)
+				group->MarkGeometryDirty();
+		}
+	}
+
 	for (RoadIntersection* intersection : m_intersections)
-		intersection->UpdateGeometry();
+	{
+		if (intersection->IsGeometryDirty())
+		{
+			intersection->UpdateGeometry();
+			m_isLaneGraphDirty = true;
+		}
+	}
+
+	// Recompile the lane graph after topology edits or when driving line
+	// lengths may have changed
+	if (m_isLaneGraphDirty)
+	{
+		m_laneGraph.Build(*this);
+		m_isLaneGraphDirty = false;
+		CoordinateTrafficLights();
+	}
 }
 
 void RoadNetwork::Simulate(Seconds dt)
 {
+	m_signalCycleTime += dt;
+	if (m_signalCycleTime >= TRAFFIC_LIGHT_CYCLE_LENGTH)
+		m_signalCycleTime -= TRAFFIC_LIGHT_CYCLE_LENGTH;
 	for (RoadIntersection* intersection : m_intersections)
 		intersection->Update(dt);
 }
 
+static RoadIntersection* FollowCorridor(NodeGroup* group,
+	Meters& outDistance, NodeGroup*& outApproach)
+{
+	// Follow the road out of an intersection until it enters the next one,
+	// as long as it does not fork
+	outDistance = 0.0f;
+	for (int i = 0; i < TRAFFIC_LIGHT_CORRIDOR_MAX_LINKS; i++)
+	{
+		if (group->GetIntersection() != nullptr)
+		{
+			outApproach = group;
+			return group->GetIntersection();
+		}
+		if (group->GetOutputs().size() != 1)
+			break;
+		NodeGroupConnection* connection = group->GetOutputs()[0];
+		outDistance += connection->GetLeftVisualEdgeLine().Length();
+		group = connection->GetOutput().group;
+	}
+	return nullptr;
+}
+
+static int FindMovementPhase(RoadIntersection* intersection,
+	NodeGroup* inputGroup, NodeGroup* outputGroup)
+{
+	// Find the phase of the first lane with a driving line between the two
+	TrafficLightProgram* program = intersection->GetTrafficLightProgram();
+	for (int i = 0; i < inputGroup->GetNumNodes(); i++)
+	{
+		Node* node = inputGroup->GetNode(i);
+		int phase = program->FindPhase(node);
+		if (phase < 0)
+			continue;
+		for (int j = 0; j < outputGroup->GetNumNodes(); j++)
+		{
+			if (intersection->FindDrivingLine(node, outputGroup->GetNode(j)) != nullptr)
+				return phase;
+		}
+	}
+	return -1;
+}
+
+static int FindCorridorPhase(RoadIntersection* intersection)
+{
+	// Find the phase serving the traffic which leaves along the first
+	// corridor to another light, preferring the approach most in line with
+	// the corridor, as that is where through traffic comes from
+	for (RoadIntersectionPoint* output : intersection->GetPoints())
+	{
+		if (output->GetIOType() != IOType::OUTPUT)
+			continue;
+		Meters distance;
+		NodeGroup* approach = nullptr;
+		RoadIntersection* next = FollowCorridor(
+			output->GetNodeGroup(), distance, approach);
+		if (next == nullptr || next->GetTrafficLightProgram() == nullptr)
+			continue;
+
+		NodeGroup* outputGroup = output->GetNodeGroup();
+		int bestPhase = -1;
+		float bestAlignment = -2.0f;
+		for (RoadIntersectionPoint* input : intersection->GetPoints())
+		{
+			NodeGroup* inputGroup = input->GetNodeGroup();
+			float alignment = inputGroup->GetDirection().Dot(outputGroup->GetDirection());
+			if (input->GetIOType() != IOType::INPUT || alignment <= bestAlignment)
+				continue;
+			int phase = FindMovementPhase(intersection, inputGroup, outputGroup);
+			if (phase >= 0)
+			{
+				bestPhase = phase;
+				bestAlignment = alignment;
+			}
+		}
+		if (bestPhase >= 0)
+			return bestPhase;
+	}
+	return 0;
+}
+
+void RoadNetwork::CoordinateTrafficLights()
+{
+	// Visit the intersections in ID order, so the corridors do not depend
+	// on pointer order
+	Array<RoadIntersection*> intersections;
+	for (RoadIntersection* intersection : m_intersections)
+	{
+		TrafficLightProgram* program = intersection->GetTrafficLightProgram();
+		if (program == nullptr)
+			continue;
+		program->SetMode(m_trafficLightMode);
+		program->SetCoordination(-1, 0.0f, m_signalCycleTime);
+		intersections.push_back(intersection);
+	}
+	if (m_trafficLightMode != TrafficLightMode::COORDINATED)
+		return;
+	std::sort(intersections.begin(), intersections.end(),
+		[](RoadIntersection* a, RoadIntersection* b) -> bool {
+		return (a->m_id < b->m_id);
+	});
+
+	// Grow a green wave downstream from each light not yet coordinated. The
+	// next light along each corridor has its cycle offset by the time to
+	// drive there, and coordinates the phase for the approach the corridor
+	// arrives on. Offsets only matter relative to each other, so each root
+	// is the reference of its wave with an offset of zero, and coordinates
+	// the phase sending traffic down its first corridor.
+	Map<RoadIntersection*, Seconds> offsets;
+	Array<RoadIntersection*> queue;
+	for (RoadIntersection* root : intersections)
+	{
+		if (offsets.find(root) != offsets.end())
+			continue;
+		offsets[root] = 0.0f;
+		root->GetTrafficLightProgram()->SetCoordination(
+			FindCorridorPhase(root), 0.0f, m_signalCycleTime);
+		queue.clear();
+		queue.push_back(root);
+		for (unsigned int i = 0; i < queue.size(); i++)
+		{
+			RoadIntersection* intersection = queue[i];
+			for (RoadIntersectionPoint* point : intersection->GetPoints())
+			{
+				if (point->GetIOType() != IOType::OUTPUT)
+					continue;
+				Meters distance;
+				NodeGroup* approach = nullptr;
+				RoadIntersection* next = FollowCorridor(
+					point->GetNodeGroup(), distance, approach);
+				if (next == nullptr || next->GetTrafficLightProgram() == nullptr ||
+					offsets.find(next) != offsets.end() ||
+					approach->GetNumNodes() == 0)
+					continue;
+				TrafficLightProgram* program = next->GetTrafficLightProgram();
+				int phase = program->FindPhase(approach->GetNode(0));
+				if (phase < 0)
+					continue;
+				Seconds offset = std::fmod(offsets[intersection] +
+					(distance / TRAFFIC_LIGHT_PROGRESSION_SPEED),
+					TRAFFIC_LIGHT_CYCLE_LENGTH);
+				offsets[next] = offset;
+				program->SetCoordination(phase, offset, m_signalCycleTime);
+				queue.push_back(next);
+			}
+		}
+	}
+}
+
 
 //-----------------------------------------------------------------------------
 // Save & Load
@@ -451,221 +742,637 @@ void RoadNetwork::Simulate(Seconds dt)
 
 bool RoadNetwork::Save(const Path& path)
 {
-	File file(path);
-	if (file.Open(FileAccess::WRITE, FileType::BINARY).Failed())
-		return false;
-
-	unsigned int count;
-
-	// Save node groups
-	count = m_nodeGroups.size();
-	file.Write(&m_nodeGroupIdCounter, sizeof(int));
-	file.Write(&count, sizeof(unsigned int));
-	for (NodeGroup* group : m_nodeGroups)
+	Array<NodeGroup*> groups;
+	Array<NodeGroupTie*> ties;
+	Array<NodeGroupConnection*> connections;
+	Array<RoadIntersection*> intersections;
+	Array<int> groupIndices;
+	Array<int> tieIndices;
+	Array<int> connectionIndices;
+	Array<int> intersectionIndices;
+	SortForSaving(m_nodeGroups, groups, groupIndices);
+	SortForSaving(m_nodeGroupTies, ties, tieIndices);
+	SortForSaving(m_nodeGroupConnections, connections, connectionIndices);
+	SortForSaving(m_intersections, intersections, intersectionIndices);
+
+	// Node groups, along with their nodes and connections
+	Array<NodeGroupRecord> groupRecords(groups.size());
+	Array<NodeRecord> nodeRecords;
+	Array<int> groupConnectionRecords;
+	for (unsigned int i = 0; i < groups.size(); i++)
 	{
-		file.Write(&group->m_id, sizeof(int));
-		file.Write(&group->m_position, sizeof(Vector3f));
-		file.Write(&group->m_direction, sizeof(Vector2f));
-		file.Write(&group->m_leftShoulderWidth, sizeof(Meters));
-		file.Write(&group->m_rightShoulderWidth, sizeof(Meters));
-		file.Write(&group->m_allowPassing, sizeof(Meters));
-		SavePointer(file, group->m_twin);
-		SavePointer(file, group->m_tie);
-		SavePointer(file, group->m_intersection);
-
-		// Save individual nodes
-		count = group->m_nodes.size();
-		file.Write(&count, sizeof(unsigned int));
-		for (unsigned int i = 0; i < group->m_nodes.size(); i++)
-		{
-			Node* node = group->m_nodes[i];
-			file.Write(&node->m_width, sizeof(Meters));
-			file.Write(&node->m_position, sizeof(Vector3f));
-			file.Write(&node->m_direction, sizeof(Vector2f));
-			file.Write(&node->m_leftDivider, sizeof(node->m_leftDivider));
-		}
-
-		// Save input & output connections
+		NodeGroup* group = groups[i];
+		NodeGroupRecord& record = groupRecords[i];
+		record.id = group->m_id;
+		record.twin = GetRecordIndex(group->m_twin, groupIndices);
+		record.tie = GetRecordIndex(group->m_tie, tieIndices);
+		record.nodeBegin = (int) nodeRecords.size();
+		record.nodeCount = (int) group->m_nodes.size();
+		record.connectionBegin = (int) groupConnectionRecords.size();
+		record.inputCount = (int) group->m_connections[(int) InputOutput::INPUT].size();
+		record.outputCount = (int) group->m_connections[(int) InputOutput::OUTPUT].size();
+		record.position[0] = group->m_position.x;
+		record.position[1] = group->m_position.y;
+		record.position[2] = group->m_position.z;
+		record.direction[0] = group->m_direction.x;
+		record.direction[1] = group->m_direction.y;
+		record.leftShoulderWidth = group->m_leftShoulderWidth;
+		record.rightShoulderWidth = group->m_rightShoulderWidth;
+		record.allowPassing = group->m_allowPassing ? 1 : 0;
+
+		for (Node& node : group->m_nodes)
+		{
+			Vector3f position = node.GetPosition();
+			Vector2f direction = node.GetDirection();
+			NodeRecord nodeRecord;
+			nodeRecord.width = node.m_width;
+			nodeRecord.position[0] = position.x;
+			nodeRecord.position[1] = position.y;
+			nodeRecord.position[2] = position.z;
+			nodeRecord.direction[0] = direction.x;
+			nodeRecord.direction[1] = direction.y;
+			nodeRecord.leftDivider = (uint32) node.m_leftDivider;
+			nodeRecord.reserved = 0;
+			nodeRecords.push_back(nodeRecord);
+		}
 		for (unsigned int inOut = 0; inOut < 2; inOut++)
 		{
-			count = group->m_connections[inOut].size();
-			file.Write(&count, sizeof(unsigned int));
-			for (unsigned int j = 0; j < group->m_connections[inOut].size(); j++)
-				SavePointer(file, group->m_connections[inOut][j]);
+			for (NodeGroupConnection* connection : group->m_connections[inOut])
+			{
+				groupConnectionRecords.push_back(
+					GetRecordIndex(connection, connectionIndices));
+			}
 		}
 	}
 
-	// Save node group ties
-	file.Write(&m_tieIdCounter, sizeof(int));
-	count = m_nodeGroupTies.size();
-	file.Write(&count, sizeof(unsigned int));
-	for (NodeGroupTie* tie : m_nodeGroupTies)
+	// Node group ties
+	Array<TieRecord> tieRecords(ties.size());
+	for (unsigned int i = 0; i < ties.size(); i++)
 	{
-		file.Write(&tie->m_id, sizeof(int));
-		file.Write(&tie->m_position, sizeof(Vector3f));
-		file.Write(&tie->m_direction, sizeof(Vector2f));
-		file.Write(&tie->m_centerDividerWidth, sizeof(Meters));
-		SavePointer(file, tie->m_nodeGroup);
+		NodeGroupTie* tie = ties[i];
+		TieRecord& record = tieRecords[i];
+		record.id = tie->m_id;
+		record.nodeGroup = GetRecordIndex(tie->m_nodeGroup, groupIndices);
+		record.position[0] = tie->m_position.x;
+		record.position[1] = tie->m_position.y;
+		record.position[2] = tie->m_position.z;
+		record.direction[0] = tie->m_direction.x;
+		record.direction[1] = tie->m_direction.y;
+		record.centerDividerWidth = tie->m_centerDividerWidth;
 	}
 
-	// Save node group connections
-	file.Write(&m_nodeGroupConnectionIdCounter, sizeof(int));
-	count = m_nodeGroupConnections.size();
-	file.Write(&count, sizeof(unsigned int));
-	for (NodeGroupConnection* connection : m_nodeGroupConnections)
+	// Node group connections
+	Array<ConnectionRecord> connectionRecords(connections.size());
+	for (unsigned int i = 0; i < connections.size(); i++)
 	{
-		file.Write(&connection->m_id, sizeof(int));
-		file.Write(&connection->GetInput().index, sizeof(int));
-		file.Write(&connection->GetInput().count, sizeof(int));
-		SavePointer(file, connection->GetInput().group);
-		file.Write(&connection->GetOutput().index, sizeof(int));
-		file.Write(&connection->GetOutput().count, sizeof(int));
-		SavePointer(file, connection->GetOutput().group);
+		NodeGroupConnection* connection = connections[i];
+		ConnectionRecord& record = connectionRecords[i];
+		record.id = connection->m_id;
+		record.inputGroup = GetRecordIndex(connection->GetInput().group, groupIndices);
+		record.inputIndex = connection->GetInput().index;
+		record.inputCount = connection->GetInput().count;
+		record.outputGroup = GetRecordIndex(connection->GetOutput().group, groupIndices);
+		record.outputIndex = connection->GetOutput().index;
+		record.outputCount = connection->GetOutput().count;
+		record.reserved = 0;
 	}
 
-	// Save intersections
-	file.Write(&m_intersectionIdCounter, sizeof(int));
-	count = m_intersections.size();
-	file.Write(&count, sizeof(unsigned int));
-	for (RoadIntersection* intersection : m_intersections)
+	// Intersections, along with their points and edges
+	Array<IntersectionRecord> intersectionRecords(intersections.size());
+	Array<IntersectionPointRecord> pointRecords;
+	Array<IntersectionEdgeRecord> edgeRecords;
+	for (unsigned int i = 0; i < intersections.size(); i++)
 	{
-		file.Write(&intersection->m_id, sizeof(int));
-
-		// Save points
-		count = intersection->m_points.size();
-		file.Write(&count, sizeof(unsigned int));
-		for (unsigned int i = 0; i < intersection->m_points.size(); i++)
+		RoadIntersection* intersection = intersections[i];
+		IntersectionRecord& record = intersectionRecords[i];
+		record.id = intersection->m_id;
+		record.pointBegin = (int) pointRecords.size();
+		record.pointCount = (int) intersection->m_points.size();
+		record.edgeBegin = (int) edgeRecords.size();
+		record.edgeCount = (int) intersection->m_edges.size();
+		record.reserved = 0;
+
+		for (RoadIntersectionPoint* point : intersection->m_points)
 		{
-			RoadIntersectionPoint* point = intersection->m_points[i];
-			file.Write(&point->m_ioType, sizeof(IOType));
-			SavePointer(file, point->m_nodeGroup);
+			IntersectionPointRecord pointRecord;
+			pointRecord.nodeGroup = GetRecordIndex(point->m_nodeGroup, groupIndices);
+			pointRecord.ioType = (uint32) point->m_ioType;
+			pointRecords.push_back(pointRecord);
 		}
-
-		// Save edges
-		count = intersection->m_edges.size();
-		file.Write(&count, sizeof(unsigned int));
-		for (unsigned int i = 0; i < intersection->m_edges.size(); i++)
+		for (RoadIntersectionEdge* edge : intersection->m_edges)
 		{
-			RoadIntersectionEdge* edge = intersection->m_edges[i];
+			IntersectionEdgeRecord edgeRecord;
 			for (unsigned int j = 0; j < 2; j++)
 			{
 				auto it = std::find(intersection->m_points.begin(),
 					intersection->m_points.end(), edge->m_points[j]);
-				unsigned int index = it - intersection->m_points.begin();
-				file.Write(&index, sizeof(unsigned int));
+				edgeRecord.points[j] = (int) (it - intersection->m_points.begin());
 			}
+			edgeRecords.push_back(edgeRecord);
 		}
 	}
 
-	return true;
+	RoadNetworkFileHeader header;
+	header.nodeGroupIdCounter = m_nodeGroupIdCounter;
+	header.tieIdCounter = m_tieIdCounter;
+	header.connectionIdCounter = m_nodeGroupConnectionIdCounter;
+	header.intersectionIdCounter = m_intersectionIdCounter;
+
+	RoadNetworkFileWriter writer;
+	writer.AddChunk(RoadNetworkChunkType::NODE_GROUPS, groupRecords);
+	writer.AddChunk(RoadNetworkChunkType::NODES, nodeRecords);
+	writer.AddChunk(RoadNetworkChunkType::GROUP_CONNECTIONS, groupConnectionRecords);
+	writer.AddChunk(RoadNetworkChunkType::CONNECTIONS, connectionRecords);
+	writer.AddChunk(RoadNetworkChunkType::TIES, tieRecords);
+	writer.AddChunk(RoadNetworkChunkType::INTERSECTIONS, intersectionRecords);
+	writer.AddChunk(RoadNetworkChunkType::INTERSECTION_POINTS, pointRecords);
+	writer.AddChunk(RoadNetworkChunkType::INTERSECTION_EDGES, edgeRecords);
+
+	// Bake the generated geometry along with the topology it came from, so
+	// loading can skip generating it. Geometry waiting to be updated isn't
+	// worth baking.
+	RoadNetworkBakedGeometry geometry;
+	if (IsGeometryUpToDate())
+	{
+		BakeGeometry(geometry, groups, groupRecords, groupIndices,
+			connections, intersections);
+		geometry.header.topologyHash = HashFileBytes(
+			&m_metrics, sizeof(RoadMetrics), writer.CalcTopologyHash());
+		writer.AddChunk(RoadNetworkChunkType::GEOMETRY,
+			&geometry.header, sizeof(GeometryRecord), 1);
+		writer.AddChunk(RoadNetworkChunkType::GROUP_GEOMETRY, geometry.groups);
+		writer.AddChunk(RoadNetworkChunkType::CONNECTION_GEOMETRY, geometry.connections);
+		writer.AddChunk(RoadNetworkChunkType::LANE_SPLITS, geometry.laneSplits);
+		writer.AddChunk(RoadNetworkChunkType::CURVES, geometry.curves);
+		writer.AddChunk(RoadNetworkChunkType::INTERSECTION_GEOMETRY, geometry.intersections);
+		writer.AddChunk(RoadNetworkChunkType::EDGE_GEOMETRY, geometry.edges);
+		writer.AddChunk(RoadNetworkChunkType::MOVEMENTS, geometry.movements);
+		writer.AddChunk(RoadNetworkChunkType::CONFLICTS, geometry.conflicts);
+		writer.AddChunk(RoadNetworkChunkType::MESH_VERTICES, geometry.meshVertices);
+		writer.AddChunk(RoadNetworkChunkType::MESH_INDICES, geometry.meshIndices);
+	}
+
+	return writer.Write(path, header);
 }
 
 bool RoadNetwork::Load(const Path& path)
 {
-	ClearNodes();
-	File file(path);
-	if (file.Open(FileAccess::READ, FileType::BINARY).Failed())
+	Array<uint8> data;
+	if (File::OpenAndGetContents(path, data).Failed())
 		return false;
+	if (!RoadNetworkFileView::HasMagic(data.data(), data.size()))
+		return LoadLegacy(data.data(), data.size());
+	return Load(data.data(), data.size());
+}
+
+bool RoadNetwork::Load(const uint8* data, uint64 size)
+{
+	RoadNetworkFileView view;
+	if (!view.Open(data, size))
+		return false;
+
+	int groupCount;
+	int nodeCount;
+	int groupConnectionCount;
+	int connectionCount;
+	int tieCount;
+	int intersectionCount;
+	int pointCount;
+	int edgeCount;
+	const NodeGroupRecord* groupRecords = view.GetRecords<NodeGroupRecord>(
+		RoadNetworkChunkType::NODE_GROUPS, groupCount);
+	const NodeRecord* nodeRecords = view.GetRecords<NodeRecord>(
+		RoadNetworkChunkType::NODES, nodeCount);
+	const int* groupConnectionRecords = view.GetRecords<int>(
+		RoadNetworkChunkType::GROUP_CONNECTIONS, groupConnectionCount);
+	const ConnectionRecord* connectionRecords = view.GetRecords<ConnectionRecord>(
+		RoadNetworkChunkType::CONNECTIONS, connectionCount);
+	const TieRecord* tieRecords = view.GetRecords<TieRecord>(
+		RoadNetworkChunkType::TIES, tieCount);
+	const IntersectionRecord* intersectionRecords = view.GetRecords<IntersectionRecord>(
+		RoadNetworkChunkType::INTERSECTIONS, intersectionCount);
+	const IntersectionPointRecord* pointRecords = view.GetRecords<IntersectionPointRecord>(
+		RoadNetworkChunkType::INTERSECTION_POINTS, pointCount);
+	const IntersectionEdgeRecord* edgeRecords = view.GetRecords<IntersectionEdgeRecord>(
+		RoadNetworkChunkType::INTERSECTION_EDGES, edgeCount);
+	if (groupRecords == nullptr || nodeRecords == nullptr ||
+		groupConnectionRecords == nullptr || connectionRecords == nullptr ||
+		tieRecords == nullptr || intersectionRecords == nullptr ||
+		pointRecords == nullptr || edgeRecords == nullptr)
+		return false;
+
+	// Check every ID and reference before touching the network, so a
+	// corrupt file leaves it as it was rather than half built. Records are
+	// saved in ID order, so rising IDs also rule out duplicates, and each
+	// must be below the counter that will hand out the next one.
+	const RoadNetworkFileHeader& header = view.GetHeader();
+	auto isIndex = [](int index, int count) {
+		return (index >= 0 && index < count);
+	};
+	auto isRange = [](int begin, int rangeCount, int count) {
+		return (begin >= 0 && rangeCount >= 0 && begin <= count &&
+			rangeCount <= count - begin);
+	};
+	auto isNextId = [](int id, int& prevId, uint32 idCounter) {
+		bool isValid = (id > prevId && (uint32) id < idCounter);
+		prevId = id;
+		return isValid;
+	};
+	int prevId = 0;
+	for (int i = 0; i < groupCount; i++)
+	{
+		const NodeGroupRecord& record = groupRecords[i];
+		if (!isNextId(record.id, prevId, header.nodeGroupIdCounter) ||
+			(record.twin != -1 && !isIndex(record.twin, groupCount)) ||
+			(record.tie != -1 && !isIndex(record.tie, tieCount)) ||
+			!isRange(record.nodeBegin, record.nodeCount, nodeCount) ||
+			record.inputCount < 0 || record.outputCount < 0 ||
+			!isRange(record.connectionBegin, record.inputCount +
+				record.outputCount, groupConnectionCount))
+			return false;
+	}
+	for (int i = 0; i < groupConnectionCount; i++)
+	{
+		if (!isIndex(groupConnectionRecords[i], connectionCount))
+			return false;
+	}
+	prevId = 0;
+	for (int i = 0; i < connectionCount; i++)
+	{
+		const ConnectionRecord& record = connectionRecords[i];
+		if (!isNextId(record.id, prevId, header.connectionIdCounter) ||
+			!isIndex(record.inputGroup, groupCount) ||
+			!isIndex(record.outputGroup, groupCount) ||
+			record.inputCount < 1 || record.outputCount < 1 ||
+			!isRange(record.inputIndex, record.inputCount,
+				groupRecords[record.inputGroup].nodeCount) ||
+			!isRange(record.outputIndex, record.outputCount,
+				groupRecords[record.outputGroup].nodeCount))
+			return false;
+	}
+	prevId = 0;
+	for (int i = 0; i < tieCount; i++)
+	{
+		if (!isNextId(tieRecords[i].id, prevId, header.tieIdCounter) ||
+			!isIndex(tieRecords[i].nodeGroup, groupCount))
+			return false;
+	}
+	prevId = 0;
+	for (int i = 0; i < intersectionCount; i++)
+	{
+		const IntersectionRecord& record = intersectionRecords[i];
+		if (!isNextId(record.id, prevId, header.intersectionIdCounter) ||
+			!isRange(record.pointBegin, record.pointCount, pointCount) ||
+			!isRange(record.edgeBegin, record.edgeCount, edgeCount))
+			return false;
+		for (int j = 0; j < record.pointCount; j++)
+		{
+			const IntersectionPointRecord& point = pointRecords[record.pointBegin + j];
+			if (!isIndex(point.nodeGroup, groupCount) ||
+				(point.ioType != (uint32) IOType::INPUT &&
+				point.ioType != (uint32) IOType::OUTPUT))
+				return false;
+		}
+		for (int j = 0; j < record.edgeCount; j++)
+		{
+			const IntersectionEdgeRecord& edge = edgeRecords[record.edgeBegin + j];
+			if (!isIndex(edge.points[0], record.pointCount) ||
+				!isIndex(edge.points[1], record.pointCount))
+				return false;
+		}
+	}
+
+	ClearNodes();
+	m_nodeGroupIdCounter = header.nodeGroupIdCounter;
+	m_tieIdCounter = header.tieIdCounter;
+	m_nodeGroupConnectionIdCounter = header.connectionIdCounter;
+	m_intersectionIdCounter = header.intersectionIdCounter;
+
+	// Create every object first, so records can refer to them by index
+	Array<NodeGroup*> groups(groupCount);
+	Array<NodeGroupTie*> ties(tieCount);
+	Array<NodeGroupConnection*> connections(connectionCount);
+	Array<RoadIntersection*> intersections(intersectionCount);
+	Array<Node*> nodes(nodeCount);
+	m_nodeGroups.Reserve(groupCount);
+	m_nodeGroupTies.Reserve(tieCount);
+	m_nodeGroupConnections.Reserve(connectionCount);
+	m_intersections.Reserve(intersectionCount);
+	for (int i = 0; i < groupCount; i++)
+		groups[i] = m_nodeGroups.Create();
+	for (int i = 0; i < tieCount; i++)
+		ties[i] = m_nodeGroupTies.Create();
+	for (int i = 0; i < connectionCount; i++)
+		connections[i] = m_nodeGroupConnections.Create();
+
+	// Read node groups
+	for (int i = 0; i < groupCount; i++)
+	{
+		const NodeGroupRecord& record = groupRecords[i];
+		NodeGroup* group = groups[i];
+		group->m_id = record.id;
+		group->m_metrics = &m_metrics;
+		group->m_position = Vector3f(
+			record.position[0], record.position[1], record.position[2]);
+		group->m_direction = Vector2f(record.direction[0], record.direction[1]);
+		group->m_leftShoulderWidth = record.leftShoulderWidth;
+		group->m_rightShoulderWidth = record.rightShoulderWidth;
+		group->m_allowPassing = (record.allowPassing != 0);
+		group->m_twin = (record.twin >= 0 ? groups[record.twin] : nullptr);
+		group->m_tie = (record.tie >= 0 ? ties[record.tie] : nullptr);
+		group->m_intersection = nullptr;
+
+		// Read individual nodes. Their positions are derived from the group,
+		// so the saved ones are only informational.
+		group->m_nodes.resize(record.nodeCount);
+		group->UpdateNodeIndices();
+		for (int j = 0; j < record.nodeCount; j++)
+		{
+			const NodeRecord& nodeRecord = nodeRecords[record.nodeBegin + j];
+			Node* node = group->GetNode(j);
+			node->m_width = nodeRecord.width;
+			node->m_leftDivider = (LaneDivider) nodeRecord.leftDivider;
+			nodes[record.nodeBegin + j] = node;
+		}
+
+		// Read input & output connections
+		const int* groupConnections = groupConnectionRecords + record.connectionBegin;
+		int inOutCounts[2] = { record.inputCount, record.outputCount };
+		for (unsigned int inOut = 0; inOut < 2; inOut++)
+		{
+			group->m_connections[inOut].resize(inOutCounts[inOut]);
+			for (int j = 0; j < inOutCounts[inOut]; j++)
+				group->m_connections[inOut][j] = connections[*groupConnections++];
+		}
+	}
+
+	// Read node group ties
+	for (int i = 0; i < tieCount; i++)
+	{
+		const TieRecord& record = tieRecords[i];
+		NodeGroupTie* tie = ties[i];
+		tie->m_id = record.id;
+		tie->m_position = Vector3f(
+			record.position[0], record.position[1], record.position[2]);
+		tie->m_direction = Vector2f(record.direction[0], record.direction[1]);
+		tie->m_centerDividerWidth = record.centerDividerWidth;
+		tie->m_nodeGroup = groups[record.nodeGroup];
+	}
+
+	// Read node group connections
+	for (int i = 0; i < connectionCount; i++)
+	{
+		const ConnectionRecord& record = connectionRecords[i];
+		NodeGroupConnection* connection = connections[i];
+		connection->m_id = record.id;
+		connection->m_metrics = &m_metrics;
+		connection->GetInput().group = groups[record.inputGroup];
+		connection->GetInput().index = record.inputIndex;
+		connection->GetInput().count = record.inputCount;
+		connection->GetOutput().group = groups[record.outputGroup];
+		connection->GetOutput().index = record.outputIndex;
+		connection->GetOutput().count = record.outputCount;
+	}
+	for (NodeGroup* group : groups)
+		group->UpdateConnectionSorting();
+
+	// Read intersections
+	for (int i = 0; i < intersectionCount; i++)
+	{
+		const IntersectionRecord& record = intersectionRecords[i];
+		RoadIntersection* intersection = m_intersections.Create();
+		intersections[i] = intersection;
+		intersection->m_id = record.id;
+
+		// Read points
+		intersection->m_points.resize(record.pointCount);
+		for (int j = 0; j < record.pointCount; j++)
+		{
+			const IntersectionPointRecord& pointRecord =
+				pointRecords[record.pointBegin + j];
+			RoadIntersectionPoint* point = new RoadIntersectionPoint();
+			intersection->m_points[j] = point;
+			point->m_ioType = (IOType) pointRecord.ioType;
+			point->m_nodeGroup = groups[pointRecord.nodeGroup];
+			if (point->m_ioType == IOType::INPUT)
+				point->m_nodeGroup->m_intersection = intersection;
+			else
+				point->m_nodeGroup->m_inputIntersection = intersection;
+		}
+
+		// Read edges
+		intersection->m_edges.resize(record.edgeCount);
+		for (int j = 0; j < record.edgeCount; j++)
+		{
+			const IntersectionEdgeRecord& edgeRecord =
+				edgeRecords[record.edgeBegin + j];
+			RoadIntersectionEdge* edge = new RoadIntersectionEdge();
+			intersection->m_edges[j] = edge;
+			for (unsigned int k = 0; k < 2; k++)
+				edge->m_points[k] = intersection->m_points[edgeRecord.points[k]];
+		}
+
+		intersection->CreateTrafficLightProgram();
+	}
+
+	// Without baked geometry, or if it was baked for different topology,
+	// everything is left dirty and generated on the next geometry update
+	LoadGeometry(view, groups, nodes, connections, intersections);
+	return true;
+}
+
+bool RoadNetwork::LoadLegacy(const uint8* data, uint64 size)
+{
+	ClearNodes();
+	RoadNetworkLegacyReader reader(data, size);
+	if (ReadLegacy(reader))
+		return true;
+
+	// Leave an empty network rather than a partially read one
+	ClearNodes();
+	return false;
+}
+
+bool RoadNetwork::ReadLegacy(RoadNetworkLegacyReader& reader)
+{
+	// Variable-length lists are bounded by what is left of the file, so a
+	// corrupt count fails on its first missing record instead of allocating.
+	// The sizes are the least each record can take.
+	constexpr uint64 idSize = sizeof(int);
+	constexpr uint64 laneSize = sizeof(Meters) + sizeof(Vector3f) +
+		sizeof(Vector2f) + sizeof(LaneDivider);
+	constexpr uint64 pointSize = sizeof(IOType) + sizeof(int);
+	constexpr uint64 edgeSize = 2 * sizeof(unsigned int);
+	constexpr uint64 groupSize = (4 * idSize) + sizeof(Vector3f) +
+		sizeof(Vector2f) + (2 * sizeof(Meters)) + sizeof(uint32) +
+		(3 * sizeof(unsigned int));
+	constexpr uint64 tieSize = (2 * idSize) + sizeof(Vector3f) +
+		sizeof(Vector2f) + sizeof(Meters);
+	constexpr uint64 connectionSize = idSize + (2 * (idSize + (2 * sizeof(int))));
+	constexpr uint64 intersectionSize = idSize + (2 * sizeof(unsigned int));
+
 	unsigned int count;
 	unsigned int count2;
 
+	// Saved IDs are resolved through tables indexed by ID, sized from each
+	// type's ID counter. Objects referenced before their type's section
+	// grow the table as they come.
+	Array<NodeGroup*> nodeGroups;
+	Array<NodeGroupTie*> ties;
+	Array<NodeGroupConnection*> connections;
+	Array<RoadIntersection*> intersections;
+	Array<uint8> isDefined;
+
 	// Read node groups
-	file.Read(&m_nodeGroupIdCounter, sizeof(int));
-	file.Read(&count, sizeof(unsigned int));
+	if (!reader.Read(m_nodeGroupIdCounter) || !reader.Read(count) ||
+		count > reader.GetRemaining() / groupSize ||
+		!ResizeLoadTable(reader, nodeGroups, m_nodeGroupIdCounter))
+		return false;
+	m_nodeGroups.Reserve(count);
 	for (unsigned int nodeGroupIndex = 0; nodeGroupIndex < count; nodeGroupIndex++)
 	{
-		NodeGroup* group = LoadPointer(file, m_nodeGroups);
-		file.Read(&group->m_position, sizeof(Vector3f));
-		file.Read(&group->m_direction, sizeof(Vector2f));
-		file.Read(&group->m_leftShoulderWidth, sizeof(Meters));
-		file.Read(&group->m_rightShoulderWidth, sizeof(Meters));
-		file.Read(&group->m_allowPassing, sizeof(Meters));
-		group->m_twin = LoadPointer(file, m_nodeGroups);
-		group->m_tie = LoadPointer(file, m_nodeGroupTies);
-		group->m_intersection = LoadPointer(file, m_intersections);
-		group->m_intersection = nullptr;
+		NodeGroup* group;
+		RoadIntersection* intersection;
+		uint32 allowPassing;
+		if (!LoadDefinition(reader, m_nodeGroups, nodeGroups, isDefined, group))
+			return false;
+		group->m_metrics = &m_metrics;
+		reader.Read(group->m_position);
+		reader.Read(group->m_direction);
+		reader.Read(group->m_leftShoulderWidth);
+		reader.Read(group->m_rightShoulderWidth);
+		reader.Read(allowPassing);
+		group->m_allowPassing = ((allowPassing & 0xFF) != 0);
+		if (!LoadPointer(reader, m_nodeGroups, nodeGroups, group->m_twin, false) ||
+			!LoadPointer(reader, m_nodeGroupTies, ties, group->m_tie, false) ||
+			!LoadPointer(reader, m_intersections, intersections, intersection, false))
+			return false;
 
 		// Read individual nodes
-		file.Read(&count2, sizeof(unsigned int));
+		if (!reader.Read(count2) || count2 > reader.GetRemaining() / laneSize)
+			return false;
 		group->m_nodes.resize(count2);
+		group->UpdateNodeIndices();
 		for (unsigned int j = 0; j < count2; j++)
 		{
-			Node* node = new Node();
-			group->m_nodes[j] = node;
-			node->m_nodeGroup = group;
-			node->m_index = j;
-			file.Read(&node->m_width, sizeof(Meters));
-			file.Read(&node->m_position, sizeof(Vector3f));
-			file.Read(&node->m_direction, sizeof(Vector2f));
-			file.Read(&node->m_leftDivider, sizeof(node->m_leftDivider));
+			Node* node = group->GetNode(j);
+			Vector3f position;
+			Vector2f direction;
+			reader.Read(node->m_width);
+			reader.Read(position);
+			reader.Read(direction);
+			reader.Read(node->m_leftDivider);
 		}
 
 		// Read input & output connections
 		for (unsigned int inOut = 0; inOut < 2; inOut++)
 		{
-			file.Read(&count2, sizeof(unsigned int));
-			Array<NodeGroupConnection*>& connections = group->m_connections[inOut];
-			connections.resize(count2);
+			if (!reader.Read(count2) || count2 > reader.GetRemaining() / idSize)
+				return false;
+			Array<NodeGroupConnection*>& groupConnections = group->m_connections[inOut];
+			groupConnections.resize(count2);
 			for (unsigned int j = 0; j < count2; j++)
-				connections[j] = LoadPointer(file, m_nodeGroupConnections);
+			{
+				if (!LoadPointer(reader, m_nodeGroupConnections,
+					connections, groupConnections[j]))
+					return false;
+			}
 		}
 	}
-
+	if (!IsLoadTableComplete(nodeGroups, count, m_nodeGroupIdCounter))
+		return false;
+	unsigned int groupCount = count;
 
 	// Read node group ties
-	file.Read(&m_tieIdCounter, sizeof(int));
-	file.Read(&count, sizeof(unsigned int));
+	isDefined.clear();
+	if (!reader.Read(m_tieIdCounter) || !reader.Read(count) ||
+		count > reader.GetRemaining() / tieSize ||
+		!ResizeLoadTable(reader, ties, m_tieIdCounter))
+		return false;
+	m_nodeGroupTies.Reserve(count);
 	for (unsigned int i = 0; i < count; i++)
 	{
-		NodeGroupTie* tie = LoadPointer(file, m_nodeGroupTies);
-		file.Read(&tie->m_position, sizeof(Vector3f));
-		file.Read(&tie->m_direction, sizeof(Vector2f));
-		file.Read(&tie->m_centerDividerWidth, sizeof(Meters));
-		tie->m_nodeGroup = LoadPointer(file, m_nodeGroups);
+		NodeGroupTie* tie;
+		if (!LoadDefinition(reader, m_nodeGroupTies, ties, isDefined, tie))
+			return false;
+		reader.Read(tie->m_position);
+		reader.Read(tie->m_direction);
+		reader.Read(tie->m_centerDividerWidth);
+		if (!LoadPointer(reader, m_nodeGroups, nodeGroups, tie->m_nodeGroup))
+			return false;
 	}
+	if (!IsLoadTableComplete(ties, count, m_tieIdCounter) ||
+		m_nodeGroups.size() != (int) groupCount)
+		return false;
 
 	// Read node group connections
-	file.Read(&m_nodeGroupConnectionIdCounter, sizeof(int));
-	file.Read(&count, sizeof(unsigned int));
+	isDefined.clear();
+	if (!reader.Read(m_nodeGroupConnectionIdCounter) || !reader.Read(count) ||
+		count > reader.GetRemaining() / connectionSize ||
+		!ResizeLoadTable(reader, connections, m_nodeGroupConnectionIdCounter))
+		return false;
+	m_nodeGroupConnections.Reserve(count);
 	for (unsigned int i = 0; i < count; i++)
 	{
-		NodeGroupConnection* connection =
-			LoadPointer(file, m_nodeGroupConnections);
-		file.Read(&connection->GetInput().index, sizeof(int));
-		file.Read(&connection->GetInput().count, sizeof(int));
-		connection->GetInput().group = LoadPointer(file, m_nodeGroups);
-		file.Read(&connection->GetOutput().index, sizeof(int));
-		file.Read(&connection->GetOutput().count, sizeof(int));
-		connection->GetOutput().group = LoadPointer(file, m_nodeGroups);
+		NodeGroupConnection* connection;
+		if (!LoadDefinition(reader, m_nodeGroupConnections, connections,
+			isDefined, connection))
+			return false;
+		connection->m_metrics = &m_metrics;
+		for (unsigned int inOut = 0; inOut < 2; inOut++)
+		{
+			NodeSubGroup& subGroup = connection->GetSubGroup((IOType) inOut);
+			reader.Read(subGroup.index);
+			reader.Read(subGroup.count);
+			if (!LoadPointer(reader, m_nodeGroups, nodeGroups, subGroup.group) ||
+				subGroup.index < 0 || subGroup.count < 1 ||
+				subGroup.count > subGroup.group->GetNumNodes() - subGroup.index)
+				return false;
+		}
 	}
+	if (!IsLoadTableComplete(connections, count, m_nodeGroupConnectionIdCounter) ||
+		m_nodeGroups.size() != (int) groupCount)
+		return false;
 	for (NodeGroup* group : m_nodeGroups)
 		group->UpdateConnectionSorting();
 
 	// Read intersections
-	file.Read(&m_intersectionIdCounter, sizeof(int));
-	file.Read(&count, sizeof(unsigned int));
+	isDefined.clear();
+	if (!reader.Read(m_intersectionIdCounter) || !reader.Read(count) ||
+		count > reader.GetRemaining() / intersectionSize ||
+		!ResizeLoadTable(reader, intersections, m_intersectionIdCounter))
+		return false;
+	m_intersections.Reserve(count);
 	for (unsigned int i = 0; i < count; i++)
 	{
-		RoadIntersection* intersection = LoadPointer(file, m_intersections);
+		RoadIntersection* intersection;
+		if (!LoadDefinition(reader, m_intersections, intersections,
+			isDefined, intersection))
+			return false;
 
 		// Read points
-		file.Read(&count2, sizeof(unsigned int));
-		intersection->m_points.resize(count2);
+		if (!reader.Read(count2) || count2 > reader.GetRemaining() / pointSize)
+			return false;
+		intersection->m_points.resize(count2, nullptr);
 		for (unsigned int j = 0; j < count2; j++)
 		{
 			RoadIntersectionPoint* point = new RoadIntersectionPoint();
 			intersection->m_points[j] = point;
-			file.Read(&point->m_ioType, sizeof(IOType));
-			point->m_nodeGroup = LoadPointer(file, m_nodeGroups);
+			reader.Read(point->m_ioType);
+			if (!LoadPointer(reader, m_nodeGroups, nodeGroups, point->m_nodeGroup))
+				return false;
 			if (point->m_ioType == IOType::INPUT)
 				point->m_nodeGroup->m_intersection = intersection;
-			else
+			else if (point->m_ioType == IOType::OUTPUT)
 				point->m_nodeGroup->m_inputIntersection = intersection;
+			else
+				return false;
 		}
 
 		// Read edges
-		file.Read(&count2, sizeof(unsigned int));
-		intersection->m_edges.resize(count2);
+		if (!reader.Read(count2) || count2 > reader.GetRemaining() / edgeSize)
+			return false;
+		intersection->m_edges.resize(count2, nullptr);
 		for (unsigned int j = 0; j < count2; j++)
 		{
 			RoadIntersectionEdge* edge = new RoadIntersectionEdge();
@@ -673,14 +1380,452 @@ bool RoadNetwork::Load(const Path& path)
 			for (unsigned int k = 0; k < 2; k++)
 			{
 				unsigned int index;
-				file.Read(&index, sizeof(unsigned int));
+				if (!reader.Read(index) || index >= intersection->m_points.size())
+					return false;
 				edge->m_points[k] = intersection->m_points[index];
 			}
 		}
 
 		intersection->CreateTrafficLightProgram();
 	}
+	if (!IsLoadTableComplete(intersections, count, m_intersectionIdCounter) ||
+		m_nodeGroups.size() != (int) groupCount)
+		return false;
+
+	return !reader.IsFailed();
+}
+
+
+
+//-----------------------------------------------------------------------------
+// Baked Geometry
+//-----------------------------------------------------------------------------
 
+bool RoadNetwork::IsGeometryUpToDate() const
+{
+	for (NodeGroupTie* tie : m_nodeGroupTies)
+	{
+		if (tie->IsGeometryDirty())
+			return false;
+	}
+	for (NodeGroup* group : m_nodeGroups)
+	{
+		if (group->IsGeometryDirty())
+			return false;
+	}
+	for (NodeGroupConnection* connection : m_nodeGroupConnections)
+	{
+		if (connection->IsGeometryDirty())
+			return false;
+	}
+	for (RoadIntersection* intersection : m_intersections)
+	{
+		if (intersection->IsGeometryDirty())
+			return false;
+	}
 	return true;
 }
 
+void RoadNetwork::BakeGeometry(RoadNetworkBakedGeometry& outGeometry,
+	const Array<NodeGroup*>& groups,
+	const Array<NodeGroupRecord>& groupRecords,
+	const Array<int>& groupIndices,
+	const Array<NodeGroupConnection*>& connections,
+	const Array<RoadIntersection*>& intersections)
+{
+	outGeometry.header.topologyHash = 0;
+	outGeometry.header.geometryVersion = ROAD_NETWORK_GEOMETRY_VERSION;
+#ifdef ROAD_MIND_HEADLESS
+	outGeometry.header.hasMeshes = 0;
+#else
+	outGeometry.header.hasMeshes = 1;
+#endif
+
+	auto addCurves = [&](const RoadCurveLine* curves, unsigned int count) {
+		outGeometry.curves.insert(outGeometry.curves.end(), curves, curves + count);
+		return (int) count;
+	};
+	auto getNodeIndex = [&](Node* node) {
+		int group = groupIndices[node->m_nodeGroup->m_id];
+		return groupRecords[group].nodeBegin + node->m_index;
+	};
+
+	// Node groups
+	outGeometry.groups.resize(groups.size());
+	for (unsigned int i = 0; i < groups.size(); i++)
+		outGeometry.groups[i].slope = groups[i]->m_slope;
+
+	// Connections, with their lines before and after trimming
+	outGeometry.connections.resize(connections.size());
+	for (unsigned int i = 0; i < connections.size(); i++)
+	{
+		NodeGroupConnection* connection = connections[i];
+		ConnectionGeometryRecord& record = outGeometry.connections[i];
+		record.laneSplitBegin = (int) outGeometry.laneSplits.size();
+		record.laneSplitCount = (int) connection->m_laneSplit.size();
+		outGeometry.laneSplits.insert(outGeometry.laneSplits.end(),
+			connection->m_laneSplit.begin(), connection->m_laneSplit.end());
+
+		record.curveBegin = (int) outGeometry.curves.size();
+		addCurves(&connection->m_leftLaneEdge, 1);
+		addCurves(connection->m_visualShoulderLines, 2);
+		addCurves(connection->m_untrimmedShoulderLines, 2);
+		record.dividerCount = addCurves(connection->m_visualDividerLines.data(),
+			connection->m_visualDividerLines.size());
+		record.untrimmedDividerCount = addCurves(
+			connection->m_untrimmedDividerLines.data(),
+			connection->m_untrimmedDividerLines.size());
+		for (unsigned int j = 0; j < 2; j++)
+		{
+			for (unsigned int k = 0; k < 2; k++)
+			{
+				record.seamCounts[j][k] = addCurves(
+					connection->m_seams[j][k].data(),
+					connection->m_seams[j][k].size());
+				record.edgeSeamCounts[j][k] = addCurves(
+					connection->m_edgeSeams[j][k].data(),
+					connection->m_edgeSeams[j][k].size());
+			}
+		}
+		record.drivingLineCount = addCurves(connection->m_drivingLines.data(),
+			connection->m_drivingLines.size());
+
+		record.meshVertexBegin = (int) outGeometry.meshVertices.size();
+		record.meshIndexBegin = (int) outGeometry.meshIndices.size();
+#ifndef ROAD_MIND_HEADLESS
+		Array<VertexPosNorm> vertices;
+		Array<unsigned int> indices;
+		connection->BuildMesh(vertices, indices);
+		for (const VertexPosNorm& vertex : vertices)
+		{
+			MeshVertexRecord vertexRecord;
+			for (unsigned int axis = 0; axis < 3; axis++)
+			{
+				vertexRecord.position[axis] = vertex.position[axis];
+				vertexRecord.normal[axis] = vertex.normal[axis];
+			}
+			outGeometry.meshVertices.push_back(vertexRecord);
+		}
+		outGeometry.meshIndices.insert(outGeometry.meshIndices.end(),
+			indices.begin(), indices.end());
+#endif
+		record.meshVertexCount = (int) outGeometry.meshVertices.size() -
+			record.meshVertexBegin;
+		record.meshIndexCount = (int) outGeometry.meshIndices.size() -
+			record.meshIndexBegin;
+	}
+
+	// Intersections, with the driving line of each movement in the order
+	// the movements are numbered, and each pair of conflicting movements
+	outGeometry.intersections.resize(intersections.size());
+	for (unsigned int i = 0; i < intersections.size(); i++)
+	{
+		RoadIntersection* intersection = intersections[i];
+		IntersectionGeometryRecord& record = outGeometry.intersections[i];
+		record.centerPosition[0] = intersection->m_centerPosition.x;
+		record.centerPosition[1] = intersection->m_centerPosition.y;
+		record.movementBegin = (int) outGeometry.movements.size();
+		record.movementCount = (int) intersection->m_drivingLines.size();
+		record.curveBegin = (int) outGeometry.curves.size();
+		record.conflictBegin = (int) outGeometry.conflicts.size();
+		record.reserved = 0;
+		for (const auto& it : intersection->m_drivingLines)
+		{
+			MovementRecord movement;
+			movement.fromNode = getNodeIndex(it.first.first.Get());
+			movement.toNode = getNodeIndex(it.first.second.Get());
+			outGeometry.movements.push_back(movement);
+			outGeometry.curves.push_back(it.second);
+		}
+
+		int count = record.movementCount;
+		if ((int) intersection->m_conflictMatrix.size() == count * count)
+		{
+			for (int a = 0; a < count; a++)
+			{
+				for (int b = a + 1; b < count; b++)
+				{
+					int index = intersection->m_conflictMatrix[(a * count) + b];
+					if (index < 0)
+						continue;
+					const RoadIntersectionConflict& conflict =
+						intersection->m_conflicts[index];
+					ConflictRecord conflictRecord;
+					conflictRecord.movement = a;
+					conflictRecord.otherMovement = b;
+					conflictRecord.enter = conflict.enter;
+					conflictRecord.exit = conflict.exit;
+					conflictRecord.otherEnter = conflict.otherEnter;
+					conflictRecord.otherExit = conflict.otherExit;
+					outGeometry.conflicts.push_back(conflictRecord);
+				}
+			}
+		}
+		record.conflictCount = (int) outGeometry.conflicts.size() -
+			record.conflictBegin;
+
+		for (RoadIntersectionEdge* edge : intersection->m_edges)
+		{
+			EdgeGeometryRecord edgeRecord;
+			edgeRecord.shoulderEdge = edge->m_shoulderEdge;
+			edgeRecord.laneEdge = edge->m_laneEdge;
+			outGeometry.edges.push_back(edgeRecord);
+		}
+	}
+}
+
+bool RoadNetwork::LoadGeometry(const RoadNetworkFileView& view,
+	const Array<NodeGroup*>& groups, const Array<Node*>& nodes,
+	const Array<NodeGroupConnection*>& connections,
+	const Array<RoadIntersection*>& intersections)
+{
+	// The geometry must have been baked by this version of the geometry
+	// code, for exactly the topology and metrics that were just loaded
+	int count;
+	const GeometryRecord* header = view.GetRecords<GeometryRecord>(
+		RoadNetworkChunkType::GEOMETRY, count);
+	if (header == nullptr || count != 1 ||
+		header->geometryVersion != ROAD_NETWORK_GEOMETRY_VERSION ||
+		header->topologyHash != HashFileBytes(
+			&m_metrics, sizeof(RoadMetrics), view.CalcTopologyHash()))
+		return false;
+
+	int groupCount;
+	int connectionCount;
+	int laneSplitCount;
+	int curveCount;
+	int intersectionCount;
+	int edgeCount;
+	int movementCount;
+	int conflictCount;
+	int vertexCount;
+	int indexCount;
+	const GroupGeometryRecord* groupRecords = view.GetRecords<GroupGeometryRecord>(
+		RoadNetworkChunkType::GROUP_GEOMETRY, groupCount);
+	const ConnectionGeometryRecord* connectionRecords =
+		view.GetRecords<ConnectionGeometryRecord>(
+		RoadNetworkChunkType::CONNECTION_GEOMETRY, connectionCount);
+	const int* laneSplits = view.GetRecords<int>(
+		RoadNetworkChunkType::LANE_SPLITS, laneSplitCount);
+	const RoadCurveLine* curves = view.GetRecords<RoadCurveLine>(
+		RoadNetworkChunkType::CURVES, curveCount);
+	const IntersectionGeometryRecord* intersectionRecords =
+		view.GetRecords<IntersectionGeometryRecord>(
+		RoadNetworkChunkType::INTERSECTION_GEOMETRY, intersectionCount);
+	const EdgeGeometryRecord* edgeRecords = view.GetRecords<EdgeGeometryRecord>(
+		RoadNetworkChunkType::EDGE_GEOMETRY, edgeCount);
+	const MovementRecord* movementRecords = view.GetRecords<MovementRecord>(
+		RoadNetworkChunkType::MOVEMENTS, movementCount);
+	const ConflictRecord* conflictRecords = view.GetRecords<ConflictRecord>(
+		RoadNetworkChunkType::CONFLICTS, conflictCount);
+	const MeshVertexRecord* vertexRecords = view.GetRecords<MeshVertexRecord>(
+		RoadNetworkChunkType::MESH_VERTICES, vertexCount);
+	const uint32* indexRecords = view.GetRecords<uint32>(
+		RoadNetworkChunkType::MESH_INDICES, indexCount);
+	int totalEdgeCount = 0;
+	for (RoadIntersection* intersection : intersections)
+		totalEdgeCount += (int) intersection->m_edges.size();
+	if (groupRecords == nullptr || connectionRecords == nullptr ||
+		laneSplits == nullptr || curves == nullptr ||
+		intersectionRecords == nullptr || edgeRecords == nullptr ||
+		movementRecords == nullptr || conflictRecords == nullptr ||
+		vertexRecords == nullptr || indexRecords == nullptr ||
+		groupCount != (int) groups.size() ||
+		connectionCount != (int) connections.size() ||
+		intersectionCount != (int) intersections.size() ||
+		edgeCount != totalEdgeCount)
+		return false;
+
+	// Check every range before using any of it
+	auto isRange = [](int begin, int rangeCount, int count) {
+		return (begin >= 0 && rangeCount >= 0 && begin <= count &&
+			rangeCount <= count - begin);
+	};
+	for (int i = 0; i < connectionCount; i++)
+	{
+		const ConnectionGeometryRecord& record = connectionRecords[i];
+		bool isValid = (record.dividerCount > 0 &&
+			record.untrimmedDividerCount > 0 && record.drivingLineCount >= 0);
+		uint64 lineCount = 5 + (uint64) record.dividerCount +
+			(uint64) record.untrimmedDividerCount + (uint64) record.drivingLineCount;
+		for (unsigned int j = 0; j < 2; j++)
+		{
+			for (unsigned int k = 0; k < 2; k++)
+			{
+				isValid = isValid && record.seamCounts[j][k] >= 0 &&
+					record.edgeSeamCounts[j][k] >= 0;
+				lineCount += (uint64) record.seamCounts[j][k] +
+					(uint64) record.edgeSeamCounts[j][k];
+			}
+		}
+
+		// The driving lines must cover every pair of input and output lanes
+		const NodeGroupConnection* connection = connections[i];
+		uint64 drivingLineCount = Math::Max((uint64) 1,
+			(uint64) Math::Max(0, connection->m_groups[0].count) *
+			(uint64) Math::Max(0, connection->m_groups[1].count));
+		isValid = isValid && (uint64) record.drivingLineCount == drivingLineCount;
+		if (!isValid || lineCount > (uint64) curveCount ||
+			!isRange(record.laneSplitBegin, record.laneSplitCount, laneSplitCount) ||
+			!isRange(record.curveBegin, (int) lineCount, curveCount) ||
+			!isRange(record.meshVertexBegin, record.meshVertexCount, vertexCount) ||
+			!isRange(record.meshIndexBegin, record.meshIndexCount, indexCount))
+			return false;
+	}
+	for (int i = 0; i < intersectionCount; i++)
+	{
+		const IntersectionGeometryRecord& record = intersectionRecords[i];
+		if (!isRange(record.movementBegin, record.movementCount, movementCount) ||
+			!isRange(record.curveBegin, record.movementCount, curveCount) ||
+			!isRange(record.conflictBegin, record.conflictCount, conflictCount))
+			return false;
+		for (int j = 0; j < record.movementCount; j++)
+		{
+			const MovementRecord& movement = movementRecords[record.movementBegin + j];
+			if (!isRange(movement.fromNode, 1, (int) nodes.size()) ||
+				!isRange(movement.toNode, 1, (int) nodes.size()))
+				return false;
+		}
+		for (int j = 0; j < record.conflictCount; j++)
+		{
+			const ConflictRecord& conflict = conflictRecords[record.conflictBegin + j];
+			if (!isRange(conflict.movement, 1, record.movementCount) ||
+				!isRange(conflict.otherMovement, 1, record.movementCount))
+				return false;
+		}
+	}
+
+	// Node groups and ties. Tie and node positions were saved as updated.
+	for (NodeGroupTie* tie : m_nodeGroupTies)
+		tie->m_isGeometryDirty = false;
+	for (int i = 0; i < groupCount; i++)
+	{
+		groups[i]->m_slope = groupRecords[i].slope;
+		groups[i]->m_isGeometryDirty = false;
+	}
+
+	// Connections
+	for (int i = 0; i < connectionCount; i++)
+	{
+		const ConnectionGeometryRecord& record = connectionRecords[i];
+		NodeGroupConnection* connection = connections[i];
+		connection->m_laneSplit.assign(laneSplits + record.laneSplitBegin,
+			laneSplits + record.laneSplitBegin + record.laneSplitCount);
+
+		const RoadCurveLine* lines = curves + record.curveBegin;
+		auto readCurves = [&](Array<RoadCurveLine>& outCurves, int count) {
+			outCurves.assign(lines, lines + count);
+			lines += count;
+		};
+		connection->m_leftLaneEdge = *lines++;
+		connection->m_visualShoulderLines[0] = *lines++;
+		connection->m_visualShoulderLines[1] = *lines++;
+		connection->m_untrimmedShoulderLines[0] = *lines++;
+		connection->m_untrimmedShoulderLines[1] = *lines++;
+		readCurves(connection->m_visualDividerLines, record.dividerCount);
+		readCurves(connection->m_untrimmedDividerLines, record.untrimmedDividerCount);
+		for (unsigned int j = 0; j < 2; j++)
+		{
+			for (unsigned int k = 0; k < 2; k++)
+			{
+				readCurves(connection->m_seams[j][k], record.seamCounts[j][k]);
+				readCurves(connection->m_edgeSeams[j][k], record.edgeSeamCounts[j][k]);
+			}
+		}
+		readCurves(connection->m_drivingLines, record.drivingLineCount);
+		connection->m_drivingLineLaneCounts[0] = connection->m_groups[0].count;
+		connection->m_drivingLineLaneCounts[1] = connection->m_groups[1].count;
+		connection->m_visualEdgeLines[0] = &connection->m_visualDividerLines.front();
+		connection->m_visualEdgeLines[1] = &connection->m_visualDividerLines.back();
+		connection->m_isGeometryDirty = false;
+
+#ifndef ROAD_MIND_HEADLESS
+		// Meshes baked without a renderer are built from the baked lines
+		bool hasMesh = (header->hasMeshes != 0);
+		Array<VertexPosNorm> vertices(record.meshVertexCount);
+		for (int j = 0; j < record.meshVertexCount; j++)
+		{
+			const MeshVertexRecord& vertex = vertexRecords[record.meshVertexBegin + j];
+			vertices[j] = VertexPosNorm(
+				Vector3f(vertex.position[0], vertex.position[1], vertex.position[2]),
+				Vector3f(vertex.normal[0], vertex.normal[1], vertex.normal[2]));
+		}
+		Array<unsigned int> indices(indexRecords + record.meshIndexBegin,
+			indexRecords + record.meshIndexBegin + record.meshIndexCount);
+		for (unsigned int index : indices)
+			hasMesh = hasMesh && (index < vertices.size());
+		if (hasMesh)
+			connection->CreateMesh(vertices, indices);
+		else
+			connection->CreateMesh();
+#endif
+	}
+
+	// Intersections
+	const EdgeGeometryRecord* edgeRecord = edgeRecords;
+	for (int i = 0; i < intersectionCount; i++)
+	{
+		const IntersectionGeometryRecord& record = intersectionRecords[i];
+		RoadIntersection* intersection = intersections[i];
+		intersection->m_centerPosition = Vector2f(
+			record.centerPosition[0], record.centerPosition[1]);
+		for (RoadIntersectionEdge* edge : intersection->m_edges)
+		{
+			// Edges between twins have no curves of their own
+			if (edge->m_points[0]->m_nodeGroup->GetTwin() != edge->m_points[1]->m_nodeGroup)
+				edge->SetCurves(edgeRecord->shoulderEdge, edgeRecord->laneEdge);
+			edgeRecord++;
+		}
+
+		// Movements are numbered in the order of the driving lines, which
+		// are sorted by node group ID, so the saved numbers still apply.
+		// Out of order movements leave the geometry dirty to be rebuilt
+		intersection->m_drivingLines.clear();
+		intersection->m_movementIndices.clear();
+		bool isOrdered = true;
+		std::pair<NodeRef, NodeRef> prevKey;
+		for (int j = 0; j < record.movementCount && isOrdered; j++)
+		{
+			const MovementRecord& movement = movementRecords[record.movementBegin + j];
+			std::pair<NodeRef, NodeRef> key = std::make_pair(
+				NodeRef(nodes[movement.fromNode]), NodeRef(nodes[movement.toNode]));
+			isOrdered = (j == 0 || prevKey < key);
+			intersection->m_drivingLines[key] = curves[record.curveBegin + j];
+			intersection->m_movementIndices[key] = j;
+			prevKey = key;
+		}
+		if (!isOrdered)
+		{
+			intersection->m_drivingLines.clear();
+			intersection->m_movementIndices.clear();
+			continue;
+		}
+
+		int count = record.movementCount;
+		intersection->m_conflicts.clear();
+		intersection->m_conflictMatrix.assign(count * count, -1);
+		for (int j = 0; j < record.conflictCount; j++)
+		{
+			const ConflictRecord& conflictRecord =
+				conflictRecords[record.conflictBegin + j];
+			int a = conflictRecord.movement;
+			int b = conflictRecord.otherMovement;
+			RoadIntersectionConflict conflict;
+			conflict.enter = conflictRecord.enter;
+			conflict.exit = conflictRecord.exit;
+			conflict.otherEnter = conflictRecord.otherEnter;
+			conflict.otherExit = conflictRecord.otherExit;
+			intersection->m_conflictMatrix[(a * count) + b] =
+				(int) intersection->m_conflicts.size();
+			intersection->m_conflicts.push_back(conflict);
+			std::swap(conflict.enter, conflict.otherEnter);
+			std::swap(conflict.exit, conflict.otherExit);
+			intersection->m_conflictMatrix[(b * count) + a] =
+				(int) intersection->m_conflicts.size();
+			intersection->m_conflicts.push_back(conflict);
+		}
+		intersection->m_isGeometryDirty = false;
+	}
+
+	return true;
+}
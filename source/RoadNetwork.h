@@ -4,8 +4,11 @@
 #include "NodeGroup.h"
 #include "NodeGroupTie.h"
 #include "NodeGroupConnection.h"
-#include "Connection.h"
 #include "RoadIntersection.h"
+#include "LaneGraph.h"
+#include "RoadNetworkFile.h"
+#include "ObjectPool.h"
+#include <algorithm>
 
 
 class RoadNetwork
@@ -16,11 +19,19 @@ public:
 	~RoadNetwork();
 
 	// Getters
-	Set<NodeGroup*>& GetNodeGroups();
-	Set<NodeGroupConnection*>& GetNodeGroupConnections();
-	Set<NodeGroupTie*>& GetNodeGroupTies();
-	Set<RoadIntersection*>& GetIntersections();
+	ObjectPool<NodeGroup>& GetNodeGroups();
+	ObjectPool<NodeGroupConnection>& GetNodeGroupConnections();
+	ObjectPool<NodeGroupTie>& GetNodeGroupTies();
+	ObjectPool<RoadIntersection>& GetIntersections();
 	const RoadMetrics& GetMetrics() const;
+	const LaneGraph& GetLaneGraph() const;
+	TrafficLightMode GetTrafficLightMode() const;
+	bool IsValid(const NodeRef& node) const;
+	bool IsValid(const NodeGroupConnection* connection, int id) const;
+	bool IsValid(const RoadIntersection* intersection, int id) const;
+
+	// Setters
+	void SetTrafficLightMode(TrafficLightMode mode);
 
 	// Topology Modification
 
@@ -49,6 +60,7 @@ public:
 
 	bool Save(const Path& path);
 	bool Load(const Path& path);
+	bool Load(const uint8* data, uint64 size);
 
 	// Geometry
 	void UpdateNodeGeometry();
@@ -56,46 +68,123 @@ public:
 
 
 private:
+	void CoordinateTrafficLights();
+	bool LoadLegacy(const uint8* data, uint64 size);
+	bool ReadLegacy(RoadNetworkLegacyReader& reader);
+	bool IsGeometryUpToDate() const;
+	void BakeGeometry(RoadNetworkBakedGeometry& outGeometry,
+		const Array<NodeGroup*>& groups,
+		const Array<NodeGroupRecord>& groupRecords,
+		const Array<int>& groupIndices,
+		const Array<NodeGroupConnection*>& connections,
+		const Array<RoadIntersection*>& intersections);
+	bool LoadGeometry(const RoadNetworkFileView& view,
+		const Array<NodeGroup*>& groups, const Array<Node*>& nodes,
+		const Array<NodeGroupConnection*>& connections,
+		const Array<RoadIntersection*>& intersections);
+
 	template <typename T>
-	void SavePointer(File& file, T* pointer)
+	void SortForSaving(const ObjectPool<T>& objects, Array<T*>& outSorted,
+		Array<int>& outIndices)
 	{
-		int id = 0;
-		if (pointer != nullptr)
-			id = pointer->m_id;
-		file.Write(&id, sizeof(int));
+		// Records are saved in ID order, and found by ID through a table
+		outSorted.assign(objects.begin(), objects.end());
+		std::sort(outSorted.begin(), outSorted.end(),
+			[](const T* a, const T* b) { return a->m_id < b->m_id; });
+		outIndices.assign(outSorted.empty() ? 1 : outSorted.back()->m_id + 1, -1);
+		for (unsigned int i = 0; i < outSorted.size(); i++)
+			outIndices[outSorted[i]->m_id] = (int) i;
 	}
 
 	template <typename T>
-	T* LoadPointer(File& file, Set<T*>& list)
+	int GetRecordIndex(const T* pointer, const Array<int>& indices)
 	{
-		int id = 0;
-		file.Read(&id, sizeof(id));
+		if (pointer == nullptr)
+			return -1;
+		return indices[pointer->m_id];
+	}
+
+	template <typename T>
+	bool ResizeLoadTable(const RoadNetworkLegacyReader& reader,
+		Array<T*>& table, uint64 idCount)
+	{
+		// Tables are indexed by ID, so a corrupt ID could make them huge.
+		// IDs can't outnumber the bytes of the file.
+		if (idCount > reader.GetSize())
+			return false;
+		if (idCount > table.size())
+			table.resize((size_t) idCount, nullptr);
+		return true;
+	}
 
+	template <typename T>
+	bool LoadPointer(RoadNetworkLegacyReader& reader, ObjectPool<T>& pool,
+		Array<T*>& table, T*& outObject, bool isRequired = true)
+	{
+		// Objects are found by ID, and created on their first reference,
+		// which may come before the object itself is read. ID zero is null.
+		int id = 0;
+		outObject = nullptr;
+		if (!reader.Read(id) || id < 0)
+			return false;
 		if (id == 0)
+			return !isRequired;
+		if ((unsigned int) id >= table.size() &&
+			!ResizeLoadTable(reader, table, (uint64) id + 1))
+			return false;
+		T*& object = table[id];
+		if (object == nullptr)
 		{
-			return nullptr;
+			object = pool.Create();
+			object->m_id = id;
 		}
-		else
-		{
-			for (T* object : list)
-			{
-				if (object->m_id == id)
-					return object;
-			}
+		outObject = object;
+		return true;
+	}
 
-			T* object = new T();
-			object->m_id = id;
-			list.insert(object);
-			return object;
+	template <typename T>
+	bool LoadDefinition(RoadNetworkLegacyReader& reader, ObjectPool<T>& pool,
+		Array<T*>& table, Array<uint8>& isDefined, T*& outObject)
+	{
+		// Reads the ID of an object's own record, which must come only once
+		if (!LoadPointer(reader, pool, table, outObject))
+			return false;
+		if (isDefined.size() < table.size())
+			isDefined.resize(table.size(), 0);
+		if (isDefined[outObject->m_id] != 0)
+			return false;
+		isDefined[outObject->m_id] = 1;
+		return true;
+	}
+
+	template <typename T>
+	bool IsLoadTableComplete(const Array<T*>& table,
+		unsigned int count, uint32 idCounter)
+	{
+		// Every object referenced must have been read exactly once, and no
+		// ID may be handed out again by the counter
+		unsigned int loadedCount = 0;
+		for (unsigned int id = 0; id < table.size(); id++)
+		{
+			if (table[id] == nullptr)
+				continue;
+			if (id >= idCounter)
+				return false;
+			loadedCount++;
 		}
+		return (loadedCount == count);
 	}
 
 	ECS& m_ecs;
 	RoadMetrics m_metrics;
-	Set<NodeGroupTie*> m_nodeGroupTies;
-	Set<NodeGroup*> m_nodeGroups;
-	Set<NodeGroupConnection*> m_nodeGroupConnections;
-	Set<RoadIntersection*> m_intersections;
+	ObjectPool<NodeGroupTie> m_nodeGroupTies;
+	ObjectPool<NodeGroup> m_nodeGroups;
+	ObjectPool<NodeGroupConnection> m_nodeGroupConnections;
+	ObjectPool<RoadIntersection> m_intersections;
+	LaneGraph m_laneGraph;
+	bool m_isLaneGraphDirty;
+	TrafficLightMode m_trafficLightMode;
+	Seconds m_signalCycleTime; // Time into the shared traffic light cycle
 	uint32 m_nodeGroupConnectionIdCounter;
 	uint32 m_tieIdCounter;
 	uint32 m_nodeGroupIdCounter;
@@ -0,0 +1,259 @@
+#include "RoadNetworkFile.h"
+#include <climits>
+
+
+uint64 HashFileBytes(const void* data, uint64 size, uint64 hash)
+{
+	const uint8* bytes = (const uint8*) data;
+	for (uint64 i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * ROAD_NETWORK_FILE_HASH_PRIME;
+	return hash;
+}
+
+uint64 HashFileValue(uint64 value, uint64 hash)
+{
+	return ((hash ^ value) * ROAD_NETWORK_FILE_HASH_PRIME);
+}
+
+uint64 HashFileFloats(std::initializer_list<float> values, uint64 hash)
+{
+	for (float value : values)
+	{
+		uint32 bits;
+		memcpy(&bits, &value, sizeof(uint32));
+		hash = (hash ^ bits) * ROAD_NETWORK_FILE_HASH_PRIME;
+	}
+	return hash;
+}
+
+static uint64 HashChunk(const RoadNetworkChunkEntry& chunk,
+	const void* records, uint64 hash)
+{
+	hash = HashFileBytes(&chunk.type, sizeof(uint32), hash);
+	hash = HashFileBytes(&chunk.recordSize, sizeof(uint32), hash);
+	hash = HashFileBytes(&chunk.recordCount, sizeof(uint32), hash);
+	return HashFileBytes(records,
+		(uint64) chunk.recordSize * chunk.recordCount, hash);
+}
+
+
+//-----------------------------------------------------------------------------
+// RoadNetworkFileView
+//-----------------------------------------------------------------------------
+
+RoadNetworkFileView::RoadNetworkFileView()
+	: m_data(nullptr)
+	, m_size(0)
+	, m_header(nullptr)
+	, m_chunks(nullptr)
+{
+}
+
+bool RoadNetworkFileView::HasMagic(const uint8* data, uint64 size)
+{
+	uint32 magic = 0;
+	if (size < sizeof(magic))
+		return false;
+	memcpy(&magic, data, sizeof(magic));
+	return (magic == ROAD_NETWORK_FILE_MAGIC);
+}
+
+const RoadNetworkFileHeader& RoadNetworkFileView::GetHeader() const
+{
+	return *m_header;
+}
+
+uint64 RoadNetworkFileView::CalcTopologyHash() const
+{
+	// Hash the topology chunks in type order, so the hash doesn't depend on
+	// where they were laid out
+	uint64 hash = ROAD_NETWORK_FILE_HASH_SEED;
+	for (uint32 type = (uint32) ROAD_NETWORK_FIRST_TOPOLOGY_CHUNK;
+		type <= (uint32) ROAD_NETWORK_LAST_TOPOLOGY_CHUNK; type++)
+	{
+		const RoadNetworkChunkEntry* chunk = FindChunk((RoadNetworkChunkType) type);
+		if (chunk != nullptr)
+			hash = HashChunk(*chunk, m_data + chunk->offset, hash);
+	}
+	return hash;
+}
+
+bool RoadNetworkFileView::Open(const uint8* data, uint64 size)
+{
+	m_data = nullptr;
+	m_size = 0;
+	m_header = nullptr;
+	m_chunks = nullptr;
+
+	if (size < sizeof(RoadNetworkFileHeader))
+		return false;
+	const RoadNetworkFileHeader* header =
+		reinterpret_cast<const RoadNetworkFileHeader*>(data);
+	if (header->magic != ROAD_NETWORK_FILE_MAGIC ||
+		header->byteOrder != ROAD_NETWORK_FILE_BYTE_ORDER ||
+		header->version == 0 || header->version > ROAD_NETWORK_FILE_VERSION)
+		return false;
+
+	// Check the table of contents and every chunk fit in the buffer
+	uint64 tableEnd = sizeof(RoadNetworkFileHeader) +
+		(uint64) header->chunkCount * sizeof(RoadNetworkChunkEntry);
+	if (tableEnd > size)
+		return false;
+	const RoadNetworkChunkEntry* chunks =
+		reinterpret_cast<const RoadNetworkChunkEntry*>(header + 1);
+	for (uint32 i = 0; i < header->chunkCount; i++)
+	{
+		const RoadNetworkChunkEntry& chunk = chunks[i];
+		if (chunk.recordCount > INT_MAX ||
+			chunk.offset % ROAD_NETWORK_FILE_ALIGNMENT != 0 ||
+			chunk.offset < tableEnd || chunk.offset > size ||
+			(uint64) chunk.recordSize * chunk.recordCount > size - chunk.offset)
+			return false;
+	}
+
+	m_data = data;
+	m_size = size;
+	m_header = header;
+	m_chunks = chunks;
+	return true;
+}
+
+const RoadNetworkChunkEntry* RoadNetworkFileView::FindChunk(
+	RoadNetworkChunkType type) const
+{
+	if (m_header == nullptr)
+		return nullptr;
+	for (uint32 i = 0; i < m_header->chunkCount; i++)
+	{
+		if (m_chunks[i].type == (uint32) type)
+			return &m_chunks[i];
+	}
+	return nullptr;
+}
+
+
+//-----------------------------------------------------------------------------
+// RoadNetworkLegacyReader
+//-----------------------------------------------------------------------------
+
+RoadNetworkLegacyReader::RoadNetworkLegacyReader(const uint8* data, uint64 size)
+	: m_data(data)
+	, m_size(size)
+	, m_offset(0)
+	, m_isFailed(false)
+{
+}
+
+bool RoadNetworkLegacyReader::IsFailed() const
+{
+	return m_isFailed;
+}
+
+uint64 RoadNetworkLegacyReader::GetSize() const
+{
+	return m_size;
+}
+
+uint64 RoadNetworkLegacyReader::GetRemaining() const
+{
+	return (m_size - m_offset);
+}
+
+bool RoadNetworkLegacyReader::Read(void* destination, uint64 size)
+{
+	if (m_isFailed || size > m_size - m_offset)
+	{
+		m_isFailed = true;
+		memset(destination, 0, (size_t) size);
+		return false;
+	}
+	memcpy(destination, m_data + m_offset, (size_t) size);
+	m_offset += size;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// RoadNetworkFileWriter
+//-----------------------------------------------------------------------------
+
+RoadNetworkFileWriter::RoadNetworkFileWriter()
+{
+}
+
+uint64 RoadNetworkFileWriter::CalcTopologyHash() const
+{
+	// Matches RoadNetworkFileView::CalcTopologyHash() for the written file
+	uint64 hash = ROAD_NETWORK_FILE_HASH_SEED;
+	for (uint32 type = (uint32) ROAD_NETWORK_FIRST_TOPOLOGY_CHUNK;
+		type <= (uint32) ROAD_NETWORK_LAST_TOPOLOGY_CHUNK; type++)
+	{
+		for (unsigned int i = 0; i < m_entries.size(); i++)
+		{
+			if (m_entries[i].type == type)
+			{
+				hash = HashChunk(m_entries[i], m_records[i], hash);
+				break;
+			}
+		}
+	}
+	return hash;
+}
+
+void RoadNetworkFileWriter::AddChunk(RoadNetworkChunkType type,
+	const void* records, uint32 recordSize, uint32 recordCount)
+{
+	RoadNetworkChunkEntry entry;
+	entry.type = (uint32) type;
+	entry.recordSize = recordSize;
+	entry.recordCount = recordCount;
+	entry.reserved = 0;
+	entry.offset = 0;
+	m_entries.push_back(entry);
+	m_records.push_back(records);
+}
+
+bool RoadNetworkFileWriter::Write(const Path& path, RoadNetworkFileHeader header)
+{
+	File file(path);
+	if (file.Open(FileAccess::WRITE, FileType::BINARY).Failed())
+		return false;
+
+	header.magic = ROAD_NETWORK_FILE_MAGIC;
+	header.byteOrder = ROAD_NETWORK_FILE_BYTE_ORDER;
+	header.version = ROAD_NETWORK_FILE_VERSION;
+	header.chunkCount = m_entries.size();
+
+	// Lay out the chunks after the table of contents, each one aligned
+	uint64 offset = sizeof(RoadNetworkFileHeader) +
+		m_entries.size() * sizeof(RoadNetworkChunkEntry);
+	for (RoadNetworkChunkEntry& entry : m_entries)
+	{
+		offset += (ROAD_NETWORK_FILE_ALIGNMENT -
+			offset % ROAD_NETWORK_FILE_ALIGNMENT) % ROAD_NETWORK_FILE_ALIGNMENT;
+		entry.offset = offset;
+		offset += (uint64) entry.recordSize * entry.recordCount;
+	}
+
+	file.Write(&header, sizeof(RoadNetworkFileHeader));
+	if (!m_entries.empty())
+	{
+		file.Write(m_entries.data(),
+			m_entries.size() * sizeof(RoadNetworkChunkEntry));
+	}
+	offset = sizeof(RoadNetworkFileHeader) +
+		m_entries.size() * sizeof(RoadNetworkChunkEntry);
+	const uint8 padding[ROAD_NETWORK_FILE_ALIGNMENT] = {};
+	for (unsigned int i = 0; i < m_entries.size(); i++)
+	{
+		const RoadNetworkChunkEntry& entry = m_entries[i];
+		if (entry.offset > offset)
+			file.Write(padding, (uint32) (entry.offset - offset));
+		uint64 size = (uint64) entry.recordSize * entry.recordCount;
+		if (size > 0)
+			file.Write(m_records[i], (uint32) size);
+		offset = entry.offset + size;
+	}
+
+	return true;
+}
@@ -0,0 +1,393 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include "RoadCurves.h"
+#include <initializer_list>
+
+// First bytes of every chunked network file, "RDMN" in file order. Legacy
+// files begin with the node group ID counter, which can't reach this value.
+constexpr uint32 ROAD_NETWORK_FILE_MAGIC = 0x4E4D4452;
+constexpr uint32 ROAD_NETWORK_FILE_VERSION = 1;
+constexpr uint32 ROAD_NETWORK_FILE_BYTE_ORDER = 0x01020304; // Reads back swapped on the other endianness
+constexpr uint64 ROAD_NETWORK_FILE_ALIGNMENT = 8; // Of every chunk's offset
+constexpr uint64 ROAD_NETWORK_FILE_HASH_SEED = 14695981039346656037ull; // FNV-1a offset basis
+constexpr uint64 ROAD_NETWORK_FILE_HASH_PRIME = 1099511628211ull; // FNV-1a prime
+
+// Bump when geometry generation changes, so older baked geometry is redone
+constexpr uint32 ROAD_NETWORK_GEOMETRY_VERSION = 1;
+
+
+enum class RoadNetworkChunkType : uint32
+{
+	NODE_GROUPS = 1,
+	NODES = 2,
+	GROUP_CONNECTIONS = 3, // Connection indices of each group, inputs first
+	CONNECTIONS = 4,
+	TIES = 5,
+	INTERSECTIONS = 6,
+	INTERSECTION_POINTS = 7,
+	INTERSECTION_EDGES = 8,
+
+	// Baked geometry, which is optional
+	GEOMETRY = 9, // A single record, with the topology hash it was baked for
+	GROUP_GEOMETRY = 10,
+	CONNECTION_GEOMETRY = 11,
+	LANE_SPLITS = 12,
+	CURVES = 13,
+	INTERSECTION_GEOMETRY = 14,
+	EDGE_GEOMETRY = 15,
+	MOVEMENTS = 16,
+	CONFLICTS = 17,
+	MESH_VERTICES = 18,
+	MESH_INDICES = 19,
+};
+
+// Topology chunks are the ones baked geometry is derived from
+constexpr auto ROAD_NETWORK_FIRST_TOPOLOGY_CHUNK = RoadNetworkChunkType::NODE_GROUPS;
+constexpr auto ROAD_NETWORK_LAST_TOPOLOGY_CHUNK = RoadNetworkChunkType::INTERSECTION_EDGES;
+
+
+//-----------------------------------------------------------------------------
+// On-disk records. Each chunk is a packed array of one record type, and
+// records refer to each other by their index within their chunk, or -1 for
+// none. Everything is 4 byte fields so the layout is the same on every
+// compiler, and the sizes are checked below.
+//-----------------------------------------------------------------------------
+
+struct RoadNetworkFileHeader
+{
+	uint32 magic;
+	uint32 byteOrder;
+	uint32 version;
+	uint32 chunkCount; // Table of contents entries, which follow the header
+	uint32 nodeGroupIdCounter;
+	uint32 tieIdCounter;
+	uint32 connectionIdCounter;
+	uint32 intersectionIdCounter;
+};
+
+struct RoadNetworkChunkEntry
+{
+	uint32 type;
+	uint32 recordSize;
+	uint32 recordCount;
+	uint32 reserved;
+	uint64 offset; // From the start of the file
+};
+
+struct NodeGroupRecord
+{
+	int id;
+	int twin;
+	int tie;
+	int nodeBegin;
+	int nodeCount;
+	int connectionBegin; // Into the group connections
+	int inputCount;
+	int outputCount;
+	float position[3];
+	float direction[2];
+	float leftShoulderWidth;
+	float rightShoulderWidth;
+	uint32 allowPassing;
+};
+
+struct NodeRecord
+{
+	float width;
+	float position[3];
+	float direction[2];
+	uint32 leftDivider;
+	uint32 reserved;
+};
+
+struct ConnectionRecord
+{
+	int id;
+	int inputGroup;
+	int inputIndex;
+	int inputCount;
+	int outputGroup;
+	int outputIndex;
+	int outputCount;
+	uint32 reserved;
+};
+
+struct TieRecord
+{
+	int id;
+	int nodeGroup;
+	float position[3];
+	float direction[2];
+	float centerDividerWidth;
+};
+
+struct IntersectionRecord
+{
+	int id;
+	int pointBegin;
+	int pointCount;
+	int edgeBegin;
+	int edgeCount;
+	uint32 reserved;
+};
+
+struct IntersectionPointRecord
+{
+	int nodeGroup;
+	uint32 ioType;
+};
+
+struct IntersectionEdgeRecord
+{
+	int points[2]; // Relative to the intersection's first point
+};
+
+
+//-----------------------------------------------------------------------------
+// Baked geometry records. Each chunk has one record per node group,
+// connection, intersection or intersection edge, in the same order as the
+// topology chunks, except for the shared arrays which those index into.
+// Curves are stored as the curve structs themselves, which are all floats;
+// a build whose curve layout differs sees a record size mismatch and
+// regenerates the geometry.
+//-----------------------------------------------------------------------------
+
+struct GeometryRecord
+{
+	uint64 topologyHash;
+	uint32 geometryVersion;
+	uint32 hasMeshes; // Headless builds don't bake meshes
+};
+
+struct GroupGeometryRecord
+{
+	float slope;
+};
+
+struct ConnectionGeometryRecord
+{
+	int laneSplitBegin;
+	int laneSplitCount;
+	int curveBegin; // Left lane edge, shoulder lines, untrimmed shoulder lines, then the arrays below
+	int dividerCount;
+	int untrimmedDividerCount;
+	int seamCounts[2][2];
+	int edgeSeamCounts[2][2];
+	int drivingLineCount;
+	int meshVertexBegin;
+	int meshVertexCount;
+	int meshIndexBegin;
+	int meshIndexCount;
+};
+
+struct IntersectionGeometryRecord
+{
+	float centerPosition[2];
+	int movementBegin;
+	int movementCount;
+	int curveBegin; // Driving line of each movement
+	int conflictBegin;
+	int conflictCount;
+	uint32 reserved;
+};
+
+struct EdgeGeometryRecord
+{
+	BiarcPair shoulderEdge;
+	BiarcPair laneEdge;
+};
+
+struct MovementRecord
+{
+	int fromNode; // Node record indices
+	int toNode;
+};
+
+struct ConflictRecord
+{
+	int movement; // Relative to the intersection's first movement
+	int otherMovement;
+	float enter;
+	float exit;
+	float otherEnter;
+	float otherExit;
+};
+
+struct MeshVertexRecord
+{
+	float position[3];
+	float normal[3];
+};
+
+static_assert(sizeof(RoadNetworkFileHeader) == 32, "Header layout changed");
+static_assert(sizeof(RoadNetworkChunkEntry) == 24, "Chunk entry layout changed");
+static_assert(sizeof(NodeGroupRecord) == 64, "Node group record layout changed");
+static_assert(sizeof(NodeRecord) == 32, "Node record layout changed");
+static_assert(sizeof(ConnectionRecord) == 32, "Connection record layout changed");
+static_assert(sizeof(TieRecord) == 32, "Tie record layout changed");
+static_assert(sizeof(IntersectionRecord) == 24, "Intersection record layout changed");
+static_assert(sizeof(IntersectionPointRecord) == 8, "Point record layout changed");
+static_assert(sizeof(IntersectionEdgeRecord) == 8, "Edge record layout changed");
+static_assert(sizeof(GeometryRecord) == 16, "Geometry record layout changed");
+static_assert(sizeof(ConnectionGeometryRecord) == 72, "Connection geometry record layout changed");
+static_assert(sizeof(IntersectionGeometryRecord) == 32, "Intersection geometry record layout changed");
+static_assert(sizeof(ConflictRecord) == 24, "Conflict record layout changed");
+static_assert(sizeof(MeshVertexRecord) == 24, "Mesh vertex record layout changed");
+
+
+//-----------------------------------------------------------------------------
+// Struct:  RoadNetworkBakedGeometry
+// Purpose: The baked geometry chunks of a network being saved.
+//-----------------------------------------------------------------------------
+struct RoadNetworkBakedGeometry
+{
+	GeometryRecord header;
+	Array<GroupGeometryRecord> groups;
+	Array<ConnectionGeometryRecord> connections;
+	Array<int> laneSplits;
+	Array<RoadCurveLine> curves;
+	Array<IntersectionGeometryRecord> intersections;
+	Array<EdgeGeometryRecord> edges;
+	Array<MovementRecord> movements;
+	Array<ConflictRecord> conflicts;
+	Array<MeshVertexRecord> meshVertices;
+	Array<uint32> meshIndices;
+};
+
+
+// FNV-1a over a block of bytes, continuing from a previous hash
+uint64 HashFileBytes(const void* data, uint64 size,
+	uint64 hash = ROAD_NETWORK_FILE_HASH_SEED);
+
+// FNV-1a step over a whole value rather than its bytes
+uint64 HashFileValue(uint64 value, uint64 hash = ROAD_NETWORK_FILE_HASH_SEED);
+
+// FNV-1a over the bits of each value, which skips the padding that hashing
+// the bytes of a struct would take in
+uint64 HashFileFloats(std::initializer_list<float> values,
+	uint64 hash = ROAD_NETWORK_FILE_HASH_SEED);
+
+
+//-----------------------------------------------------------------------------
+// Class:   RoadNetworkFileView
+// Purpose: Read only view of a chunked network file held in memory, whether
+//          read in whole or mapped. Open checks the header, the table of
+//          contents and that every chunk lies inside the buffer; after that
+//          the records are read straight from the buffer, field by field
+//          with no parsing, as the network copies them into its objects.
+//          Chunks of unknown types are ignored, so newer files with extra
+//          chunks still open.
+//-----------------------------------------------------------------------------
+class RoadNetworkFileView
+{
+public:
+	// Constructors
+
+	RoadNetworkFileView();
+
+	// Getters
+
+	static bool HasMagic(const uint8* data, uint64 size);
+	const RoadNetworkFileHeader& GetHeader() const;
+	uint64 CalcTopologyHash() const;
+
+	// Returns null, with a count of zero, if the chunk is missing or its
+	// records aren't the expected size
+	template <typename T>
+	const T* GetRecords(RoadNetworkChunkType type, int& outCount) const
+	{
+		const RoadNetworkChunkEntry* chunk = FindChunk(type);
+		if (chunk == nullptr || chunk->recordSize != sizeof(T))
+		{
+			outCount = 0;
+			return nullptr;
+		}
+		outCount = (int) chunk->recordCount;
+		return reinterpret_cast<const T*>(m_data + chunk->offset);
+	}
+
+	// Setters
+
+	bool Open(const uint8* data, uint64 size);
+
+private:
+	const RoadNetworkChunkEntry* FindChunk(RoadNetworkChunkType type) const;
+
+	const uint8* m_data;
+	uint64 m_size;
+	const RoadNetworkFileHeader* m_header;
+	const RoadNetworkChunkEntry* m_chunks;
+};
+
+
+//-----------------------------------------------------------------------------
+// Class:   RoadNetworkLegacyReader
+// Purpose: Reads the fields of a network saved in the legacy, unchunked
+//          format one after another, from the file's contents in memory. A
+//          read past the end fails and zeroes its value, as do all reads
+//          after it.
+//-----------------------------------------------------------------------------
+class RoadNetworkLegacyReader
+{
+public:
+	// Constructors
+
+	RoadNetworkLegacyReader(const uint8* data, uint64 size);
+
+	// Getters
+
+	bool IsFailed() const;
+	uint64 GetSize() const;
+	uint64 GetRemaining() const;
+
+	// Setters
+
+	bool Read(void* destination, uint64 size);
+
+	template <typename T>
+	bool Read(T& value)
+	{
+		return Read(&value, sizeof(T));
+	}
+
+private:
+	const uint8* m_data;
+	uint64 m_size;
+	uint64 m_offset;
+	bool m_isFailed;
+};
+
+
+//-----------------------------------------------------------------------------
+// Class:   RoadNetworkFileWriter
+// Purpose: Lays out chunks of records behind a header and table of contents
+//          and writes them to a file. Chunks are only referenced until Write,
+//          so their records must stay alive until then.
+//-----------------------------------------------------------------------------
+class RoadNetworkFileWriter
+{
+public:
+	// Constructors
+
+	RoadNetworkFileWriter();
+
+	// Getters
+
+	uint64 CalcTopologyHash() const;
+
+	// Setters
+
+	template <typename T>
+	void AddChunk(RoadNetworkChunkType type, const Array<T>& records)
+	{
+		AddChunk(type, records.data(), sizeof(T), records.size());
+	}
+	void AddChunk(RoadNetworkChunkType type, const void* records,
+		uint32 recordSize, uint32 recordCount);
+	bool Write(const Path& path, RoadNetworkFileHeader header);
+
+private:
+	Array<RoadNetworkChunkEntry> m_entries;
+	Array<const void*> m_records;
+};
@@ -1,4 +1,24 @@
 #include "RoadSurface.h"
+#include "Driver.h"
+#include "RoadNetwork.h"
+
+
+//-----------------------------------------------------------------------------
+// RoadSurfaceLane
+//-----------------------------------------------------------------------------
+
+bool RoadSurfaceLane::IsParallel(const NodeRef& otherStartNode,
+	const NodeRef& otherEndNode) const
+{
+	// Lines between the same node groups run alongside each other when
+	// they keep the same order of lanes at both ends
+	if (startNode.group != otherStartNode.group ||
+		endNode.group != otherEndNode.group)
+		return false;
+	int startOrder = startNode.index - otherStartNode.index;
+	int endOrder = endNode.index - otherEndNode.index;
+	return ((startOrder < 0 && endOrder < 0) || (startOrder > 0 && endOrder > 0));
+}
 
 
 //-----------------------------------------------------------------------------
@@ -6,6 +26,7 @@
 //-----------------------------------------------------------------------------
 
 RoadSurface::RoadSurface()
+	: m_isGeometryDirty(true)
 {
 }
 
@@ -18,9 +39,32 @@ RoadSurface::~RoadSurface()
 // Getters
 //-----------------------------------------------------------------------------
 
-Set<Driver*>& RoadSurface::GetDrivers()
+int RoadSurface::GetLaneCount() const
+{
+	return (int) m_lanes.size();
+}
+
+const RoadSurfaceLane& RoadSurface::GetLane(int index) const
+{
+	return m_lanes[index];
+}
+
+int RoadSurface::FindLane(const NodeRef& startNode, const NodeRef& endNode) const
 {
-	return m_drivers;
+	// Lanes are kept once created, and removed once their nodes are gone,
+	// so there are never more than the surface's driving lines to look
+	// through
+	for (int i = 0; i < (int) m_lanes.size(); i++)
+	{
+		if (m_lanes[i].startNode == startNode && m_lanes[i].endNode == endNode)
+			return i;
+	}
+	return -1;
+}
+
+bool RoadSurface::IsGeometryDirty() const
+{
+	return m_isGeometryDirty;
 }
 
 
@@ -28,12 +72,92 @@ Set<Driver*>& RoadSurface::GetDrivers()
 // Setters
 //-----------------------------------------------------------------------------
 
-void RoadSurface::AddDriver(Driver* driver)
+void RoadSurface::AddDriver(Driver* driver, const NodeRef& startNode,
+	const NodeRef& endNode)
 {
-	m_drivers.insert(driver);
+	int laneIndex = FindLane(startNode, endNode);
+	if (laneIndex < 0)
+	{
+		laneIndex = (int) m_lanes.size();
+		RoadSurfaceLane lane;
+		lane.startNode = startNode;
+		lane.endNode = endNode;
+		lane.front = nullptr;
+		lane.back = nullptr;
+		m_lanes.push_back(lane);
+	}
+	RoadSurfaceLane& lane = m_lanes[laneIndex];
+
+	// Drivers usually enter at the start of the line, behind everyone else
+	Driver* ahead = lane.back;
+	while (ahead != nullptr && ahead->GetDistance() < driver->GetDistance())
+		ahead = ahead->m_driverAhead;
+	Driver* behind = (ahead != nullptr ? ahead->m_driverBehind : lane.front);
+	driver->m_surfaceLane = laneIndex;
+	driver->m_driverAhead = ahead;
+	driver->m_driverBehind = behind;
+	if (ahead != nullptr)
+		ahead->m_driverBehind = driver;
+	else
+		lane.front = driver;
+	if (behind != nullptr)
+		behind->m_driverAhead = driver;
+	else
+		lane.back = driver;
 }
 
 void RoadSurface::RemoveDriver(Driver* driver)
 {
-	m_drivers.erase(driver);
+	RoadSurfaceLane& lane = m_lanes[driver->m_surfaceLane];
+	if (driver->m_driverAhead != nullptr)
+		driver->m_driverAhead->m_driverBehind = driver->m_driverBehind;
+	else
+		lane.front = driver->m_driverBehind;
+	if (driver->m_driverBehind != nullptr)
+		driver->m_driverBehind->m_driverAhead = driver->m_driverAhead;
+	else
+		lane.back = driver->m_driverAhead;
+	driver->m_surfaceLane = -1;
+	driver->m_driverAhead = nullptr;
+	driver->m_driverBehind = nullptr;
+}
+
+void RoadSurface::SortDriver(Driver* driver)
+{
+	// Drivers in a lane rarely pass each other, so this seldom moves them
+	Driver* ahead = driver->m_driverAhead;
+	if (ahead == nullptr || ahead->GetDistance() >= driver->GetDistance())
+		return;
+	NodeRef startNode = m_lanes[driver->m_surfaceLane].startNode;
+	NodeRef endNode = m_lanes[driver->m_surfaceLane].endNode;
+	RemoveDriver(driver);
+	AddDriver(driver, startNode, endNode);
+}
+
+void RoadSurface::RemoveStaleLanes(const RoadNetwork& network)
+{
+	// Lanes whose nodes were removed from the network would only be looked
+	// through from now on. Their drivers are taken off the road first.
+	int count = 0;
+	for (int i = 0; i < (int) m_lanes.size(); i++)
+	{
+		const RoadSurfaceLane& lane = m_lanes[i];
+		if (lane.front == nullptr && (!network.IsValid(lane.startNode) ||
+			!network.IsValid(lane.endNode)))
+			continue;
+		if (count != i)
+		{
+			m_lanes[count] = lane;
+			for (Driver* driver = lane.front; driver != nullptr;
+				driver = driver->m_driverBehind)
+				driver->m_surfaceLane = count;
+		}
+		count++;
+	}
+	m_lanes.resize(count);
+}
+
+void RoadSurface::MarkGeometryDirty()
+{
+	m_isGeometryDirty = true;
 }
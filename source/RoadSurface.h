@@ -4,9 +4,26 @@
 #include <cmgMath/cmg_math.h>
 #include "CommonTypes.h"
 #include "NodeGroup.h"
-#include <set>
 
 class Driver;
+class RoadNetwork;
+
+
+//-----------------------------------------------------------------------------
+// Struct:  RoadSurfaceLane
+// Purpose: The drivers on one driving line of a surface, as a list linked
+//          through the drivers themselves, sorted by their distance along
+//          the line.
+//-----------------------------------------------------------------------------
+struct RoadSurfaceLane
+{
+	NodeRef startNode;
+	NodeRef endNode;
+	Driver* front; // Farthest along the line
+	Driver* back;
+
+	bool IsParallel(const NodeRef& otherStartNode, const NodeRef& otherEndNode) const;
+};
 
 
 class RoadSurface
@@ -22,16 +39,23 @@ public:
 
 	// Getters
 
-	Set<Driver*>& GetDrivers();
+	int GetLaneCount() const;
+	const RoadSurfaceLane& GetLane(int index) const;
+	int FindLane(const NodeRef& startNode, const NodeRef& endNode) const;
+	bool IsGeometryDirty() const;
 
 	// Setters
 
-	void AddDriver(Driver* driver);
+	void AddDriver(Driver* driver, const NodeRef& startNode, const NodeRef& endNode);
 	void RemoveDriver(Driver* driver);
+	void SortDriver(Driver* driver);
+	void RemoveStaleLanes(const RoadNetwork& network);
+	void MarkGeometryDirty();
 
 	virtual void UpdateGeometry() = 0;
 
 protected:
-	Set<Driver*> m_drivers;
+	Array<RoadSurfaceLane> m_lanes;
+	bool m_isGeometryDirty;
 };
 
@@ -0,0 +1,201 @@
+#include "Router.h"
+#include "Node.h"
+#include <algorithm>
+#include <functional>
+
+
+//-----------------------------------------------------------------------------
+// Route
+//-----------------------------------------------------------------------------
+
+Route::Route()
+	: originLane(-1)
+	, destinationLane(-1)
+	, length(0.0f)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+Router::Router(const LaneGraph* laneGraph)
+	: m_laneGraph(laneGraph)
+	, m_mode(RouterMode::A_STAR)
+	, m_graphVersion(0)
+	, m_searchStamp(0)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+const LaneGraph* Router::GetLaneGraph() const
+{
+	return m_laneGraph;
+}
+
+RouterMode Router::GetMode() const
+{
+	return m_mode;
+}
+
+int Router::GetCacheSize() const
+{
+	return (int) m_cache.size();
+}
+
+const ContractionHierarchy& Router::GetContractionHierarchy() const
+{
+	return m_contractionHierarchy;
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+void Router::SetLaneGraph(const LaneGraph* laneGraph)
+{
+	m_laneGraph = laneGraph;
+	ClearCache();
+	m_contractionHierarchy.Clear();
+}
+
+void Router::SetMode(RouterMode mode)
+{
+	m_mode = mode;
+}
+
+void Router::ClearCache()
+{
+	m_cache.clear();
+}
+
+
+//-----------------------------------------------------------------------------
+// Queries
+//-----------------------------------------------------------------------------
+
+const Route* Router::FindRoute(int originLane, int destinationLane)
+{
+	CheckGraphVersion();
+	uint64 key = ((uint64) (uint32) originLane << 32) | (uint32) destinationLane;
+	auto it = m_cache.find(key);
+	if (it != m_cache.end())
+		return (it->second.found ? &it->second.route : nullptr);
+
+	if (m_cache.size() >= ROUTE_CACHE_MAX_SIZE)
+		m_cache.clear();
+	CachedRoute& cached = m_cache[key];
+	if (m_mode == RouterMode::CONTRACTION_HIERARCHY)
+		cached.found = FindRouteContractionHierarchy(originLane, destinationLane, cached.route);
+	else
+		cached.found = FindRouteAStar(originLane, destinationLane, cached.route);
+	return (cached.found ? &cached.route : nullptr);
+}
+
+bool Router::FindRouteAStar(int originLane, int destinationLane, Route& outRoute)
+{
+	outRoute.originLane = originLane;
+	outRoute.destinationLane = destinationLane;
+	outRoute.edges.clear();
+	outRoute.length = 0.0f;
+	int laneCount = m_laneGraph->GetLaneCount();
+	if (originLane < 0 || originLane >= laneCount ||
+		destinationLane < 0 || destinationLane >= laneCount)
+		return false;
+
+	if ((int) m_stamp.size() != laneCount)
+	{
+		m_distance.assign(laneCount, 0.0f);
+		m_parentEdge.assign(laneCount, -1);
+		m_stamp.assign(laneCount, 0);
+		m_searchStamp = 0;
+	}
+	m_searchStamp++;
+	m_queue.clear();
+	m_stamp[originLane] = m_searchStamp;
+	m_distance[originLane] = 0.0f;
+	m_parentEdge[originLane] = -1;
+	m_queue.push_back(QueueEntry(GetHeuristic(originLane, destinationLane), originLane));
+
+	while (!m_queue.empty())
+	{
+		std::pop_heap(m_queue.begin(), m_queue.end(), std::greater<QueueEntry>());
+		int lane = m_queue.back().second;
+		Meters estimate = m_queue.back().first;
+		m_queue.pop_back();
+		Meters distance = m_distance[lane];
+		if (estimate > distance + GetHeuristic(lane, destinationLane))
+			continue;
+
+		if (lane == destinationLane)
+		{
+			// Walk back along the parent edges
+			for (int edge = m_parentEdge[lane]; edge >= 0;
+				edge = m_parentEdge[m_laneGraph->GetEdge(edge).fromLane])
+				outRoute.edges.push_back(edge);
+			std::reverse(outRoute.edges.begin(), outRoute.edges.end());
+			outRoute.length = distance;
+			return true;
+		}
+
+		for (int i = m_laneGraph->GetEdgeBegin(lane); i < m_laneGraph->GetEdgeEnd(lane); i++)
+		{
+			const LaneGraphEdge& edge = m_laneGraph->GetEdge(i);
+			Meters nextDistance = distance + edge.length;
+			if (m_stamp[edge.toLane] != m_searchStamp ||
+				nextDistance < m_distance[edge.toLane])
+			{
+				m_stamp[edge.toLane] = m_searchStamp;
+				m_distance[edge.toLane] = nextDistance;
+				m_parentEdge[edge.toLane] = i;
+				m_queue.push_back(QueueEntry(nextDistance +
+					GetHeuristic(edge.toLane, destinationLane), edge.toLane));
+				std::push_heap(m_queue.begin(), m_queue.end(), std::greater<QueueEntry>());
+			}
+		}
+	}
+
+	return false;
+}
+
+bool Router::FindRouteContractionHierarchy(int originLane, int destinationLane, Route& outRoute)
+{
+	int laneCount = m_laneGraph->GetLaneCount();
+	if (originLane < 0 || originLane >= laneCount ||
+		destinationLane < 0 || destinationLane >= laneCount)
+		return false;
+	if (!m_contractionHierarchy.IsBuilt() ||
+		m_contractionHierarchy.GetGraphVersion() != m_laneGraph->GetVersion())
+		m_contractionHierarchy.Build(*m_laneGraph);
+	return m_contractionHierarchy.FindRoute(originLane, destinationLane, outRoute);
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+void Router::CheckGraphVersion()
+{
+	// Cached routes refer to lane graph edges, so drop them when the graph
+	// is rebuilt
+	if (m_laneGraph->GetVersion() != m_graphVersion)
+	{
+		m_graphVersion = m_laneGraph->GetVersion();
+		ClearCache();
+	}
+}
+
+Meters Router::GetHeuristic(int lane, int destinationLane) const
+{
+	// Driving lines connect lane centers, so they are never shorter than
+	// the straight line between them. Edge lengths are horizontal only.
+	return m_laneGraph->GetLane(lane)->GetCenter().xy.DistTo(
+		m_laneGraph->GetLane(destinationLane)->GetCenter().xy);
+}
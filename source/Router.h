@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include "CommonTypes.h"
+#include "LaneGraph.h"
+#include "ContractionHierarchy.h"
+#include <unordered_map>
+
+constexpr auto ROUTE_CACHE_MAX_SIZE = 65536;
+
+
+//-----------------------------------------------------------------------------
+// Struct:  Route
+// Purpose: Shortest sequence of lane graph edges from one lane to another.
+//-----------------------------------------------------------------------------
+struct Route
+{
+	int originLane;
+	int destinationLane;
+	Array<int> edges; // Lane graph edge indices, in driving order
+	Meters length;
+
+	Route();
+};
+
+
+enum class RouterMode
+{
+	A_STAR = 0,
+	CONTRACTION_HIERARCHY,
+};
+
+
+//-----------------------------------------------------------------------------
+// Class:   Router
+// Purpose: Finds shortest routes between lanes of a lane graph, either with
+//          A* (using the straight-line distance between lanes as the
+//          heuristic) or with a contraction hierarchy that is preprocessed
+//          on first use. Results are cached by origin and destination until
+//          the lane graph changes.
+//
+//          Queries reuse internal buffers, so a router must only be used
+//          from one thread at a time.
+//-----------------------------------------------------------------------------
+class Router
+{
+public:
+	// Constructors
+
+	Router(const LaneGraph* laneGraph = nullptr);
+
+	// Getters
+
+	const LaneGraph* GetLaneGraph() const;
+	RouterMode GetMode() const;
+	int GetCacheSize() const;
+	const ContractionHierarchy& GetContractionHierarchy() const;
+
+	// Setters
+
+	void SetLaneGraph(const LaneGraph* laneGraph);
+	void SetMode(RouterMode mode);
+	void ClearCache();
+
+	// Queries
+
+	const Route* FindRoute(int originLane, int destinationLane);
+	bool FindRouteAStar(int originLane, int destinationLane, Route& outRoute);
+	bool FindRouteContractionHierarchy(int originLane, int destinationLane, Route& outRoute);
+
+private:
+	typedef std::pair<Meters, int> QueueEntry;
+
+	struct CachedRoute
+	{
+		Route route;
+		bool found;
+	};
+
+	void CheckGraphVersion();
+	Meters GetHeuristic(int lane, int destinationLane) const;
+
+	const LaneGraph* m_laneGraph;
+	RouterMode m_mode;
+	uint32 m_graphVersion;
+	std::unordered_map<uint64, CachedRoute> m_cache;
+	ContractionHierarchy m_contractionHierarchy;
+
+	// A* search state, reset lazily by comparing the search stamp
+	Array<Meters> m_distance;
+	Array<int> m_parentEdge;
+	Array<uint32> m_stamp;
+	Array<QueueEntry> m_queue;
+	uint32 m_searchStamp;
+};
@@ -0,0 +1,174 @@
+#include "SimulationLog.h"
+
+
+//-----------------------------------------------------------------------------
+// Simulation Event
+//-----------------------------------------------------------------------------
+
+SimulationEvent::SimulationEvent()
+	: type(SimulationEventType::STEP)
+	, driverId(0)
+	, timeStep(0.0f)
+	, value(0)
+{
+}
+
+SimulationEvent::SimulationEvent(SimulationEventType type, int driverId,
+		Seconds timeStep, uint64 value)
+	: type(type)
+	, driverId(driverId)
+	, timeStep(timeStep)
+	, value(value)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Simulation Settings
+//-----------------------------------------------------------------------------
+
+SimulationSettings::SimulationSettings()
+	: routerMode(RouterMode::A_STAR)
+	, carFollowingModel(CarFollowingModel::COLLISION_BOXES)
+	, signalMode(TrafficLightMode::FIXED_TIME)
+	, queuedVehicleCount(0)
+	, hasFocusArea(false)
+	, focusCenter(Vector2f::ZERO)
+	, focusRadius(0.0f)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+SimulationLog::SimulationLog()
+	: m_stepCount(0)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+const Array<SimulationEvent>& SimulationLog::GetEvents() const
+{
+	return m_events;
+}
+
+const SimulationSettings& SimulationLog::GetSettings() const
+{
+	return m_settings;
+}
+
+int SimulationLog::GetStepCount() const
+{
+	return m_stepCount;
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+void SimulationLog::SetSettings(const SimulationSettings& settings)
+{
+	m_settings = settings;
+}
+
+
+//-----------------------------------------------------------------------------
+// Recording
+//-----------------------------------------------------------------------------
+
+void SimulationLog::Clear()
+{
+	m_events.clear();
+	m_stepCount = 0;
+}
+
+void SimulationLog::Record(const SimulationEvent& event)
+{
+	m_events.push_back(event);
+	if (event.type == SimulationEventType::STEP)
+		m_stepCount++;
+}
+
+
+//-----------------------------------------------------------------------------
+// Save & Load
+//-----------------------------------------------------------------------------
+
+bool SimulationLog::Save(const Path& path)
+{
+	File file(path);
+	if (file.Open(FileAccess::WRITE, FileType::BINARY).Failed())
+		return false;
+
+	int routerMode = (int) m_settings.routerMode;
+	int carFollowingModel = (int) m_settings.carFollowingModel;
+	int signalMode = (int) m_settings.signalMode;
+	int hasFocusArea = (m_settings.hasFocusArea ? 1 : 0);
+	file.Write(&routerMode, sizeof(int));
+	file.Write(&carFollowingModel, sizeof(int));
+	file.Write(&signalMode, sizeof(int));
+	file.Write(&m_settings.queuedVehicleCount, sizeof(int));
+	file.Write(&hasFocusArea, sizeof(int));
+	file.Write(&m_settings.focusCenter, sizeof(Vector2f));
+	file.Write(&m_settings.focusRadius, sizeof(Meters));
+
+	unsigned int count = m_events.size();
+	file.Write(&count, sizeof(unsigned int));
+	for (const SimulationEvent& event : m_events)
+	{
+		int type = (int) event.type;
+		file.Write(&type, sizeof(int));
+		file.Write(&event.driverId, sizeof(int));
+		file.Write(&event.timeStep, sizeof(Seconds));
+		file.Write(&event.value, sizeof(uint64));
+	}
+
+	return true;
+}
+
+bool SimulationLog::Load(const Path& path)
+{
+	Clear();
+	File file(path);
+	if (file.Open(FileAccess::READ, FileType::BINARY).Failed())
+		return false;
+
+	int routerMode;
+	int carFollowingModel;
+	int signalMode;
+	int hasFocusArea;
+	file.Read(&routerMode, sizeof(int));
+	file.Read(&carFollowingModel, sizeof(int));
+	file.Read(&signalMode, sizeof(int));
+	file.Read(&m_settings.queuedVehicleCount, sizeof(int));
+	file.Read(&hasFocusArea, sizeof(int));
+	file.Read(&m_settings.focusCenter, sizeof(Vector2f));
+	file.Read(&m_settings.focusRadius, sizeof(Meters));
+	m_settings.routerMode = (RouterMode) routerMode;
+	m_settings.carFollowingModel = (CarFollowingModel) carFollowingModel;
+	m_settings.signalMode = (TrafficLightMode) signalMode;
+	m_settings.hasFocusArea = (hasFocusArea != 0);
+
+	unsigned int count;
+	file.Read(&count, sizeof(unsigned int));
+	for (unsigned int i = 0; i < count; i++)
+	{
+		SimulationEvent event;
+		int type;
+		file.Read(&type, sizeof(int));
+		file.Read(&event.driverId, sizeof(int));
+		file.Read(&event.timeStep, sizeof(Seconds));
+		file.Read(&event.value, sizeof(uint64));
+		event.type = (SimulationEventType) type;
+		Record(event);
+	}
+
+	return true;
+}
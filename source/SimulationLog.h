@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include "CommonTypes.h"
+#include "Driver.h"
+#include "Router.h"
+#include "TrafficLight.h"
+
+
+enum class SimulationEventType
+{
+	SEED = 0,
+	SPAWN_DRIVER = 1,
+	DELETE_DRIVER = 2,
+	CLEAR = 3,
+	STEP = 4,
+};
+
+
+struct SimulationEvent
+{
+	SimulationEventType type;
+	int driverId;
+	Seconds timeStep;
+	uint64 value; // Seed for SEED, state checksum for STEP
+
+	SimulationEvent();
+	SimulationEvent(SimulationEventType type, int driverId = 0,
+		Seconds timeStep = 0.0f, uint64 value = 0);
+};
+
+
+//-----------------------------------------------------------------------------
+// Struct:  SimulationSettings
+// Purpose: How the systems were set up for a recorded run, which a replay
+//          must match for its steps to come out the same.
+//-----------------------------------------------------------------------------
+struct SimulationSettings
+{
+	RouterMode routerMode;
+	CarFollowingModel carFollowingModel;
+	TrafficLightMode signalMode;
+	int queuedVehicleCount; // Spawned before the first step
+	bool hasFocusArea;
+	Vector2f focusCenter;
+	Meters focusRadius;
+
+	SimulationSettings();
+};
+
+
+//-----------------------------------------------------------------------------
+// Class:   SimulationLog
+// Purpose: Recording of everything that was done to a driving system: the
+//          seed, spawned and deleted drivers and every time step along with
+//          a checksum of the resulting driver state. Replaying the events
+//          against the same network reproduces the run, and the checksums
+//          tell where a replay diverged. The settings the run was made
+//          with are saved ahead of the events.
+//-----------------------------------------------------------------------------
+class SimulationLog
+{
+public:
+	// Constructors
+
+	SimulationLog();
+
+	// Getters
+
+	const Array<SimulationEvent>& GetEvents() const;
+	const SimulationSettings& GetSettings() const;
+	int GetStepCount() const;
+
+	// Setters
+
+	void SetSettings(const SimulationSettings& settings);
+
+	// Recording
+
+	void Clear();
+	void Record(const SimulationEvent& event);
+
+	// Save & Load
+
+	bool Save(const Path& path);
+	bool Load(const Path& path);
+
+private:
+	Array<SimulationEvent> m_events;
+	SimulationSettings m_settings;
+	int m_stepCount;
+};
+
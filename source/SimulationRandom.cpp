@@ -0,0 +1,97 @@
+#include "SimulationRandom.h"
+
+
+//-----------------------------------------------------------------------------
+// Random Stream
+//-----------------------------------------------------------------------------
+
+RandomStream::RandomStream()
+	: m_key(0)
+	, m_counter(0)
+{
+}
+
+RandomStream::RandomStream(uint64 key)
+	: m_key(key)
+	, m_counter(0)
+{
+}
+
+uint64 RandomStream::GetKey() const
+{
+	return m_key;
+}
+
+uint64 RandomStream::GetCounter() const
+{
+	return m_counter;
+}
+
+uint32 RandomStream::NextUInt()
+{
+	uint64 value = Mix(m_key + (m_counter * 0x9E3779B97F4A7C15ull));
+	m_counter++;
+	return (uint32) (value >> 32);
+}
+
+int RandomStream::NextInt(int max)
+{
+	if (max <= 0)
+		return 0;
+	return (int) (((uint64) NextUInt() * (uint64) max) >> 32);
+}
+
+int RandomStream::NextInt(int min, int max)
+{
+	return min + NextInt(max - min);
+}
+
+float RandomStream::NextFloat()
+{
+	// Use the top 24 bits so that the result is exactly representable
+	return (NextUInt() >> 8) * (1.0f / 16777216.0f);
+}
+
+float RandomStream::NextFloat(float min, float max)
+{
+	return min + (NextFloat() * (max - min));
+}
+
+bool RandomStream::NextBool()
+{
+	return ((NextUInt() & 0x80000000u) != 0);
+}
+
+uint64 RandomStream::Mix(uint64 value)
+{
+	// SplitMix64 finalizer
+	value += 0x9E3779B97F4A7C15ull;
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+	return value ^ (value >> 31);
+}
+
+
+//-----------------------------------------------------------------------------
+// Simulation Random
+//-----------------------------------------------------------------------------
+
+SimulationRandom::SimulationRandom(uint64 seed)
+	: m_seed(seed)
+{
+}
+
+uint64 SimulationRandom::GetSeed() const
+{
+	return m_seed;
+}
+
+RandomStream SimulationRandom::CreateStream(uint64 streamId) const
+{
+	return RandomStream(RandomStream::Mix(m_seed ^ RandomStream::Mix(streamId)));
+}
+
+void SimulationRandom::SetSeed(uint64 seed)
+{
+	m_seed = seed;
+}
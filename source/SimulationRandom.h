@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+
+
+//-----------------------------------------------------------------------------
+// Class:   RandomStream
+// Purpose: Counter-based random number stream. Each value is a hash of the
+//          stream key and the number of values drawn so far, so a stream's
+//          output only depends on its own key and how often it was used,
+//          never on what other streams (or threads) are doing.
+//-----------------------------------------------------------------------------
+class RandomStream
+{
+public:
+	// Constructors
+
+	RandomStream();
+	RandomStream(uint64 key);
+
+	// Getters
+
+	uint64 GetKey() const;
+	uint64 GetCounter() const;
+
+	// Random values
+
+	uint32 NextUInt();
+	int NextInt(int max);
+	int NextInt(int min, int max);
+	float NextFloat();
+	float NextFloat(float min, float max);
+	bool NextBool();
+
+	template <typename T>
+	T& Choose(Array<T>& values)
+	{
+		return values[NextInt((int) values.size())];
+	}
+
+	static uint64 Mix(uint64 value);
+
+private:
+	uint64 m_key;
+	uint64 m_counter;
+};
+
+
+//-----------------------------------------------------------------------------
+// Class:   SimulationRandom
+// Purpose: Seed for all random decisions made by a simulation. Hands out
+//          independent streams by ID (the driving system uses stream zero
+//          for spawning and each driver's ID for its own stream), so a run
+//          can be reproduced from the seed alone.
+//-----------------------------------------------------------------------------
+class SimulationRandom
+{
+public:
+	// Constructors
+
+	SimulationRandom(uint64 seed = 0);
+
+	// Getters
+
+	uint64 GetSeed() const;
+	RandomStream CreateStream(uint64 streamId) const;
+
+	// Setters
+
+	void SetSeed(uint64 seed);
+
+private:
+	uint64 m_seed;
+};
+
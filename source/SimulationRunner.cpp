@@ -0,0 +1,696 @@
+#include "SimulationRunner.h"
+#include "ContractionHierarchy.h"
+#include <chrono>
+
+
+//-----------------------------------------------------------------------------
+// Simulation Stats
+//-----------------------------------------------------------------------------
+
+SimulationStats::SimulationStats()
+	: stepCount(0)
+	, simulatedTime(0.0f)
+	, wallTime(0.0)
+	, driverSteps(0.0)
+	, trafficPercent(0.0f)
+	, finishedCount(0)
+	, queuedVehicleSteps(0.0)
+	, handoffCount(0)
+	, handbackCount(0)
+{
+}
+
+double SimulationStats::GetStepsPerSecond() const
+{
+	if (wallTime <= 0.0)
+		return 0.0;
+	return stepCount / wallTime;
+}
+
+double SimulationStats::GetDriverStepsPerSecond() const
+{
+	if (wallTime <= 0.0)
+		return 0.0;
+	return driverSteps / wallTime;
+}
+
+double SimulationStats::GetRealTimeFactor() const
+{
+	if (wallTime <= 0.0)
+		return 0.0;
+	return simulatedTime / wallTime;
+}
+
+float SimulationStats::GetAverageDriverCount() const
+{
+	if (stepCount == 0)
+		return 0.0f;
+	return (float) (driverSteps / stepCount);
+}
+
+float SimulationStats::GetAverageQueuedVehicleCount() const
+{
+	if (stepCount == 0)
+		return 0.0f;
+	return (float) (queuedVehicleSteps / stepCount);
+}
+
+double SimulationStats::GetVehiclesPerHour() const
+{
+	if (simulatedTime <= 0.0f)
+		return 0.0;
+	return finishedCount * 3600.0 / simulatedTime;
+}
+
+
+RouteBenchmark::RouteBenchmark()
+	: laneCount(0)
+	, edgeCount(0)
+	, queryCount(0)
+	, routeCount(0)
+	, mismatchCount(0)
+	, shortcutCount(0)
+	, aStarTime(0.0)
+	, contractionTime(0.0)
+	, contractionQueryTime(0.0)
+{
+}
+
+CollisionBenchmark::CollisionBenchmark()
+	: boxCount(0)
+	, testCount(0.0)
+	, overlapCount(0)
+	, mismatchCount(0)
+	, scalarTime(0.0)
+	, batchTime(0.0)
+{
+}
+
+double CollisionBenchmark::GetScalarBoxesPerSecond() const
+{
+	if (scalarTime <= 0.0)
+		return 0.0;
+	return testCount / scalarTime;
+}
+
+double CollisionBenchmark::GetBatchBoxesPerSecond() const
+{
+	if (batchTime <= 0.0)
+		return 0.0;
+	return testCount / batchTime;
+}
+
+BroadphaseBenchmark::BroadphaseBenchmark()
+	: driverCount(0)
+	, passCount(0)
+	, pairCount(0)
+	, mismatchCount(0)
+	, allPairsTime(0.0)
+	, gridTime(0.0)
+{
+}
+
+double BroadphaseBenchmark::GetAllPairsPassTime() const
+{
+	if (passCount <= 0)
+		return 0.0;
+	return allPairsTime / passCount;
+}
+
+double BroadphaseBenchmark::GetGridPassTime() const
+{
+	if (passCount <= 0)
+		return 0.0;
+	return gridTime / passCount;
+}
+
+RegressionResult::RegressionResult()
+	: stepCount(0)
+	, threadCount(0)
+	, replayStep(-1)
+	, threadStep(-1)
+	, roundTripStep(-1)
+	, reloadStep(-1)
+	, isRoundTripIdentical(false)
+{
+}
+
+bool RegressionResult::IsPassed() const
+{
+	return (stepCount > 0 && replayStep < 0 && threadStep < 0 &&
+		roundTripStep < 0 && reloadStep < 0 && isRoundTripIdentical);
+}
+
+LoadBenchmark::LoadBenchmark()
+	: groupCount(0)
+	, connectionCount(0)
+	, tieCount(0)
+	, mismatchCount(0)
+	, saveTime(0.0)
+	, loadTime(0.0)
+	, geometryTime(0.0)
+	, generateTime(0.0)
+{
+}
+
+double LoadBenchmark::GetGroupsPerSecond() const
+{
+	if (loadTime <= 0.0)
+		return 0.0;
+	return groupCount / loadTime;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+SimulationRunner::SimulationRunner()
+{
+	m_network = new RoadNetwork(m_ecs);
+	m_drivingSystem = new DrivingSystem(m_network);
+	m_mesoscopicSystem = new MesoscopicSystem(m_network, m_drivingSystem);
+}
+
+SimulationRunner::~SimulationRunner()
+{
+	delete m_mesoscopicSystem;
+	m_mesoscopicSystem = nullptr;
+	delete m_drivingSystem;
+	m_drivingSystem = nullptr;
+	delete m_network;
+	m_network = nullptr;
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+RoadNetwork* SimulationRunner::GetNetwork()
+{
+	return m_network;
+}
+
+DrivingSystem* SimulationRunner::GetDrivingSystem()
+{
+	return m_drivingSystem;
+}
+
+MesoscopicSystem* SimulationRunner::GetMesoscopicSystem()
+{
+	return m_mesoscopicSystem;
+}
+
+const SimulationStats& SimulationRunner::GetStats() const
+{
+	return m_stats;
+}
+
+
+//-----------------------------------------------------------------------------
+// Simulation
+//-----------------------------------------------------------------------------
+
+bool SimulationRunner::Load(const Path& path)
+{
+	m_mesoscopicSystem->Clear();
+	m_drivingSystem->Clear();
+	if (!m_network->Load(path))
+		return false;
+	m_network->UpdateNodeGeometry();
+	return true;
+}
+
+void SimulationRunner::SetSeed(uint64 seed)
+{
+	m_drivingSystem->SetRandom(SimulationRandom(seed));
+	m_mesoscopicSystem->SetRandom(SimulationRandom(seed));
+}
+
+void SimulationRunner::ApplySettings(const SimulationSettings& settings)
+{
+	m_drivingSystem->GetRouter().SetMode(settings.routerMode);
+	m_drivingSystem->SetCarFollowingModel(settings.carFollowingModel);
+	m_network->SetTrafficLightMode(settings.signalMode);
+	if (settings.hasFocusArea)
+		m_mesoscopicSystem->SetFocusArea(settings.focusCenter, settings.focusRadius);
+	else
+		m_mesoscopicSystem->ClearFocusArea();
+}
+
+void SimulationRunner::SpawnDrivers(int count)
+{
+	for (int i = 0; i < count; i++)
+		m_drivingSystem->SpawnDriver();
+}
+
+void SimulationRunner::SpawnQueuedVehicles(int count)
+{
+	for (int i = 0; i < count; i++)
+		m_mesoscopicSystem->SpawnVehicle();
+}
+
+void SimulationRunner::Run(Seconds duration, Seconds timeStep)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	m_stats = SimulationStats();
+	int stepCount = (int) ((duration / timeStep) + 0.5f);
+
+	Clock::time_point startTime = Clock::now();
+	for (int step = 0; step < stepCount; step++)
+		Step(timeStep);
+	Clock::time_point endTime = Clock::now();
+
+	m_stats.wallTime = std::chrono::duration<double>(endTime - startTime).count();
+	if (m_stats.stepCount > 0)
+		m_stats.trafficPercent /= m_stats.stepCount;
+}
+
+bool SimulationRunner::Replay(const SimulationLog& log, int& outDivergentStep)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	m_stats = SimulationStats();
+	m_mesoscopicSystem->Clear();
+	m_drivingSystem->Clear();
+	ApplySettings(log.GetSettings());
+	outDivergentStep = -1;
+
+	// Re-apply each recorded event, checking that spawned drivers get the
+	// same IDs and that every step ends in the same driver state. Queued
+	// vehicles don't touch the driver state until the first step, so they
+	// are spawned just before it.
+	bool matched = true;
+	bool isQueueSpawned = false;
+	Clock::time_point startTime = Clock::now();
+	for (const SimulationEvent& event : log.GetEvents())
+	{
+		if (event.type == SimulationEventType::SEED)
+		{
+			SetSeed(event.value);
+		}
+		else if (event.type == SimulationEventType::SPAWN_DRIVER)
+		{
+			m_drivingSystem->SpawnDriver();
+			Driver* driver = m_drivingSystem->GetDriverById(event.driverId);
+			matched = (driver != nullptr);
+		}
+		else if (event.type == SimulationEventType::DELETE_DRIVER)
+		{
+			Driver* driver = m_drivingSystem->GetDriverById(event.driverId);
+			matched = (driver != nullptr);
+			if (driver != nullptr)
+				m_drivingSystem->DeleteDriver(driver);
+		}
+		else if (event.type == SimulationEventType::CLEAR)
+		{
+			m_drivingSystem->Clear();
+		}
+		else if (event.type == SimulationEventType::STEP)
+		{
+			if (!isQueueSpawned)
+			{
+				SpawnQueuedVehicles(log.GetSettings().queuedVehicleCount);
+				isQueueSpawned = true;
+			}
+			Step(event.timeStep);
+			matched = (m_drivingSystem->ComputeChecksum() == event.value);
+		}
+
+		if (!matched)
+		{
+			outDivergentStep = m_stats.stepCount;
+			break;
+		}
+	}
+	Clock::time_point endTime = Clock::now();
+
+	m_stats.wallTime = std::chrono::duration<double>(endTime - startTime).count();
+	if (m_stats.stepCount > 0)
+		m_stats.trafficPercent /= m_stats.stepCount;
+	return matched;
+}
+
+void SimulationRunner::BenchmarkRouting(int queryCount, RouteBenchmark& outResult)
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const LaneGraph& laneGraph = m_network->GetLaneGraph();
+	outResult = RouteBenchmark();
+	outResult.laneCount = laneGraph.GetLaneCount();
+	outResult.edgeCount = laneGraph.GetEdgeCount();
+	if (outResult.laneCount == 0)
+		return;
+
+	// Pick the same random origins and destinations for both methods
+	RandomStream random = m_drivingSystem->GetRandom().CreateStream(0);
+	Array<int> origins;
+	Array<int> destinations;
+	for (int i = 0; i < queryCount; i++)
+	{
+		origins.push_back(random.NextInt(outResult.laneCount));
+		destinations.push_back(random.NextInt(outResult.laneCount));
+	}
+	outResult.queryCount = queryCount;
+
+	// Queries bypass the route cache so that every one is a full search
+	Router router(&laneGraph);
+	Array<Route> routes(queryCount);
+	Array<bool> found(queryCount);
+	Clock::time_point startTime = Clock::now();
+	for (int i = 0; i < queryCount; i++)
+		found[i] = router.FindRouteAStar(origins[i], destinations[i], routes[i]);
+	Clock::time_point endTime = Clock::now();
+	outResult.aStarTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	ContractionHierarchy contractionHierarchy;
+	startTime = Clock::now();
+	contractionHierarchy.Build(laneGraph);
+	endTime = Clock::now();
+	outResult.contractionTime = std::chrono::duration<double>(endTime - startTime).count();
+	outResult.shortcutCount = contractionHierarchy.GetShortcutCount();
+
+	Array<Route> contractionRoutes(queryCount);
+	Array<bool> contractionFound(queryCount);
+	startTime = Clock::now();
+	for (int i = 0; i < queryCount; i++)
+	{
+		contractionFound[i] = contractionHierarchy.FindRoute(
+			origins[i], destinations[i], contractionRoutes[i]);
+	}
+	endTime = Clock::now();
+	outResult.contractionQueryTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	// Both methods find shortest routes, so only the lengths must match
+	for (int i = 0; i < queryCount; i++)
+	{
+		if (found[i])
+			outResult.routeCount++;
+		if (found[i] != contractionFound[i] || (found[i] &&
+			Math::Abs(routes[i].length - contractionRoutes[i].length) >
+			0.001f * Math::Max(1.0f, routes[i].length)))
+			outResult.mismatchCount++;
+	}
+}
+
+void SimulationRunner::BenchmarkCollision(int boxCount, CollisionBenchmark& outResult)
+{
+	typedef std::chrono::steady_clock Clock;
+	const int egoCount = 256;
+
+	// Scatter vehicle sized boxes over an area dense enough for some of
+	// them to overlap
+	outResult = CollisionBenchmark();
+	outResult.boxCount = boxCount;
+	RandomStream random = m_drivingSystem->GetRandom().CreateStream(1);
+	Meters area = Math::Sqrt((float) boxCount + egoCount) * 6.0f;
+	auto randomBox = [&random, area]() {
+		OrientedBox box;
+		Radians angle = random.NextFloat(0.0f, Math::TWO_PI);
+		box.center = Vector2f(random.NextFloat(0.0f, area), random.NextFloat(0.0f, area));
+		box.axis = Vector2f(Math::Cos(angle), Math::Sin(angle));
+		box.halfSize = Vector2f(random.NextFloat(2.0f, 8.0f), random.NextFloat(1.0f, 1.5f));
+		return box;
+	};
+	OrientedBoxBatch batch(boxCount);
+	for (int i = 0; i < boxCount; i++)
+		batch.Set(i, randomBox());
+	Array<OrientedBox> egoBoxes;
+	for (int i = 0; i < egoCount; i++)
+		egoBoxes.push_back(randomBox());
+
+	Array<uint32> scalarMasks;
+	Array<uint32> batchMasks;
+	scalarMasks.reserve(egoCount * (boxCount / ORIENTED_BOX_MAX_TEST_COUNT + 1));
+	batchMasks.reserve(scalarMasks.capacity());
+	Clock::time_point startTime = Clock::now();
+	for (const OrientedBox& box : egoBoxes)
+	{
+		for (int i = 0; i < boxCount; i += ORIENTED_BOX_MAX_TEST_COUNT)
+		{
+			scalarMasks.push_back(OrientedBoxBatch::OverlapScalar(box, batch, i,
+				Math::Min(ORIENTED_BOX_MAX_TEST_COUNT, boxCount - i)));
+		}
+	}
+	Clock::time_point endTime = Clock::now();
+	outResult.scalarTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	startTime = Clock::now();
+	for (const OrientedBox& box : egoBoxes)
+	{
+		for (int i = 0; i < boxCount; i += ORIENTED_BOX_MAX_TEST_COUNT)
+		{
+			batchMasks.push_back(OrientedBoxBatch::Overlap(box, batch, i,
+				Math::Min(ORIENTED_BOX_MAX_TEST_COUNT, boxCount - i)));
+		}
+	}
+	endTime = Clock::now();
+	outResult.batchTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	outResult.testCount = (double) egoCount * boxCount;
+	for (unsigned int i = 0; i < scalarMasks.size(); i++)
+	{
+		for (uint32 bits = batchMasks[i]; bits != 0; bits &= bits - 1)
+			outResult.overlapCount++;
+		for (uint32 bits = scalarMasks[i] ^ batchMasks[i]; bits != 0; bits &= bits - 1)
+			outResult.mismatchCount++;
+	}
+}
+
+void SimulationRunner::BenchmarkBroadphase(int driverCount,
+	BroadphaseBenchmark& outResult)
+{
+	typedef std::chrono::steady_clock Clock;
+	const int passCount = 10;
+	const Seconds settleTime = 2.0f;
+
+	// Let freshly spawned drivers spread out along their roads, then find
+	// the overlapping pairs of the push pass by testing all pairs and by
+	// querying the driver grid
+	outResult = BroadphaseBenchmark();
+	m_drivingSystem->Clear();
+	SpawnDrivers(driverCount);
+	Run(settleTime, 1.0f / 60.0f);
+	const Array<Driver*>& drivers = m_drivingSystem->GetDrivers();
+	const DriverGrid& grid = m_drivingSystem->GetGrid();
+	int count = (int) drivers.size();
+	outResult.driverCount = count;
+	outResult.passCount = passCount;
+
+	int allPairsCount = 0;
+	Clock::time_point startTime = Clock::now();
+	for (int pass = 0; pass < passCount; pass++)
+	{
+		allPairsCount = 0;
+		for (int a = 0; a < count; a++)
+		{
+			Vector2f position = drivers[a]->GetPosition().xy;
+			for (int b = 0; b < count; b++)
+			{
+				if (b != a && Vector2f::Dist(position,
+					drivers[b]->GetPosition().xy) < DRIVER_PUSH_DISTANCE)
+					allPairsCount++;
+			}
+		}
+	}
+	Clock::time_point endTime = Clock::now();
+	outResult.allPairsTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	int gridCount = 0;
+	Array<Driver*> neighbors;
+	startTime = Clock::now();
+	for (int pass = 0; pass < passCount; pass++)
+	{
+		gridCount = 0;
+		for (Driver* a : drivers)
+		{
+			Vector2f position = a->GetPosition().xy;
+			neighbors.clear();
+			grid.Query(position, DRIVER_PUSH_DISTANCE, neighbors);
+			for (Driver* b : neighbors)
+			{
+				if (b != a && Vector2f::Dist(position,
+					b->GetPosition().xy) < DRIVER_PUSH_DISTANCE)
+					gridCount++;
+			}
+		}
+	}
+	endTime = Clock::now();
+	outResult.gridTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	outResult.pairCount = allPairsCount;
+	outResult.mismatchCount = (allPairsCount > gridCount ?
+		allPairsCount - gridCount : gridCount - allPairsCount);
+}
+
+void SimulationRunner::BenchmarkLoading(int groupCount, const Path& path,
+	LoadBenchmark& outResult)
+{
+	typedef std::chrono::steady_clock Clock;
+	const int rowLength = 100;
+
+	// Lay out two way roads in rows. Each direction is a chain of connected
+	// node groups, and the two directions are tied together.
+	outResult = LoadBenchmark();
+	RoadNetwork network(m_ecs);
+	NodeGroup* prevForward = nullptr;
+	NodeGroup* prevBackward = nullptr;
+	for (int i = 0; i + 1 < groupCount; i += 2)
+	{
+		int column = (i / 2) % rowLength;
+		int row = (i / 2) / rowLength;
+		Vector3f position(column * 50.0f, row * 50.0f, 0.0f);
+		NodeGroup* forward = network.CreateNodeGroup(position, Vector2f::UNITX, 2);
+		NodeGroup* backward = network.CreateNodeGroup(position, -Vector2f::UNITX, 2);
+		network.TieNodeGroups(forward, backward);
+		if (column > 0)
+		{
+			network.ConnectNodeGroups(prevForward, forward);
+			network.ConnectNodeGroups(backward, prevBackward);
+		}
+		prevForward = forward;
+		prevBackward = backward;
+	}
+	outResult.groupCount = (int) network.GetNodeGroups().size();
+	outResult.connectionCount = (int) network.GetNodeGroupConnections().size();
+	outResult.tieCount = (int) network.GetNodeGroupTies().size();
+
+	// Generate the geometry so it's baked into the file
+	Clock::time_point startTime = Clock::now();
+	network.UpdateNodeGeometry();
+	Clock::time_point endTime = Clock::now();
+	outResult.generateTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	startTime = Clock::now();
+	bool saved = network.Save(path);
+	endTime = Clock::now();
+	outResult.saveTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	RoadNetwork loaded(m_ecs);
+	startTime = Clock::now();
+	bool isLoaded = (saved && loaded.Load(path));
+	endTime = Clock::now();
+	outResult.loadTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	startTime = Clock::now();
+	loaded.UpdateNodeGeometry();
+	endTime = Clock::now();
+	outResult.geometryTime = std::chrono::duration<double>(endTime - startTime).count();
+
+	if (!isLoaded || (int) loaded.GetNodeGroups().size() != outResult.groupCount)
+		outResult.mismatchCount++;
+	if (!isLoaded || (int) loaded.GetNodeGroupConnections().size() != outResult.connectionCount)
+		outResult.mismatchCount++;
+	if (!isLoaded || (int) loaded.GetNodeGroupTies().size() != outResult.tieCount)
+		outResult.mismatchCount++;
+}
+
+
+void SimulationRunner::RunRegression(const Path& networkPath,
+	const Path& scratchPath, const SimulationSettings& settings,
+	int driverCount, Seconds duration, Seconds timeStep, int threadCount,
+	RegressionResult& outResult)
+{
+	// Record a single threaded run from the current seed. Every check
+	// replays it and must end each step in the same driver state and with
+	// the same run statistics.
+	outResult = RegressionResult();
+	outResult.threadCount = Math::Max(2, threadCount);
+	SimulationLog log;
+	log.SetSettings(settings);
+	if (!Load(networkPath))
+		return;
+	m_drivingSystem->SetThreadCount(1);
+	ApplySettings(settings);
+	m_drivingSystem->SetEventLog(&log);
+	SpawnDrivers(driverCount);
+	SpawnQueuedVehicles(settings.queuedVehicleCount);
+	Run(duration, timeStep);
+	m_drivingSystem->SetEventLog(nullptr);
+	SimulationStats recordedStats = m_stats;
+	outResult.stepCount = recordedStats.stepCount;
+
+	// Replaying on a fresh runner
+	{
+		SimulationRunner runner;
+		runner.Load(networkPath);
+		outResult.replayStep = runner.FindDivergentStep(log, recordedStats);
+	}
+
+	// Replaying with several threads
+	{
+		SimulationRunner runner;
+		runner.Load(networkPath);
+		runner.m_drivingSystem->SetThreadCount(outResult.threadCount);
+		outResult.threadStep = runner.FindDivergentStep(log, recordedStats);
+	}
+
+	// Replaying on a saved and loaded copy of the network, which must then
+	// save to the same bytes
+	{
+		Array<uint8> savedData;
+		Array<uint8> resavedData;
+		SimulationRunner runner;
+		if (m_network->Save(scratchPath) &&
+			!File::OpenAndGetContents(scratchPath, savedData).Failed() &&
+			runner.Load(scratchPath))
+		{
+			outResult.roundTripStep = runner.FindDivergentStep(log, recordedStats);
+			outResult.isRoundTripIdentical = (
+				runner.m_network->Save(scratchPath) &&
+				!File::OpenAndGetContents(scratchPath, resavedData).Failed() &&
+				resavedData == savedData);
+		}
+		else
+		{
+			outResult.roundTripStep = 0;
+		}
+	}
+
+	// Replaying here, after loading the network again into the pools and
+	// driver slots the recorded run released
+	Load(networkPath);
+	outResult.reloadStep = FindDivergentStep(log, recordedStats);
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+int SimulationRunner::FindDivergentStep(const SimulationLog& log,
+	const SimulationStats& expectedStats)
+{
+	// Returns -1 if the replay matched the log and ended with the same
+	// statistics, other than wall time
+	int divergentStep;
+	if (!Replay(log, divergentStep))
+		return divergentStep;
+	if (m_stats.stepCount != expectedStats.stepCount ||
+		m_stats.driverSteps != expectedStats.driverSteps ||
+		m_stats.trafficPercent != expectedStats.trafficPercent ||
+		m_stats.finishedCount != expectedStats.finishedCount ||
+		m_stats.queuedVehicleSteps != expectedStats.queuedVehicleSteps ||
+		m_stats.handoffCount != expectedStats.handoffCount ||
+		m_stats.handbackCount != expectedStats.handbackCount)
+		return m_stats.stepCount;
+	return -1;
+}
+
+void SimulationRunner::Step(Seconds timeStep)
+{
+	m_network->Simulate(timeStep);
+	m_drivingSystem->Update(timeStep);
+	m_mesoscopicSystem->Update(timeStep);
+	m_stats.stepCount++;
+	m_stats.simulatedTime += timeStep;
+	m_stats.driverSteps += (double) m_drivingSystem->GetDrivers().size();
+	m_stats.trafficPercent += m_drivingSystem->GetTrafficPercent();
+	m_stats.finishedCount += m_drivingSystem->GetFinishedCount() +
+		m_mesoscopicSystem->GetFinishedCount();
+	m_stats.queuedVehicleSteps += (double) m_mesoscopicSystem->GetVehicleCount();
+	m_stats.handoffCount += m_mesoscopicSystem->GetHandoffCount();
+	m_stats.handbackCount += m_mesoscopicSystem->GetHandbackCount();
+}
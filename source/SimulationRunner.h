@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include "RoadNetwork.h"
+#include "DrivingSystem.h"
+#include "MesoscopicSystem.h"
+
+
+struct SimulationStats
+{
+	int stepCount;
+	Seconds simulatedTime;
+	double wallTime;
+	double driverSteps;
+	float trafficPercent;
+	int finishedCount; // Drivers and queued vehicles which reached the end of the road
+	double queuedVehicleSteps;
+	int handoffCount; // Queued vehicles handed to the driving system
+	int handbackCount; // Drivers handed back to the mesoscopic system
+
+	SimulationStats();
+
+	double GetStepsPerSecond() const;
+	double GetDriverStepsPerSecond() const;
+	double GetRealTimeFactor() const;
+	float GetAverageDriverCount() const;
+	float GetAverageQueuedVehicleCount() const;
+	double GetVehiclesPerHour() const;
+};
+
+
+struct RouteBenchmark
+{
+	int laneCount;
+	int edgeCount;
+	int queryCount;
+	int routeCount; // Queries with a route
+	int mismatchCount; // Queries where the two methods disagree
+	int shortcutCount;
+	double aStarTime;
+	double contractionTime; // Time to preprocess the contraction hierarchy
+	double contractionQueryTime;
+
+	RouteBenchmark();
+};
+
+struct CollisionBenchmark
+{
+	int boxCount;
+	double testCount; // Box pairs tested by each method
+	int overlapCount;
+	int mismatchCount; // Tests where the scalar and batched results differ
+	double scalarTime;
+	double batchTime;
+
+	CollisionBenchmark();
+
+	double GetScalarBoxesPerSecond() const;
+	double GetBatchBoxesPerSecond() const;
+};
+
+struct BroadphaseBenchmark
+{
+	int driverCount;
+	int passCount;
+	int pairCount; // Pairs of drivers closer than the push distance
+	int mismatchCount; // Difference in the pairs found by the two methods
+	double allPairsTime;
+	double gridTime;
+
+	BroadphaseBenchmark();
+
+	double GetAllPairsPassTime() const;
+	double GetGridPassTime() const;
+};
+
+struct RegressionResult
+{
+	int stepCount; // Steps in the recorded run
+	int threadCount; // Threads of the multithreaded replay
+	int replayStep; // Step each replay diverged at, or -1 if it matched
+	int threadStep;
+	int roundTripStep; // Replaying on a saved and loaded copy of the network
+	int reloadStep; // Replaying after loading the network again in place
+	bool isRoundTripIdentical; // The loaded copy saves to the same bytes
+
+	RegressionResult();
+
+	bool IsPassed() const;
+};
+
+struct LoadBenchmark
+{
+	int groupCount;
+	int connectionCount;
+	int tieCount;
+	int mismatchCount; // Object counts which differ after loading
+	double saveTime;
+	double loadTime;
+	double geometryTime; // Updating geometry after loading, with baked geometry
+	double generateTime; // Generating the same geometry from scratch
+
+	LoadBenchmark();
+
+	double GetGroupsPerSecond() const;
+};
+
+
+//-----------------------------------------------------------------------------
+// Class:   SimulationRunner
+// Purpose: Steps a road network and its drivers at a fixed time step without
+//          a window or any rendering, for batch runs on machines without a
+//          GPU. Build with ROAD_MIND_HEADLESS to leave out all mesh code.
+//-----------------------------------------------------------------------------
+class SimulationRunner
+{
+public:
+	// Constructors
+
+	SimulationRunner();
+	~SimulationRunner();
+
+	// Getters
+
+	RoadNetwork* GetNetwork();
+	DrivingSystem* GetDrivingSystem();
+	MesoscopicSystem* GetMesoscopicSystem();
+	const SimulationStats& GetStats() const;
+
+	// Simulation
+
+	bool Load(const Path& path);
+	void SetSeed(uint64 seed);
+	void ApplySettings(const SimulationSettings& settings);
+	void SpawnDrivers(int count);
+	void SpawnQueuedVehicles(int count);
+	void Run(Seconds duration, Seconds timeStep);
+	bool Replay(const SimulationLog& log, int& outDivergentStep);
+	void BenchmarkRouting(int queryCount, RouteBenchmark& outResult);
+	void BenchmarkCollision(int boxCount, CollisionBenchmark& outResult);
+	void BenchmarkBroadphase(int driverCount, BroadphaseBenchmark& outResult);
+	void BenchmarkLoading(int groupCount, const Path& path, LoadBenchmark& outResult);
+	void RunRegression(const Path& networkPath, const Path& scratchPath,
+		const SimulationSettings& settings, int driverCount, Seconds duration,
+		Seconds timeStep, int threadCount, RegressionResult& outResult);
+
+private:
+	void Step(Seconds timeStep);
+	int FindDivergentStep(const SimulationLog& log,
+		const SimulationStats& expectedStats);
+
+	ECS m_ecs;
+	RoadNetwork* m_network;
+	DrivingSystem* m_drivingSystem;
+	MesoscopicSystem* m_mesoscopicSystem;
+	SimulationStats m_stats;
+};
+
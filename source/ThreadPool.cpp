@@ -0,0 +1,170 @@
+#include "ThreadPool.h"
+
+// Index of the worker running on this thread, zero for any other thread
+static thread_local int s_workerIndex = 0;
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(int threadCount)
+	: m_remaining(0)
+	, m_generation(0)
+	, m_quit(false)
+{
+	threadCount = Math::Max(1, threadCount);
+	for (int i = 0; i < threadCount; i++)
+		m_queues.push_back(new WorkQueue());
+
+	// Worker zero is the thread which calls ParallelFor
+	for (int i = 1; i < threadCount; i++)
+		m_threads.push_back(std::thread(&ThreadPool::WorkerMain, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+	for (WorkQueue* queue : m_queues)
+		delete queue;
+	m_queues.clear();
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+int ThreadPool::GetThreadCount() const
+{
+	return (int) m_queues.size();
+}
+
+int ThreadPool::GetWorkerIndex()
+{
+	return s_workerIndex;
+}
+
+
+//-----------------------------------------------------------------------------
+// Execution
+//-----------------------------------------------------------------------------
+
+void ThreadPool::ParallelFor(int count, int grainSize, const RangeFunction& function)
+{
+	if (count <= 0)
+		return;
+	grainSize = Math::Max(1, grainSize);
+	if (m_threads.empty() || count <= grainSize)
+	{
+		function(0, count);
+		return;
+	}
+
+	// Deal the ranges out to the worker queues round-robin
+	int taskCount = (count + grainSize - 1) / grainSize;
+	m_remaining = taskCount;
+	for (int i = 0; i < taskCount; i++)
+	{
+		Task task;
+		task.begin = i * grainSize;
+		task.end = Math::Min(count, task.begin + grainSize);
+		task.function = &function;
+		WorkQueue* queue = m_queues[i % m_queues.size()];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		queue->tasks.push_back(task);
+	}
+
+	// Wake the workers and help out until all work is taken
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_generation++;
+	}
+	m_wake.notify_all();
+	while (RunTask(0))
+	{
+	}
+
+	// Wait for any ranges still running on other workers
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this]() { return (m_remaining == 0); });
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+void ThreadPool::WorkerMain(int index)
+{
+	s_workerIndex = index;
+	uint32 generation = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() {
+				return (m_quit || m_generation != generation);
+			});
+			if (m_quit)
+				return;
+			generation = m_generation;
+		}
+		while (RunTask(index))
+		{
+		}
+	}
+}
+
+bool ThreadPool::PopTask(int index, Task& outTask)
+{
+	// Take work from the back of our own queue
+	WorkQueue* queue = m_queues[index];
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	if (queue->tasks.empty())
+		return false;
+	outTask = queue->tasks.back();
+	queue->tasks.pop_back();
+	return true;
+}
+
+bool ThreadPool::StealTask(int index, Task& outTask)
+{
+	// Take work from the front of another worker's queue
+	int count = (int) m_queues.size();
+	for (int i = 1; i < count; i++)
+	{
+		WorkQueue* queue = m_queues[(index + i) % count];
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (!queue->tasks.empty())
+		{
+			outTask = queue->tasks.front();
+			queue->tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ThreadPool::RunTask(int index)
+{
+	Task task;
+	if (!PopTask(index, task) && !StealTask(index, task))
+		return false;
+
+	(*task.function)(task.begin, task.end);
+
+	if (--m_remaining == 0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_done.notify_all();
+	}
+	return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+//-----------------------------------------------------------------------------
+// Class:   ThreadPool
+// Purpose: Fixed set of worker threads which execute ranges of a parallel
+//          for-loop. Each worker owns a queue of ranges and steals from the
+//          other workers' queues once its own queue runs dry. The calling
+//          thread takes part in the work as worker zero. Work can keep
+//          scratch buffers per worker index.
+//-----------------------------------------------------------------------------
+class ThreadPool
+{
+public:
+	typedef std::function<void(int begin, int end)> RangeFunction;
+
+public:
+	// Constructors
+
+	ThreadPool(int threadCount);
+	~ThreadPool();
+
+	// Getters
+
+	int GetThreadCount() const;
+	static int GetWorkerIndex();
+
+	// Execution
+
+	void ParallelFor(int count, int grainSize, const RangeFunction& function);
+
+private:
+	struct Task
+	{
+		int begin;
+		int end;
+		const RangeFunction* function;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void WorkerMain(int index);
+	bool PopTask(int index, Task& outTask);
+	bool StealTask(int index, Task& outTask);
+	bool RunTask(int index);
+
+	Array<std::thread> m_threads;
+	Array<WorkQueue*> m_queues;
+	std::atomic<int> m_remaining;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	uint32 m_generation;
+	bool m_quit;
+};
+
@@ -0,0 +1,361 @@
+#include "TrafficAssignment.h"
+#include "Driver.h"
+#include <algorithm>
+#include <cfloat>
+
+
+//-----------------------------------------------------------------------------
+// Constructors
+//-----------------------------------------------------------------------------
+
+TrafficAssignment::TrafficAssignment(const LaneGraph* laneGraph)
+	: m_laneGraph(laneGraph)
+	, m_graphVersion(0)
+	, m_timer(0.0f)
+	, m_batchIndex(0)
+	, m_rerouteCount(0)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// Getters
+//-----------------------------------------------------------------------------
+
+Seconds TrafficAssignment::GetTravelTime(int edge) const
+{
+	if (edge < 0 || edge >= (int) m_travelTime.size())
+		return GetFreeFlowTime(edge);
+	return m_travelTime[edge];
+}
+
+Seconds TrafficAssignment::GetFreeFlowTime(int edge) const
+{
+	if (m_laneGraph == nullptr || edge < 0 || edge >= m_laneGraph->GetEdgeCount())
+		return 0.0f;
+	return m_laneGraph->GetEdge(edge).length / TRAFFIC_FREE_FLOW_SPEED;
+}
+
+int TrafficAssignment::GetTreeCount() const
+{
+	return (int) m_trees.size();
+}
+
+int TrafficAssignment::GetRerouteCount() const
+{
+	return m_rerouteCount;
+}
+
+
+//-----------------------------------------------------------------------------
+// Setters
+//-----------------------------------------------------------------------------
+
+void TrafficAssignment::Clear()
+{
+	m_graphVersion = 0;
+	m_timer = 0.0f;
+	m_batchIndex = 0;
+	m_rerouteCount = 0;
+	m_travelTime.clear();
+	m_cost.clear();
+	m_changedEdges.clear();
+	m_inOffsets.clear();
+	m_inEdges.clear();
+	m_trees.clear();
+	m_requests.clear();
+}
+
+void TrafficAssignment::RecordTraversal(int edge, Seconds time)
+{
+	// Edges recorded against an older lane graph are dropped
+	if (m_laneGraph == nullptr || m_graphVersion != m_laneGraph->GetVersion() ||
+		edge < 0 || edge >= (int) m_travelTime.size())
+		return;
+	m_travelTime[edge] += TRAFFIC_TRAVEL_TIME_SMOOTHING *
+		(Math::Max(0.0f, time) - m_travelTime[edge]);
+}
+
+void TrafficAssignment::Update(Seconds dt, const Array<Driver*>& drivers, ThreadPool* threadPool)
+{
+	if (m_laneGraph == nullptr)
+		return;
+	if (m_graphVersion != m_laneGraph->GetVersion() ||
+		(int) m_travelTime.size() != m_laneGraph->GetEdgeCount())
+		Reset();
+
+	m_timer += dt;
+	if (m_timer < TRAFFIC_ASSIGNMENT_INTERVAL)
+		return;
+	m_timer = 0.0f;
+	m_batchIndex++;
+
+	// Drop trees for destinations nobody has asked about in a while
+	m_trees.erase(std::remove_if(m_trees.begin(), m_trees.end(),
+		[this](const DestinationTree& tree) {
+			return (m_batchIndex - tree.lastUsedBatch > TRAFFIC_TREE_MAX_IDLE_BATCHES);
+		}), m_trees.end());
+
+	// Gather the requests in driver order
+	m_requests.resize(drivers.size());
+	int requestCount = 0;
+	for (Driver* driver : drivers)
+	{
+		RerouteRequest& request = m_requests[requestCount];
+		int destinationLane;
+		if (driver->PollReroute(request.originLane, destinationLane, request.route))
+		{
+			request.driver = driver;
+			request.treeIndex = GetTree(destinationLane);
+			requestCount++;
+		}
+	}
+	m_requests.resize(requestCount);
+
+	// Bring the trees up to date with the latest travel times, then answer
+	// the requests from them
+	UpdateCosts();
+	ForEach(threadPool, (int) m_trees.size(), [this](int index) {
+		DestinationTree& tree = m_trees[index];
+		Array<QueueEntry> queue;
+		Array<int> affected;
+		if (!tree.isBuilt)
+			BuildTree(tree, queue);
+		else if (!m_changedEdges.empty())
+			UpdateTree(tree, queue, affected);
+	});
+	ForEach(threadPool, requestCount, [this](int index) {
+		ProcessRequest(m_requests[index]);
+	});
+
+	for (RerouteRequest& request : m_requests)
+	{
+		if (!request.newRoute.empty())
+		{
+			request.driver->SetRoute(request.newRoute);
+			m_rerouteCount++;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+void TrafficAssignment::Reset()
+{
+	int laneCount = m_laneGraph->GetLaneCount();
+	int edgeCount = m_laneGraph->GetEdgeCount();
+	m_graphVersion = m_laneGraph->GetVersion();
+	m_timer = 0.0f;
+	m_trees.clear();
+	m_changedEdges.clear();
+
+	m_travelTime.resize(edgeCount);
+	for (int i = 0; i < edgeCount; i++)
+		m_travelTime[i] = GetFreeFlowTime(i);
+	m_cost = m_travelTime;
+
+	m_inOffsets.assign(laneCount + 1, 0);
+	for (int i = 0; i < edgeCount; i++)
+		m_inOffsets[m_laneGraph->GetEdge(i).toLane + 1]++;
+	for (int lane = 0; lane < laneCount; lane++)
+		m_inOffsets[lane + 1] += m_inOffsets[lane];
+	m_inEdges.resize(edgeCount);
+	Array<int> counts(laneCount, 0);
+	for (int i = 0; i < edgeCount; i++)
+	{
+		int lane = m_laneGraph->GetEdge(i).toLane;
+		m_inEdges[m_inOffsets[lane] + counts[lane]++] = i;
+	}
+}
+
+void TrafficAssignment::UpdateCosts()
+{
+	// Small changes in travel time are not worth updating the trees for
+	m_changedEdges.clear();
+	for (int i = 0; i < (int) m_cost.size(); i++)
+	{
+		if (Math::Abs(m_travelTime[i] - m_cost[i]) >
+			TRAFFIC_COST_UPDATE_THRESHOLD * m_cost[i])
+		{
+			ChangedEdge change;
+			change.edge = i;
+			change.oldCost = m_cost[i];
+			m_changedEdges.push_back(change);
+			m_cost[i] = m_travelTime[i];
+		}
+	}
+}
+
+int TrafficAssignment::GetTree(int destinationLane)
+{
+	for (int i = 0; i < (int) m_trees.size(); i++)
+	{
+		if (m_trees[i].destinationLane == destinationLane)
+		{
+			m_trees[i].lastUsedBatch = m_batchIndex;
+			return i;
+		}
+	}
+	DestinationTree tree;
+	tree.destinationLane = destinationLane;
+	tree.lastUsedBatch = m_batchIndex;
+	tree.isBuilt = false;
+	m_trees.push_back(tree);
+	return (int) m_trees.size() - 1;
+}
+
+void TrafficAssignment::BuildTree(DestinationTree& tree, Array<QueueEntry>& queue) const
+{
+	int laneCount = m_laneGraph->GetLaneCount();
+	tree.time.assign(laneCount, FLT_MAX);
+	tree.nextEdge.assign(laneCount, -1);
+	tree.time[tree.destinationLane] = 0.0f;
+	queue.clear();
+	queue.push_back(QueueEntry(0.0f, tree.destinationLane));
+	SearchTree(tree, queue);
+	tree.isBuilt = true;
+}
+
+void TrafficAssignment::UpdateTree(DestinationTree& tree, Array<QueueEntry>& queue,
+	Array<int>& affected) const
+{
+	// Lanes whose fastest route used an edge that got slower, along with
+	// every lane routed through them, have to be searched again
+	affected.clear();
+	for (const ChangedEdge& change : m_changedEdges)
+	{
+		int lane = m_laneGraph->GetEdge(change.edge).fromLane;
+		if (m_cost[change.edge] > change.oldCost &&
+			tree.nextEdge[lane] == change.edge && tree.time[lane] != FLT_MAX)
+		{
+			tree.time[lane] = FLT_MAX;
+			affected.push_back(lane);
+		}
+	}
+	for (unsigned int i = 0; i < affected.size(); i++)
+	{
+		int lane = affected[i];
+		for (int j = m_inOffsets[lane]; j < m_inOffsets[lane + 1]; j++)
+		{
+			int edge = m_inEdges[j];
+			int fromLane = m_laneGraph->GetEdge(edge).fromLane;
+			if (tree.nextEdge[fromLane] == edge && tree.time[fromLane] != FLT_MAX)
+			{
+				tree.time[fromLane] = FLT_MAX;
+				affected.push_back(fromLane);
+			}
+		}
+	}
+
+	// Start those lanes from their best neighbor outside of the affected
+	// set, and the lanes at the start of any edge that got faster
+	queue.clear();
+	for (int lane : affected)
+	{
+		tree.nextEdge[lane] = -1;
+		for (int edge = m_laneGraph->GetEdgeBegin(lane);
+			edge < m_laneGraph->GetEdgeEnd(lane); edge++)
+		{
+			int toLane = m_laneGraph->GetEdge(edge).toLane;
+			if (tree.time[toLane] != FLT_MAX &&
+				tree.time[toLane] + m_cost[edge] < tree.time[lane])
+			{
+				tree.time[lane] = tree.time[toLane] + m_cost[edge];
+				tree.nextEdge[lane] = edge;
+			}
+		}
+		if (tree.time[lane] != FLT_MAX)
+			queue.push_back(QueueEntry(tree.time[lane], lane));
+	}
+	for (const ChangedEdge& change : m_changedEdges)
+	{
+		const LaneGraphEdge& edge = m_laneGraph->GetEdge(change.edge);
+		if (m_cost[change.edge] < change.oldCost &&
+			tree.time[edge.toLane] != FLT_MAX &&
+			tree.time[edge.toLane] + m_cost[change.edge] < tree.time[edge.fromLane])
+		{
+			tree.time[edge.fromLane] = tree.time[edge.toLane] + m_cost[change.edge];
+			tree.nextEdge[edge.fromLane] = change.edge;
+			queue.push_back(QueueEntry(tree.time[edge.fromLane], edge.fromLane));
+		}
+	}
+	std::make_heap(queue.begin(), queue.end(), std::greater<QueueEntry>());
+	SearchTree(tree, queue);
+}
+
+void TrafficAssignment::SearchTree(DestinationTree& tree, Array<QueueEntry>& queue) const
+{
+	// Search backward from the queued lanes, toward the lanes leading
+	// into them
+	while (!queue.empty())
+	{
+		std::pop_heap(queue.begin(), queue.end(), std::greater<QueueEntry>());
+		Seconds time = queue.back().first;
+		int lane = queue.back().second;
+		queue.pop_back();
+		if (time > tree.time[lane])
+			continue;
+
+		for (int i = m_inOffsets[lane]; i < m_inOffsets[lane + 1]; i++)
+		{
+			int edge = m_inEdges[i];
+			int fromLane = m_laneGraph->GetEdge(edge).fromLane;
+			Seconds nextTime = time + m_cost[edge];
+			if (nextTime < tree.time[fromLane])
+			{
+				tree.time[fromLane] = nextTime;
+				tree.nextEdge[fromLane] = edge;
+				queue.push_back(QueueEntry(nextTime, fromLane));
+				std::push_heap(queue.begin(), queue.end(), std::greater<QueueEntry>());
+			}
+		}
+	}
+}
+
+void TrafficAssignment::ProcessRequest(RerouteRequest& request) const
+{
+	request.newRoute.clear();
+	const DestinationTree& tree = m_trees[request.treeIndex];
+
+	// Only reroute drivers stuck in traffic, and only when another route is
+	// clearly faster
+	Seconds time = 0.0f;
+	Seconds freeFlowTime = 0.0f;
+	for (int edge : request.route)
+	{
+		time += m_cost[edge];
+		freeFlowTime += GetFreeFlowTime(edge);
+	}
+	Seconds bestTime = tree.time[request.originLane];
+	if (time <= freeFlowTime * DRIVER_REROUTE_CONGESTION || bestTime == FLT_MAX ||
+		bestTime >= time * (1.0f - DRIVER_REROUTE_MIN_GAIN))
+		return;
+
+	int lane = request.originLane;
+	while (lane != tree.destinationLane && tree.nextEdge[lane] >= 0 &&
+		(int) request.newRoute.size() < m_laneGraph->GetLaneCount())
+	{
+		request.newRoute.push_back(tree.nextEdge[lane]);
+		lane = m_laneGraph->GetEdge(tree.nextEdge[lane]).toLane;
+	}
+	if (lane != tree.destinationLane)
+		request.newRoute.clear();
+}
+
+void TrafficAssignment::ForEach(ThreadPool* threadPool, int count,
+	const std::function<void(int)>& function) const
+{
+	if (threadPool == nullptr)
+	{
+		for (int i = 0; i < count; i++)
+			function(i);
+		return;
+	}
+	threadPool->ParallelFor(count, 1, [&function](int begin, int end) {
+		for (int i = begin; i < end; i++)
+			function(i);
+	});
+}
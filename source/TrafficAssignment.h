@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cmgCore/cmg_core.h>
+#include "CommonTypes.h"
+#include "LaneGraph.h"
+#include "ThreadPool.h"
+
+class Driver;
+
+
+constexpr MetersPerSecond TRAFFIC_FREE_FLOW_SPEED = 15.0f;
+constexpr float TRAFFIC_TRAVEL_TIME_SMOOTHING = 0.2f; // Weight of each new sample
+constexpr float TRAFFIC_COST_UPDATE_THRESHOLD = 0.05f; // Relative change before routes are updated
+constexpr Seconds TRAFFIC_ASSIGNMENT_INTERVAL = 1.0f;
+constexpr auto TRAFFIC_TREE_MAX_IDLE_BATCHES = 60;
+constexpr Seconds DRIVER_REROUTE_INTERVAL = 5.0f;
+constexpr float DRIVER_REROUTE_CONGESTION = 1.5f; // Slowdown over free flow before rerouting
+constexpr float DRIVER_REROUTE_MIN_GAIN = 0.1f; // Fraction of the remaining time to save
+
+
+//-----------------------------------------------------------------------------
+// Class:   TrafficAssignment
+// Purpose: Tracks the travel time of each lane graph edge from the drivers
+//          that drive along it, and reroutes drivers whose remaining route
+//          has become congested.
+//
+//          Reroute requests are gathered from the drivers and processed in
+//          batches at a fixed interval, spread over the thread pool. Each
+//          destination keeps a tree of the fastest way to it from every lane,
+//          which is updated incrementally from the edges whose travel times
+//          changed since the last batch, so answering a request is just a
+//          walk down the tree.
+//-----------------------------------------------------------------------------
+class TrafficAssignment
+{
+public:
+	// Constructors
+
+	TrafficAssignment(const LaneGraph* laneGraph = nullptr);
+
+	// Getters
+
+	Seconds GetTravelTime(int edge) const;
+	Seconds GetFreeFlowTime(int edge) const;
+	int GetTreeCount() const;
+	int GetRerouteCount() const;
+
+	// Setters
+
+	void Clear();
+	void RecordTraversal(int edge, Seconds time);
+	void Update(Seconds dt, const Array<Driver*>& drivers, ThreadPool* threadPool);
+
+private:
+	struct DestinationTree
+	{
+		int destinationLane;
+		Array<Seconds> time; // Time from each lane to the destination
+		Array<int> nextEdge; // First edge of the fastest route from each lane
+		int lastUsedBatch;
+		bool isBuilt;
+	};
+
+	struct RerouteRequest
+	{
+		Driver* driver;
+		int originLane;
+		int treeIndex;
+		Array<int> route; // Remaining edges of the driver's current route
+		Array<int> newRoute;
+	};
+
+	struct ChangedEdge
+	{
+		int edge;
+		Seconds oldCost;
+	};
+
+	typedef std::pair<Seconds, int> QueueEntry;
+
+	void Reset();
+	void UpdateCosts();
+	int GetTree(int destinationLane);
+	void BuildTree(DestinationTree& tree, Array<QueueEntry>& queue) const;
+	void UpdateTree(DestinationTree& tree, Array<QueueEntry>& queue,
+		Array<int>& affected) const;
+	void SearchTree(DestinationTree& tree, Array<QueueEntry>& queue) const;
+	void ProcessRequest(RerouteRequest& request) const;
+	void ForEach(ThreadPool* threadPool, int count,
+		const std::function<void(int)>& function) const;
+
+	const LaneGraph* m_laneGraph;
+	uint32 m_graphVersion;
+	Seconds m_timer;
+	int m_batchIndex;
+	int m_rerouteCount;
+
+	// Travel time per edge, smoothed over the recorded traversals, and the
+	// cost the destination trees were last updated with
+	Array<Seconds> m_travelTime;
+	Array<Seconds> m_cost;
+	Array<ChangedEdge> m_changedEdges;
+
+	// Edges into each lane, as CSR arrays, for searching backward
+	Array<int> m_inOffsets;
+	Array<int> m_inEdges;
+
+	Array<DestinationTree> m_trees;
+	Array<RerouteRequest> m_requests;
+};
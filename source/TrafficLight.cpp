@@ -1,30 +1,38 @@
 #include "TrafficLight.h"
+#include <algorithm>
+#include <cmath>
 
 TrafficLightPhase::TrafficLightPhase()
 	: m_duration(6.0f)
 {
 }
 
-bool TrafficLightPhase::IsTriggered() const
+bool TrafficLightPhase::IsTriggered(const Array<int>& detectorCounts) const
 {
-	if (m_triggers.empty())
+	// Phases without detectors are always called
+	return (m_triggers.empty() || GetDetectorCount(detectorCounts) > 0);
+}
+
+int TrafficLightPhase::GetDetectorCount(const Array<int>& detectorCounts) const
+{
+	int count = 0;
+	for (int slot : m_triggers)
 	{
-		return true;
-	}
-	else
-	{
-		return true;
-		//for (Node* node : m_triggers)
-		//	if (node->IsTriggered())
-		//		return true;
-		//return false;
+		if (slot < (int) detectorCounts.size())
+			count += detectorCounts[slot];
 	}
+	return count;
 }
 
 TrafficLightSignal TrafficLightPhase::GetNodeSignal(const Node* node) const
 {
-	if (m_signals.find((Node*) node) != m_signals.end())
-		return m_signals.at((Node*) node);
+	return GetSlotSignal(node->GetSignalSlot());
+}
+
+TrafficLightSignal TrafficLightPhase::GetSlotSignal(int slot) const
+{
+	if (slot >= 0 && slot < (int) m_signals.size())
+		return m_signals[slot];
 	return TrafficLightSignal::STOP;
 }
 
@@ -41,12 +49,19 @@ void TrafficLightPhase::Clear()
 
 void TrafficLightPhase::SetSignal(Node* node, TrafficLightSignal signal)
 {
-	m_signals[node] = signal;
+	int slot = node->GetSignalSlot();
+	CMG_ASSERT(slot >= 0);
+	if (slot >= (int) m_signals.size())
+		m_signals.resize(slot + 1, TrafficLightSignal::STOP);
+	m_signals[slot] = signal;
 }
 
 void TrafficLightPhase::AddTrigger(Node * node)
 {
-	m_triggers.insert(node);
+	int slot = node->GetSignalSlot();
+	CMG_ASSERT(slot >= 0);
+	if (std::find(m_triggers.begin(), m_triggers.end(), slot) == m_triggers.end())
+		m_triggers.push_back(slot);
 }
 
 void TrafficLightPhase::SetDuration(Seconds duration)
@@ -60,6 +75,12 @@ TrafficLightProgram::TrafficLightProgram()
 	: m_currentPhase(nullptr)
 	, m_nextPhase(nullptr)
 	, m_phaseTimer(0.0f)
+	, m_signalVersion(0)
+	, m_mode(TrafficLightMode::FIXED_TIME)
+	, m_greenTimer(0.0f)
+	, m_gapTimer(0.0f)
+	, m_coordinatedPhase(-1)
+	, m_cycleTime(0.0f)
 	, m_yellowDuration(2.0f)
 	, m_redDelay(1.0f)
 {
@@ -72,38 +93,70 @@ TrafficLightProgram::~TrafficLightProgram()
 TrafficLightSignal TrafficLightProgram::GetSignal(const Node* node) const
 {
 	if (m_currentPhase == nullptr)
-	{
 		return TrafficLightSignal::GO;
-	}
-	else if (m_nextPhase != nullptr)
-	{
-		TrafficLightSignal prev = m_currentPhase->GetNodeSignal(node);
-		TrafficLightSignal next = m_nextPhase->GetNodeSignal(node);
-		if (prev == next)
-		{
-			return prev;
-		}
-		else if (next == TrafficLightSignal::STOP)
-		{
-			if (m_phaseTimer < m_yellowDuration)
-				return TrafficLightSignal::YELLOW;
-			else
-				return TrafficLightSignal::STOP;
-		}
-		else
-		{
-			return TrafficLightSignal::STOP;
-		}
-	}
-	else
+	int slot = node->GetSignalSlot();
+	if (slot >= (int) m_signals.size() || !IsSlotOf(slot, node))
+		return TrafficLightSignal::STOP;
+	return m_signals[slot];
+}
+
+uint32 TrafficLightProgram::GetSignalVersion() const
+{
+	return m_signalVersion;
+}
+
+TrafficLightMode TrafficLightProgram::GetMode() const
+{
+	return m_mode;
+}
+
+int TrafficLightProgram::GetPhaseCount() const
+{
+	return (int) m_phases.size();
+}
+
+int TrafficLightProgram::GetCurrentPhaseIndex() const
+{
+	return (m_currentPhase != nullptr ? m_currentPhaseIndex : -1);
+}
+
+int TrafficLightProgram::GetCoordinatedPhaseIndex() const
+{
+	return m_coordinatedPhase;
+}
+
+int TrafficLightProgram::GetSlotCount() const
+{
+	return (int) m_slotLanes.size();
+}
+
+bool TrafficLightProgram::HasSlot(const Node* node) const
+{
+	return IsSlotOf(node->GetSignalSlot(), node);
+}
+
+int TrafficLightProgram::FindPhase(const Node* node) const
+{
+	for (int i = 0; i < (int) m_phases.size(); i++)
 	{
-		return m_currentPhase->GetNodeSignal(node);
+		if (m_phases[i].GetNodeSignal(node) == TrafficLightSignal::GO)
+			return i;
 	}
+	return -1;
+}
+
+int TrafficLightProgram::AddNode(Node* node)
+{
+	node->m_signalSlot = (int) m_slotLanes.size();
+	m_slotLanes.push_back(std::make_pair(node->m_nodeGroup, node->m_index));
+	m_detectorCounts.push_back(0);
+	return node->m_signalSlot;
 }
 
 void TrafficLightProgram::AddPhase(const TrafficLightPhase& phase)
 {
 	m_phases.push_back(phase);
+	m_signalVersion++;
 }
 
 void TrafficLightProgram::BeginPhase(int index)
@@ -113,6 +166,57 @@ void TrafficLightProgram::BeginPhase(int index)
 	if (m_currentPhase == nullptr)
 		m_currentPhase = m_nextPhase;
 	m_phaseTimer = 0.0f;
+	m_greenTimer = 0.0f;
+	m_gapTimer = 0.0f;
+
+	// Lanes losing the right of way show yellow and then red, while lanes
+	// gaining it stay red until the red delay is over
+	int slotCount = (int) m_slotLanes.size();
+	m_signals.resize(slotCount);
+	m_redSignals.resize(slotCount);
+	for (int slot = 0; slot < slotCount; slot++)
+	{
+		TrafficLightSignal prev = m_currentPhase->GetSlotSignal(slot);
+		TrafficLightSignal next = m_nextPhase->GetSlotSignal(slot);
+		if (prev == next)
+		{
+			m_signals[slot] = prev;
+			m_redSignals[slot] = prev;
+		}
+		else
+		{
+			m_signals[slot] = (next == TrafficLightSignal::STOP ?
+				TrafficLightSignal::YELLOW : TrafficLightSignal::STOP);
+			m_redSignals[slot] = TrafficLightSignal::STOP;
+		}
+	}
+	m_signalVersion++;
+}
+
+void TrafficLightProgram::SetMode(TrafficLightMode mode)
+{
+	m_mode = mode;
+}
+
+void TrafficLightProgram::SetCoordination(int phaseIndex, Seconds offset, Seconds cycleTime)
+{
+	m_coordinatedPhase = phaseIndex;
+	m_cycleTime = std::fmod(cycleTime - offset, TRAFFIC_LIGHT_CYCLE_LENGTH);
+	if (m_cycleTime < 0.0f)
+		m_cycleTime += TRAFFIC_LIGHT_CYCLE_LENGTH;
+}
+
+void TrafficLightProgram::ClearDetectors()
+{
+	for (unsigned int slot = 0; slot < m_detectorCounts.size(); slot++)
+		m_detectorCounts[slot] = 0;
+}
+
+void TrafficLightProgram::AddDetection(const Node* node)
+{
+	int slot = node->GetSignalSlot();
+	if (IsSlotOf(slot, node))
+		m_detectorCounts[slot]++;
 }
 
 void TrafficLightProgram::Udpate(Seconds dt)
@@ -122,8 +226,11 @@ void TrafficLightProgram::Udpate(Seconds dt)
 	if (m_currentPhase == nullptr)
 		BeginPhase(0);
 
-
+	Seconds prevTimer = m_phaseTimer;
 	m_phaseTimer += dt;
+	m_cycleTime += dt;
+	if (m_cycleTime >= TRAFFIC_LIGHT_CYCLE_LENGTH)
+		m_cycleTime -= TRAFFIC_LIGHT_CYCLE_LENGTH;
 
 	if (m_nextPhase != nullptr)
 	{
@@ -131,19 +238,109 @@ void TrafficLightProgram::Udpate(Seconds dt)
 		{
 			m_currentPhase = m_nextPhase;
 			m_nextPhase = nullptr;
+			for (int slot = 0; slot < (int) m_signals.size(); slot++)
+				m_signals[slot] = m_currentPhase->GetSlotSignal(slot);
+			m_signalVersion++;
+		}
+		else if (prevTimer < m_yellowDuration && m_phaseTimer >= m_yellowDuration)
+		{
+			// Yellow lights turn red
+			m_signals.swap(m_redSignals);
+			m_signalVersion++;
 		}
+		return;
+	}
+
+	m_greenTimer += dt;
+	if (m_currentPhase->GetDetectorCount(m_detectorCounts) > 0)
+		m_gapTimer = 0.0f;
+	else
+		m_gapTimer += dt;
+
+	int nextPhase = -1;
+	if (m_mode == TrafficLightMode::FIXED_TIME)
+	{
+		if (m_phaseTimer >= m_currentPhase->GetDuration())
+			nextPhase = ChooseNextPhase();
+	}
+	else
+	{
+		nextPhase = ChooseActuatedPhase();
+	}
+	if (nextPhase >= 0)
+		BeginPhase(nextPhase);
+}
+
+
+//-----------------------------------------------------------------------------
+// Internal Methods
+//-----------------------------------------------------------------------------
+
+bool TrafficLightProgram::IsSlotOf(int slot, const Node* node) const
+{
+	return (slot >= 0 && slot < (int) m_slotLanes.size() &&
+		m_slotLanes[slot].first == node->m_nodeGroup &&
+		m_slotLanes[slot].second == node->m_index);
+}
+
+bool TrafficLightProgram::IsPhaseCalled(int index) const
+{
+	// Fixed time lights serve every phase, and coordinated lights always
+	// return to their coordinated phase
+	if (m_mode == TrafficLightMode::FIXED_TIME || index == m_coordinatedPhase)
+		return true;
+	return m_phases[index].IsTriggered(m_detectorCounts);
+}
+
+int TrafficLightProgram::ChooseNextPhase() const
+{
+	for (int i = 1; i < (int) m_phases.size(); i++)
+	{
+		int index = (m_currentPhaseIndex + i) % m_phases.size();
+		if (IsPhaseCalled(index))
+			return index;
 	}
-	else if (m_phaseTimer >= m_currentPhase->GetDuration())
+	return -1;
+}
+
+int TrafficLightProgram::ChooseActuatedPhase() const
+{
+	// A phase ends once it has had its minimum green, and either no driver
+	// has been detected for the passage time (gap out) or it has reached
+	// its maximum green (max out). It stays green while no other phase has
+	// a call.
+	Seconds changeDuration = m_yellowDuration + m_redDelay;
+	bool isCoordinated = (m_mode == TrafficLightMode::COORDINATED &&
+		m_coordinatedPhase >= 0);
+	Seconds cycleTimeLeft = TRAFFIC_LIGHT_CYCLE_LENGTH - m_cycleTime;
+
+	if (isCoordinated)
 	{
-		// Change to the next phase
-		for (int i = 1; i < (int) m_phases.size(); i++)
+		if (m_currentPhaseIndex == m_coordinatedPhase)
 		{
-			int index = (m_currentPhaseIndex + i) % m_phases.size();
-			if (m_phases[index].IsTriggered())
-			{
-				BeginPhase(index);
-				break;
-			}
+			// Hold the coordinated phase for its share of the cycle, then
+			// serve calls from the other phases if there is still time
+			Seconds split = Math::Max(TRAFFIC_LIGHT_MIN_GREEN,
+				(TRAFFIC_LIGHT_CYCLE_LENGTH / m_phases.size()) - changeDuration);
+			if (m_cycleTime < split ||
+				cycleTimeLeft < (2.0f * changeDuration) + TRAFFIC_LIGHT_MIN_GREEN)
+				return -1;
+			return ChooseNextPhase();
 		}
+
+		// Force off the other phases in time for the coordinated phase to
+		// turn green as the cycle starts
+		if (cycleTimeLeft <= changeDuration)
+			return m_coordinatedPhase;
 	}
+
+	if (m_greenTimer < TRAFFIC_LIGHT_MIN_GREEN ||
+		(m_gapTimer < TRAFFIC_LIGHT_PASSAGE_TIME &&
+		m_greenTimer < TRAFFIC_LIGHT_MAX_GREEN))
+		return -1;
+	int nextPhase = ChooseNextPhase();
+	if (isCoordinated && nextPhase >= 0 &&
+		cycleTimeLeft < (2.0f * changeDuration) + TRAFFIC_LIGHT_MIN_GREEN)
+		nextPhase = m_coordinatedPhase;
+	return nextPhase;
 }
@@ -5,14 +5,32 @@
 class RoadIntersection;
 
 
+enum class TrafficLightMode
+{
+	FIXED_TIME = 0, // Phases change at a fixed interval
+	ACTUATED = 1, // Phases are served on demand from the loop detectors
+	COORDINATED = 2, // Actuated, with green waves along corridors
+};
+
+constexpr Seconds TRAFFIC_LIGHT_MIN_GREEN = 5.0f;
+constexpr Seconds TRAFFIC_LIGHT_MAX_GREEN = 30.0f;
+constexpr Seconds TRAFFIC_LIGHT_PASSAGE_TIME = 2.5f; // Gap in detections before a phase gaps out
+constexpr Meters TRAFFIC_LIGHT_DETECTOR_LENGTH = 30.0f; // Detector zone before the stop line
+constexpr Seconds TRAFFIC_LIGHT_CYCLE_LENGTH = 60.0f; // Cycle shared by coordinated lights
+constexpr MetersPerSecond TRAFFIC_LIGHT_PROGRESSION_SPEED = 13.0f; // Speed of green waves
+constexpr auto TRAFFIC_LIGHT_CORRIDOR_MAX_LINKS = 64; // Connections followed between lights
+
+
 class TrafficLightPhase
 {
 public:
 	TrafficLightPhase();
 
 	// Getters 
-	bool IsTriggered() const;
+	bool IsTriggered(const Array<int>& detectorCounts) const;
+	int GetDetectorCount(const Array<int>& detectorCounts) const;
 	TrafficLightSignal GetNodeSignal(const Node* node) const;
+	TrafficLightSignal GetSlotSignal(int slot) const;
 	Seconds GetDuration() const;
 
 	// Setters
@@ -23,8 +41,8 @@ public:
 	void SetDuration(Seconds duration);
 
 private:
-	Map<Node*, TrafficLightSignal> m_signals;
-	Set<Node*> m_triggers;
+	Array<TrafficLightSignal> m_signals; // By node signal slot
+	Array<int> m_triggers; // Signal slots of the detectors that call this phase
 	Seconds m_duration;
 };
 
@@ -41,18 +59,56 @@ public:
 
 	// Getters
 	TrafficLightSignal GetSignal(const Node* node) const;
+	uint32 GetSignalVersion() const;
+	TrafficLightMode GetMode() const;
+	int GetPhaseCount() const;
+	int GetCurrentPhaseIndex() const;
+	int GetCoordinatedPhaseIndex() const;
+	int FindPhase(const Node* node) const;
+	int GetSlotCount() const;
+	bool HasSlot(const Node* node) const;
 
 	// Setters
+	int AddNode(Node* node);
 	void AddPhase(const TrafficLightPhase& phase);
 	void BeginPhase(int index);
+	void SetMode(TrafficLightMode mode);
+	void SetCoordination(int phaseIndex, Seconds offset, Seconds cycleTime);
+	void ClearDetectors();
+	void AddDetection(const Node* node);
 	void Udpate(Seconds dt);
 
 private:
+	bool IsSlotOf(int slot, const Node* node) const;
+	bool IsPhaseCalled(int index) const;
+	int ChooseNextPhase() const;
+	int ChooseActuatedPhase() const;
+
+private:
+	Array<std::pair<const NodeGroup*, int>> m_slotLanes; // Group and lane index, by signal slot
 	Array<TrafficLightPhase> m_phases; // Ordered by priority
 	TrafficLightPhase* m_currentPhase;
 	TrafficLightPhase* m_nextPhase;
 	int m_currentPhaseIndex;
 	Seconds m_phaseTimer;
+	uint32 m_signalVersion; // Changes whenever any node's signal may change
+
+	// Signal of each node by its slot, as currently shown, and as shown once
+	// the yellow lights of the current phase change turn red
+	Array<TrafficLightSignal> m_signals;
+	Array<TrafficLightSignal> m_redSignals;
+
+	// Actuated control. The detector counts are the drivers in each slot's
+	// detector zone this step.
+	TrafficLightMode m_mode;
+	Array<int> m_detectorCounts;
+	Seconds m_greenTimer;
+	Seconds m_gapTimer; // Time since the current phase last detected a driver
+
+	// Coordination. The coordinated phase turns green at the start of each
+	// cycle, with the cycle shifted by this light's offset in its corridor.
+	int m_coordinatedPhase;
+	Seconds m_cycleTime;
 
 	Seconds m_yellowDuration;
 	Seconds m_redDelay;
@@ -7,6 +7,8 @@
 #include <gl/GL.h>
 #include <ctime>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "MainApp.h"
 #include "GeometryApp.h"
 #include "DrivingApp.h"
@@ -16,6 +18,11 @@ int main(int argc, char* argv[])
 	srand((unsigned int) time(nullptr));
 
 	MainApp app;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "--seed") == 0)
+			app.SetSeed(strtoull(argv[++i], nullptr, 10));
+	}
 	//ECSApp app;
 	//GeometryApp app;
 	//DrivingApp app;
@@ -0,0 +1,314 @@
+
+#include <cmgCore/cmg_core.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SimulationRunner.h"
+
+static void PrintUsage(const char* program)
+{
+	printf("Usage: %s <network file> [options]\n", program);
+	printf("  --drivers <count>     Number of drivers to spawn (default 100)\n");
+	printf("  --queued <count>      Number of queue simulated vehicles to spawn (default 0)\n");
+	printf("  --focus <x> <y> <radius>\n");
+	printf("                        Drive queued vehicles individually inside this area\n");
+	printf("  --duration <seconds>  Simulated time to run for (default 60)\n");
+	printf("  --dt <seconds>        Fixed time step (default 1/60)\n");
+	printf("  --threads <count>     Driver update threads (default 1)\n");
+	printf("  --seed <seed>         Simulation random seed (default 0)\n");
+	printf("  --record <file>       Save an event log of the run\n");
+	printf("  --replay <file>       Replay an event log and verify it matches\n");
+	printf("  --router <astar|ch>   Driver routing method (default astar)\n");
+	printf("  --car-following <boxes|idm>\n");
+	printf("                        Car following model (default boxes)\n");
+	printf("  --signals <fixed|actuated|coordinated>\n");
+	printf("                        Traffic light control (default fixed)\n");
+	printf("  --route-benchmark <queries>\n");
+	printf("                        Time random route queries instead of running\n");
+	printf("  --collision-benchmark <boxes>\n");
+	printf("                        Time vehicle box overlap tests instead of running\n");
+	printf("  --broadphase-benchmark <drivers>\n");
+	printf("                        Time finding overlapping drivers by testing all pairs\n");
+	printf("                        and through the driver grid, doubling the driver count\n");
+	printf("                        up to the given count, instead of running\n");
+	printf("  --regression <scratch file>\n");
+	printf("                        Record a run, then check that it replays the same with\n");
+	printf("                        more threads, on a saved copy of the network and after\n");
+	printf("                        reloading it; the scratch file is overwritten\n");
+	printf("  --load-benchmark <groups>\n");
+	printf("                        Time saving and loading a generated network instead\n");
+	printf("                        of running; the network file is written, not read\n");
+}
+
+int main(int argc, char* argv[])
+{
+	const char* networkPath = nullptr;
+	const char* recordPath = nullptr;
+	const char* replayPath = nullptr;
+	const char* regressionPath = nullptr;
+	uint64 seed = 0;
+	int driverCount = 100;
+	Seconds duration = 60.0f;
+	Seconds timeStep = 1.0f / 60.0f;
+	int threadCount = 1;
+	int routeQueryCount = 0;
+	int collisionBoxCount = 0;
+	int broadphaseDriverCount = 0;
+	int loadGroupCount = 0;
+	SimulationSettings settings;
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = (i + 1 < argc);
+		if (strcmp(argv[i], "--drivers") == 0 && hasValue)
+			driverCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--queued") == 0 && hasValue)
+			settings.queuedVehicleCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--focus") == 0 && i + 3 < argc)
+		{
+			settings.hasFocusArea = true;
+			settings.focusCenter.x = (float) atof(argv[++i]);
+			settings.focusCenter.y = (float) atof(argv[++i]);
+			settings.focusRadius = (Meters) atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--duration") == 0 && hasValue)
+			duration = (Seconds) atof(argv[++i]);
+		else if (strcmp(argv[i], "--dt") == 0 && hasValue)
+			timeStep = (Seconds) atof(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue)
+			threadCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && hasValue)
+			seed = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--record") == 0 && hasValue)
+			recordPath = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && hasValue)
+			replayPath = argv[++i];
+		else if (strcmp(argv[i], "--router") == 0 && hasValue)
+		{
+			i++;
+			if (strcmp(argv[i], "ch") == 0)
+				settings.routerMode = RouterMode::CONTRACTION_HIERARCHY;
+			else if (strcmp(argv[i], "astar") != 0)
+			{
+				PrintUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--car-following") == 0 && hasValue)
+		{
+			i++;
+			if (strcmp(argv[i], "idm") == 0)
+				settings.carFollowingModel = CarFollowingModel::INTELLIGENT_DRIVER;
+			else if (strcmp(argv[i], "boxes") != 0)
+			{
+				PrintUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--signals") == 0 && hasValue)
+		{
+			i++;
+			if (strcmp(argv[i], "fixed") == 0)
+				settings.signalMode = TrafficLightMode::FIXED_TIME;
+			else if (strcmp(argv[i], "coordinated") == 0)
+				settings.signalMode = TrafficLightMode::COORDINATED;
+			else if (strcmp(argv[i], "actuated") == 0)
+				settings.signalMode = TrafficLightMode::ACTUATED;
+			else
+			{
+				PrintUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--route-benchmark") == 0 && hasValue)
+			routeQueryCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--collision-benchmark") == 0 && hasValue)
+			collisionBoxCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--broadphase-benchmark") == 0 && hasValue)
+			broadphaseDriverCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--regression") == 0 && hasValue)
+			regressionPath = argv[++i];
+		else if (strcmp(argv[i], "--load-benchmark") == 0 && hasValue)
+			loadGroupCount = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && networkPath == nullptr)
+			networkPath = argv[i];
+		else
+		{
+			PrintUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (networkPath == nullptr || timeStep <= 0.0f)
+	{
+		PrintUsage(argv[0]);
+		return 1;
+	}
+
+	SimulationRunner runner;
+	if (loadGroupCount > 0)
+	{
+		LoadBenchmark result;
+		runner.BenchmarkLoading(loadGroupCount, networkPath, result);
+		printf("network:            %s\n", networkPath);
+		printf("node groups:        %d\n", result.groupCount);
+		printf("connections:        %d\n", result.connectionCount);
+		printf("ties:               %d\n", result.tieCount);
+		printf("save time:          %.3f s\n", result.saveTime);
+		printf("load time:          %.3f s\n", result.loadTime);
+		printf("groups/sec loaded:  %.1f\n", result.GetGroupsPerSecond());
+		printf("geometry generate:  %.3f s\n", result.generateTime);
+		printf("geometry on load:   %.3f s\n", result.geometryTime);
+		printf("mismatched counts:  %d\n", result.mismatchCount);
+		return (result.mismatchCount == 0 ? 0 : 2);
+	}
+
+	if (!runner.Load(networkPath))
+	{
+		fprintf(stderr, "Error: failed to load network '%s'\n", networkPath);
+		return 1;
+	}
+	runner.GetDrivingSystem()->SetThreadCount(threadCount);
+	runner.ApplySettings(settings);
+
+	if (collisionBoxCount > 0)
+	{
+		CollisionBenchmark result;
+		runner.SetSeed(seed);
+		runner.BenchmarkCollision(collisionBoxCount, result);
+		printf("boxes:              %d\n", result.boxCount);
+		printf("box tests:          %.0f (%d overlapping)\n", result.testCount, result.overlapCount);
+		printf("scalar boxes/sec:   %.1f\n", result.GetScalarBoxesPerSecond());
+		printf("batched boxes/sec:  %.1f\n", result.GetBatchBoxesPerSecond());
+		printf("mismatched tests:   %d\n", result.mismatchCount);
+		return (result.mismatchCount == 0 ? 0 : 2);
+	}
+
+	if (regressionPath != nullptr)
+	{
+		RegressionResult result;
+		runner.SetSeed(seed);
+		runner.RunRegression(networkPath, regressionPath, settings,
+			driverCount, duration, timeStep, threadCount, result);
+		auto printCheck = [](const char* name, int divergentStep) {
+			if (divergentStep < 0)
+				printf("%-20smatched\n", name);
+			else
+				printf("%-20sDIVERGED at step %d\n", name, divergentStep);
+		};
+		printf("network:            %s\n", networkPath);
+		printf("recorded steps:     %d\n", result.stepCount);
+		printCheck("replay:", result.replayStep);
+		printf("threads:            %d\n", result.threadCount);
+		printCheck("threaded replay:", result.threadStep);
+		printCheck("round trip replay:", result.roundTripStep);
+		printf("round trip save:    %s\n",
+			(result.isRoundTripIdentical ? "identical" : "DIFFERENT"));
+		printCheck("reload replay:", result.reloadStep);
+		return (result.IsPassed() ? 0 : 2);
+	}
+
+	if (broadphaseDriverCount > 0)
+	{
+		// Double the driver count until the grid overtakes testing all pairs
+		int mismatchCount = 0;
+		int crossover = 0;
+		runner.SetSeed(seed);
+		printf("network:            %s\n", networkPath);
+		printf("%10s %10s %14s %14s\n", "drivers", "pairs", "all pairs (ms)", "grid (ms)");
+		for (int count = 16; ; count *= 2)
+		{
+			count = Math::Min(count, broadphaseDriverCount);
+			BroadphaseBenchmark result;
+			runner.BenchmarkBroadphase(count, result);
+			printf("%10d %10d %14.3f %14.3f\n", result.driverCount, result.pairCount,
+				result.GetAllPairsPassTime() * 1000.0, result.GetGridPassTime() * 1000.0);
+			mismatchCount += result.mismatchCount;
+			if (crossover == 0 && result.gridTime < result.allPairsTime)
+				crossover = result.driverCount;
+			if (count >= broadphaseDriverCount)
+				break;
+		}
+		if (crossover > 0)
+			printf("crossover:          %d drivers\n", crossover);
+		else
+			printf("crossover:          not reached\n");
+		printf("mismatched pairs:   %d\n", mismatchCount);
+		return (mismatchCount == 0 ? 0 : 2);
+	}
+
+	if (routeQueryCount > 0)
+	{
+		RouteBenchmark result;
+		runner.SetSeed(seed);
+		runner.BenchmarkRouting(routeQueryCount, result);
+		double queryCount = (double) (result.queryCount > 0 ? result.queryCount : 1);
+		printf("network:            %s\n", networkPath);
+		printf("lanes:              %d\n", result.laneCount);
+		printf("lane edges:         %d\n", result.edgeCount);
+		printf("queries:            %d (%d with a route)\n", result.queryCount, result.routeCount);
+		printf("A* query time:      %.2f us\n", result.aStarTime * 1.0e6 / queryCount);
+		printf("CH preprocess time: %.3f s (%d shortcuts)\n", result.contractionTime, result.shortcutCount);
+		printf("CH query time:      %.2f us\n", result.contractionQueryTime * 1.0e6 / queryCount);
+		printf("mismatched routes:  %d\n", result.mismatchCount);
+		return (result.mismatchCount == 0 ? 0 : 2);
+	}
+
+	if (replayPath != nullptr)
+	{
+		SimulationLog log;
+		if (!log.Load(replayPath))
+		{
+			fprintf(stderr, "Error: failed to load event log '%s'\n", replayPath);
+			return 1;
+		}
+		int divergentStep;
+		if (!runner.Replay(log, divergentStep))
+		{
+			printf("replay:             DIVERGED at step %d of %d\n",
+				divergentStep, log.GetStepCount());
+			return 2;
+		}
+		settings = log.GetSettings();
+		printf("replay:             matched %d steps\n", log.GetStepCount());
+	}
+	else
+	{
+		SimulationLog log;
+		runner.SetSeed(seed);
+		log.SetSettings(settings);
+		if (recordPath != nullptr)
+			runner.GetDrivingSystem()->SetEventLog(&log);
+		runner.SpawnDrivers(driverCount);
+		runner.SpawnQueuedVehicles(settings.queuedVehicleCount);
+		runner.Run(duration, timeStep);
+		runner.GetDrivingSystem()->SetEventLog(nullptr);
+		if (recordPath != nullptr && !log.Save(recordPath))
+		{
+			fprintf(stderr, "Error: failed to save event log '%s'\n", recordPath);
+			return 1;
+		}
+	}
+
+	const SimulationStats& stats = runner.GetStats();
+	printf("network:            %s\n", networkPath);
+	printf("seed:               %llu\n", (unsigned long long) runner.GetDrivingSystem()->GetRandom().GetSeed());
+	printf("threads:            %d\n", runner.GetDrivingSystem()->GetThreadCount());
+	printf("steps:              %d (dt = %.4f s)\n", stats.stepCount, timeStep);
+	printf("simulated time:     %.2f s\n", stats.simulatedTime);
+	printf("wall time:          %.3f s\n", stats.wallTime);
+	printf("steps/sec:          %.1f\n", stats.GetStepsPerSecond());
+	printf("driver steps/sec:   %.1f\n", stats.GetDriverStepsPerSecond());
+	printf("real-time factor:   %.2fx\n", stats.GetRealTimeFactor());
+	printf("average drivers:    %.1f\n", stats.GetAverageDriverCount());
+	if (settings.queuedVehicleCount > 0 || settings.hasFocusArea)
+	{
+		printf("average queued:     %.1f\n", stats.GetAverageQueuedVehicleCount());
+		printf("handoffs:           %d to drivers, %d back\n",
+			stats.handoffCount, stats.handbackCount);
+	}
+	printf("average slowdown:   %.1f%%\n", stats.trafficPercent * 100.0f);
+	printf("throughput:         %.1f vehicles/hour (%d finished)\n",
+		stats.GetVehiclesPerHour(), stats.finishedCount);
+	printf("reroutes:           %d\n", runner.GetDrivingSystem()->GetTrafficAssignment().GetRerouteCount());
+	return 0;
+}